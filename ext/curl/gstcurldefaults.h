@@ -133,6 +133,12 @@
 #define GSTCURL_DEFAULT_CONNECTIONS_SERVER 5
 #define GSTCURL_DEFAULT_CONNECTIONS_PROXY 30
 #define GSTCURL_DEFAULT_CONNECTIONS_GLOBAL 255
+/* Received data is written to blocks of that size, and the transfer is
+ * paused once that many of them are waiting to be pushed */
+#define GSTCURL_BLOCK_SIZE (64 * 1024)
+#define GSTCURL_MAX_BLOCKS 8
+#define GSTCURL_MAX_BUFFERED (GSTCURL_BLOCK_SIZE * GSTCURL_MAX_BLOCKS)
+#define GSTCURL_DEFAULT_COALESCE_SIZE 0
 #define GSTCURL_INFO_RESPONSE(x) ((x >= 100) && (x <= 199))
 #define GSTCURL_SUCCESS_RESPONSE(x) ((x >= 200) && (x <=299))
 #define GSTCURL_REDIRECT_RESPONSE(x) ((x >= 300) && (x <= 399))
@@ -89,14 +89,20 @@
  * to wait for gst_curl_http_src_curl_multi_loop() to perform the
  * request and signal completion.
  *
+ * The curl write callback copies the received data into GstMemory blocks
+ * that ::create() pushes without copying them again. ::create() is only
+ * woken up once it has coalesce-size bytes to push, and the transfer is
+ * paused while GSTCURL_MAX_BUFFERED bytes are waiting. The multi loop
+ * resumes it once ::create() took them and woke it up.
+ *
  * Each instance of GstCurlHttpSrc is protected by the mutexes:
  * 1. uri_mutex
  * 2. buffer_mutex
  *
  * uri_mutex is used to protect access to the uri field.
  *
- * buffer_mutex is used to protect access to buffer_cond, state and
- * connection_status.
+ * buffer_mutex is used to protect access to buffer_cond, state,
+ * connection_status and the received data.
  *
  * The gst_curl_http_src_curl_multi_loop() function uses the mutexes:
  * 1. multi_task_context.task_rec_mutex
@@ -127,6 +133,9 @@ GST_DEBUG_CATEGORY_STATIC (gst_curl_http_src_debug);
 #define GST_CAT_DEFAULT gst_curl_http_src_debug
 GST_DEBUG_CATEGORY_STATIC (gst_curl_loop_debug);
 
+/* curl_multi_poll() can be woken up, unlike select() on the transfers */
+#define GSTCURL_HAVE_MULTI_POLL CURL_AT_LEAST_VERSION (7, 68, 0)
+
 #define CURL_HTTP_SRC_ERROR(src,cat,code,error_message)     \
   do { \
     GST_ELEMENT_ERROR_WITH_DETAILS ((src), cat, code, ("%s", error_message), \
@@ -162,6 +171,7 @@ enum
   PROP_MAXCONCURRENT_GLOBAL,
   PROP_HTTPVERSION,
   PROP_IRADIO_MODE,
+  PROP_COALESCE_SIZE,
   PROP_MAX
 };
 
@@ -219,6 +229,8 @@ static size_t gst_curl_http_src_get_header (void *header, size_t size,
 static size_t gst_curl_http_src_get_chunks (void *chunk, size_t size,
     size_t nmemb, void *src);
 static void gst_curl_http_src_request_remove (GstCurlHttpSrc * src);
+static void gst_curl_http_src_wake_multi_loop (GstCurlHttpSrcMultiTaskContext *
+    context);
 static void gst_curl_http_src_wait_until_removed (GstCurlHttpSrc * src);
 static char *gst_curl_http_src_strcasestr (const char *haystack,
     const char *needle);
@@ -469,6 +481,22 @@ gst_curl_http_src_class_init (GstCurlHttpSrcClass * klass)
           GST_TYPE_CURL_HTTP_VERSION, pref_http_ver,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * GstCurlHttpSrc:coalesce-size:
+   *
+   * Minimum amount of data to gather before pushing a buffer, unless the
+   * transfer is over. Larger values mean fewer and larger buffers, and fewer
+   * wake-ups of the streaming thread, at the cost of latency.
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_COALESCE_SIZE,
+      g_param_spec_uint ("coalesce-size", "Coalesce Size",
+          "Minimum number of bytes to gather before pushing a buffer "
+          "(0 = push data as soon as it is received)", 0,
+          GSTCURL_MAX_BUFFERED, GSTCURL_DEFAULT_COALESCE_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   /* Add a debugging task so it's easier to debug in the Multi worker thread */
   GST_DEBUG_CATEGORY_INIT (gst_curl_loop_debug, "curl_multi_loop", 0,
       "libcURL loop thread debugging");
@@ -586,6 +614,11 @@ gst_curl_http_src_set_property (GObject * object, guint prop_id,
     case PROP_HTTPVERSION:
       source->preferred_http_version = g_value_get_enum (value);
       break;
+    case PROP_COALESCE_SIZE:
+      g_mutex_lock (&source->buffer_mutex);
+      source->coalesce_size = g_value_get_uint (value);
+      g_mutex_unlock (&source->buffer_mutex);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -669,6 +702,9 @@ gst_curl_http_src_get_property (GObject * object, guint prop_id,
     case PROP_HTTPVERSION:
       g_value_set_enum (value, source->preferred_http_version);
       break;
+    case PROP_COALESCE_SIZE:
+      g_value_set_uint (value, source->coalesce_size);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -725,8 +761,12 @@ gst_curl_http_src_init (GstCurlHttpSrc * source)
   g_mutex_init (&source->buffer_mutex);
   g_cond_init (&source->buffer_cond);
 
-  source->buffer = NULL;
+  source->blocks = gst_queue_array_new (GSTCURL_MAX_BLOCKS + 2);
+  source->block = NULL;
+  source->block_fill = 0;
   source->buffer_len = 0;
+  source->coalesce_size = GSTCURL_DEFAULT_COALESCE_SIZE;
+  source->transfer_paused = FALSE;
   source->state = GSTCURL_NONE;
   source->pending_state = GSTCURL_NONE;
   source->transfer_begun = FALSE;
@@ -769,8 +809,14 @@ gst_curl_http_src_ref_multi (GstCurlHttpSrc * src)
     /* set up curl */
     klass->multi_task_context.multi_handle = curl_multi_init ();
 
+#ifdef CURLPIPE_MULTIPLEX
+    /* all the transfers to a server share one HTTP/2 connection */
+    curl_multi_setopt (klass->multi_task_context.multi_handle,
+        CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#else
     curl_multi_setopt (klass->multi_task_context.multi_handle,
         CURLMOPT_PIPELINING, 1);
+#endif
 #ifdef CURLMOPT_MAX_HOST_CONNECTIONS
     curl_multi_setopt (klass->multi_task_context.multi_handle,
         CURLMOPT_MAX_HOST_CONNECTIONS, 1);
@@ -859,6 +905,70 @@ gst_curl_http_src_finalize (GObject * obj)
   G_OBJECT_CLASS (gst_curl_http_src_parent_class)->finalize (obj);
 }
 
+/*
+ * Queue the block being written to, for ::create() to push it. Must be called
+ * with buffer_mutex held.
+ */
+static void
+gst_curl_http_src_push_block (GstCurlHttpSrc * src)
+{
+  gboolean partial = src->block_fill < src->block_map.size;
+
+  gst_memory_unmap (src->block, &src->block_map);
+  if (partial)
+    gst_memory_resize (src->block, 0, src->block_fill);
+  gst_queue_array_push_tail (src->blocks, src->block);
+  src->block = NULL;
+  src->block_fill = 0;
+}
+
+/*
+ * Drop all the received data. Must be called with buffer_mutex held.
+ */
+static void
+gst_curl_http_src_clear_blocks (GstCurlHttpSrc * src)
+{
+  while (!gst_queue_array_is_empty (src->blocks))
+    gst_memory_unref (gst_queue_array_pop_head (src->blocks));
+  if (src->block) {
+    gst_memory_unmap (src->block, &src->block_map);
+    gst_memory_unref (src->block);
+    src->block = NULL;
+  }
+  src->block_fill = 0;
+  src->buffer_len = 0;
+}
+
+/*
+ * Take all the received data as a buffer, made of the blocks it was written
+ * to. Must be called with buffer_mutex held.
+ */
+static GstBuffer *
+gst_curl_http_src_take_buffer (GstCurlHttpSrc * src)
+{
+  GstBuffer *buffer = gst_buffer_new ();
+
+  /* don't tie up a whole block for a little data, copy that data instead
+   * and keep on writing to the block from its start */
+  if (src->block && src->block_fill >= src->block_map.size / 4)
+    gst_curl_http_src_push_block (src);
+
+  while (!gst_queue_array_is_empty (src->blocks))
+    gst_buffer_append_memory (buffer, gst_queue_array_pop_head (src->blocks));
+
+  if (src->block_fill > 0) {
+    GstMemory *mem = gst_allocator_alloc (NULL, src->block_fill, NULL);
+
+    gst_buffer_append_memory (buffer, mem);
+    gst_buffer_fill (buffer, src->buffer_len - src->block_fill,
+        src->block_map.data, src->block_fill);
+    src->block_fill = 0;
+  }
+
+  src->buffer_len = 0;
+  return buffer;
+}
+
 /*
  * Do the transfer. If the transfer hasn't begun yet, start a new curl handle
  * and pass it to the multi queue to be operated on. Then wait for any blocks
@@ -872,6 +982,7 @@ gst_curl_http_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
   GstCurlHttpSrcClass *klass;
   GstStructure *empty_headers;
   GstBaseSrc *basesrc;
+  guint threshold;
 
   GSTCURL_FUNCTION_ENTRY (src);
 
@@ -906,11 +1017,12 @@ retry:
       goto escape;
     }
     /* Signal the worker thread */
-    g_cond_signal (&klass->multi_task_context.signal);
+    gst_curl_http_src_wake_multi_loop (&klass->multi_task_context);
 
     src->state = GSTCURL_OK;
     src->transfer_begun = TRUE;
     src->data_received = FALSE;
+    src->transfer_paused = FALSE;
 
     GST_DEBUG_OBJECT (src, "Submitted request for URI %s to curl", src->uri);
 
@@ -928,18 +1040,15 @@ retry:
 
   g_mutex_unlock (&klass->multi_task_context.mutex);
 
-  /* Wait for data to become available, then punt it downstream */
-  while ((src->buffer_len == 0) && (src->state == GSTCURL_OK)
+  /* Wait for enough data to become available, then punt it downstream */
+  threshold = MAX (src->coalesce_size, 1);
+  while ((src->buffer_len < threshold) && (src->state == GSTCURL_OK)
       && (src->connection_status == GSTCURL_CONNECTED)) {
     g_cond_wait (&src->buffer_cond, &src->buffer_mutex);
   }
 
   if (src->state == GSTCURL_UNLOCK) {
-    if (src->buffer_len > 0) {
-      g_free (src->buffer);
-      src->buffer = NULL;
-      src->buffer_len = 0;
-    }
+    gst_curl_http_src_clear_blocks (src);
     g_mutex_unlock (&src->buffer_mutex);
     return GST_FLOW_FLUSHING;
   }
@@ -994,15 +1103,16 @@ retry:
 
     GST_DEBUG_OBJECT (src, "Pushing %u bytes of transfer for URI %s to pad",
         src->buffer_len, src->uri);
-    *outbuf = gst_buffer_new_allocate (NULL, src->buffer_len, NULL);
-    gst_buffer_fill (*outbuf, 0, src->buffer, src->buffer_len);
+    *outbuf = gst_curl_http_src_take_buffer (src);
     GST_BUFFER_OFFSET (*outbuf) = basesrc->segment.position;
-
-    g_free (src->buffer);
-    src->buffer = NULL;
-    src->buffer_len = 0;
     src->data_received = TRUE;
 
+    if (src->transfer_paused) {
+      /* the multi loop resumes the transfer now that there's room again */
+      GST_LOG_OBJECT (src, "Waking up the multi loop to resume the transfer");
+      gst_curl_http_src_wake_multi_loop (&klass->multi_task_context);
+    }
+
     /* ret should still be GST_FLOW_OK */
   } else if ((src->state == GSTCURL_DONE) && (src->buffer_len == 0)) {
     GST_INFO_OBJECT (src, "Full body received, signalling EOS for URI %s.",
@@ -1192,6 +1302,12 @@ gst_curl_http_src_create_easy_handle (GstCurlHttpSrc * s)
           GST_INFO_OBJECT (s, "HTTP/2 unsupported by libcurl at this time");
         }
       }
+      /* wait for a connection to the server to be available for
+       * multiplexing rather than opening a new one */
+      if (curl_easy_setopt (handle, CURLOPT_PIPEWAIT, 1L) != CURLE_OK) {
+        GST_WARNING_OBJECT (s,
+            "Cannot set unsupported option CURLOPT_PIPEWAIT");
+      }
       break;
 #endif
     default:
@@ -1447,6 +1563,9 @@ gst_curl_http_src_change_state (GstElement * element, GstStateChange transition)
          and wait until the multi_loop has stopped using this element */
       gst_curl_http_src_wait_until_removed (source);
       gst_curl_http_src_unref_multi (source);
+      g_mutex_lock (&source->buffer_mutex);
+      gst_curl_http_src_clear_blocks (source);
+      g_mutex_unlock (&source->buffer_mutex);
       break;
     default:
       break;
@@ -1493,13 +1612,14 @@ gst_curl_http_src_cleanup_instance (GstCurlHttpSrc * src)
   g_free (src->user_agent);
   src->user_agent = NULL;
 
+  gst_curl_http_src_clear_blocks (src);
+  gst_queue_array_free (src->blocks);
+  src->blocks = NULL;
+
   g_mutex_clear (&src->buffer_mutex);
 
   g_cond_clear (&src->buffer_cond);
 
-  g_free (src->buffer);
-  src->buffer = NULL;
-
   if (src->request_headers) {
     gst_structure_free (src->request_headers);
     src->request_headers = NULL;
@@ -1726,7 +1846,7 @@ gst_curl_http_src_unlock (GstBaseSrc * bsrc)
         GST_TYPE_CURL_HTTP_SRC,
         GstCurlHttpSrcClass);
     g_mutex_lock (&klass->multi_task_context.mutex);
-    g_cond_signal (&klass->multi_task_context.signal);
+    gst_curl_http_src_wake_multi_loop (&klass->multi_task_context);
     g_mutex_unlock (&klass->multi_task_context.mutex);
   }
 
@@ -1764,6 +1884,7 @@ gst_curl_http_src_curl_multi_loop (gpointer thread_data)
   CURLMsg *curl_message;
   GstCurlHttpSrc *elt;
   guint active = 0;
+  gboolean resume = FALSE;
 
   context = (GstCurlHttpSrcMultiTaskContext *) thread_data;
 
@@ -1806,9 +1927,19 @@ gst_curl_http_src_curl_multi_loop (gpointer thread_data)
       if (g_atomic_int_compare_and_exchange (&qelement->running, 0, 1)) {
         GSTCURL_DEBUG_PRINT ("Adding easy handle for URI %s", qelement->p->uri);
         curl_multi_add_handle (context->multi_handle, qelement->p->curl_handle);
+      } else if (elt->transfer_paused &&
+          elt->buffer_len < GSTCURL_MAX_BUFFERED) {
+        elt->transfer_paused = FALSE;
+        resume = TRUE;
       }
     }
     g_mutex_unlock (&elt->buffer_mutex);
+    /* the write callback may be called from there, which takes buffer_mutex */
+    if (resume) {
+      GSTCURL_DEBUG_PRINT ("Resuming transfer for URI %s", elt->uri);
+      curl_easy_pause (elt->curl_handle, CURLPAUSE_CONT);
+      resume = FALSE;
+    }
     qelement = qnext;
   }
 
@@ -1820,11 +1951,13 @@ gst_curl_http_src_curl_multi_loop (gpointer thread_data)
   /* perform a select() on all of the active sockets and process any
      messages from curl */
   {
+#if !GSTCURL_HAVE_MULTI_POLL
     struct timeval timeout;
     gint rc;
     fd_set fdread, fdwrite, fdexcep;
     int maxfd = -1;
     long curl_timeo = -1;
+#endif
     gboolean cond = FALSE;
 
     /* Because curl can possibly take some time here, be nice and let go of the
@@ -1832,6 +1965,12 @@ gst_curl_http_src_curl_multi_loop (gpointer thread_data)
      * care about those until the end of this. */
     g_mutex_unlock (&context->mutex);
 
+#if GSTCURL_HAVE_MULTI_POLL
+    /* Returns early when woken up with curl_multi_wakeup(), so that new,
+     * removed and resumed transfers are handled right away */
+    curl_multi_poll (context->multi_handle, NULL, 0, 1000, NULL);
+    curl_multi_perform (context->multi_handle, &still_running);
+#else
     FD_ZERO (&fdread);
     FD_ZERO (&fdwrite);
     FD_ZERO (&fdexcep);
@@ -1865,6 +2004,7 @@ gst_curl_http_src_curl_multi_loop (gpointer thread_data)
         curl_multi_perform (context->multi_handle, &still_running);
         break;
     }
+#endif
 
     g_mutex_lock (&context->mutex);
 
@@ -2056,6 +2196,11 @@ gst_curl_http_src_get_chunks (void *chunk, size_t size, size_t nmemb, void *src)
 {
   GstCurlHttpSrc *s = src;
   size_t chunk_len = size * nmemb;
+  const guint8 *data = chunk;
+  gsize remaining = chunk_len;
+  guint threshold;
+  gboolean was_ready;
+
   GST_TRACE_OBJECT (s,
       "Received curl chunk for URI %s of size %d", s->uri, (int) chunk_len);
   g_mutex_lock (&s->buffer_mutex);
@@ -2063,15 +2208,49 @@ gst_curl_http_src_get_chunks (void *chunk, size_t size, size_t nmemb, void *src)
     g_mutex_unlock (&s->buffer_mutex);
     return chunk_len;
   }
-  s->buffer =
-      g_realloc (s->buffer, (s->buffer_len + chunk_len + 1) * sizeof (char));
-  if (s->buffer == NULL) {
-    GST_ERROR_OBJECT (s, "Realloc for cURL response message failed!");
-    return 0;
+#if GSTCURL_HAVE_MULTI_POLL
+  if (s->buffer_len >= GSTCURL_MAX_BUFFERED) {
+    /* curl passes the same data again once the transfer is resumed */
+    GST_LOG_OBJECT (s, "%u bytes waiting to be pushed, pausing transfer",
+        s->buffer_len);
+    s->transfer_paused = TRUE;
+    g_mutex_unlock (&s->buffer_mutex);
+    return CURL_WRITEFUNC_PAUSE;
+  }
+#endif
+
+  threshold = MAX (s->coalesce_size, 1);
+  was_ready = s->buffer_len >= threshold;
+
+  while (remaining > 0) {
+    gsize len;
+
+    if (s->block == NULL) {
+      s->block = gst_allocator_alloc (NULL, GSTCURL_BLOCK_SIZE, NULL);
+      if (!gst_memory_map (s->block, &s->block_map, GST_MAP_WRITE)) {
+        GST_ERROR_OBJECT (s, "Failed to map memory for cURL response message!");
+        gst_memory_unref (s->block);
+        s->block = NULL;
+        g_mutex_unlock (&s->buffer_mutex);
+        return 0;
+      }
+      s->block_fill = 0;
+    }
+
+    len = MIN (remaining, s->block_map.size - s->block_fill);
+    memcpy (s->block_map.data + s->block_fill, data, len);
+    s->block_fill += len;
+    s->buffer_len += len;
+    data += len;
+    remaining -= len;
+
+    if (s->block_fill == s->block_map.size)
+      gst_curl_http_src_push_block (s);
   }
-  memcpy (s->buffer + s->buffer_len, chunk, chunk_len);
-  s->buffer_len += chunk_len;
-  g_cond_signal (&s->buffer_cond);
+
+  /* only wake ::create() up once there is enough for it to push */
+  if (!was_ready && s->buffer_len >= threshold)
+    g_cond_signal (&s->buffer_cond);
   g_mutex_unlock (&s->buffer_mutex);
   return chunk_len;
 }
@@ -2092,10 +2271,24 @@ gst_curl_http_src_request_remove (GstCurlHttpSrc * src)
     src->connection_status = GSTCURL_WANT_REMOVAL;
   }
   g_mutex_unlock (&src->buffer_mutex);
-  g_cond_signal (&klass->multi_task_context.signal);
+  gst_curl_http_src_wake_multi_loop (&klass->multi_task_context);
   g_mutex_unlock (&klass->multi_task_context.mutex);
 }
 
+/*
+ * Wake the multi loop up, whether it waits for an element to be added or for
+ * activity on the transfers.
+ */
+static void
+gst_curl_http_src_wake_multi_loop (GstCurlHttpSrcMultiTaskContext * context)
+{
+  g_cond_signal (&context->signal);
+#if GSTCURL_HAVE_MULTI_POLL
+  if (context->multi_handle)
+    curl_multi_wakeup (context->multi_handle);
+#endif
+}
+
 /*
  * Request a cancellation of a currently running curl handle and
  * block this thread until the src element has been removed
@@ -56,6 +56,7 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <gst/base/gstpushsrc.h>
+#include <gst/base/gstqueuearray.h>
 
 #include "curltask.h"
 
@@ -204,8 +205,13 @@ struct _GstCurlHttpSrc
   CURL *curl_handle;
   GMutex buffer_mutex;
   GCond buffer_cond;
-  gchar *buffer;
-  guint buffer_len;
+  GstQueueArray *blocks;        /* full GstMemory blocks */
+  GstMemory *block;             /* block being written to, mapped */
+  GstMapInfo block_map;
+  gsize block_fill;
+  guint buffer_len;             /* bytes in blocks and block */
+  guint coalesce_size;
+  gboolean transfer_paused;
   gboolean transfer_begun;
   gboolean data_received;
   enum {
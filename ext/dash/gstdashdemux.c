@@ -280,6 +280,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <inttypes.h>
 #include <gio/gio.h>
 #include <gst/base/gsttypefindhelper.h>
@@ -326,6 +327,7 @@ enum
   PROP_MAX_VIDEO_HEIGHT,
   PROP_MAX_VIDEO_FRAMERATE,
   PROP_PRESENTATION_DELAY,
+  PROP_TARGET_LATENCY,
   PROP_LAST
 };
 
@@ -338,6 +340,15 @@ enum
 #define DEFAULT_MAX_VIDEO_FRAMERATE_N     0
 #define DEFAULT_MAX_VIDEO_FRAMERATE_D     1
 #define DEFAULT_PRESENTATION_DELAY     "10s"    /* 10s */
+#define DEFAULT_TARGET_LATENCY          GST_CLOCK_TIME_NONE
+
+/* Live catch-up: latency differences smaller than the deadband are left
+ * alone, others are corrected over the horizon within these rates unless
+ * the MPD ServiceDescription says otherwise */
+#define LIVE_CATCH_UP_DEADBAND     (500 * GST_MSECOND)
+#define LIVE_CATCH_UP_HORIZON      (10 * GST_SECOND)
+#define LIVE_CATCH_UP_MIN_RATE     0.95
+#define LIVE_CATCH_UP_MAX_RATE     1.05
 
 /* Clock drift compensation for live streams */
 #define SLOW_CLOCK_UPDATE_INTERVAL  (1000000 * 30 * 60) /* 30 minutes */
@@ -378,6 +389,9 @@ static gboolean gst_dash_demux_process_manifest (GstAdaptiveDemux * ademux,
 static gboolean gst_dash_demux_seek (GstAdaptiveDemux * demux, GstEvent * seek);
 static GstFlowReturn
 gst_dash_demux_stream_update_fragment_info (GstAdaptiveDemuxStream * stream);
+static GstFlowReturn
+gst_dash_demux_stream_peek_fragment (GstAdaptiveDemuxStream * stream, guint n,
+    GstAdaptiveDemuxStreamFragment * fragment);
 static GstFlowReturn gst_dash_demux_stream_seek (GstAdaptiveDemuxStream *
     stream, gboolean forward, GstSeekFlags flags, GstClockTime ts,
     GstClockTime * final_ts);
@@ -389,6 +403,8 @@ static gboolean
 gst_dash_demux_stream_advance_subfragment (GstAdaptiveDemuxStream * stream);
 static gboolean gst_dash_demux_stream_select_bitrate (GstAdaptiveDemuxStream *
     stream, guint64 bitrate);
+static GArray *gst_dash_demux_stream_get_bitrates (GstAdaptiveDemuxStream *
+    stream);
 static gint64 gst_dash_demux_get_manifest_update_interval (GstAdaptiveDemux *
     demux);
 static GstFlowReturn gst_dash_demux_update_manifest_data (GstAdaptiveDemux *
@@ -423,6 +439,9 @@ static void gst_dash_demux_clock_drift_free (GstDashDemuxClockDrift *);
 static gboolean gst_dash_demux_poll_clock_drift (GstDashDemux * demux);
 static GTimeSpan gst_dash_demux_get_clock_compensation (GstDashDemux * demux);
 static GDateTime *gst_dash_demux_get_server_now_utc (GstDashDemux * demux);
+static GstClockTime gst_dash_demux_get_target_latency (GstDashDemux * demux);
+static void gst_dash_demux_update_live_catch_up (GstDashDemux * demux,
+    GstAdaptiveDemuxStream * stream);
 
 #define SIDX(s) (&(s)->sidx_parser.sidx)
 
@@ -598,6 +617,28 @@ gst_dash_demux_class_init (GstDashDemuxClass * klass)
           DEFAULT_PRESENTATION_DELAY,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * GstDashDemux:target-latency:
+   *
+   * Latency to keep behind the live edge of dynamic MPDs, in nanoseconds.
+   * When not set, the Latency@target of the MPD ServiceDescription is used
+   * if present, and #GstDashDemux:presentation-delay otherwise.
+   *
+   * With a target latency, playback starts that far from the live edge and
+   * a `dash-live-latency` element message is posted whenever the playback
+   * rate needed to get back to the target changes. It contains the current
+   * `latency` and `target-latency` (#GstClockTime) and the suggested
+   * `playback-rate` (gdouble), which the application can apply with an
+   * instant rate change seek.
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_TARGET_LATENCY,
+      g_param_spec_uint64 ("target-latency", "Target latency",
+          "Latency to keep behind the live edge in nanoseconds "
+          "(-1 = from the MPD ServiceDescription)", 0, G_MAXUINT64,
+          DEFAULT_TARGET_LATENCY, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gst_element_class_add_static_pad_template (gstelement_class,
       &gst_dash_demux_audiosrc_template);
   gst_element_class_add_static_pad_template (gstelement_class,
@@ -638,8 +679,12 @@ gst_dash_demux_class_init (GstDashDemuxClass * klass)
   gstadaptivedemux_class->stream_seek = gst_dash_demux_stream_seek;
   gstadaptivedemux_class->stream_select_bitrate =
       gst_dash_demux_stream_select_bitrate;
+  gstadaptivedemux_class->stream_get_bitrates =
+      gst_dash_demux_stream_get_bitrates;
   gstadaptivedemux_class->stream_update_fragment_info =
       gst_dash_demux_stream_update_fragment_info;
+  gstadaptivedemux_class->stream_peek_fragment =
+      gst_dash_demux_stream_peek_fragment;
   gstadaptivedemux_class->stream_free = gst_dash_demux_stream_free;
   gstadaptivedemux_class->get_live_seek_range =
       gst_dash_demux_get_live_seek_range;
@@ -667,6 +712,8 @@ gst_dash_demux_init (GstDashDemux * demux)
   demux->max_video_framerate_n = DEFAULT_MAX_VIDEO_FRAMERATE_N;
   demux->max_video_framerate_d = DEFAULT_MAX_VIDEO_FRAMERATE_D;
   demux->default_presentation_delay = g_strdup (DEFAULT_PRESENTATION_DELAY);
+  demux->target_latency = DEFAULT_TARGET_LATENCY;
+  demux->live_catch_up_rate = 1.0;
 
   g_mutex_init (&demux->client_lock);
 
@@ -705,6 +752,9 @@ gst_dash_demux_set_property (GObject * object, guint prop_id,
       g_free (demux->default_presentation_delay);
       demux->default_presentation_delay = g_value_dup_string (value);
       break;
+    case PROP_TARGET_LATENCY:
+      demux->target_latency = g_value_get_uint64 (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -744,6 +794,9 @@ gst_dash_demux_get_property (GObject * object, guint prop_id, GValue * value,
       else
         g_value_set_string (value, demux->default_presentation_delay);
       break;
+    case PROP_TARGET_LATENCY:
+      g_value_set_uint64 (value, demux->target_latency);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -943,6 +996,8 @@ gst_dash_demux_setup_streams (GstAdaptiveDemux * demux)
   period_idx = 0;
   if (gst_mpd_client_is_live (dashdemux->client)) {
     GDateTime *g_now;
+    GstClockTime target_latency;
+
     if (dashdemux->client->mpd_root_node->availabilityStartTime == NULL) {
       ret = FALSE;
       GST_ERROR_OBJECT (demux, "MPD does not have availabilityStartTime");
@@ -962,7 +1017,14 @@ gst_dash_demux_setup_streams (GstAdaptiveDemux * demux)
     /* get period index for period encompassing the current time */
     g_now = gst_dash_demux_get_server_now_utc (dashdemux);
     now = gst_date_time_new_from_g_date_time (g_now);
-    if (dashdemux->client->mpd_root_node->suggestedPresentationDelay != -1) {
+    target_latency = gst_dash_demux_get_target_latency (dashdemux);
+    if (GST_CLOCK_TIME_IS_VALID (target_latency)) {
+      GstDateTime *target = gst_mpd_client_add_time_difference (now,
+          -(gint64) (target_latency / GST_USECOND));
+      gst_date_time_unref (now);
+      now = target;
+    } else if (dashdemux->client->mpd_root_node->suggestedPresentationDelay !=
+        -1) {
       GstDateTime *target = gst_mpd_client_add_time_difference (now,
           dashdemux->client->mpd_root_node->suggestedPresentationDelay * -1000);
       gst_date_time_unref (now);
@@ -1126,6 +1188,9 @@ gst_dash_demux_reset (GstAdaptiveDemux * ademux)
 
   demux->trickmode_no_audio = FALSE;
   demux->allow_trickmode_key_units = TRUE;
+  GST_OBJECT_LOCK (demux);
+  demux->live_catch_up_rate = 1.0;
+  GST_OBJECT_UNLOCK (demux);
 }
 
 static GstCaps *
@@ -1339,6 +1404,9 @@ gst_dash_demux_stream_update_fragment_info (GstAdaptiveDemuxStream * stream)
         &fragment);
 
     stream->fragment.uri = fragment.uri;
+    stream->fragment.incomplete =
+        !gst_mpd_client_is_availability_time_complete (dashdemux->client,
+        dashstream->active_stream);
     /* If mpd does not specify indexRange (i.e., null index_uri),
      * sidx entries may not be available until download it */
     if (isombff && dashstream->sidx_position != GST_CLOCK_TIME_NONE
@@ -1380,6 +1448,35 @@ gst_dash_demux_stream_update_fragment_info (GstAdaptiveDemuxStream * stream)
   return GST_FLOW_EOS;
 }
 
+static GstFlowReturn
+gst_dash_demux_stream_peek_fragment (GstAdaptiveDemuxStream * stream, guint n,
+    GstAdaptiveDemuxStreamFragment * fragment)
+{
+  GstDashDemuxStream *dashstream = (GstDashDemuxStream *) stream;
+  GstDashDemux *dashdemux = GST_DASH_DEMUX_CAST (stream->demux);
+  GstMediaFragmentInfo info;
+
+  /* Subsegments are only known once the sidx is downloaded, and segments of
+   * live streams only become available over time */
+  if (gst_mpd_client_has_isoff_ondemand_profile (dashdemux->client)
+      || gst_mpd_client_is_live (dashdemux->client))
+    return GST_FLOW_EOS;
+
+  if (!gst_mpd_client_peek_fragment (dashdemux->client, dashstream->index, n,
+          &info))
+    return GST_FLOW_EOS;
+
+  fragment->uri = info.uri;
+  info.uri = NULL;
+  fragment->range_start = MAX (info.range_start, dashstream->sidx_base_offset);
+  fragment->range_end = info.range_end;
+  fragment->duration = info.duration;
+
+  gst_mpdparser_media_fragment_info_clear (&info);
+
+  return GST_FLOW_OK;
+}
+
 static gint
 gst_dash_demux_index_entry_search (GstSidxBoxEntry * entry, GstClockTime * ts,
     gpointer user_data)
@@ -1986,6 +2083,9 @@ gst_dash_demux_stream_advance_fragment (GstAdaptiveDemuxStream * stream)
 
   GST_DEBUG_OBJECT (stream->pad, "Advance fragment");
 
+  if (!GST_ADAPTIVE_DEMUX_IN_TRICKMODE_KEY_UNITS (dashdemux))
+    gst_dash_demux_update_live_catch_up (dashdemux, stream);
+
   /* Update download statistics */
   if (dashstream->moof_sync_samples &&
       GST_ADAPTIVE_DEMUX_IN_TRICKMODE_KEY_UNITS (dashdemux) &&
@@ -2287,6 +2387,44 @@ end:
   return ret;
 }
 
+static GArray *
+gst_dash_demux_stream_get_bitrates (GstAdaptiveDemuxStream * stream)
+{
+  GstDashDemux *demux = GST_DASH_DEMUX_CAST (stream->demux);
+  GstDashDemuxStream *dashstream = (GstDashDemuxStream *) stream;
+  GstActiveStream *active_stream = dashstream->active_stream;
+  GArray *bitrates;
+  GList *rep_list, *iter;
+  gint i;
+
+  if (active_stream == NULL || active_stream->cur_adapt_set == NULL ||
+      GST_ADAPTIVE_DEMUX_IN_TRICKMODE_KEY_UNITS (demux))
+    return NULL;
+
+  rep_list = active_stream->cur_adapt_set->Representations;
+  bitrates = g_array_new (FALSE, FALSE, sizeof (guint64));
+
+  /* only keep what select_bitrate() can switch to given the limits set on
+   * the element */
+  for (iter = rep_list, i = 0; iter; iter = g_list_next (iter), i++) {
+    GstMPDRepresentationNode *rep = iter->data;
+    guint64 bitrate = rep->bandwidth;
+
+    if (active_stream->mimeType == GST_STREAM_VIDEO && demux->max_bitrate &&
+        bitrate > demux->max_bitrate)
+      continue;
+
+    if (gst_mpd_client_get_rep_idx_with_max_bandwidth (rep_list, bitrate,
+            demux->max_video_width, demux->max_video_height,
+            demux->max_video_framerate_n, demux->max_video_framerate_d) != i)
+      continue;
+
+    g_array_append_val (bitrates, bitrate);
+  }
+
+  return bitrates;
+}
+
 #define SEEK_UPDATES_PLAY_POSITION(r, start_type, stop_type) \
   ((r >= 0 && start_type != GST_SEEK_TYPE_NONE) || \
    (r < 0 && stop_type != GST_SEEK_TYPE_NONE))
@@ -2412,7 +2550,8 @@ gst_dash_demux_update_manifest_data (GstAdaptiveDemux * demux,
   new_client->mpd_base_uri = g_strdup (demux->manifest_base_uri);
   gst_buffer_map (buffer, &mapinfo, GST_MAP_READ);
 
-  if (gst_mpd_client_parse (new_client, (gchar *) mapinfo.data, mapinfo.size)) {
+  if (gst_mpd_client_parse_update (new_client, dashdemux->client,
+          (gchar *) mapinfo.data, mapinfo.size)) {
     const gchar *period_id;
     guint period_idx;
     GList *iter;
@@ -4009,3 +4148,172 @@ gst_dash_demux_get_server_now_utc (GstDashDemux * demux)
   g_date_time_unref (client_now);
   return server_now;
 }
+
+/* Latency to keep behind the live edge, GST_CLOCK_TIME_NONE if none */
+static GstClockTime
+gst_dash_demux_get_target_latency (GstDashDemux * demux)
+{
+  GstMPDServiceDescriptionNode *service;
+
+  if (GST_CLOCK_TIME_IS_VALID (demux->target_latency))
+    return demux->target_latency;
+
+  service = gst_mpd_client_get_service_description (demux->client);
+  if (service && service->latencyTarget >= 0)
+    return service->latencyTarget * GST_MSECOND;
+
+  return GST_CLOCK_TIME_NONE;
+}
+
+/* What is needed to compute the live latency once the playback position is
+ * known, taken from the manifest when a fragment is done */
+typedef struct
+{
+  GstPad *pad;
+  GstSegment segment;
+  GstClockTime period_start;
+  GstClockTime presentation_offset;
+  GstClockTime live_edge;
+  GstClockTime target_latency;
+  gdouble min_rate;
+  gdouble max_rate;
+} GstDashDemuxLiveCatchUp;
+
+static void
+gst_dash_demux_live_catch_up_free (GstDashDemuxLiveCatchUp * catch_up)
+{
+  gst_object_unref (catch_up->pad);
+  g_slice_free (GstDashDemuxLiveCatchUp, catch_up);
+}
+
+/* Runs without the manifest lock, as the position query goes downstream.
+ * Compares how far behind the live edge playback is with the target latency
+ * and tells the application which playback rate would bring it back there.
+ * The demuxer can't change the rate of the pipeline by itself. */
+static void
+gst_dash_demux_check_live_latency (GstElement * element,
+    GstDashDemuxLiveCatchUp * catch_up)
+{
+  GstDashDemux *demux = GST_DASH_DEMUX_CAST (element);
+  GstClockTime latency, target_latency, presentation_time;
+  guint64 timestamp;
+  gint64 position;
+  gdouble rate = 1.0;
+  gboolean ok;
+
+  ok = gst_pad_peer_query_position (catch_up->pad, GST_FORMAT_TIME, &position)
+      && position >= 0;
+
+  GST_OBJECT_LOCK (demux);
+  demux->live_catch_up_pending = FALSE;
+  GST_OBJECT_UNLOCK (demux);
+
+  if (!ok)
+    return;
+
+  /* the position is a stream time, go back to the media timestamps and from
+   * there to the presentation timeline of the MPD */
+  if (gst_segment_position_from_stream_time_full (&catch_up->segment,
+          GST_FORMAT_TIME, position, &timestamp) != 1)
+    return;
+  if (timestamp < catch_up->presentation_offset)
+    timestamp = catch_up->presentation_offset;
+  presentation_time =
+      catch_up->period_start + timestamp - catch_up->presentation_offset;
+
+  target_latency = catch_up->target_latency;
+  latency = catch_up->live_edge > presentation_time ?
+      catch_up->live_edge - presentation_time : 0;
+
+  if (latency > target_latency + LIVE_CATCH_UP_DEADBAND ||
+      latency + LIVE_CATCH_UP_DEADBAND < target_latency) {
+    rate = 1.0 + (gdouble) GST_CLOCK_DIFF (target_latency, latency) /
+        LIVE_CATCH_UP_HORIZON;
+    rate = CLAMP (rate, catch_up->min_rate, catch_up->max_rate);
+  }
+
+  GST_LOG_OBJECT (catch_up->pad, "Live latency %" GST_TIME_FORMAT " target %"
+      GST_TIME_FORMAT " rate %f", GST_TIME_ARGS (latency),
+      GST_TIME_ARGS (target_latency), rate);
+
+  GST_OBJECT_LOCK (demux);
+  if (fabs (rate - demux->live_catch_up_rate) < 0.01 &&
+      (rate != 1.0 || demux->live_catch_up_rate == 1.0)) {
+    GST_OBJECT_UNLOCK (demux);
+    return;
+  }
+  demux->live_catch_up_rate = rate;
+  GST_OBJECT_UNLOCK (demux);
+
+  GST_DEBUG_OBJECT (demux, "Suggesting playback rate %f to get from latency %"
+      GST_TIME_FORMAT " to %" GST_TIME_FORMAT, rate, GST_TIME_ARGS (latency),
+      GST_TIME_ARGS (target_latency));
+
+  gst_element_post_message (GST_ELEMENT_CAST (demux),
+      gst_message_new_element (GST_OBJECT_CAST (demux),
+          gst_structure_new ("dash-live-latency",
+              "latency", GST_TYPE_CLOCK_TIME, latency,
+              "target-latency", GST_TYPE_CLOCK_TIME, target_latency,
+              "playback-rate", G_TYPE_DOUBLE, rate, NULL)));
+}
+
+/* must be called with manifest_lock taken.
+ * Schedules a check of the live latency of @stream, unless one is
+ * already pending */
+static void
+gst_dash_demux_update_live_catch_up (GstDashDemux * demux,
+    GstAdaptiveDemuxStream * stream)
+{
+  GstDashDemuxLiveCatchUp *catch_up;
+  GstMPDServiceDescriptionNode *service;
+  GstDateTime *availability_start;
+  GDateTime *now, *start;
+  GTimeSpan since_start;
+  GstClockTime target_latency;
+
+  if (!gst_mpd_client_is_live (demux->client) || stream->segment.rate < 0.0)
+    return;
+
+  target_latency = gst_dash_demux_get_target_latency (demux);
+  availability_start = demux->client->mpd_root_node->availabilityStartTime;
+  if (!GST_CLOCK_TIME_IS_VALID (target_latency) || !availability_start)
+    return;
+
+  now = gst_dash_demux_get_server_now_utc (demux);
+  start = gst_date_time_to_g_date_time (availability_start);
+  since_start = g_date_time_difference (now, start);
+  g_date_time_unref (start);
+  g_date_time_unref (now);
+  if (since_start <= 0)
+    return;
+
+  GST_OBJECT_LOCK (demux);
+  if (demux->live_catch_up_pending) {
+    GST_OBJECT_UNLOCK (demux);
+    return;
+  }
+  demux->live_catch_up_pending = TRUE;
+  GST_OBJECT_UNLOCK (demux);
+
+  catch_up = g_slice_new0 (GstDashDemuxLiveCatchUp);
+  catch_up->pad = gst_object_ref (stream->pad);
+  gst_segment_copy_into (&stream->segment, &catch_up->segment);
+  catch_up->period_start = gst_mpd_client_get_period_start_time (demux->client);
+  catch_up->presentation_offset =
+      gst_dash_demux_get_presentation_offset (GST_ADAPTIVE_DEMUX_CAST (demux),
+      stream);
+  catch_up->live_edge = since_start * GST_USECOND;
+  catch_up->target_latency = target_latency;
+
+  catch_up->min_rate = LIVE_CATCH_UP_MIN_RATE;
+  catch_up->max_rate = LIVE_CATCH_UP_MAX_RATE;
+  service = gst_mpd_client_get_service_description (demux->client);
+  if (service && service->playbackRateMin > 0)
+    catch_up->min_rate = MIN (service->playbackRateMin, 1.0);
+  if (service && service->playbackRateMax > 0)
+    catch_up->max_rate = MAX (service->playbackRateMax, 1.0);
+
+  gst_element_call_async (GST_ELEMENT_CAST (demux),
+      (GstElementCallAsyncFunc) gst_dash_demux_check_live_latency, catch_up,
+      (GDestroyNotify) gst_dash_demux_live_catch_up_free);
+}
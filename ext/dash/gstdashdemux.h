@@ -139,6 +139,12 @@ struct _GstDashDemux
   gint max_video_width, max_video_height;
   gint max_video_framerate_n, max_video_framerate_d;
   gchar* default_presentation_delay; /* presentation time delay if MPD@suggestedPresentationDelay is not present */
+  GstClockTime target_latency;  /* live latency to keep, overrides ServiceDescription */
+
+  /* playback rate last suggested to get to the target latency, and whether
+   * a latency check is scheduled. Protected by the object lock */
+  gdouble live_catch_up_rate;
+  gboolean live_catch_up_pending;
 
   gint n_audio_streams;
   gint n_video_streams;
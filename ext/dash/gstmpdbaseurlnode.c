@@ -108,6 +108,14 @@ gst_mpd_baseurl_get_xml_node (GstMPDNode * node)
     gst_xml_helper_set_prop_string (baseurl_xml_node, "byteRange",
         self->byteRange);
 
+  if (self->availabilityTimeOffset != 0)
+    gst_xml_helper_set_prop_double (baseurl_xml_node,
+        "availabilityTimeOffset", self->availabilityTimeOffset);
+
+  if (!self->availabilityTimeComplete)
+    gst_xml_helper_set_prop_boolean (baseurl_xml_node,
+        "availabilityTimeComplete", self->availabilityTimeComplete);
+
   if (self->baseURL)
     gst_xml_helper_set_content (baseurl_xml_node, self->baseURL);
 
@@ -150,6 +158,8 @@ gst_mpd_baseurl_node_init (GstMPDBaseURLNode * self)
   self->baseURL = NULL;
   self->serviceLocation = NULL;
   self->byteRange = NULL;
+  self->availabilityTimeOffset = 0;
+  self->availabilityTimeComplete = TRUE;
 }
 
 GstMPDBaseURLNode *
@@ -35,6 +35,8 @@ struct _GstMPDBaseURLNode
   gchar *baseURL;
   gchar *serviceLocation;
   gchar *byteRange;
+  gdouble availabilityTimeOffset;     /* [s], may be infinite */
+  gboolean availabilityTimeComplete;
   /* TODO add missing fields such as weight etc.*/
 };
 
@@ -19,6 +19,8 @@
  *
  */
 
+#include <math.h>
+
 #include "gstmpdclient.h"
 #include "gstmpdparser.h"
 
@@ -477,10 +479,19 @@ gst_mpd_client_free (GstMPDClient * client)
 gboolean
 gst_mpd_client_parse (GstMPDClient * client, const gchar * data, gint size)
 {
-  gboolean ret = FALSE;
+  return gst_mpd_client_parse_update (client, NULL, data, size);
+}
 
+/* Like gst_mpd_client_parse(), but Periods that are unchanged from the MPD
+ * of @previous are shared with it instead of being parsed again */
+gboolean
+gst_mpd_client_parse_update (GstMPDClient * client, GstMPDClient * previous,
+    const gchar * data, gint size)
+{
+  gboolean ret = FALSE;
 
-  ret = gst_mpdparser_get_mpd_root_node (&client->mpd_root_node, data, size);
+  ret = gst_mpdparser_update_mpd_root_node (&client->mpd_root_node,
+      previous ? previous->mpd_root_node : NULL, data, size);
 
   if (ret) {
     gst_mpd_client_check_profiles (client);
@@ -756,6 +767,140 @@ gst_mpd_client_parse_baseURL (GstMPDClient * client, GstActiveStream * stream,
   return ret;
 }
 
+/* The BaseURL of @list used for the stream, as picked by
+ * gst_mpd_helper_combine_urls() */
+static GstMPDBaseURLNode *
+gst_mpd_client_get_stream_baseURL (GList * list, guint idx)
+{
+  GstMPDBaseURLNode *baseURL;
+
+  if (list == NULL)
+    return NULL;
+
+  baseURL = g_list_nth_data (list, idx);
+  return baseURL ? baseURL : list->data;
+}
+
+static GstMPDSegmentBaseNode *
+gst_mpd_client_get_stream_segment_base (GstActiveStream * stream)
+{
+  if (stream->cur_segment_list)
+    return GST_MPD_MULT_SEGMENT_BASE_NODE (stream->cur_segment_list)->
+        SegmentBase;
+  if (stream->cur_seg_template)
+    return GST_MPD_MULT_SEGMENT_BASE_NODE (stream->cur_seg_template)->
+        SegmentBase;
+  return stream->cur_segment_base;
+}
+
+/**
+ * gst_mpd_client_get_availability_time_offset:
+ * @client: #GstMPDClient that has a parsed manifest
+ * @stream: the #GstActiveStream
+ *
+ * Returns: how long before the end of its segments they can be requested,
+ * as the sum of the availabilityTimeOffset of the segment information and of
+ * the BaseURL elements used for @stream (ISO/IEC 23009-1:2019 5.3.9.5.3).
+ * %GST_CLOCK_TIME_NONE means segments are always available.
+ */
+GstClockTime
+gst_mpd_client_get_availability_time_offset (GstMPDClient * client,
+    GstActiveStream * stream)
+{
+  GstStreamPeriod *stream_period;
+  GstMPDSegmentBaseNode *segbase;
+  GList *levels[4];
+  gdouble offset = 0;
+  guint i;
+
+  g_return_val_if_fail (stream != NULL, 0);
+  stream_period = gst_mpd_client_get_stream_period (client);
+  g_return_val_if_fail (stream_period != NULL, 0);
+
+  segbase = gst_mpd_client_get_stream_segment_base (stream);
+  if (segbase)
+    offset += segbase->availabilityTimeOffset;
+
+  levels[0] = client->mpd_root_node->BaseURLs;
+  levels[1] = stream_period->period->BaseURLs;
+  levels[2] = stream->cur_adapt_set->BaseURLs;
+  levels[3] = stream->cur_representation->BaseURLs;
+  for (i = 0; i < G_N_ELEMENTS (levels); i++) {
+    GstMPDBaseURLNode *baseURL =
+        gst_mpd_client_get_stream_baseURL (levels[i], stream->baseURL_idx);
+
+    if (baseURL)
+      offset += baseURL->availabilityTimeOffset;
+  }
+
+  if (isinf (offset))
+    return GST_CLOCK_TIME_NONE;
+  if (offset <= 0)
+    return 0;
+
+  return offset * GST_SECOND;
+}
+
+/**
+ * gst_mpd_client_is_availability_time_complete:
+ * @client: #GstMPDClient that has a parsed manifest
+ * @stream: the #GstActiveStream
+ *
+ * Returns: %FALSE if segments of @stream may be requested before they are
+ * complete, in which case they are delivered as they get produced
+ * (low-latency DASH).
+ */
+gboolean
+gst_mpd_client_is_availability_time_complete (GstMPDClient * client,
+    GstActiveStream * stream)
+{
+  GstStreamPeriod *stream_period;
+  GstMPDSegmentBaseNode *segbase;
+  GstMPDBaseURLNode *baseURL;
+
+  g_return_val_if_fail (stream != NULL, TRUE);
+  stream_period = gst_mpd_client_get_stream_period (client);
+  g_return_val_if_fail (stream_period != NULL, TRUE);
+
+  segbase = gst_mpd_client_get_stream_segment_base (stream);
+  if (segbase && !segbase->availabilityTimeComplete)
+    return FALSE;
+
+  /* the value of the innermost BaseURL level wins */
+  baseURL = gst_mpd_client_get_stream_baseURL
+      (stream->cur_representation->BaseURLs, stream->baseURL_idx);
+  if (!baseURL)
+    baseURL = gst_mpd_client_get_stream_baseURL (stream->cur_adapt_set->
+        BaseURLs, stream->baseURL_idx);
+  if (!baseURL)
+    baseURL = gst_mpd_client_get_stream_baseURL (stream_period->period->
+        BaseURLs, stream->baseURL_idx);
+  if (!baseURL)
+    baseURL = gst_mpd_client_get_stream_baseURL (client->mpd_root_node->
+        BaseURLs, stream->baseURL_idx);
+
+  return baseURL == NULL || baseURL->availabilityTimeComplete;
+}
+
+/**
+ * gst_mpd_client_get_service_description:
+ * @client: #GstMPDClient that has a parsed manifest
+ *
+ * Returns: (transfer none) (nullable): the first ServiceDescription of the
+ * manifest, if any
+ */
+GstMPDServiceDescriptionNode *
+gst_mpd_client_get_service_description (GstMPDClient * client)
+{
+  g_return_val_if_fail (client != NULL, NULL);
+  g_return_val_if_fail (client->mpd_root_node != NULL, NULL);
+
+  if (client->mpd_root_node->ServiceDescriptions == NULL)
+    return NULL;
+
+  return client->mpd_root_node->ServiceDescriptions->data;
+}
+
 static GstClockTime
 gst_mpd_client_get_segment_end_time (GstMPDClient * client,
     GPtrArray * segments, const GstMediaSegment * segment, gint index)
@@ -777,6 +922,34 @@ gst_mpd_client_get_segment_end_time (GstMPDClient * client,
   return end;
 }
 
+/* Returns the index of the first run of @segments that ends after @ts, or at
+ * @ts when going backwards, or the number of runs if there is none. Runs are
+ * sorted by time, so a DVR window of thousands of them takes a handful of
+ * steps. */
+static guint
+gst_mpd_client_find_segment_run (GstMPDClient * client, GPtrArray * segments,
+    GstClockTime ts, gboolean forward)
+{
+  guint low = 0, high = segments->len;
+
+  while (low < high) {
+    guint mid = low + (high - low) / 2;
+    const GstMediaSegment *segment = g_ptr_array_index (segments, mid);
+    GstClockTime end_time;
+
+    end_time =
+        gst_mpd_client_get_segment_end_time (client, segments, segment, mid);
+
+    /* avoid downloading another fragment just for 1ns in reverse mode */
+    if (forward ? ts < end_time : ts <= end_time)
+      high = mid;
+    else
+      low = mid + 1;
+  }
+
+  return low;
+}
+
 static gboolean
 gst_mpd_client_add_media_segment (GstActiveStream * stream,
     GstMPDSegmentURLNode * url_node, guint number, gint repeat,
@@ -806,6 +979,38 @@ gst_mpd_client_add_media_segment (GstActiveStream * stream,
   return TRUE;
 }
 
+/* Appends @repeat + 1 segments to the last run of @stream if they directly
+ * follow it with the same duration, so that a SegmentTimeline listing equal
+ * segments one S at a time is stored as compactly as one using S@r */
+static gboolean
+gst_mpd_client_extend_media_segment (GstActiveStream * stream, gint repeat,
+    guint64 scale_start, guint64 scale_duration, GstClockTime start,
+    GstClockTime duration, GstClockTime period_end)
+{
+  GstMediaSegment *last;
+
+  if (repeat < 0 || stream->segments->len == 0)
+    return FALSE;
+
+  last = g_ptr_array_index (stream->segments, stream->segments->len - 1);
+  if (last->SegmentURL != NULL || last->repeat < 0
+      || last->repeat > G_MAXINT - repeat - 1
+      || last->scale_duration != scale_duration || last->duration != duration
+      || last->scale_start + last->scale_duration * (last->repeat + 1) !=
+      scale_start || last->start + last->duration * (last->repeat + 1) != start)
+    return FALSE;
+
+  /* segments crossing the end of the Period are clipped one run at a time */
+  if (GST_CLOCK_TIME_IS_VALID (period_end)
+      && start + duration * (repeat + 1) > period_end)
+    return FALSE;
+
+  last->repeat += repeat + 1;
+  GST_LOG ("Extended segment %d to repeat %d", last->number, last->repeat);
+
+  return TRUE;
+}
+
 static void
 gst_mpd_client_stream_update_presentation_time_offset (GstMPDClient * client,
     GstActiveStream * stream)
@@ -1044,8 +1249,10 @@ gst_mpd_client_setup_representation (GstMPDClient * client,
                 + PeriodStart - presentationTimeOffset;
           }
 
-          if (!gst_mpd_client_add_media_segment (stream, NULL, i, S->r, start,
-                  S->d, start_time, duration)) {
+          if (!gst_mpd_client_extend_media_segment (stream, S->r, start,
+                  S->d, start_time, duration, PeriodEnd)
+              && !gst_mpd_client_add_media_segment (stream, NULL, i, S->r,
+                  start, S->d, start_time, duration)) {
             return FALSE;
           }
           i += S->r + 1;
@@ -1670,67 +1877,54 @@ gst_mpd_client_stream_seek (GstMPDClient * client, GstActiveStream * stream,
   g_return_val_if_fail (stream != NULL, 0);
 
   if (stream->segments) {
-    for (index = 0; index < stream->segments->len; index++) {
-      gboolean in_segment = FALSE;
-      GstMediaSegment *segment = g_ptr_array_index (stream->segments, index);
-      GstClockTime end_time;
+    index =
+        gst_mpd_client_find_segment_run (client, stream->segments, ts,
+        forward);
+    GST_DEBUG ("Found fragment sequence chunk %d / %d", index,
+        stream->segments->len);
 
-      GST_DEBUG ("Looking at fragment sequence chunk %d / %d", index,
-          stream->segments->len);
-
-      end_time =
-          gst_mpd_client_get_segment_end_time (client, stream->segments,
-          segment, index);
-
-      /* avoid downloading another fragment just for 1ns in reverse mode */
-      if (forward)
-        in_segment = ts < end_time;
-      else
-        in_segment = ts <= end_time;
-
-      if (in_segment) {
-        GstClockTime chunk_time;
+    if (index < stream->segments->len) {
+      GstMediaSegment *segment = g_ptr_array_index (stream->segments, index);
+      GstClockTime chunk_time;
 
-        selectedChunk = segment;
-        repeat_index = (ts - segment->start) / segment->duration;
+      selectedChunk = segment;
+      repeat_index = (ts - segment->start) / segment->duration;
 
-        chunk_time = segment->start + segment->duration * repeat_index;
+      chunk_time = segment->start + segment->duration * repeat_index;
 
-        /* At the end of a segment in reverse mode, start from the previous fragment */
-        if (!forward && repeat_index > 0
-            && ((ts - segment->start) % segment->duration == 0))
-          repeat_index--;
+      /* At the end of a segment in reverse mode, start from the previous fragment */
+      if (!forward && repeat_index > 0
+          && ((ts - segment->start) % segment->duration == 0))
+        repeat_index--;
 
-        if ((flags & GST_SEEK_FLAG_SNAP_NEAREST) == GST_SEEK_FLAG_SNAP_NEAREST) {
-          if (repeat_index + 1 < segment->repeat) {
-            if (ts - chunk_time > chunk_time + segment->duration - ts)
-              repeat_index++;
-          } else if (index + 1 < stream->segments->len) {
-            GstMediaSegment *next_segment =
-                g_ptr_array_index (stream->segments, index + 1);
+      if ((flags & GST_SEEK_FLAG_SNAP_NEAREST) == GST_SEEK_FLAG_SNAP_NEAREST) {
+        if (repeat_index < segment->repeat) {
+          if (ts - chunk_time > chunk_time + segment->duration - ts)
+            repeat_index++;
+        } else if (index + 1 < stream->segments->len) {
+          GstMediaSegment *next_segment =
+              g_ptr_array_index (stream->segments, index + 1);
 
-            if (ts - chunk_time > next_segment->start - ts) {
-              repeat_index = 0;
-              selectedChunk = next_segment;
-              index++;
-            }
+          if (ts - chunk_time > next_segment->start - ts) {
+            repeat_index = 0;
+            selectedChunk = next_segment;
+            index++;
           }
-        } else if (((forward && flags & GST_SEEK_FLAG_SNAP_AFTER) ||
-                (!forward && flags & GST_SEEK_FLAG_SNAP_BEFORE)) &&
-            ts != chunk_time) {
-
-          if (repeat_index + 1 < segment->repeat) {
-            repeat_index++;
+        }
+      } else if (((forward && flags & GST_SEEK_FLAG_SNAP_AFTER) ||
+              (!forward && flags & GST_SEEK_FLAG_SNAP_BEFORE)) &&
+          ts != chunk_time) {
+
+        if (repeat_index < segment->repeat) {
+          repeat_index++;
+        } else {
+          repeat_index = 0;
+          if (index + 1 >= stream->segments->len) {
+            selectedChunk = NULL;
           } else {
-            repeat_index = 0;
-            if (index + 1 >= stream->segments->len) {
-              selectedChunk = NULL;
-            } else {
-              selectedChunk = g_ptr_array_index (stream->segments, ++index);
-            }
+            selectedChunk = g_ptr_array_index (stream->segments, ++index);
           }
         }
-        break;
       }
     }
 
@@ -2136,6 +2330,37 @@ gst_mpd_client_get_next_fragment (GstMPDClient * client,
   return TRUE;
 }
 
+/* Gets the fragment @n segments after the current one, leaving the
+ * stream position untouched */
+gboolean
+gst_mpd_client_peek_fragment (GstMPDClient * client, guint indexStream,
+    guint n, GstMediaFragmentInfo * fragment)
+{
+  GstActiveStream *stream;
+  gint segment_index;
+  guint segment_repeat_index;
+  gboolean ret = TRUE;
+
+  g_return_val_if_fail (client != NULL, FALSE);
+  g_return_val_if_fail (client->active_streams != NULL, FALSE);
+  stream = g_list_nth_data (client->active_streams, indexStream);
+  g_return_val_if_fail (stream != NULL, FALSE);
+
+  segment_index = stream->segment_index;
+  segment_repeat_index = stream->segment_repeat_index;
+
+  while (ret && n-- > 0)
+    ret = gst_mpd_client_advance_segment (client, stream, TRUE) == GST_FLOW_OK;
+
+  if (ret)
+    ret = gst_mpd_client_get_next_fragment (client, indexStream, fragment);
+
+  stream->segment_index = segment_index;
+  stream->segment_repeat_index = segment_repeat_index;
+
+  return ret;
+}
+
 gboolean
 gst_mpd_client_has_next_segment (GstMPDClient * client,
     GstActiveStream * stream, gboolean forward)
@@ -2913,6 +3138,7 @@ gst_mpd_client_get_next_segment_availability_start_time (GstMPDClient * client,
   gint seg_idx;
   GstMediaSegment *segment;
   GstClockTime segmentEndTime;
+  GstClockTime availability_time_offset;
   const GstStreamPeriod *stream_period;
   GstClockTime period_start = 0;
 
@@ -2948,6 +3174,15 @@ gst_mpd_client_get_next_segment_availability_start_time (GstMPDClient * client,
     segmentEndTime = period_start + (1 + seg_idx) * seg_duration;
   }
 
+  /* Low latency streams make segments available before they are complete,
+   * they then get delivered as they are produced */
+  availability_time_offset =
+      gst_mpd_client_get_availability_time_offset (client, stream);
+  if (GST_CLOCK_TIME_IS_VALID (availability_time_offset))
+    segmentEndTime -= MIN (segmentEndTime, availability_time_offset);
+  else
+    segmentEndTime = 0;
+
   availability_start_time = gst_mpd_client_get_availability_start_time (client);
   if (availability_start_time == NULL) {
     GST_WARNING_OBJECT (client, "Failed to get availability_start_time");
@@ -26,6 +26,8 @@
 
 #include <string.h>
 
+#include <libxml/xmlreader.h>
+
 #include "gstmpdparser.h"
 #include "gstdash_debug.h"
 
@@ -47,34 +49,41 @@ static void gst_mpdparser_parse_url_type_node (GstMPDURLTypeNode ** pointer,
     xmlNode * a_node);
 static void gst_mpdparser_parse_seg_base_type_ext (GstMPDSegmentBaseNode **
     pointer, xmlNode * a_node, GstMPDSegmentBaseNode * parent);
-static void gst_mpdparser_parse_s_node (GQueue * queue, xmlNode * a_node);
+static void gst_mpdparser_parse_s_node (GQueue * queue, xmlNode * a_node,
+    GHashTable * s_nodes);
 static void gst_mpdparser_parse_segment_timeline_node (GstMPDSegmentTimelineNode
-    ** pointer, xmlNode * a_node);
+    ** pointer, xmlNode * a_node, GHashTable * s_nodes);
 static gboolean
 gst_mpdparser_parse_mult_seg_base_node (GstMPDMultSegmentBaseNode *
-    pointer, xmlNode * a_node, GstMPDMultSegmentBaseNode * parent);
+    pointer, xmlNode * a_node, GstMPDMultSegmentBaseNode * parent,
+    GHashTable * s_nodes);
 static gboolean gst_mpdparser_parse_segment_list_node (GstMPDSegmentListNode **
-    pointer, xmlNode * a_node, GstMPDSegmentListNode * parent);
+    pointer, xmlNode * a_node, GstMPDSegmentListNode * parent,
+    GHashTable * s_nodes);
 static void
 gst_mpdparser_parse_representation_base (GstMPDRepresentationBaseNode *
     pointer, xmlNode * a_node);
 static gboolean gst_mpdparser_parse_representation_node (GList ** list,
     xmlNode * a_node, GstMPDAdaptationSetNode * parent,
-    GstMPDPeriodNode * period_node);
+    GstMPDPeriodNode * period_node, GHashTable * s_nodes);
 static gboolean gst_mpdparser_parse_adaptation_set_node (GList ** list,
-    xmlNode * a_node, GstMPDPeriodNode * parent);
+    xmlNode * a_node, GstMPDPeriodNode * parent, GHashTable * s_nodes);
 static void gst_mpdparser_parse_subset_node (GList ** list, xmlNode * a_node);
 static gboolean
 gst_mpdparser_parse_segment_template_node (GstMPDSegmentTemplateNode ** pointer,
-    xmlNode * a_node, GstMPDSegmentTemplateNode * parent);
+    xmlNode * a_node, GstMPDSegmentTemplateNode * parent,
+    GHashTable * s_nodes);
 static gboolean gst_mpdparser_parse_period_node (GList ** list,
-    xmlNode * a_node);
+    xmlNode * a_node, GList ** previous);
 static void gst_mpdparser_parse_program_info_node (GList ** list,
     xmlNode * a_node);
 static void gst_mpdparser_parse_metrics_range_node (GList ** list,
     xmlNode * a_node);
 static void gst_mpdparser_parse_metrics_node (GList ** list, xmlNode * a_node);
-static gboolean gst_mpdparser_parse_root_node (GstMPDRootNode ** pointer,
+static GstMPDRootNode *gst_mpdparser_parse_root_attributes (xmlNode * a_node);
+static gboolean gst_mpdparser_parse_root_child (GstMPDRootNode * mpd_root,
+    xmlNode * a_node, GList ** previous_periods);
+static void gst_mpdparser_parse_service_description_node (GList ** list,
     xmlNode * a_node);
 static void gst_mpdparser_parse_utctiming_node (GList ** list,
     xmlNode * a_node);
@@ -116,6 +125,10 @@ gst_mpdparser_parse_baseURL_node (GList ** list, xmlNode * a_node)
       &new_base_url->serviceLocation);
   gst_xml_helper_get_prop_string (a_node, "byteRange",
       &new_base_url->byteRange);
+  gst_xml_helper_get_prop_double (a_node, "availabilityTimeOffset",
+      &new_base_url->availabilityTimeOffset);
+  gst_xml_helper_get_prop_boolean (a_node, "availabilityTimeComplete", TRUE,
+      &new_base_url->availabilityTimeComplete);
 }
 
 static void
@@ -253,6 +266,7 @@ gst_mpdparser_parse_seg_base_type_ext (GstMPDSegmentBaseNode ** pointer,
   GstMPDSegmentBaseNode *seg_base_type;
   guint intval;
   guint64 int64val;
+  gdouble doubleval;
   gboolean boolval;
   GstXMLRange *rangeval;
 
@@ -269,6 +283,8 @@ gst_mpdparser_parse_seg_base_type_ext (GstMPDSegmentBaseNode ** pointer,
     seg_base_type->presentationTimeOffset = parent->presentationTimeOffset;
     seg_base_type->indexRange = gst_xml_helper_clone_range (parent->indexRange);
     seg_base_type->indexRangeExact = parent->indexRangeExact;
+    seg_base_type->availabilityTimeOffset = parent->availabilityTimeOffset;
+    seg_base_type->availabilityTimeComplete = parent->availabilityTimeComplete;
     seg_base_type->Initialization =
         gst_mpd_url_type_node_clone (parent->Initialization);
     seg_base_type->RepresentationIndex =
@@ -296,6 +312,14 @@ gst_mpdparser_parse_seg_base_type_ext (GstMPDSegmentBaseNode ** pointer,
           FALSE, &boolval)) {
     seg_base_type->indexRangeExact = boolval;
   }
+  if (gst_xml_helper_get_prop_double (a_node, "availabilityTimeOffset",
+          &doubleval)) {
+    seg_base_type->availabilityTimeOffset = doubleval;
+  }
+  if (gst_xml_helper_get_prop_boolean (a_node, "availabilityTimeComplete",
+          TRUE, &boolval)) {
+    seg_base_type->availabilityTimeComplete = boolval;
+  }
 
   /* explore children nodes */
   for (cur_node = a_node->children; cur_node; cur_node = cur_node->next) {
@@ -317,25 +341,157 @@ gst_mpdparser_parse_seg_base_type_ext (GstMPDSegmentBaseNode ** pointer,
 
 
 
+/* S nodes are never modified after parsing, so S elements with the same
+ * attributes can share one node. This is what makes a refreshed
+ * SegmentTimeline cheap: only the entries that were appended since the
+ * previous MPD are allocated. */
+static guint
+gst_mpdparser_s_node_hash (gconstpointer key)
+{
+  const GstMPDSNode *s_node = key;
+  guint64 hash;
+
+  hash = s_node->t * G_GUINT64_CONSTANT (0x100000001b3) ^ s_node->d;
+  hash = hash * G_GUINT64_CONSTANT (0x100000001b3) ^ (guint) s_node->r;
+
+  return (guint) (hash ^ (hash >> 32));
+}
+
+static gboolean
+gst_mpdparser_s_node_equal (gconstpointer a, gconstpointer b)
+{
+  const GstMPDSNode *s_a = a, *s_b = b;
+
+  return s_a->t == s_b->t && s_a->d == s_b->d && s_a->r == s_b->r;
+}
+
 static void
-gst_mpdparser_parse_s_node (GQueue * queue, xmlNode * a_node)
+gst_mpdparser_add_s_nodes (GHashTable * s_nodes,
+    GstMPDMultSegmentBaseNode * mult_seg_base_node)
 {
-  GstMPDSNode *new_s_node;
+  GList *list;
 
-  new_s_node = gst_mpd_s_node_new ();
-  g_queue_push_tail (queue, new_s_node);
+  if (mult_seg_base_node == NULL || mult_seg_base_node->SegmentTimeline == NULL)
+    return;
+
+  for (list = g_queue_peek_head_link (&mult_seg_base_node->SegmentTimeline->S);
+      list; list = g_list_next (list))
+    g_hash_table_add (s_nodes, list->data);
+}
+
+/* Makes the S nodes of @period available to the parsing of its next
+ * version */
+static void
+gst_mpdparser_add_period_s_nodes (GHashTable * s_nodes,
+    GstMPDPeriodNode * period)
+{
+  GList *adapt_sets, *reps;
+
+  gst_mpdparser_add_s_nodes (s_nodes,
+      (GstMPDMultSegmentBaseNode *) period->SegmentTemplate);
+  gst_mpdparser_add_s_nodes (s_nodes,
+      (GstMPDMultSegmentBaseNode *) period->SegmentList);
+
+  for (adapt_sets = period->AdaptationSets; adapt_sets;
+      adapt_sets = g_list_next (adapt_sets)) {
+    GstMPDAdaptationSetNode *adapt_set = adapt_sets->data;
+
+    gst_mpdparser_add_s_nodes (s_nodes,
+        (GstMPDMultSegmentBaseNode *) adapt_set->SegmentTemplate);
+    gst_mpdparser_add_s_nodes (s_nodes,
+        (GstMPDMultSegmentBaseNode *) adapt_set->SegmentList);
+
+    for (reps = adapt_set->Representations; reps; reps = g_list_next (reps)) {
+      GstMPDRepresentationNode *rep = reps->data;
+
+      gst_mpdparser_add_s_nodes (s_nodes,
+          (GstMPDMultSegmentBaseNode *) rep->SegmentTemplate);
+      gst_mpdparser_add_s_nodes (s_nodes,
+          (GstMPDMultSegmentBaseNode *) rep->SegmentList);
+    }
+  }
+}
+
+/* @s_nodes, if not NULL, holds the S nodes that can be shared */
+static void
+gst_mpdparser_parse_s_node (GQueue * queue, xmlNode * a_node,
+    GHashTable * s_nodes)
+{
+  GstMPDSNode *new_s_node = NULL;
+  xmlAttr *attr;
+  guint64 t = 0, d = 0;
+  gint r = 0;
 
   GST_LOG ("attributes of S node:");
-  gst_xml_helper_get_prop_unsigned_integer_64 (a_node, "t", 0, &new_s_node->t);
-  gst_xml_helper_get_prop_unsigned_integer_64 (a_node, "d", 0, &new_s_node->d);
-  gst_xml_helper_get_prop_signed_integer (a_node, "r", 0, &new_s_node->r);
+
+  /* A live SegmentTimeline can hold thousands of S elements, read their plain
+   * text attributes in place instead of copying each one with xmlGetProp() */
+  for (attr = a_node->properties; attr; attr = attr->next) {
+    const gchar *value;
+
+    if (attr->children == NULL || attr->children->type != XML_TEXT_NODE
+        || attr->children->next != NULL)
+      goto slow_path;
+    value = (const gchar *) attr->children->content;
+
+    if (xmlStrcmp (attr->name, (xmlChar *) "t") == 0) {
+      if (!g_ascii_string_to_unsigned (value, 10, 0, G_MAXUINT64, &t, NULL))
+        GST_WARNING ("failed to parse S@t from xml string %s", value);
+    } else if (xmlStrcmp (attr->name, (xmlChar *) "d") == 0) {
+      if (!g_ascii_string_to_unsigned (value, 10, 0, G_MAXUINT64, &d, NULL))
+        GST_WARNING ("failed to parse S@d from xml string %s", value);
+    } else if (xmlStrcmp (attr->name, (xmlChar *) "r") == 0) {
+      gchar *end;
+      gint64 r64;
+
+      r64 = g_ascii_strtoll (value, &end, 10);
+      if (end != value && r64 >= G_MININT && r64 <= G_MAXINT)
+        r = r64;
+      else
+        GST_WARNING ("failed to parse S@r from xml string %s", value);
+    }
+  }
+  goto done;
+
+slow_path:
+  /* entity references in a value */
+  gst_xml_helper_get_prop_unsigned_integer_64 (a_node, "t", 0, &t);
+  gst_xml_helper_get_prop_unsigned_integer_64 (a_node, "d", 0, &d);
+  gst_xml_helper_get_prop_signed_integer (a_node, "r", 0, &r);
+
+done:
+  GST_LOG (" - t: %" G_GUINT64_FORMAT " d: %" G_GUINT64_FORMAT " r: %d",
+      t, d, r);
+
+  if (s_nodes) {
+    /* only the t, d and r fields of the key are read */
+    GstMPDSNode key;
+
+    key.t = t;
+    key.d = d;
+    key.r = r;
+    new_s_node = g_hash_table_lookup (s_nodes, &key);
+  }
+
+  if (new_s_node) {
+    gst_object_ref (new_s_node);
+  } else {
+    new_s_node = gst_mpd_s_node_new ();
+    new_s_node->t = t;
+    new_s_node->d = d;
+    new_s_node->r = r;
+    if (s_nodes)
+      g_hash_table_add (s_nodes, new_s_node);
+  }
+
+  g_queue_push_tail (queue, new_s_node);
 }
 
 
 
 static void
 gst_mpdparser_parse_segment_timeline_node (GstMPDSegmentTimelineNode ** pointer,
-    xmlNode * a_node)
+    xmlNode * a_node, GHashTable * s_nodes)
 {
   xmlNode *cur_node;
   GstMPDSegmentTimelineNode *new_seg_timeline;
@@ -351,7 +507,7 @@ gst_mpdparser_parse_segment_timeline_node (GstMPDSegmentTimelineNode ** pointer,
   for (cur_node = a_node->children; cur_node; cur_node = cur_node->next) {
     if (cur_node->type == XML_ELEMENT_NODE) {
       if (xmlStrcmp (cur_node->name, (xmlChar *) "S") == 0) {
-        gst_mpdparser_parse_s_node (&new_seg_timeline->S, cur_node);
+        gst_mpdparser_parse_s_node (&new_seg_timeline->S, cur_node, s_nodes);
       }
     }
   }
@@ -359,7 +515,8 @@ gst_mpdparser_parse_segment_timeline_node (GstMPDSegmentTimelineNode ** pointer,
 
 static gboolean
 gst_mpdparser_parse_mult_seg_base_node (GstMPDMultSegmentBaseNode *
-    mult_seg_base_node, xmlNode * a_node, GstMPDMultSegmentBaseNode * parent)
+    mult_seg_base_node, xmlNode * a_node, GstMPDMultSegmentBaseNode * parent,
+    GHashTable * s_nodes)
 {
   xmlNode *cur_node;
 
@@ -402,7 +559,7 @@ gst_mpdparser_parse_mult_seg_base_node (GstMPDMultSegmentBaseNode *
       if (xmlStrcmp (cur_node->name, (xmlChar *) "SegmentTimeline") == 0) {
         /* parse frees the segmenttimeline if any */
         gst_mpdparser_parse_segment_timeline_node
-            (&mult_seg_base_node->SegmentTimeline, cur_node);
+            (&mult_seg_base_node->SegmentTimeline, cur_node, s_nodes);
       } else if (xmlStrcmp (cur_node->name,
               (xmlChar *) "BitstreamSwitching") == 0) {
         /* parse frees the old url before setting the new one */
@@ -425,7 +582,7 @@ gst_mpdparser_parse_mult_seg_base_node (GstMPDMultSegmentBaseNode *
 
 static gboolean
 gst_mpdparser_parse_segment_list_node (GstMPDSegmentListNode ** pointer,
-    xmlNode * a_node, GstMPDSegmentListNode * parent)
+    xmlNode * a_node, GstMPDSegmentListNode * parent, GHashTable * s_nodes)
 {
   xmlNode *cur_node;
   GstMPDSegmentListNode *new_segment_list;
@@ -462,7 +619,7 @@ gst_mpdparser_parse_segment_list_node (GstMPDSegmentListNode ** pointer,
   GST_LOG ("extension of SegmentList node:");
   if (!gst_mpdparser_parse_mult_seg_base_node
       (GST_MPD_MULT_SEGMENT_BASE_NODE (new_segment_list), a_node,
-          (parent ? GST_MPD_MULT_SEGMENT_BASE_NODE (parent) : NULL)))
+          (parent ? GST_MPD_MULT_SEGMENT_BASE_NODE (parent) : NULL), s_nodes))
     goto error;
 
   /* explore children nodes */
@@ -594,7 +751,8 @@ gst_mpdparser_parse_representation_base (GstMPDRepresentationBaseNode *
 
 static gboolean
 gst_mpdparser_parse_representation_node (GList ** list, xmlNode * a_node,
-    GstMPDAdaptationSetNode * parent, GstMPDPeriodNode * period_node)
+    GstMPDAdaptationSetNode * parent, GstMPDPeriodNode * period_node,
+    GHashTable * s_nodes)
 {
   xmlNode *cur_node;
   GstMPDRepresentationNode *new_representation;
@@ -633,13 +791,14 @@ gst_mpdparser_parse_representation_node (GList ** list, xmlNode * a_node,
         if (!gst_mpdparser_parse_segment_template_node
             (&new_representation->SegmentTemplate, cur_node,
                 parent->SegmentTemplate ?
-                parent->SegmentTemplate : period_node->SegmentTemplate))
+                parent->SegmentTemplate : period_node->SegmentTemplate,
+                s_nodes))
           goto error;
       } else if (xmlStrcmp (cur_node->name, (xmlChar *) "SegmentList") == 0) {
         if (!gst_mpdparser_parse_segment_list_node
             (&new_representation->SegmentList, cur_node,
                 parent->SegmentList ? parent->SegmentList : period_node->
-                SegmentList))
+                SegmentList, s_nodes))
           goto error;
       } else if (xmlStrcmp (cur_node->name, (xmlChar *) "BaseURL") == 0) {
         gst_mpdparser_parse_baseURL_node (&new_representation->BaseURLs,
@@ -664,7 +823,7 @@ error:
 
 static gboolean
 gst_mpdparser_parse_adaptation_set_node (GList ** list, xmlNode * a_node,
-    GstMPDPeriodNode * parent)
+    GstMPDPeriodNode * parent, GHashTable * s_nodes)
 {
   xmlNode *cur_node;
   GstMPDAdaptationSetNode *new_adap_set;
@@ -745,7 +904,7 @@ gst_mpdparser_parse_adaptation_set_node (GList ** list, xmlNode * a_node,
             cur_node, parent->SegmentBase);
       } else if (xmlStrcmp (cur_node->name, (xmlChar *) "SegmentList") == 0) {
         if (!gst_mpdparser_parse_segment_list_node (&new_adap_set->SegmentList,
-                cur_node, parent->SegmentList))
+                cur_node, parent->SegmentList, s_nodes))
           goto error;
       } else if (xmlStrcmp (cur_node->name,
               (xmlChar *) "ContentComponent") == 0) {
@@ -753,7 +912,8 @@ gst_mpdparser_parse_adaptation_set_node (GList ** list, xmlNode * a_node,
             (&new_adap_set->ContentComponents, cur_node);
       } else if (xmlStrcmp (cur_node->name, (xmlChar *) "SegmentTemplate") == 0) {
         if (!gst_mpdparser_parse_segment_template_node
-            (&new_adap_set->SegmentTemplate, cur_node, parent->SegmentTemplate))
+            (&new_adap_set->SegmentTemplate, cur_node, parent->SegmentTemplate,
+                s_nodes))
           goto error;
       }
     }
@@ -767,7 +927,8 @@ gst_mpdparser_parse_adaptation_set_node (GList ** list, xmlNode * a_node,
     if (cur_node->type == XML_ELEMENT_NODE) {
       if (xmlStrcmp (cur_node->name, (xmlChar *) "Representation") == 0) {
         if (!gst_mpdparser_parse_representation_node
-            (&new_adap_set->Representations, cur_node, new_adap_set, parent))
+            (&new_adap_set->Representations, cur_node, new_adap_set, parent,
+                s_nodes))
           goto error;
       }
     }
@@ -796,7 +957,7 @@ gst_mpdparser_parse_subset_node (GList ** list, xmlNode * a_node)
 
 static gboolean
 gst_mpdparser_parse_segment_template_node (GstMPDSegmentTemplateNode ** pointer,
-    xmlNode * a_node, GstMPDSegmentTemplateNode * parent)
+    xmlNode * a_node, GstMPDSegmentTemplateNode * parent, GHashTable * s_nodes)
 {
   GstMPDSegmentTemplateNode *new_segment_template;
   gchar *strval;
@@ -807,7 +968,8 @@ gst_mpdparser_parse_segment_template_node (GstMPDSegmentTemplateNode ** pointer,
   GST_LOG ("extension of SegmentTemplate node:");
   if (!gst_mpdparser_parse_mult_seg_base_node
       (GST_MPD_MULT_SEGMENT_BASE_NODE (new_segment_template), a_node,
-          (parent ? GST_MPD_MULT_SEGMENT_BASE_NODE (parent) : NULL)))
+          (parent ? GST_MPD_MULT_SEGMENT_BASE_NODE (parent) : NULL),
+          s_nodes))
     goto error;
 
   /* Inherit attribute values from parent when the value isn't found */
@@ -846,14 +1008,134 @@ error:
   return FALSE;
 }
 
+static guint64
+gst_mpdparser_hash_string (guint64 hash, const xmlChar * str)
+{
+  if (str) {
+    for (; *str; str++) {
+      hash ^= *str;
+      hash *= G_GUINT64_CONSTANT (0x100000001b3);
+    }
+  }
+  /* terminate every string so that "ab" "c" and "a" "bc" differ */
+  hash ^= 0xff;
+  hash *= G_GUINT64_CONSTANT (0x100000001b3);
+
+  return hash;
+}
+
+/* FNV-1a over the names, attributes and text of a subtree. It does not
+ * allocate, so comparing it is much cheaper than converting the subtree.
+ * @xlink is set if the subtree references remote elements. */
+static guint64
+gst_mpdparser_hash_node (guint64 hash, xmlNode * a_node, gboolean * xlink)
+{
+  xmlNode *cur_node;
+  xmlAttr *attr;
+
+  hash = gst_mpdparser_hash_string (hash, a_node->name);
+  if (a_node->ns)
+    hash = gst_mpdparser_hash_string (hash, a_node->ns->href);
+
+  for (attr = a_node->properties; attr; attr = attr->next) {
+    hash = gst_mpdparser_hash_string (hash, attr->name);
+    if (attr->ns) {
+      hash = gst_mpdparser_hash_string (hash, attr->ns->href);
+      if (xmlStrcmp (attr->ns->href,
+              (xmlChar *) "http://www.w3.org/1999/xlink") == 0)
+        *xlink = TRUE;
+    }
+    for (cur_node = attr->children; cur_node; cur_node = cur_node->next)
+      hash = gst_mpdparser_hash_string (hash, cur_node->content);
+  }
+
+  for (cur_node = a_node->children; cur_node; cur_node = cur_node->next) {
+    if (cur_node->type == XML_ELEMENT_NODE)
+      hash = gst_mpdparser_hash_node (hash, cur_node, xlink);
+    else if (cur_node->type == XML_TEXT_NODE
+        || cur_node->type == XML_CDATA_SECTION_NODE)
+      hash = gst_mpdparser_hash_string (hash, cur_node->content);
+  }
+
+  return hash;
+}
+
+/* Looks for a Period of the previous MPD that was parsed from exactly the
+ * same XML. @previous is advanced past it, so Periods are matched in order
+ * and never twice. */
+static GstMPDPeriodNode *
+gst_mpdparser_find_unchanged_period (GList ** previous, guint64 hash)
+{
+  GList *l;
+
+  for (l = *previous; l; l = l->next) {
+    GstMPDPeriodNode *period = l->data;
+
+    if (period->xml_hash == hash) {
+      *previous = l->next;
+      return period;
+    }
+  }
+
+  return NULL;
+}
+
+/* Looks for the previous version of a Period that changed, usually because
+ * its SegmentTimeline grew: the next Period with the same id, or the next one
+ * if neither has an id. @previous is advanced past it. */
+static GstMPDPeriodNode *
+gst_mpdparser_find_changed_period (GList ** previous, const gchar * id)
+{
+  GList *l;
+
+  for (l = *previous; l; l = l->next) {
+    GstMPDPeriodNode *period = l->data;
+
+    if (g_strcmp0 (period->id, id) == 0) {
+      *previous = l->next;
+      return period;
+    }
+    if (id == NULL)
+      break;
+  }
+
+  return NULL;
+}
+
 static gboolean
-gst_mpdparser_parse_period_node (GList ** list, xmlNode * a_node)
+gst_mpdparser_parse_period_node (GList ** list, xmlNode * a_node,
+    GList ** previous)
 {
   xmlNode *cur_node;
   GstMPDPeriodNode *new_period;
+  GstMPDPeriodNode *previous_period = NULL;
+  GHashTable *s_nodes;
   gchar *actuate;
+  gboolean xlink = FALSE;
+  guint64 hash;
+
+  hash = gst_mpdparser_hash_node (G_GUINT64_CONSTANT (0xcbf29ce484222325),
+      a_node, &xlink);
+  /* Resolving remote elements modifies the Period after parsing, so those
+   * are never shared with the next version of the MPD. 0 also marks Periods
+   * that were not parsed from the MPD itself. */
+  if (xlink)
+    hash = 0;
+  else if (hash == 0)
+    hash = 1;
+
+  if (previous && hash != 0) {
+    new_period = gst_mpdparser_find_unchanged_period (previous, hash);
+    if (new_period) {
+      GST_LOG ("Period %s did not change, reusing it",
+          GST_STR_NULL (new_period->id));
+      *list = g_list_append (*list, gst_object_ref (new_period));
+      return TRUE;
+    }
+  }
 
   new_period = gst_mpd_period_node_new ();
+  new_period->xml_hash = hash;
 
   GST_LOG ("attributes of Period node:");
 
@@ -868,6 +1150,20 @@ gst_mpdparser_parse_period_node (GList ** list, xmlNode * a_node)
   }
 
   gst_xml_helper_get_prop_string (a_node, "id", &new_period->id);
+
+  /* The S nodes of the previous version of the Period are shared, so only
+   * the S elements that are new are allocated */
+  s_nodes = g_hash_table_new (gst_mpdparser_s_node_hash,
+      gst_mpdparser_s_node_equal);
+  if (previous)
+    previous_period = gst_mpdparser_find_changed_period (previous,
+        new_period->id);
+  if (previous_period) {
+    GST_LOG ("Period %s changed, sharing its previous S nodes",
+        GST_STR_NULL (new_period->id));
+    gst_mpdparser_add_period_s_nodes (s_nodes, previous_period);
+  }
+
   gst_xml_helper_get_prop_duration (a_node, "start", GST_MPD_DURATION_NONE,
       &new_period->start);
   gst_xml_helper_get_prop_duration (a_node, "duration",
@@ -883,11 +1179,11 @@ gst_mpdparser_parse_period_node (GList ** list, xmlNode * a_node)
             cur_node, NULL);
       } else if (xmlStrcmp (cur_node->name, (xmlChar *) "SegmentList") == 0) {
         if (!gst_mpdparser_parse_segment_list_node (&new_period->SegmentList,
-                cur_node, NULL))
+                cur_node, NULL, s_nodes))
           goto error;
       } else if (xmlStrcmp (cur_node->name, (xmlChar *) "SegmentTemplate") == 0) {
         if (!gst_mpdparser_parse_segment_template_node
-            (&new_period->SegmentTemplate, cur_node, NULL))
+            (&new_period->SegmentTemplate, cur_node, NULL, s_nodes))
           goto error;
       } else if (xmlStrcmp (cur_node->name, (xmlChar *) "Subset") == 0) {
         gst_mpdparser_parse_subset_node (&new_period->Subsets, cur_node);
@@ -905,16 +1201,18 @@ gst_mpdparser_parse_period_node (GList ** list, xmlNode * a_node)
     if (cur_node->type == XML_ELEMENT_NODE) {
       if (xmlStrcmp (cur_node->name, (xmlChar *) "AdaptationSet") == 0) {
         if (!gst_mpdparser_parse_adaptation_set_node
-            (&new_period->AdaptationSets, cur_node, new_period))
+            (&new_period->AdaptationSets, cur_node, new_period, s_nodes))
           goto error;
       }
     }
   }
 
+  g_hash_table_destroy (s_nodes);
   *list = g_list_append (*list, new_period);
   return TRUE;
 
 error:
+  g_hash_table_destroy (s_nodes);
   gst_mpd_period_node_free (new_period);
   return FALSE;
 }
@@ -1031,14 +1329,52 @@ gst_mpdparser_parse_utctiming_node (GList ** list, xmlNode * a_node)
   }
 }
 
-static gboolean
-gst_mpdparser_parse_root_node (GstMPDRootNode ** pointer, xmlNode * a_node)
+/* The ServiceDescription element is defined in ISO/IEC 23009-1:2019 Annex K,
+ * low latency players use its Latency and PlaybackRate children */
+static void
+gst_mpdparser_parse_service_description_node (GList ** list, xmlNode * a_node)
 {
+  GstMPDServiceDescriptionNode *new_description;
   xmlNode *cur_node;
+  guint64 int64val;
+
+  new_description = gst_mpd_service_description_node_new ();
+  *list = g_list_append (*list, new_description);
+
+  GST_LOG ("attributes of ServiceDescription node:");
+  gst_xml_helper_get_prop_unsigned_integer (a_node, "id", 0,
+      &new_description->id);
+
+  for (cur_node = a_node->children; cur_node; cur_node = cur_node->next) {
+    if (cur_node->type != XML_ELEMENT_NODE)
+      continue;
+
+    if (xmlStrcmp (cur_node->name, (xmlChar *) "Latency") == 0) {
+      GST_LOG ("attributes of Latency node:");
+      if (gst_xml_helper_get_prop_unsigned_integer_64 (cur_node, "target", 0,
+              &int64val))
+        new_description->latencyTarget = int64val;
+      if (gst_xml_helper_get_prop_unsigned_integer_64 (cur_node, "min", 0,
+              &int64val))
+        new_description->latencyMin = int64val;
+      if (gst_xml_helper_get_prop_unsigned_integer_64 (cur_node, "max", 0,
+              &int64val))
+        new_description->latencyMax = int64val;
+    } else if (xmlStrcmp (cur_node->name, (xmlChar *) "PlaybackRate") == 0) {
+      GST_LOG ("attributes of PlaybackRate node:");
+      gst_xml_helper_get_prop_double (cur_node, "min",
+          &new_description->playbackRateMin);
+      gst_xml_helper_get_prop_double (cur_node, "max",
+          &new_description->playbackRateMax);
+    }
+  }
+}
+
+static GstMPDRootNode *
+gst_mpdparser_parse_root_attributes (xmlNode * a_node)
+{
   GstMPDRootNode *new_mpd_root;
 
-  gst_mpd_root_node_free (*pointer);
-  *pointer = NULL;
   new_mpd_root = gst_mpd_root_node_new ();
 
   GST_LOG ("namespaces of root MPD node:");
@@ -1074,35 +1410,36 @@ gst_mpdparser_parse_root_node (GstMPDRootNode ** pointer, xmlNode * a_node)
   gst_xml_helper_get_prop_duration (a_node, "maxSubsegmentDuration",
       GST_MPD_DURATION_NONE, &new_mpd_root->maxSubsegmentDuration);
 
-  /* explore children Period nodes */
-  for (cur_node = a_node->children; cur_node; cur_node = cur_node->next) {
-    if (cur_node->type == XML_ELEMENT_NODE) {
-      if (xmlStrcmp (cur_node->name, (xmlChar *) "Period") == 0) {
-        if (!gst_mpdparser_parse_period_node (&new_mpd_root->Periods, cur_node))
-          goto error;
-      } else if (xmlStrcmp (cur_node->name,
-              (xmlChar *) "ProgramInformation") == 0) {
-        gst_mpdparser_parse_program_info_node (&new_mpd_root->ProgramInfos,
-            cur_node);
-      } else if (xmlStrcmp (cur_node->name, (xmlChar *) "BaseURL") == 0) {
-        gst_mpdparser_parse_baseURL_node (&new_mpd_root->BaseURLs, cur_node);
-      } else if (xmlStrcmp (cur_node->name, (xmlChar *) "Location") == 0) {
-        gst_mpdparser_parse_location_node (&new_mpd_root->Locations, cur_node);
-      } else if (xmlStrcmp (cur_node->name, (xmlChar *) "Metrics") == 0) {
-        gst_mpdparser_parse_metrics_node (&new_mpd_root->Metrics, cur_node);
-      } else if (xmlStrcmp (cur_node->name, (xmlChar *) "UTCTiming") == 0) {
-        gst_mpdparser_parse_utctiming_node (&new_mpd_root->UTCTimings,
-            cur_node);
-      }
-    }
+  return new_mpd_root;
+}
+
+static gboolean
+gst_mpdparser_parse_root_child (GstMPDRootNode * new_mpd_root,
+    xmlNode * cur_node, GList ** previous_periods)
+{
+  if (xmlStrcmp (cur_node->name, (xmlChar *) "Period") == 0) {
+    if (!gst_mpdparser_parse_period_node (&new_mpd_root->Periods, cur_node,
+            previous_periods))
+      return FALSE;
+  } else if (xmlStrcmp (cur_node->name,
+          (xmlChar *) "ProgramInformation") == 0) {
+    gst_mpdparser_parse_program_info_node (&new_mpd_root->ProgramInfos,
+        cur_node);
+  } else if (xmlStrcmp (cur_node->name, (xmlChar *) "BaseURL") == 0) {
+    gst_mpdparser_parse_baseURL_node (&new_mpd_root->BaseURLs, cur_node);
+  } else if (xmlStrcmp (cur_node->name, (xmlChar *) "Location") == 0) {
+    gst_mpdparser_parse_location_node (&new_mpd_root->Locations, cur_node);
+  } else if (xmlStrcmp (cur_node->name, (xmlChar *) "Metrics") == 0) {
+    gst_mpdparser_parse_metrics_node (&new_mpd_root->Metrics, cur_node);
+  } else if (xmlStrcmp (cur_node->name, (xmlChar *) "UTCTiming") == 0) {
+    gst_mpdparser_parse_utctiming_node (&new_mpd_root->UTCTimings, cur_node);
+  } else if (xmlStrcmp (cur_node->name,
+          (xmlChar *) "ServiceDescription") == 0) {
+    gst_mpdparser_parse_service_description_node
+        (&new_mpd_root->ServiceDescriptions, cur_node);
   }
 
-  *pointer = new_mpd_root;
   return TRUE;
-
-error:
-  gst_mpd_root_node_free (new_mpd_root);
-  return FALSE;
 }
 
 /* internal memory management functions */
@@ -1210,45 +1547,92 @@ gboolean
 gst_mpdparser_get_mpd_root_node (GstMPDRootNode ** mpd_root_node,
     const gchar * data, gint size)
 {
+  return gst_mpdparser_update_mpd_root_node (mpd_root_node, NULL, data, size);
+}
+
+gboolean
+gst_mpdparser_update_mpd_root_node (GstMPDRootNode ** mpd_root_node,
+    GstMPDRootNode * previous, const gchar * data, gint size)
+{
+  xmlTextReaderPtr reader;
+  GstMPDRootNode *new_mpd_root = NULL;
+  GList *previous_periods;
   gboolean ret = FALSE;
+  gint res;
 
-  if (data) {
-    xmlDocPtr doc;
-    xmlNode *root_element = NULL;
+  if (!data)
+    return FALSE;
 
-    GST_DEBUG ("MPD file fully buffered, start parsing...");
+  GST_DEBUG ("MPD file fully buffered, start parsing...");
 
-    /* parse the complete MPD file into a tree (using the libxml2 default parser API) */
+  /* this initialize the library and check potential ABI mismatches
+   * between the version it was compiled for and the actual shared
+   * library used
+   */
+  LIBXML_TEST_VERSION;
+
+  /* Pull the MPD through a streaming reader rather than building the tree of
+   * the whole document: only one child of the MPD element (usually a Period)
+   * is expanded into a tree at a time, and the reader frees it again as soon
+   * as it moves on to the next one */
+  reader = xmlReaderForMemory (data, size, "noname.xml", NULL, XML_PARSE_NONET);
+  if (reader == NULL) {
+    GST_ERROR ("failed to create a reader for the MPD file");
+    return FALSE;
+  }
 
-    /* this initialize the library and check potential ABI mismatches
-     * between the version it was compiled for and the actual shared
-     * library used
-     */
-    LIBXML_TEST_VERSION;
+  previous_periods = previous ? previous->Periods : NULL;
 
-    /* parse "data" into a document (which is a libxml2 tree structure xmlDoc) */
-    doc = xmlReadMemory (data, size, "noname.xml", NULL, XML_PARSE_NONET);
-    if (doc == NULL) {
-      GST_ERROR ("failed to parse the MPD file");
-      ret = FALSE;
-    } else {
-      /* get the root element node */
-      root_element = xmlDocGetRootElement (doc);
+  res = xmlTextReaderRead (reader);
+  while (res == 1) {
+    xmlNode *cur_node;
 
-      if (root_element->type != XML_ELEMENT_NODE
-          || xmlStrcmp (root_element->name, (xmlChar *) "MPD") != 0) {
+    if (xmlTextReaderNodeType (reader) != XML_READER_TYPE_ELEMENT) {
+      res = xmlTextReaderRead (reader);
+      continue;
+    }
+
+    if (new_mpd_root == NULL) {
+      /* start tag of the root element, its attributes are complete but its
+       * children are still to be read */
+      cur_node = xmlTextReaderCurrentNode (reader);
+      if (cur_node == NULL
+          || xmlStrcmp (cur_node->name, (xmlChar *) "MPD") != 0) {
         GST_ERROR
             ("can not find the root element MPD, failed to parse the MPD file");
-        ret = FALSE;            /* used to return TRUE before, but this seems wrong */
-      } else {
-        /* now we can parse the MPD root node and all children nodes, recursively */
-        ret = gst_mpdparser_parse_root_node (mpd_root_node, root_element);
+        goto done;
       }
-      /* free the document */
-      xmlFreeDoc (doc);
+      new_mpd_root = gst_mpdparser_parse_root_attributes (cur_node);
+      res = xmlTextReaderRead (reader);
+      continue;
     }
+
+    /* a child of the root element, parse its subtree and skip past it */
+    cur_node = xmlTextReaderExpand (reader);
+    if (cur_node == NULL) {
+      res = -1;
+      break;
+    }
+    if (!gst_mpdparser_parse_root_child (new_mpd_root, cur_node,
+            previous ? &previous_periods : NULL))
+      goto done;
+    res = xmlTextReaderNext (reader);
+  }
+
+  if (res < 0 || new_mpd_root == NULL) {
+    GST_ERROR ("failed to parse the MPD file");
+    goto done;
   }
 
+  gst_mpd_root_node_free (*mpd_root_node);
+  *mpd_root_node = new_mpd_root;
+  new_mpd_root = NULL;
+  ret = TRUE;
+
+done:
+  gst_mpd_root_node_free (new_mpd_root);
+  xmlFreeTextReader (reader);
+
   return ret;
 }
 
@@ -1272,7 +1656,7 @@ gst_mpdparser_get_external_segment_list (const gchar * data, gint size,
     if (root_element->type == XML_ELEMENT_NODE &&
         xmlStrcmp (root_element->name, (xmlChar *) "SegmentList") == 0) {
       gst_mpdparser_parse_segment_list_node (&new_segment_list, root_element,
-          parent);
+          parent, NULL);
     }
   }
 
@@ -1298,7 +1682,7 @@ gst_mpdparser_get_external_periods (const gchar * data, gint size)
     for (iter = root_element->children; iter; iter = iter->next) {
       if (iter->type == XML_ELEMENT_NODE) {
         if (xmlStrcmp (iter->name, (xmlChar *) "Period") == 0) {
-          gst_mpdparser_parse_period_node (&new_periods, iter);
+          gst_mpdparser_parse_period_node (&new_periods, iter, NULL);
         } else {
           goto error;
         }
@@ -1338,7 +1722,7 @@ gst_mpdparser_get_external_adaptation_sets (const gchar * data, gint size,
     if (root_element->type == XML_ELEMENT_NODE &&
         xmlStrcmp (root_element->name, (xmlChar *) "AdaptationSet") == 0) {
       gst_mpdparser_parse_adaptation_set_node (&new_adaptation_sets,
-          root_element, period);
+          root_element, period, NULL);
     }
   }
 
@@ -55,6 +55,10 @@ struct _GstMPDPeriodNode
 
   gchar *xlink_href;
   int actuate;
+
+  /* hash of the XML the Period was parsed from, 0 if it can't be reused
+   * for a later version of the MPD */
+  guint64 xml_hash;
 };
 
 GstMPDPeriodNode * gst_mpd_period_node_new (void);
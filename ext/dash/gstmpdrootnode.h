@@ -61,6 +61,8 @@ struct _GstMPDRootNode
   GList *Metrics;
   /* list of GstUTCTimingNode nodes */
   GList *UTCTimings;
+  /* list of GstMPDServiceDescriptionNode nodes */
+  GList *ServiceDescriptions;
 };
 
 GstMPDRootNode * gst_mpd_root_node_new (void);
@@ -61,6 +61,12 @@ gst_mpd_segment_base_get_xml_node (GstMPDNode * node)
     gst_xml_helper_set_prop_boolean (segment_base_xml_node, "indexRangeExact",
         self->indexRangeExact);
   }
+  if (self->availabilityTimeOffset != 0)
+    gst_xml_helper_set_prop_double (segment_base_xml_node,
+        "availabilityTimeOffset", self->availabilityTimeOffset);
+  if (!self->availabilityTimeComplete)
+    gst_xml_helper_set_prop_boolean (segment_base_xml_node,
+        "availabilityTimeComplete", self->availabilityTimeComplete);
   if (self->Initialization)
     gst_mpd_node_add_child_node (GST_MPD_NODE (self->Initialization),
         segment_base_xml_node);
@@ -92,6 +98,8 @@ gst_mpd_segment_base_node_init (GstMPDSegmentBaseNode * self)
   self->presentationTimeOffset = 0;
   self->indexRange = NULL;
   self->indexRangeExact = FALSE;
+  self->availabilityTimeOffset = 0;
+  self->availabilityTimeComplete = TRUE;
   /* Initialization node */
   self->Initialization = NULL;
   /* RepresentationIndex node */
@@ -0,0 +1,94 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+#include "gstmpdservicedescriptionnode.h"
+#include "gstmpdparser.h"
+
+G_DEFINE_TYPE (GstMPDServiceDescriptionNode, gst_mpd_service_description_node,
+    GST_TYPE_MPD_NODE);
+
+/* Base class */
+
+static xmlNodePtr
+gst_mpd_service_description_get_xml_node (GstMPDNode * node)
+{
+  xmlNodePtr service_description_xml_node = NULL;
+  xmlNodePtr child;
+  GstMPDServiceDescriptionNode *self = GST_MPD_SERVICE_DESCRIPTION_NODE (node);
+
+  service_description_xml_node =
+      xmlNewNode (NULL, (xmlChar *) "ServiceDescription");
+
+  gst_xml_helper_set_prop_uint (service_description_xml_node, "id", self->id);
+
+  if (self->latencyTarget != -1 || self->latencyMin != -1 ||
+      self->latencyMax != -1) {
+    child = xmlNewNode (NULL, (xmlChar *) "Latency");
+    if (self->latencyTarget != -1)
+      gst_xml_helper_set_prop_int64 (child, "target", self->latencyTarget);
+    if (self->latencyMin != -1)
+      gst_xml_helper_set_prop_int64 (child, "min", self->latencyMin);
+    if (self->latencyMax != -1)
+      gst_xml_helper_set_prop_int64 (child, "max", self->latencyMax);
+    xmlAddChild (service_description_xml_node, child);
+  }
+
+  if (self->playbackRateMin != 0 || self->playbackRateMax != 0) {
+    child = xmlNewNode (NULL, (xmlChar *) "PlaybackRate");
+    if (self->playbackRateMin != 0)
+      gst_xml_helper_set_prop_double (child, "min", self->playbackRateMin);
+    if (self->playbackRateMax != 0)
+      gst_xml_helper_set_prop_double (child, "max", self->playbackRateMax);
+    xmlAddChild (service_description_xml_node, child);
+  }
+
+  return service_description_xml_node;
+}
+
+static void
+gst_mpd_service_description_node_class_init (GstMPDServiceDescriptionNodeClass
+    * klass)
+{
+  GstMPDNodeClass *m_klass;
+
+  m_klass = GST_MPD_NODE_CLASS (klass);
+  m_klass->get_xml_node = gst_mpd_service_description_get_xml_node;
+}
+
+static void
+gst_mpd_service_description_node_init (GstMPDServiceDescriptionNode * self)
+{
+  self->id = 0;
+  self->latencyTarget = -1;
+  self->latencyMin = -1;
+  self->latencyMax = -1;
+  self->playbackRateMin = 0;
+  self->playbackRateMax = 0;
+}
+
+GstMPDServiceDescriptionNode *
+gst_mpd_service_description_node_new (void)
+{
+  return g_object_new (GST_TYPE_MPD_SERVICE_DESCRIPTION_NODE, NULL);
+}
+
+void
+gst_mpd_service_description_node_free (GstMPDServiceDescriptionNode * self)
+{
+  if (self)
+    gst_object_unref (self);
+}
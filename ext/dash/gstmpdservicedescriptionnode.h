@@ -0,0 +1,49 @@
+/* GStreamer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301 USA
+ *
+ */
+#ifndef __GSTMPDSERVICEDESCRIPTIONNODE_H__
+#define __GSTMPDSERVICEDESCRIPTIONNODE_H__
+
+#include <gst/gst.h>
+#include "gstmpdhelper.h"
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_MPD_SERVICE_DESCRIPTION_NODE gst_mpd_service_description_node_get_type ()
+G_DECLARE_FINAL_TYPE (GstMPDServiceDescriptionNode, gst_mpd_service_description_node, GST, MPD_SERVICE_DESCRIPTION_NODE, GstMPDNode)
+
+/* ServiceDescription element of ISO/IEC 23009-1:2019 Annex K. Only its
+ * Latency and PlaybackRate children are kept, flattened in the node. */
+struct _GstMPDServiceDescriptionNode
+{
+  GstObject     parent_instance;
+  guint id;
+  /* Latency, -1 if unset */
+  gint64 latencyTarget;               /* [ms] */
+  gint64 latencyMin;                  /* [ms] */
+  gint64 latencyMax;                  /* [ms] */
+  /* PlaybackRate, 0 if unset */
+  gdouble playbackRateMin;
+  gdouble playbackRateMax;
+};
+
+GstMPDServiceDescriptionNode * gst_mpd_service_description_node_new (void);
+void gst_mpd_service_description_node_free (GstMPDServiceDescriptionNode* self);
+
+G_END_DECLS
+
+#endif /* __GSTMPDSERVICEDESCRIPTIONNODE_H__ */
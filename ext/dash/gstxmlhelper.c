@@ -19,6 +19,8 @@
  *
  */
 
+#include <math.h>
+
 #include "gstxmlhelper.h"
 
 #define XML_HELPER_MINUTE_TO_SEC       60
@@ -1119,6 +1121,14 @@ gst_xml_helper_set_prop_double (xmlNodePtr node, const gchar * name,
     gdouble value)
 {
   gchar *text;
+
+  /* xs:double spelling, printf would give "inf" */
+  if (isinf (value)) {
+    xmlSetProp (node, (xmlChar *) name,
+        (xmlChar *) (value > 0 ? "INF" : "-INF"));
+    return;
+  }
+
   text = g_strdup_printf ("%lf", value);
   xmlSetProp (node, (xmlChar *) name, (xmlChar *) text);
   g_free (text);
@@ -62,6 +62,29 @@ GST_DEBUG_CATEGORY (gst_hls_demux_debug);
 #define GST_M3U8_CLIENT_LOCK(l) /* FIXME */
 #define GST_M3U8_CLIENT_UNLOCK(l)       /* FIXME */
 
+/* Encrypted data is handed over to the decryption worker in blocks of at
+ * least this size, so that the crypto backend can run its hardware
+ * accelerated CBC implementation over large runs of data */
+#define DECRYPT_BLOCK_SIZE (128 * 1024)
+
+/* Maximum number of blocks being decrypted per stream before the streaming
+ * thread waits for the worker */
+#define MAX_DECRYPT_JOBS 4
+
+typedef struct
+{
+  GstBuffer *buffer;            /* encrypted, decrypted once done */
+  GError *error;
+  gboolean done;
+} GstHLSDecryptJob;
+
+typedef struct
+{
+  gchar *key_url;
+  gchar *referer;
+  gboolean allow_cache;
+} GstHLSKeyPrefetch;
+
 /* GObject */
 static void gst_hls_demux_finalize (GObject * obj);
 
@@ -71,7 +94,7 @@ gst_hls_demux_change_state (GstElement * element, GstStateChange transition);
 
 /* GstHLSDemux */
 static gboolean gst_hls_demux_update_playlist (GstHLSDemux * demux,
-    gboolean update, GError ** err);
+    gboolean update, gboolean blocking, GError ** err);
 static gchar *gst_hls_src_buf_to_utf8_playlist (GstBuffer * buf);
 
 /* FIXME: the return value is never used? */
@@ -83,6 +106,8 @@ static gboolean
 gst_hls_demux_stream_decrypt_start (GstHLSDemuxStream * stream,
     const guint8 * key_data, const guint8 * iv_data);
 static void gst_hls_demux_stream_decrypt_end (GstHLSDemuxStream * stream);
+static void gst_hls_demux_stream_cancel_decrypt (GstHLSDemuxStream * stream);
+static void gst_hls_demux_stop_key_prefetch (GstHLSDemux * demux);
 
 static gboolean gst_hls_demux_is_live (GstAdaptiveDemux * demux);
 static GstClockTime gst_hls_demux_get_duration (GstAdaptiveDemux * demux);
@@ -109,8 +134,12 @@ static GstFlowReturn gst_hls_demux_advance_fragment (GstAdaptiveDemuxStream *
     stream);
 static GstFlowReturn gst_hls_demux_update_fragment_info (GstAdaptiveDemuxStream
     * stream);
+static GstFlowReturn gst_hls_demux_peek_fragment (GstAdaptiveDemuxStream *
+    stream, guint n, GstAdaptiveDemuxStreamFragment * fragment);
 static gboolean gst_hls_demux_select_bitrate (GstAdaptiveDemuxStream * stream,
     guint64 bitrate);
+static GArray *gst_hls_demux_stream_get_bitrates (GstAdaptiveDemuxStream *
+    stream);
 static void gst_hls_demux_reset (GstAdaptiveDemux * demux);
 static gboolean gst_hls_demux_get_live_seek_range (GstAdaptiveDemux * demux,
     gint64 * start, gint64 * stop);
@@ -129,7 +158,10 @@ gst_hls_demux_finalize (GObject * obj)
   GstHLSDemux *demux = GST_HLS_DEMUX (obj);
 
   gst_hls_demux_reset (GST_ADAPTIVE_DEMUX_CAST (demux));
+  gst_hls_demux_stop_key_prefetch (demux);
+  g_object_unref (demux->key_downloader);
   g_mutex_clear (&demux->keys_lock);
+  g_cond_clear (&demux->keys_cond);
   if (demux->keys) {
     g_hash_table_unref (demux->keys);
     demux->keys = NULL;
@@ -178,7 +210,10 @@ gst_hls_demux_class_init (GstHLSDemuxClass * klass)
   adaptivedemux_class->stream_advance_fragment = gst_hls_demux_advance_fragment;
   adaptivedemux_class->stream_update_fragment_info =
       gst_hls_demux_update_fragment_info;
+  adaptivedemux_class->stream_peek_fragment = gst_hls_demux_peek_fragment;
   adaptivedemux_class->stream_select_bitrate = gst_hls_demux_select_bitrate;
+  adaptivedemux_class->stream_get_bitrates =
+      gst_hls_demux_stream_get_bitrates;
   adaptivedemux_class->stream_free = gst_hls_demux_stream_free;
 
   adaptivedemux_class->start_fragment = gst_hls_demux_start_fragment;
@@ -197,6 +232,13 @@ gst_hls_demux_init (GstHLSDemux * demux)
 
   demux->keys = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
   g_mutex_init (&demux->keys_lock);
+  g_cond_init (&demux->keys_cond);
+  demux->key_downloader = gst_uri_downloader_new ();
+  gst_uri_downloader_set_parent (demux->key_downloader,
+      GST_ELEMENT_CAST (demux));
+
+  demux->reload_msn = -1;
+  demux->reload_part = -1;
 }
 
 static GstStateChangeReturn
@@ -209,6 +251,11 @@ gst_hls_demux_change_state (GstElement * element, GstStateChange transition)
     case GST_STATE_CHANGE_READY_TO_PAUSED:
       gst_hls_demux_reset (GST_ADAPTIVE_DEMUX_CAST (demux));
       break;
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      /* like the base class does with its downloader, before it waits for
+       * the streaming threads */
+      gst_hls_demux_stop_key_prefetch (demux);
+      break;
     default:
       break;
   }
@@ -218,6 +265,7 @@ gst_hls_demux_change_state (GstElement * element, GstStateChange transition)
   switch (transition) {
     case GST_STATE_CHANGE_PAUSED_TO_READY:
       gst_hls_demux_reset (GST_ADAPTIVE_DEMUX_CAST (demux));
+      gst_hls_demux_stop_key_prefetch (demux);
       g_hash_table_remove_all (demux->keys);
       break;
     default:
@@ -266,6 +314,7 @@ gst_hls_demux_stream_clear_pending_data (GstHLSDemuxStream * hls_stream)
   gst_buffer_replace (&hls_stream->pending_typefind_buffer, NULL);
   gst_buffer_replace (&hls_stream->pending_pcr_buffer, NULL);
   hls_stream->current_offset = -1;
+  gst_hls_demux_stream_cancel_decrypt (hls_stream);
   gst_hls_demux_stream_decrypt_end (hls_stream);
 }
 
@@ -337,6 +386,10 @@ gst_hls_demux_seek (GstAdaptiveDemux * demux, GstEvent * seek)
     return TRUE;
   }
 
+  /* The streams were stopped, the keys being prefetched are for fragments
+   * that may not be played anymore */
+  gst_hls_demux_stop_key_prefetch (hlsdemux);
+
   old_rate = demux->segment.rate;
 
   bitrate = gst_hls_demux_get_bitrate (hlsdemux);
@@ -350,7 +403,7 @@ gst_hls_demux_seek (GstAdaptiveDemux * demux, GstEvent * seek)
     gst_hls_demux_set_current_variant (hlsdemux,
         hlsdemux->master->iframe_variants->data);
     gst_uri_downloader_reset (demux->downloader);
-    if (!gst_hls_demux_update_playlist (hlsdemux, FALSE, &err)) {
+    if (!gst_hls_demux_update_playlist (hlsdemux, FALSE, FALSE, &err)) {
       GST_ELEMENT_ERROR_FROM_ERROR (hlsdemux, "Could not switch playlist", err);
       return FALSE;
     }
@@ -363,7 +416,7 @@ gst_hls_demux_seek (GstAdaptiveDemux * demux, GstEvent * seek)
     gst_hls_demux_set_current_variant (hlsdemux,
         hlsdemux->master->variants->data);
     gst_uri_downloader_reset (demux->downloader);
-    if (!gst_hls_demux_update_playlist (hlsdemux, FALSE, &err)) {
+    if (!gst_hls_demux_update_playlist (hlsdemux, FALSE, FALSE, &err)) {
       GST_ELEMENT_ERROR_FROM_ERROR (hlsdemux, "Could not switch playlist", err);
       return FALSE;
     }
@@ -458,6 +511,7 @@ gst_hls_demux_stream_seek (GstAdaptiveDemuxStream * stream, gboolean forward,
       (guint) current_sequence);
   hls_stream->reset_pts = TRUE;
   hls_stream->playlist->sequence = current_sequence;
+  hls_stream->playlist->part = -1;
   hls_stream->playlist->current_file = walk;
   hls_stream->playlist->sequence_position = current_pos;
   GST_M3U8_CLIENT_UNLOCK (hlsdemux->client);
@@ -481,7 +535,9 @@ static GstFlowReturn
 gst_hls_demux_update_manifest (GstAdaptiveDemux * demux)
 {
   GstHLSDemux *hlsdemux = GST_HLS_DEMUX_CAST (demux);
-  if (!gst_hls_demux_update_playlist (hlsdemux, TRUE, NULL))
+  /* the updates task is the only one that can wait for a blocking reload
+   * without holding up the streams */
+  if (!gst_hls_demux_update_playlist (hlsdemux, TRUE, TRUE, NULL))
     return GST_FLOW_ERROR;
 
   return GST_FLOW_OK;
@@ -517,6 +573,10 @@ create_stream_for_playlist (GstAdaptiveDemux * demux, GstM3U8 * playlist,
 
   hlsdemux_stream->do_typefind = TRUE;
   hlsdemux_stream->reset_pts = TRUE;
+
+  g_queue_init (&hlsdemux_stream->decrypt_jobs);
+  g_mutex_init (&hlsdemux_stream->decrypt_lock);
+  g_cond_init (&hlsdemux_stream->decrypt_cond);
 }
 
 static GstHLSDemuxStream *
@@ -717,6 +777,8 @@ gst_hls_demux_set_current_variant (GstHLSDemux * hlsdemux,
     variant->m3u8->sequence_position =
         hlsdemux->current_variant->m3u8->sequence_position;
     variant->m3u8->sequence = hlsdemux->current_variant->m3u8->sequence;
+    /* parts are aligned across renditions */
+    variant->m3u8->part = hlsdemux->current_variant->m3u8->part;
 
     GST_DEBUG_OBJECT (hlsdemux,
         "Switching Variant. Copying over sequence %" G_GINT64_FORMAT
@@ -738,6 +800,7 @@ gst_hls_demux_set_current_variant (GstHLSDemux * hlsdemux,
           GST_LOG_OBJECT (hlsdemux, "new_media '%s' '%s'", new_media->name,
               new_media->uri);
           new_media->playlist->sequence = old_media->playlist->sequence;
+          new_media->playlist->part = old_media->playlist->part;
           new_media->playlist->sequence_position =
               old_media->playlist->sequence_position;
         } else {
@@ -807,7 +870,7 @@ gst_hls_demux_process_manifest (GstAdaptiveDemux * demux, GstBuffer * buf)
   if (!hlsdemux->master->is_simple) {
     GError *err = NULL;
 
-    if (!gst_hls_demux_update_playlist (hlsdemux, FALSE, &err)) {
+    if (!gst_hls_demux_update_playlist (hlsdemux, FALSE, FALSE, &err)) {
       GST_ELEMENT_ERROR_FROM_ERROR (demux, "Could not fetch media playlist",
           err);
       GST_M3U8_CLIENT_UNLOCK (self);
@@ -843,49 +906,87 @@ gst_hls_demux_is_live (GstAdaptiveDemux * demux)
   return is_live;
 }
 
+/* Looks the key up in the cache or downloads it with @downloader.
+ *
+ * If the key is already being downloaded, the prefetch thread waits for that
+ * download instead of starting a second one, unless the prefetches are being
+ * stopped. The streaming threads hold the manifest lock, which seeks and
+ * state changes need before they can stop anything, so they never wait for
+ * another download: with @wait_pending FALSE the key is fetched again. */
 static const GstHLSKey *
-gst_hls_demux_get_key (GstHLSDemux * demux, const gchar * key_url,
-    const gchar * referer, gboolean allow_cache)
+gst_hls_demux_get_key (GstHLSDemux * demux, GstUriDownloader * downloader,
+    const gchar * key_url, const gchar * referer, gboolean allow_cache,
+    gboolean wait_pending)
 {
   GstFragment *key_fragment;
   GstBuffer *key_buffer;
-  GstHLSKey *key;
+  GstHLSKey *key = NULL, *cached;
   GError *err = NULL;
+  gboolean pending;
 
   GST_LOG_OBJECT (demux, "Looking up key for key url %s", key_url);
 
   g_mutex_lock (&demux->keys_lock);
 
-  key = g_hash_table_lookup (demux->keys, key_url);
+  while ((pending = g_hash_table_lookup_extended (demux->keys, key_url, NULL,
+              (gpointer *) & key)) && key == NULL) {
+    if (!wait_pending) {
+      GST_DEBUG_OBJECT (demux, "Key %s is still being downloaded, fetching "
+          "it from here too", key_url);
+      break;
+    }
+    if (demux->keys_flushing) {
+      GST_LOG_OBJECT (demux, "Stopped waiting for key %s", key_url);
+      goto out;
+    }
+    GST_LOG_OBJECT (demux, "Waiting for the download of key %s", key_url);
+    g_cond_wait (&demux->keys_cond, &demux->keys_lock);
+  }
 
   if (key != NULL) {
     GST_LOG_OBJECT (demux, "Found key for key url %s in key cache", key_url);
     goto out;
   }
 
+  /* Mark the key as pending and download it without holding the lock */
+  if (!pending)
+    g_hash_table_insert (demux->keys, g_strdup (key_url), NULL);
+  g_mutex_unlock (&demux->keys_lock);
+
   GST_INFO_OBJECT (demux, "Fetching key %s", key_url);
 
-  key_fragment =
-      gst_uri_downloader_fetch_uri (GST_ADAPTIVE_DEMUX (demux)->downloader,
-      key_url, referer, FALSE, FALSE, allow_cache, &err);
+  key_fragment = gst_uri_downloader_fetch_uri (downloader, key_url, referer,
+      FALSE, FALSE, allow_cache, &err);
 
-  if (key_fragment == NULL) {
+  if (key_fragment != NULL) {
+    key_buffer = gst_fragment_get_buffer (key_fragment);
+
+    key = g_new0 (GstHLSKey, 1);
+    if (gst_buffer_extract (key_buffer, 0, key->data, 16) < 16)
+      GST_WARNING_OBJECT (demux, "Download decryption key is too short!");
+
+    gst_buffer_unref (key_buffer);
+    g_object_unref (key_fragment);
+  } else {
     GST_WARNING_OBJECT (demux, "Failed to download key to decrypt data: %s",
         err ? err->message : "error");
     g_clear_error (&err);
-    goto out;
   }
 
-  key_buffer = gst_fragment_get_buffer (key_fragment);
-
-  key = g_new0 (GstHLSKey, 1);
-  if (gst_buffer_extract (key_buffer, 0, key->data, 16) < 16)
-    GST_WARNING_OBJECT (demux, "Download decryption key is too short!");
-
-  g_hash_table_insert (demux->keys, g_strdup (key_url), key);
-
-  gst_buffer_unref (key_buffer);
-  g_object_unref (key_fragment);
+  g_mutex_lock (&demux->keys_lock);
+  /* The same key can be downloaded twice at once, keep the first one so that
+   * the key returned to the other caller stays valid */
+  pending = g_hash_table_lookup_extended (demux->keys, key_url, NULL,
+      (gpointer *) & cached);
+  if (pending && cached != NULL) {
+    g_free (key);
+    key = cached;
+  } else if (key != NULL) {
+    g_hash_table_insert (demux->keys, g_strdup (key_url), key);
+  } else if (pending) {
+    g_hash_table_remove (demux->keys, key_url);
+  }
+  g_cond_broadcast (&demux->keys_cond);
 
 out:
 
@@ -897,6 +998,89 @@ out:
   return key;
 }
 
+static void
+gst_hls_demux_prefetch_key_func (GstHLSKeyPrefetch * prefetch,
+    GstHLSDemux * demux)
+{
+  gst_hls_demux_get_key (demux, demux->key_downloader, prefetch->key_url,
+      prefetch->referer, prefetch->allow_cache, TRUE);
+
+  g_free (prefetch->key_url);
+  g_free (prefetch->referer);
+  g_free (prefetch);
+}
+
+/* Starts downloading the key of the fragment after the current one if it
+ * isn't known yet, so that it is available once that fragment starts */
+static void
+gst_hls_demux_stream_prefetch_next_key (GstHLSDemux * demux,
+    GstHLSDemuxStream * hls_stream)
+{
+  GstAdaptiveDemux *ademux = GST_ADAPTIVE_DEMUX_CAST (demux);
+  GstHLSKeyPrefetch *prefetch;
+  GstM3U8MediaFile *file;
+  GstM3U8 *m3u8;
+
+  m3u8 = gst_hls_demux_stream_get_m3u8 (hls_stream);
+
+  file = gst_m3u8_peek_fragment (m3u8, ademux->segment.rate > 0, 1);
+  if (file == NULL)
+    return;
+
+  if (file->key == NULL)
+    goto out;
+
+  g_mutex_lock (&demux->keys_lock);
+  if (!g_hash_table_contains (demux->keys, file->key)) {
+    GST_DEBUG_OBJECT (demux, "Prefetching key %s", file->key);
+
+    if (demux->key_pool == NULL)
+      demux->key_pool =
+          g_thread_pool_new ((GFunc) gst_hls_demux_prefetch_key_func, demux,
+          1, FALSE, NULL);
+
+    prefetch = g_new0 (GstHLSKeyPrefetch, 1);
+    prefetch->key_url = g_strdup (file->key);
+    prefetch->referer = g_strdup (m3u8->uri);
+    prefetch->allow_cache = m3u8->allowcache;
+    g_thread_pool_push (demux->key_pool, prefetch, NULL);
+  }
+  g_mutex_unlock (&demux->keys_lock);
+
+out:
+  gst_m3u8_media_file_unref (file);
+}
+
+/* Cancels the key prefetches, the ones waiting for a download and the one
+ * being downloaded, and waits for the prefetch thread to be done */
+static void
+gst_hls_demux_stop_key_prefetch (GstHLSDemux * demux)
+{
+  GThreadPool *pool;
+
+  g_mutex_lock (&demux->keys_lock);
+  pool = demux->key_pool;
+  demux->key_pool = NULL;
+  if (pool != NULL) {
+    demux->keys_flushing = TRUE;
+    g_cond_broadcast (&demux->keys_cond);
+  }
+  g_mutex_unlock (&demux->keys_lock);
+
+  if (pool == NULL)
+    return;
+
+  GST_DEBUG_OBJECT (demux, "Stopping key prefetches");
+
+  gst_uri_downloader_cancel (demux->key_downloader);
+  g_thread_pool_free (pool, FALSE, TRUE);
+  gst_uri_downloader_reset (demux->key_downloader);
+
+  g_mutex_lock (&demux->keys_lock);
+  demux->keys_flushing = FALSE;
+  g_mutex_unlock (&demux->keys_lock);
+}
+
 static gboolean
 gst_hls_demux_start_fragment (GstAdaptiveDemux * demux,
     GstAdaptiveDemuxStream * stream)
@@ -914,14 +1098,17 @@ gst_hls_demux_start_fragment (GstAdaptiveDemux * demux,
   gst_hlsdemux_tsreader_set_type (&hls_stream->tsreader,
       hls_stream->stream_type);
 
+  /* Get the key of the next fragment while this one is downloaded */
+  gst_hls_demux_stream_prefetch_next_key (hlsdemux, hls_stream);
+
   /* If no decryption is needed, there's nothing to be done here */
   if (hls_stream->current_key == NULL)
     return TRUE;
 
   m3u8 = gst_hls_demux_stream_get_m3u8 (hls_stream);
 
-  key = gst_hls_demux_get_key (hlsdemux, hls_stream->current_key,
-      m3u8->uri, m3u8->allowcache);
+  key = gst_hls_demux_get_key (hlsdemux, demux->downloader,
+      hls_stream->current_key, m3u8->uri, m3u8->allowcache, FALSE);
 
   if (key == NULL)
     goto key_failed;
@@ -1057,6 +1244,118 @@ gst_hls_demux_handle_buffer (GstAdaptiveDemux * demux,
   return GST_FLOW_OK;
 }
 
+static void
+gst_hls_demux_stream_decrypt_func (GstHLSDecryptJob * job,
+    GstHLSDemuxStream * hls_stream)
+{
+  GstAdaptiveDemuxStream *stream = (GstAdaptiveDemuxStream *) hls_stream;
+  GstBuffer *buffer;
+
+  buffer = gst_hls_demux_decrypt_fragment (GST_HLS_DEMUX_CAST (stream->demux),
+      hls_stream, job->buffer, &job->error);
+
+  g_mutex_lock (&hls_stream->decrypt_lock);
+  job->buffer = buffer;
+  job->done = TRUE;
+  g_cond_broadcast (&hls_stream->decrypt_cond);
+  g_mutex_unlock (&hls_stream->decrypt_lock);
+}
+
+/* Queues @size bytes of pending encrypted data for decryption. The worker
+ * only runs one job at a time, so the blocks are decrypted in order and the
+ * CBC state carries over from one to the next */
+static void
+gst_hls_demux_stream_submit_decrypt (GstHLSDemuxStream * hls_stream,
+    gsize size)
+{
+  GstHLSDecryptJob *job;
+
+  if (hls_stream->decrypt_pool == NULL)
+    hls_stream->decrypt_pool =
+        g_thread_pool_new ((GFunc) gst_hls_demux_stream_decrypt_func,
+        hls_stream, 1, FALSE, NULL);
+
+  job = g_new0 (GstHLSDecryptJob, 1);
+  job->buffer =
+      gst_adapter_take_buffer (hls_stream->pending_encrypted_data, size);
+
+  g_mutex_lock (&hls_stream->decrypt_lock);
+  g_queue_push_tail (&hls_stream->decrypt_jobs, job);
+  g_mutex_unlock (&hls_stream->decrypt_lock);
+
+  g_thread_pool_push (hls_stream->decrypt_pool, job, NULL);
+}
+
+/* Handles the decrypted blocks in order, keeping the last one back for pkcs7
+ * unpadding. If @drain, waits for all the queued blocks, otherwise only
+ * until less than MAX_DECRYPT_JOBS are left */
+static GstFlowReturn
+gst_hls_demux_stream_collect_decrypted (GstAdaptiveDemux * demux,
+    GstAdaptiveDemuxStream * stream, gboolean drain)
+{
+  GstHLSDemuxStream *hls_stream = GST_HLS_DEMUX_STREAM_CAST (stream);
+  GstFlowReturn ret = GST_FLOW_OK;
+  GstHLSDecryptJob *job;
+  GstBuffer *buffer;
+
+  g_mutex_lock (&hls_stream->decrypt_lock);
+  while ((ret == GST_FLOW_OK || ret == GST_FLOW_NOT_LINKED)
+      && (job = g_queue_peek_head (&hls_stream->decrypt_jobs))) {
+    if (!job->done) {
+      if (!drain && hls_stream->decrypt_jobs.length < MAX_DECRYPT_JOBS)
+        break;
+      g_cond_wait (&hls_stream->decrypt_cond, &hls_stream->decrypt_lock);
+      continue;
+    }
+
+    g_queue_pop_head (&hls_stream->decrypt_jobs);
+    g_mutex_unlock (&hls_stream->decrypt_lock);
+
+    if (job->buffer == NULL) {
+      GST_ELEMENT_ERROR (demux, STREAM, DECODE, ("Failed to decrypt buffer"),
+          ("decryption failed %s", job->error->message));
+      g_error_free (job->error);
+      ret = GST_FLOW_ERROR;
+    } else {
+      buffer = hls_stream->pending_decrypted_buffer;
+      hls_stream->pending_decrypted_buffer = job->buffer;
+      ret = gst_hls_demux_handle_buffer (demux, stream, buffer, FALSE);
+    }
+    g_free (job);
+
+    g_mutex_lock (&hls_stream->decrypt_lock);
+  }
+  g_mutex_unlock (&hls_stream->decrypt_lock);
+
+  return ret;
+}
+
+/* Drops the queued blocks. Those already handed to the worker can't be taken
+ * back, so this waits for them */
+static void
+gst_hls_demux_stream_cancel_decrypt (GstHLSDemuxStream * hls_stream)
+{
+  GstHLSDecryptJob *job;
+
+  if (hls_stream->decrypt_pool == NULL)
+    return;
+
+  g_mutex_lock (&hls_stream->decrypt_lock);
+  while ((job = g_queue_peek_head (&hls_stream->decrypt_jobs))) {
+    if (!job->done) {
+      g_cond_wait (&hls_stream->decrypt_cond, &hls_stream->decrypt_lock);
+      continue;
+    }
+
+    g_queue_pop_head (&hls_stream->decrypt_jobs);
+    if (job->buffer)
+      gst_buffer_unref (job->buffer);
+    g_clear_error (&job->error);
+    g_free (job);
+  }
+  g_mutex_unlock (&hls_stream->decrypt_lock);
+}
+
 static GstFlowReturn
 gst_hls_demux_finish_fragment (GstAdaptiveDemux * demux,
     GstAdaptiveDemuxStream * stream)
@@ -1064,10 +1363,25 @@ gst_hls_demux_finish_fragment (GstAdaptiveDemux * demux,
   GstHLSDemuxStream *hls_stream = GST_HLS_DEMUX_STREAM_CAST (stream);   // FIXME: pass HlsStream into function
   GstFlowReturn ret = GST_FLOW_OK;
 
-  if (hls_stream->current_key)
+  if (hls_stream->current_key) {
+    if (stream->last_ret == GST_FLOW_OK) {
+      gsize size = 0;
+
+      /* Decrypt what's left, a multiple of 16 bytes */
+      if (hls_stream->pending_encrypted_data)
+        size = gst_adapter_available (hls_stream->pending_encrypted_data);
+      size &= (~0xF);
+      if (size > 0)
+        gst_hls_demux_stream_submit_decrypt (hls_stream, size);
+
+      ret = gst_hls_demux_stream_collect_decrypted (demux, stream, TRUE);
+    }
+    gst_hls_demux_stream_cancel_decrypt (hls_stream);
     gst_hls_demux_stream_decrypt_end (hls_stream);
+  }
 
-  if (stream->last_ret == GST_FLOW_OK) {
+  if (stream->last_ret == GST_FLOW_OK && (ret == GST_FLOW_OK
+          || ret == GST_FLOW_NOT_LINKED)) {
     if (hls_stream->pending_decrypted_buffer) {
       if (hls_stream->current_key) {
         GstMapInfo info;
@@ -1127,16 +1441,13 @@ gst_hls_demux_data_received (GstAdaptiveDemux * demux,
     GstAdaptiveDemuxStream * stream, GstBuffer * buffer)
 {
   GstHLSDemuxStream *hls_stream = GST_HLS_DEMUX_STREAM_CAST (stream);
-  GstHLSDemux *hlsdemux = GST_HLS_DEMUX_CAST (demux);
 
   if (hls_stream->current_offset == -1)
     hls_stream->current_offset = 0;
 
   /* Is it encrypted? */
   if (hls_stream->current_key) {
-    GError *err = NULL;
     gsize size;
-    GstBuffer *tmp_buffer;
 
     if (hls_stream->pending_encrypted_data == NULL)
       hls_stream->pending_encrypted_data = gst_adapter_new ();
@@ -1144,26 +1455,11 @@ gst_hls_demux_data_received (GstAdaptiveDemux * demux,
     gst_adapter_push (hls_stream->pending_encrypted_data, buffer);
     size = gst_adapter_available (hls_stream->pending_encrypted_data);
 
-    /* must be a multiple of 16 */
-    size &= (~0xF);
-
-    if (size == 0) {
-      return GST_FLOW_OK;
-    }
-
-    buffer = gst_adapter_take_buffer (hls_stream->pending_encrypted_data, size);
-    buffer =
-        gst_hls_demux_decrypt_fragment (hlsdemux, hls_stream, buffer, &err);
-    if (buffer == NULL) {
-      GST_ELEMENT_ERROR (demux, STREAM, DECODE, ("Failed to decrypt buffer"),
-          ("decryption failed %s", err->message));
-      g_error_free (err);
-      return GST_FLOW_ERROR;
-    }
+    /* decrypt in large blocks, a multiple of 16 bytes */
+    if (size >= DECRYPT_BLOCK_SIZE)
+      gst_hls_demux_stream_submit_decrypt (hls_stream, size & (~0xF));
 
-    tmp_buffer = hls_stream->pending_decrypted_buffer;
-    hls_stream->pending_decrypted_buffer = buffer;
-    buffer = tmp_buffer;
+    return gst_hls_demux_stream_collect_decrypted (demux, stream, FALSE);
   }
 
   return gst_hls_demux_handle_buffer (demux, stream, buffer, FALSE);
@@ -1194,6 +1490,15 @@ gst_hls_demux_stream_free (GstAdaptiveDemuxStream * stream)
     g_free (hls_stream->current_iv);
     hls_stream->current_iv = NULL;
   }
+
+  gst_hls_demux_stream_cancel_decrypt (hls_stream);
+  if (hls_stream->decrypt_pool) {
+    g_thread_pool_free (hls_stream->decrypt_pool, FALSE, TRUE);
+    hls_stream->decrypt_pool = NULL;
+  }
+  g_mutex_clear (&hls_stream->decrypt_lock);
+  g_cond_clear (&hls_stream->decrypt_cond);
+
   gst_hls_demux_stream_decrypt_end (hls_stream);
 }
 
@@ -1294,6 +1599,7 @@ gst_hls_demux_update_fragment_info (GstAdaptiveDemuxStream * stream)
     stream->fragment.range_end = -1;
 
   stream->fragment.duration = file->duration;
+  stream->fragment.incomplete = file->incomplete;
 
   if (discont)
     stream->discont = TRUE;
@@ -1303,6 +1609,34 @@ gst_hls_demux_update_fragment_info (GstAdaptiveDemuxStream * stream)
   return GST_FLOW_OK;
 }
 
+static GstFlowReturn
+gst_hls_demux_peek_fragment (GstAdaptiveDemuxStream * stream, guint n,
+    GstAdaptiveDemuxStreamFragment * fragment)
+{
+  GstHLSDemuxStream *hlsdemux_stream = GST_HLS_DEMUX_STREAM_CAST (stream);
+  GstM3U8MediaFile *file;
+  GstM3U8 *m3u8;
+
+  m3u8 = gst_hls_demux_stream_get_m3u8 (hlsdemux_stream);
+
+  file = gst_m3u8_peek_fragment (m3u8, stream->demux->segment.rate > 0, n);
+  if (file == NULL)
+    return GST_FLOW_EOS;
+
+  fragment->uri = g_strdup (file->uri);
+  fragment->range_start = file->offset;
+  if (file->size != -1)
+    fragment->range_end = file->offset + file->size - 1;
+  else
+    fragment->range_end = -1;
+  fragment->duration = file->duration;
+  fragment->incomplete = file->incomplete;
+
+  gst_m3u8_media_file_unref (file);
+
+  return GST_FLOW_OK;
+}
+
 static gboolean
 gst_hls_demux_select_bitrate (GstAdaptiveDemuxStream * stream, guint64 bitrate)
 {
@@ -1332,6 +1666,39 @@ gst_hls_demux_select_bitrate (GstAdaptiveDemuxStream * stream, guint64 bitrate)
   return changed;
 }
 
+static GArray *
+gst_hls_demux_stream_get_bitrates (GstAdaptiveDemuxStream * stream)
+{
+  GstHLSDemux *hlsdemux = GST_HLS_DEMUX_CAST (stream->demux);
+  GstHLSDemuxStream *hls_stream = GST_HLS_DEMUX_STREAM_CAST (stream);
+  GArray *bitrates = NULL;
+  GList *l;
+
+  /* only the primary stream switches variants */
+  if (hls_stream->is_primary_playlist == FALSE)
+    return NULL;
+
+  GST_M3U8_CLIENT_LOCK (hlsdemux->client);
+  if (hlsdemux->master && !hlsdemux->master->is_simple &&
+      hlsdemux->current_variant) {
+    if (hlsdemux->current_variant->iframe)
+      l = hlsdemux->master->iframe_variants;
+    else
+      l = hlsdemux->master->variants;
+
+    bitrates = g_array_new (FALSE, FALSE, sizeof (guint64));
+    for (; l; l = l->next) {
+      GstHLSVariantStream *variant = l->data;
+      guint64 bitrate = variant->bandwidth;
+
+      g_array_append_val (bitrates, bitrate);
+    }
+  }
+  GST_M3U8_CLIENT_UNLOCK (hlsdemux->client);
+
+  return bitrates;
+}
+
 static void
 gst_hls_demux_reset (GstAdaptiveDemux * ademux)
 {
@@ -1353,6 +1720,8 @@ gst_hls_demux_reset (GstAdaptiveDemux * ademux)
     demux->previous_variant = NULL;
   }
   demux->srcpad_counter = 0;
+  demux->reload_msn = -1;
+  demux->reload_part = -1;
   demux->streams_aware = GST_OBJECT_PARENT (demux)
       && GST_OBJECT_FLAG_IS_SET (GST_OBJECT_PARENT (demux),
       GST_BIN_FLAG_STREAMS_AWARE);
@@ -1451,6 +1820,7 @@ gst_hls_demux_update_variant_playlist (GstHLSDemux * hlsdemux, gchar * data,
       /* FIXME: Deal with losing position due to missing an update */
       variant->m3u8->sequence_position = old->m3u8->sequence_position;
       variant->m3u8->sequence = old->m3u8->sequence;
+      variant->m3u8->part = old->m3u8->part;
     }
   }
 
@@ -1494,34 +1864,177 @@ out:
   return ret;
 }
 
+/* Low-latency HLS delivery directives: the server holds requests carrying
+ * them until the playlist has the segment and part they ask for */
+static gchar *
+gst_hls_demux_add_delivery_directives (const gchar * uri, gint64 msn,
+    gint part)
+{
+  const gchar *sep = strchr (uri, '?') ? "&" : "?";
+
+  if (part >= 0)
+    return g_strdup_printf ("%s%s_HLS_msn=%" G_GINT64_FORMAT "&_HLS_part=%d",
+        uri, sep, msn, part);
+
+  return g_strdup_printf ("%s%s_HLS_msn=%" G_GINT64_FORMAT, uri, sep, msn);
+}
+
+static gchar *
+gst_hls_demux_strip_delivery_directives (const gchar * uri)
+{
+  const gchar *directives = strstr (uri, "_HLS_msn=");
+
+  if (directives && directives > uri && (directives[-1] == '?'
+          || directives[-1] == '&'))
+    return g_strndup (uri, directives - 1 - uri);
+
+  return g_strdup (uri);
+}
+
+/* Returns the URI to request @m3u8, located at @uri, with the _HLS_msn and
+ * _HLS_part delivery directives for a blocking reload when the server
+ * supports them. Such servers are asked to hold the request until the part
+ * after the last one we know of is out. A playlist we switch to is asked for from where the rendition
+ * report of the one we played says it is, so that no stale copy of it is
+ * served. @msn and @part are set to the directive used, -1 if none */
+static gchar *
+gst_hls_demux_get_playlist_request_uri (GstHLSDemux * demux, GstM3U8 * m3u8,
+    const gchar * uri, gint64 * msn, gint * part)
+{
+  GstHLSVariantStream *reporters[] =
+      { demux->previous_variant, demux->current_variant };
+  gint64 reload_msn = -1, report_msn;
+  gint reload_part = -1, report_part;
+  guint i;
+
+  gst_m3u8_get_blocking_reload_position (m3u8, &reload_msn, &reload_part);
+
+  for (i = 0; i < G_N_ELEMENTS (reporters); i++) {
+    if (reporters[i] == NULL || reporters[i]->m3u8 == m3u8)
+      continue;
+
+    if (gst_m3u8_get_rendition_report (reporters[i]->m3u8, uri, &report_msn,
+            &report_part) && (report_msn > reload_msn
+            || (report_msn == reload_msn && report_part > reload_part))) {
+      reload_msn = report_msn;
+      reload_part = report_part;
+    }
+  }
+
+  if (msn)
+    *msn = reload_msn;
+  if (part)
+    *part = reload_part;
+
+  if (reload_msn < 0)
+    return g_strdup (uri);
+
+  GST_LOG_OBJECT (demux, "Requesting playlist with _HLS_msn=%"
+      G_GINT64_FORMAT " _HLS_part=%d", reload_msn, reload_part);
+
+  return gst_hls_demux_add_delivery_directives (uri, reload_msn, reload_part);
+}
+
+/* Sets the URI @m3u8 was downloaded from, without the delivery directives
+ * it was requested with */
+static void
+gst_hls_demux_set_playlist_uri (GstM3U8 * m3u8, GstFragment * download,
+    const gchar * name)
+{
+  gchar *uri, *redirect_uri = NULL;
+
+  uri = gst_hls_demux_strip_delivery_directives (download->uri);
+  if (download->redirect_uri)
+    redirect_uri =
+        gst_hls_demux_strip_delivery_directives (download->redirect_uri);
+
+  /* Set the base URI of the playlist to the redirect target if any */
+  if (download->redirect_permanent && redirect_uri) {
+    gst_m3u8_set_uri (m3u8, redirect_uri, NULL, name);
+  } else {
+    gst_m3u8_set_uri (m3u8, uri, redirect_uri, name);
+  }
+
+  g_free (uri);
+  g_free (redirect_uri);
+}
+
+/* must be called with manifest_lock taken.
+ * Downloads @uri, the request URI of @m3u8 as returned by
+ * gst_hls_demux_get_playlist_request_uri(). If @blocking is set and the
+ * server is asked to hold the request, the manifest lock is released in the
+ * meantime. @stale is then set if @variant stopped being the current one, or
+ * @m3u8 got updated by someone else, and the download is dropped */
+static GstFragment *
+gst_hls_demux_fetch_playlist (GstHLSDemux * demux,
+    GstHLSVariantStream * variant, GstM3U8 * m3u8, const gchar * uri,
+    gboolean blocking, gboolean * stale, GError ** err)
+{
+  GstAdaptiveDemux *adaptive_demux = GST_ADAPTIVE_DEMUX (demux);
+  GstFragment *download;
+  gchar *main_uri;
+  gint64 msn = -1, new_msn = -1;
+  gint part = -1, new_part = -1;
+
+  *stale = FALSE;
+  main_uri = g_strdup (gst_adaptive_demux_get_manifest_ref_uri
+      (adaptive_demux));
+
+  if (!blocking || strstr (uri, "_HLS_msn=") == NULL) {
+    download = gst_uri_downloader_fetch_uri (adaptive_demux->downloader, uri,
+        main_uri, TRUE, TRUE, TRUE, err);
+    g_free (main_uri);
+    return download;
+  }
+
+  /* the refs keep the playlists alive while the lock is released */
+  gst_hls_variant_stream_ref (variant);
+  gst_m3u8_ref (m3u8);
+  gst_m3u8_get_blocking_reload_position (m3u8, &msn, &part);
+
+  download = gst_adaptive_demux_fetch_uri_unlocked (adaptive_demux, uri,
+      main_uri, TRUE, TRUE, TRUE, err);
+
+  gst_m3u8_get_blocking_reload_position (m3u8, &new_msn, &new_part);
+  if (demux->current_variant != variant || new_msn != msn || new_part != part) {
+    GST_DEBUG_OBJECT (demux, "Playlist changed during the blocking reload of "
+        "%s, dropping it", uri);
+    *stale = TRUE;
+    g_clear_object (&download);
+    g_clear_error (err);
+  }
+
+  gst_m3u8_unref (m3u8);
+  gst_hls_variant_stream_unref (variant);
+  g_free (main_uri);
+
+  return download;
+}
+
 static gboolean
 gst_hls_demux_update_rendition_manifest (GstHLSDemux * demux,
-    GstHLSMedia * media, GError ** err)
+    GstHLSVariantStream * variant, GstHLSMedia * media, gboolean blocking,
+    GError ** err)
 {
-  GstAdaptiveDemux *adaptive_demux = GST_ADAPTIVE_DEMUX (demux);
   GstFragment *download;
   GstBuffer *buf;
   gchar *playlist;
-  const gchar *main_uri;
-  GstM3U8 *m3u8;
-  gchar *uri = media->uri;
+  GstM3U8 *m3u8 = media->playlist;
+  gboolean stale;
+  gchar *uri;
 
-  main_uri = gst_adaptive_demux_get_manifest_ref_uri (adaptive_demux);
-  download =
-      gst_uri_downloader_fetch_uri (adaptive_demux->downloader, uri, main_uri,
-      TRUE, TRUE, TRUE, err);
+  uri = gst_hls_demux_get_playlist_request_uri (demux, m3u8, media->uri, NULL,
+      NULL);
+  download = gst_hls_demux_fetch_playlist (demux, variant, m3u8, uri,
+      blocking, &stale, err);
+  g_free (uri);
 
+  if (stale)
+    return TRUE;
   if (download == NULL)
     return FALSE;
 
-  m3u8 = media->playlist;
-
-  /* Set the base URI of the playlist to the redirect target if any */
-  if (download->redirect_permanent && download->redirect_uri) {
-    gst_m3u8_set_uri (m3u8, download->redirect_uri, NULL, media->name);
-  } else {
-    gst_m3u8_set_uri (m3u8, download->uri, download->redirect_uri, media->name);
-  }
+  gst_hls_demux_set_playlist_uri (m3u8, download, media->name);
 
   buf = gst_fragment_get_buffer (download);
   playlist = gst_hls_src_buf_to_utf8_playlist (buf);
@@ -1545,26 +2058,39 @@ gst_hls_demux_update_rendition_manifest (GstHLSDemux * demux,
   return TRUE;
 }
 
+/* must be called with manifest_lock taken.
+ * With @blocking, blocking reloads are done without the manifest lock, see
+ * gst_hls_demux_fetch_playlist(). Playlists that changed in the meantime are
+ * left as they are */
 static gboolean
 gst_hls_demux_update_playlist (GstHLSDemux * demux, gboolean update,
-    GError ** err)
+    gboolean blocking, GError ** err)
 {
   GstAdaptiveDemux *adaptive_demux = GST_ADAPTIVE_DEMUX (demux);
+  GstHLSVariantStream *variant;
   GstFragment *download;
   GstBuffer *buf;
   gchar *playlist;
   gboolean main_checked = FALSE;
+  gboolean stale;
   const gchar *main_uri;
   GstM3U8 *m3u8;
-  gchar *uri;
+  gchar *uri, *playlist_uri;
   gint i;
 
 retry:
-  uri = gst_m3u8_get_uri (demux->current_variant->m3u8);
+  variant = demux->current_variant;
+  playlist_uri = gst_m3u8_get_uri (variant->m3u8);
+  uri = gst_hls_demux_get_playlist_request_uri (demux, variant->m3u8,
+      playlist_uri, &demux->reload_msn, &demux->reload_part);
+  g_free (playlist_uri);
+  download = gst_hls_demux_fetch_playlist (demux, variant, variant->m3u8, uri,
+      blocking, &stale, err);
+  if (stale) {
+    g_free (uri);
+    return TRUE;
+  }
   main_uri = gst_adaptive_demux_get_manifest_ref_uri (adaptive_demux);
-  download =
-      gst_uri_downloader_fetch_uri (adaptive_demux->downloader, uri, main_uri,
-      TRUE, TRUE, TRUE, err);
   if (download == NULL) {
     gchar *base_uri;
 
@@ -1625,14 +2151,7 @@ retry:
 
   m3u8 = demux->current_variant->m3u8;
 
-  /* Set the base URI of the playlist to the redirect target if any */
-  if (download->redirect_permanent && download->redirect_uri) {
-    gst_m3u8_set_uri (m3u8, download->redirect_uri, NULL,
-        demux->current_variant->name);
-  } else {
-    gst_m3u8_set_uri (m3u8, download->uri, download->redirect_uri,
-        demux->current_variant->name);
-  }
+  gst_hls_demux_set_playlist_uri (m3u8, download, demux->current_variant->name);
 
   buf = gst_fragment_get_buffer (download);
   playlist = gst_hls_src_buf_to_utf8_playlist (buf);
@@ -1653,8 +2172,11 @@ retry:
     return FALSE;
   }
 
+  /* the variant can be switched while a blocking reload of one of its
+   * renditions is waiting, the ref keeps its media lists around */
+  variant = gst_hls_variant_stream_ref (demux->current_variant);
   for (i = 0; i < GST_HLS_N_MEDIA_TYPES; ++i) {
-    GList *mlist = demux->current_variant->media[i];
+    GList *mlist = variant->media[i];
 
     while (mlist != NULL) {
       GstHLSMedia *media = mlist->data;
@@ -1669,16 +2191,27 @@ retry:
           "Updating playlist for media of type %d - %s, uri: %s", i,
           media->name, media->uri);
 
-      if (!gst_hls_demux_update_rendition_manifest (demux, media, err))
+      if (!gst_hls_demux_update_rendition_manifest (demux, variant, media,
+              blocking, err)) {
+        gst_hls_variant_stream_unref (variant);
         return FALSE;
+      }
+
+      if (demux->current_variant != variant) {
+        gst_hls_variant_stream_unref (variant);
+        return TRUE;
+      }
 
       mlist = mlist->next;
     }
   }
+  gst_hls_variant_stream_unref (variant);
 
   /* If it's a live source, do not let the sequence number go beyond
-   * three fragments before the end of the list */
-  if (update == FALSE && gst_m3u8_is_live (m3u8)) {
+   * three fragments before the end of the list. Low-latency playback
+   * starts PART-HOLD-BACK from the end instead */
+  if (update == FALSE && gst_m3u8_is_live (m3u8)
+      && !gst_m3u8_is_low_latency (m3u8)) {
     gint64 last_sequence, first_sequence;
 
     GST_M3U8_CLIENT_LOCK (demux->client);
@@ -1788,7 +2321,7 @@ retry_failover_protection:
   GST_INFO_OBJECT (demux, "Client was on %dbps, max allowed is %dbps, switching"
       " to bitrate %dbps", old_bandwidth, max_bitrate, new_bandwidth);
 
-  if (gst_hls_demux_update_playlist (demux, TRUE, NULL)) {
+  if (gst_hls_demux_update_playlist (demux, TRUE, FALSE, NULL)) {
     const gchar *main_uri;
     gchar *uri;
 
@@ -2048,8 +2581,21 @@ gst_hls_demux_get_manifest_update_interval (GstAdaptiveDemux * demux)
   GstClockTime target_duration;
 
   if (hlsdemux->current_variant) {
-    target_duration =
-        gst_m3u8_get_target_duration (hlsdemux->current_variant->m3u8);
+    GstM3U8 *m3u8 = hlsdemux->current_variant->m3u8;
+    gint64 msn;
+    gint part;
+
+    target_duration = gst_m3u8_get_target_duration (m3u8);
+
+    if (gst_m3u8_is_low_latency (m3u8)) {
+      /* A blocking reload only returns once there is a new part, the next
+       * one can be issued right away unless the server didn't wait */
+      if (gst_m3u8_get_blocking_reload_position (m3u8, &msn, &part)
+          && (msn != hlsdemux->reload_msn || part != hlsdemux->reload_part))
+        return 0;
+
+      target_duration = gst_m3u8_get_part_target (m3u8);
+    }
   } else {
     target_duration = 5 * GST_SECOND;
   }
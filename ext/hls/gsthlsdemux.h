@@ -114,6 +114,15 @@ struct _GstHLSDemuxStream
   gchar     *current_key;
   guint8    *current_iv;
 
+  /* Decryption worker: encrypted data is handed over in large blocks and
+   * decrypted in order on a separate thread while the download goes on.
+   * decrypt_jobs holds the GstHLSDecryptJob in submission order, protected
+   * by decrypt_lock */
+  GThreadPool *decrypt_pool;
+  GQueue       decrypt_jobs;
+  GMutex       decrypt_lock;
+  GCond        decrypt_cond;
+
   /* Accumulator for reading PAT/PMT/PCR from
    * the stream so we can set timestamps/segments
    * and switch cleanly */
@@ -137,9 +146,18 @@ struct _GstHLSDemux
 
   gint srcpad_counter;
 
-  /* Decryption key cache: url => GstHLSKey */
+  /* Decryption key cache: url => GstHLSKey, or NULL while the key is being
+   * downloaded. keys_cond is signalled when a download finishes, and when
+   * keys_flushing is set to stop the prefetches waiting for one */
   GHashTable *keys;
   GMutex      keys_lock;
+  GCond       keys_cond;
+  gboolean    keys_flushing;
+
+  /* Keys of upcoming fragments are fetched ahead of time on key_pool, with
+   * their own downloader */
+  GThreadPool      *key_pool;
+  GstUriDownloader *key_downloader;
 
   /* FIXME: check locking, protected automatically by manifest_lock already? */
   /* The master playlist with the available variant streams */
@@ -149,6 +167,11 @@ struct _GstHLSDemux
   /* The previous variant, used to transition streams over */
   GstHLSVariantStream  *previous_variant;
 
+  /* Low-latency delivery directive the current variant playlist was last
+   * requested with, -1 if none */
+  gint64 reload_msn;
+  gint   reload_part;
+
   gboolean streams_aware;
 };
 
@@ -34,6 +34,8 @@
 static GstM3U8MediaFile *gst_m3u8_media_file_new (gchar * uri,
     gchar * title, GstClockTime duration, guint sequence);
 static void gst_m3u8_init_file_unref (GstM3U8InitFile * self);
+static void gst_m3u8_partial_segment_unref (GstM3U8PartialSegment * self);
+static void gst_m3u8_rendition_report_free (GstM3U8RenditionReport * report);
 static gchar *uri_join (const gchar * uri, const gchar * path);
 
 GstM3U8 *
@@ -49,6 +51,8 @@ gst_m3u8_new (void)
   m3u8->sequence_position = 0;
   m3u8->highest_sequence_number = -1;
   m3u8->duration = GST_CLOCK_TIME_NONE;
+  m3u8->part_hold_back = GST_CLOCK_TIME_NONE;
+  m3u8->part = -1;
 
   g_mutex_init (&m3u8->lock);
   m3u8->ref_count = 1;
@@ -108,7 +112,13 @@ gst_m3u8_unref (GstM3U8 * self)
     g_list_foreach (self->files, (GFunc) gst_m3u8_media_file_unref, NULL);
     g_list_free (self->files);
 
-    g_free (self->last_data);
+    if (self->partial_file)
+      gst_m3u8_media_file_unref (self->partial_file);
+    if (self->preload_hint)
+      gst_m3u8_partial_segment_unref (self->preload_hint);
+    g_list_free_full (self->rendition_reports,
+        (GDestroyNotify) gst_m3u8_rendition_report_free);
+
     g_mutex_clear (&self->lock);
     g_free (self);
   }
@@ -147,6 +157,8 @@ gst_m3u8_media_file_unref (GstM3U8MediaFile * self)
   if (g_atomic_int_dec_and_test (&self->ref_count)) {
     if (self->init_file)
       gst_m3u8_init_file_unref (self->init_file);
+    if (self->partial_segments)
+      g_ptr_array_unref (self->partial_segments);
     g_free (self->title);
     g_free (self->uri);
     g_free (self->key);
@@ -186,6 +198,47 @@ gst_m3u8_init_file_unref (GstM3U8InitFile * self)
   }
 }
 
+static GstM3U8PartialSegment *
+gst_m3u8_partial_segment_new (gchar * uri, GstClockTime duration)
+{
+  GstM3U8PartialSegment *part;
+
+  part = g_new0 (GstM3U8PartialSegment, 1);
+  part->uri = uri;
+  part->duration = duration;
+  part->size = -1;
+  part->ref_count = 1;
+
+  return part;
+}
+
+static GstM3U8PartialSegment *
+gst_m3u8_partial_segment_ref (GstM3U8PartialSegment * part)
+{
+  g_assert (part != NULL && part->ref_count > 0);
+
+  g_atomic_int_add (&part->ref_count, 1);
+  return part;
+}
+
+static void
+gst_m3u8_partial_segment_unref (GstM3U8PartialSegment * self)
+{
+  g_return_if_fail (self != NULL && self->ref_count > 0);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count)) {
+    g_free (self->uri);
+    g_free (self);
+  }
+}
+
+static void
+gst_m3u8_rendition_report_free (GstM3U8RenditionReport * report)
+{
+  g_free (report->uri);
+  g_free (report);
+}
+
 static gboolean
 int_from_string (gchar * ptr, gchar ** endptr, gint * val)
 {
@@ -391,7 +444,8 @@ check_media_seqnums (GstM3U8 * self, GList * previous_files)
     f1 = l->data;
     f2 = m->data;
 
-    if (f1->sequence == f2->sequence && !g_str_equal (f1->uri, f2->uri)) {
+    if (f1->sequence == f2->sequence && f1 != f2
+        && !g_str_equal (f1->uri, f2->uri)) {
       /* Same sequence, different URI. This is bad! */
       GST_ERROR ("Media URIs inconsistent (sequence %" G_GINT64_FORMAT
           "): had '%s', got '%s'", f1->sequence, f2->uri, f1->uri);
@@ -476,6 +530,87 @@ generate_media_seqnums (GstM3U8 * self, GList * previous_files)
   }
 }
 
+/* FNV-1a, to tell if a playlist changed without keeping a copy of it */
+static guint64
+m3u8_data_hash (const gchar * data, gsize * len)
+{
+  const guchar *p = (const guchar *) data;
+  guint64 hash = G_GUINT64_CONSTANT (0xcbf29ce484222325);
+
+  while (*p) {
+    hash ^= *p++;
+    hash *= G_GUINT64_CONSTANT (0x100000001b3);
+  }
+  *len = p - (const guchar *) data;
+
+  return hash;
+}
+
+/* Whether @file, from the previous update, is the segment at @uri as
+ * written in the playlist. Segments don't change once they are listed, so
+ * it can then be kept instead of parsing the entry again */
+static gboolean
+m3u8_media_file_matches (GstM3U8MediaFile * file, const gchar * uri)
+{
+  gsize len = strlen (file->uri), uri_len = strlen (uri);
+
+  if (uri_len > len || strcmp (file->uri + len - uri_len, uri) != 0)
+    return FALSE;
+
+  /* relative URIs must match whole path components */
+  return uri_len == len || file->uri[len - uri_len - 1] == '/';
+}
+
+/* call with M3U8_LOCK held. Low-latency playlists are joined PART-HOLD-BACK
+ * from the end of their parts, at a part the decoder can start from (6.3.3
+ * of the HLS draft). Returns FALSE if there aren't enough parts for that */
+static gboolean
+m3u8_set_low_latency_start (GstM3U8 * self)
+{
+  GList *walk = g_list_last (self->files);
+  GstM3U8MediaFile *file = self->partial_file;
+  GstClockTime hold_back, end, distance = 0;
+  gint i;
+
+  if (self->part_target == 0)
+    return FALSE;
+
+  hold_back = GST_CLOCK_TIME_IS_VALID (self->part_hold_back) ?
+      self->part_hold_back : 3 * self->part_target;
+  end = self->last_file_end + (file ? file->duration : 0);
+
+  if (file == NULL) {
+    file = walk->data;
+    walk = walk->prev;
+  }
+
+  while (file) {
+    /* the parts of an encrypted segment can't be decrypted on their own */
+    if (file->partial_segments == NULL || file->key)
+      return FALSE;
+
+    for (i = file->partial_segments->len - 1; i >= 0; i--) {
+      GstM3U8PartialSegment *part =
+          g_ptr_array_index (file->partial_segments, i);
+
+      distance += part->duration;
+      /* segments start with a part that is independent */
+      if (distance >= hold_back && (part->independent || i == 0)) {
+        self->current_file = NULL;
+        self->sequence = file->sequence;
+        self->part = i;
+        self->sequence_position = end > distance ? end - distance : 0;
+        return TRUE;
+      }
+    }
+
+    file = walk ? walk->data : NULL;
+    walk = walk ? walk->prev : NULL;
+  }
+
+  return FALSE;
+}
+
 /*
  * @data: a m3u8 playlist text data, taking ownership
  */
@@ -491,9 +626,13 @@ gst_m3u8_update (GstM3U8 * self, gchar * data)
   guint8 iv[16] = { 0, };
   gint64 size = -1, offset = -1;
   gint64 mediasequence;
-  GList *previous_files = NULL;
+  GList *previous_files = NULL, *previous = NULL;
   gboolean have_mediasequence = FALSE;
+  gchar *playlist_data = data;
+  guint64 data_hash;
+  gsize data_len;
   GstM3U8InitFile *last_init_file = NULL;
+  GPtrArray *parts = NULL;
 
   g_return_val_if_fail (self != NULL, FALSE);
   g_return_val_if_fail (data != NULL, FALSE);
@@ -501,7 +640,8 @@ gst_m3u8_update (GstM3U8 * self, gchar * data)
   GST_M3U8_LOCK (self);
 
   /* check if the data changed since last update */
-  if (self->last_data && g_str_equal (self->last_data, data)) {
+  data_hash = m3u8_data_hash (data, &data_len);
+  if (self->last_data_len == data_len && self->last_data_hash == data_hash) {
     GST_DEBUG ("Playlist is the same as previous one");
     g_free (data);
     GST_M3U8_UNLOCK (self);
@@ -523,11 +663,8 @@ gst_m3u8_update (GstM3U8 * self, gchar * data)
 
   GST_TRACE ("data:\n%s", data);
 
-  g_free (self->last_data);
-  self->last_data = data;
-
   self->current_file = NULL;
-  previous_files = self->files;
+  previous_files = previous = self->files;
   self->files = NULL;
   self->duration = GST_CLOCK_TIME_NONE;
   mediasequence = 0;
@@ -535,6 +672,15 @@ gst_m3u8_update (GstM3U8 * self, gchar * data)
   /* By default, allow caching */
   self->allowcache = TRUE;
 
+  self->part_target = 0;
+  self->can_block_reload = FALSE;
+  self->part_hold_back = GST_CLOCK_TIME_NONE;
+  g_clear_pointer (&self->partial_file, gst_m3u8_media_file_unref);
+  g_clear_pointer (&self->preload_hint, gst_m3u8_partial_segment_unref);
+  g_list_free_full (self->rendition_reports,
+      (GDestroyNotify) gst_m3u8_rendition_report_free);
+  self->rendition_reports = NULL;
+
   duration = 0;
   title = NULL;
   data += 7;
@@ -555,6 +701,34 @@ gst_m3u8_update (GstM3U8 * self, gchar * data)
         goto next_line;
       }
 
+      /* With a MEDIA-SEQUENCE, the segments known from the previous update
+       * are found in order as we go, and kept as they are */
+      if (have_mediasequence) {
+        while (previous
+            && GST_M3U8_MEDIA_FILE (previous->data)->sequence < mediasequence)
+          previous = previous->next;
+
+        if (previous
+            && GST_M3U8_MEDIA_FILE (previous->data)->sequence == mediasequence
+            && GST_M3U8_MEDIA_FILE (previous->data)->discont == discontinuity
+            && m3u8_media_file_matches (previous->data, data)) {
+          self->files = g_list_prepend (self->files,
+              gst_m3u8_media_file_ref (previous->data));
+          mediasequence++;
+
+          duration = 0;
+          g_free (title);
+          title = NULL;
+          discontinuity = FALSE;
+          size = offset = -1;
+          if (parts) {
+            g_ptr_array_unref (parts);
+            parts = NULL;
+          }
+          goto next_line;
+        }
+      }
+
       data = uri_join (self->base_uri ? self->base_uri : self->uri, data);
       if (data != NULL) {
         GstM3U8MediaFile *file;
@@ -594,6 +768,10 @@ gst_m3u8_update (GstM3U8 * self, gchar * data)
         if (last_init_file)
           file->init_file = gst_m3u8_init_file_ref (last_init_file);
 
+        /* the EXT-X-PART tags before a segment are its parts */
+        file->partial_segments = parts;
+        parts = NULL;
+
         duration = 0;
         title = NULL;
         discontinuity = FALSE;
@@ -751,6 +929,150 @@ gst_m3u8_update (GstM3U8 * self, gchar * data)
 
           last_init_file = init_file;
         }
+      } else if (g_str_has_prefix (data_ext_x, "PART-INF:")) {
+        gchar *v, *a;
+        gdouble fval;
+
+        data = data + 16;
+
+        while (data != NULL && parse_attributes (&data, &a, &v)) {
+          if (g_str_equal (a, "PART-TARGET")
+              && double_from_string (v, NULL, &fval))
+            self->part_target = fval * (gdouble) GST_SECOND;
+        }
+      } else if (g_str_has_prefix (data_ext_x, "PART:")) {
+        GstM3U8PartialSegment *part;
+        gchar *v, *a, *part_uri = NULL;
+        gdouble part_duration = -1;
+        gboolean independent = FALSE;
+        gint64 part_size = -1, part_offset = -1;
+
+        data = data + 12;
+
+        while (data != NULL && parse_attributes (&data, &a, &v)) {
+          if (g_str_equal (a, "URI")) {
+            g_free (part_uri);
+            part_uri =
+                uri_join (self->base_uri ? self->base_uri : self->uri, v);
+          } else if (g_str_equal (a, "DURATION")) {
+            if (!double_from_string (v, NULL, &part_duration))
+              part_duration = -1;
+          } else if (g_str_equal (a, "INDEPENDENT")) {
+            independent = g_str_equal (v, "YES");
+          } else if (g_str_equal (a, "BYTERANGE")) {
+            if (!int64_from_string (v, &v, &part_size))
+              part_size = -1;
+            else if (*v == '@' && !int64_from_string (v + 1, &v, &part_offset))
+              part_offset = -1;
+          }
+        }
+
+        if (part_uri == NULL || part_duration < 0) {
+          GST_WARNING ("Invalid EXT-X-PART, ignoring");
+          g_free (part_uri);
+          goto next_line;
+        }
+
+        part = gst_m3u8_partial_segment_new (part_uri,
+            part_duration * (gdouble) GST_SECOND);
+        part->independent = independent;
+        if (part_size != -1) {
+          part->size = part_size;
+          if (part_offset == -1) {
+            GstM3U8PartialSegment *prev =
+                parts ? g_ptr_array_index (parts, parts->len - 1) : NULL;
+
+            /* the range continues the previous part of the same resource */
+            if (prev && prev->size != -1 && g_str_equal (prev->uri, part_uri))
+              part_offset = prev->offset + prev->size;
+            else
+              part_offset = 0;
+          }
+          part->offset = part_offset;
+        }
+
+        if (parts == NULL)
+          parts = g_ptr_array_new_with_free_func ((GDestroyNotify)
+              gst_m3u8_partial_segment_unref);
+        g_ptr_array_add (parts, part);
+      } else if (g_str_has_prefix (data_ext_x, "SERVER-CONTROL:")) {
+        gchar *v, *a;
+        gdouble fval;
+
+        data = data + 22;
+
+        while (data != NULL && parse_attributes (&data, &a, &v)) {
+          if (g_str_equal (a, "CAN-BLOCK-RELOAD")) {
+            self->can_block_reload = g_str_equal (v, "YES");
+          } else if (g_str_equal (a, "PART-HOLD-BACK")
+              && double_from_string (v, NULL, &fval)) {
+            self->part_hold_back = fval * (gdouble) GST_SECOND;
+          }
+        }
+      } else if (g_str_has_prefix (data_ext_x, "PRELOAD-HINT:")) {
+        gchar *v, *a, *hint_uri = NULL;
+        gboolean is_part = FALSE;
+        gint64 hint_offset = 0, hint_size = -1;
+
+        data = data + 20;
+
+        while (data != NULL && parse_attributes (&data, &a, &v)) {
+          if (g_str_equal (a, "TYPE")) {
+            is_part = g_str_equal (v, "PART");
+          } else if (g_str_equal (a, "URI")) {
+            g_free (hint_uri);
+            hint_uri =
+                uri_join (self->base_uri ? self->base_uri : self->uri, v);
+          } else if (g_str_equal (a, "BYTERANGE-START")) {
+            if (!int64_from_string (v, NULL, &hint_offset))
+              hint_offset = 0;
+          } else if (g_str_equal (a, "BYTERANGE-LENGTH")) {
+            if (!int64_from_string (v, NULL, &hint_size))
+              hint_size = -1;
+          }
+        }
+
+        /* hints for the next EXT-X-MAP aren't of any use to us */
+        if (is_part && hint_uri) {
+          if (self->preload_hint)
+            gst_m3u8_partial_segment_unref (self->preload_hint);
+          self->preload_hint =
+              gst_m3u8_partial_segment_new (hint_uri, GST_CLOCK_TIME_NONE);
+          self->preload_hint->offset = hint_offset;
+          self->preload_hint->size = hint_size;
+        } else {
+          g_free (hint_uri);
+        }
+      } else if (g_str_has_prefix (data_ext_x, "RENDITION-REPORT:")) {
+        GstM3U8RenditionReport *report;
+        gchar *v, *a;
+
+        report = g_new0 (GstM3U8RenditionReport, 1);
+        report->last_msn = -1;
+        report->last_part = -1;
+
+        data = data + 24;
+
+        while (data != NULL && parse_attributes (&data, &a, &v)) {
+          if (g_str_equal (a, "URI")) {
+            g_free (report->uri);
+            report->uri =
+                uri_join (self->base_uri ? self->base_uri : self->uri, v);
+          } else if (g_str_equal (a, "LAST-MSN")) {
+            if (!int64_from_string (v, NULL, &report->last_msn))
+              report->last_msn = -1;
+          } else if (g_str_equal (a, "LAST-PART")) {
+            if (!int_from_string (v, NULL, &report->last_part))
+              report->last_part = -1;
+          }
+        }
+
+        if (report->uri) {
+          self->rendition_reports =
+              g_list_prepend (self->rendition_reports, report);
+        } else {
+          gst_m3u8_rendition_report_free (report);
+        }
       } else {
         GST_LOG ("Ignored line: %s", data);
       }
@@ -764,6 +1086,31 @@ gst_m3u8_update (GstM3U8 * self, gchar * data)
     data = g_utf8_next_char (end);      /* skip \n */
   }
 
+  g_free (playlist_data);
+
+  if (parts) {
+    GstM3U8MediaFile *file;
+    guint i;
+
+    /* The parts after the last complete segment. This one only gets a
+     * sequence number once the complete ones are numbered, and isn't part
+     * of the files as it has no URI of its own */
+    file = gst_m3u8_media_file_new (NULL, NULL, 0, 0);
+    for (i = 0; i < parts->len; i++)
+      file->duration +=
+          ((GstM3U8PartialSegment *) g_ptr_array_index (parts, i))->duration;
+    file->key = current_key ? g_strdup (current_key) : NULL;
+    if (file->key && have_iv)
+      memcpy (file->iv, iv, sizeof (iv));
+    file->size = -1;
+    file->discont = discontinuity;
+    if (last_init_file)
+      file->init_file = gst_m3u8_init_file_ref (last_init_file);
+    file->partial_segments = parts;
+    parts = NULL;
+    self->partial_file = file;
+  }
+
   g_free (current_key);
   current_key = NULL;
 
@@ -798,6 +1145,21 @@ gst_m3u8_update (GstM3U8 * self, gchar * data)
     return FALSE;
   }
 
+  /* the segment in progress and the preload hint come right after the last
+   * complete segment */
+  mediasequence =
+      GST_M3U8_MEDIA_FILE (g_list_last (self->files)->data)->sequence + 1;
+  if (self->partial_file) {
+    self->partial_file->sequence = mediasequence;
+    if (self->partial_file->key && !have_iv)
+      GST_WRITE_UINT32_BE (self->partial_file->iv + 12, mediasequence);
+  }
+  if (self->preload_hint) {
+    self->preload_hint_sequence = mediasequence;
+    self->preload_hint_part = self->partial_file ?
+        self->partial_file->partial_segments->len : 0;
+  }
+
   /* calculate the start and end times of this media playlist. */
   {
     GList *walk;
@@ -845,7 +1207,11 @@ gst_m3u8_update (GstM3U8 * self, gchar * data)
   }
 
   /* first-time setup */
-  if (self->files && self->sequence == -1) {
+  if (self->files && self->sequence == -1 && GST_M3U8_IS_LIVE (self)
+      && m3u8_set_low_latency_start (self)) {
+    GST_DEBUG ("first sequence: %u, part %d", (guint) self->sequence,
+        self->part);
+  } else if (self->files && self->sequence == -1) {
     GList *file;
 
     if (GST_M3U8_IS_LIVE (self)) {
@@ -877,6 +1243,9 @@ gst_m3u8_update (GstM3U8 * self, gchar * data)
     GST_DEBUG ("first sequence: %u", (guint) self->sequence);
   }
 
+  self->last_data_hash = data_hash;
+  self->last_data_len = data_len;
+
   GST_LOG ("processed media playlist %s, %u fragments", self->name,
       g_list_length (self->files));
 
@@ -917,6 +1286,116 @@ m3u8_find_next_fragment (GstM3U8 * m3u8, gboolean forward)
   return l;
 }
 
+/* call with M3U8_LOCK held */
+static GstM3U8MediaFile *
+m3u8_find_file_by_sequence (GstM3U8 * m3u8, gint64 sequence)
+{
+  GList *l;
+
+  if (m3u8->partial_file && m3u8->partial_file->sequence == sequence)
+    return m3u8->partial_file;
+
+  for (l = m3u8->files; l; l = l->next) {
+    if (GST_M3U8_MEDIA_FILE (l->data)->sequence == sequence)
+      return l->data;
+  }
+
+  return NULL;
+}
+
+/* call with M3U8_LOCK held. Returns part @index of segment @sequence, or
+ * the preload hint if it is the one for it. A complete segment with less
+ * parts than that is followed by the first part of the next segment, in
+ * which case @sequence and @index are updated. @parent is set to the
+ * segment of the part, NULL if there is only a hint for it so far */
+static GstM3U8PartialSegment *
+m3u8_find_part (GstM3U8 * m3u8, gint64 * sequence, gint * index,
+    GstM3U8MediaFile ** parent)
+{
+  GstM3U8MediaFile *file;
+
+  while ((file = m3u8_find_file_by_sequence (m3u8, *sequence))) {
+    if (file->partial_segments &&
+        (guint) * index < file->partial_segments->len)
+      break;
+
+    if (file == m3u8->partial_file || file->partial_segments == NULL)
+      break;
+
+    *sequence += 1;
+    *index = 0;
+  }
+
+  *parent = file;
+
+  if (file && file->partial_segments &&
+      (guint) * index < file->partial_segments->len)
+    return g_ptr_array_index (file->partial_segments, *index);
+
+  if (m3u8->preload_hint && *sequence == m3u8->preload_hint_sequence &&
+      *index == m3u8->preload_hint_part)
+    return m3u8->preload_hint;
+
+  return NULL;
+}
+
+/* call with M3U8_LOCK held. Returns the part @n positions after the
+ * current one, with @sequence and @index set to where it is */
+static GstM3U8PartialSegment *
+m3u8_peek_part (GstM3U8 * m3u8, guint n, gint64 * sequence, gint * index,
+    GstM3U8MediaFile ** parent)
+{
+  GstM3U8PartialSegment *part;
+
+  *sequence = m3u8->sequence;
+  *index = m3u8->part;
+
+  part = m3u8_find_part (m3u8, sequence, index, parent);
+  while (part && n-- > 0) {
+    *index += 1;
+    part = m3u8_find_part (m3u8, sequence, index, parent);
+  }
+
+  return part;
+}
+
+/* call with M3U8_LOCK held. Parts are handed out as fragments of their
+ * own, which share the initialization and discontinuity of their segment */
+static GstM3U8MediaFile *
+m3u8_media_file_new_for_part (GstM3U8 * m3u8, GstM3U8PartialSegment * part,
+    gint64 sequence, gint index, GstM3U8MediaFile * parent)
+{
+  GstM3U8MediaFile *file;
+  GstM3U8MediaFile *last = g_list_last (m3u8->files)->data;
+
+  file = gst_m3u8_media_file_new (g_strdup (part->uri), NULL,
+      GST_CLOCK_TIME_IS_VALID (part->duration) ? part->duration :
+      m3u8->part_target, sequence);
+  file->offset = part->offset;
+  file->size = part->size;
+  file->incomplete = (part == m3u8->preload_hint);
+  file->discont = parent && parent->discont && index == 0;
+
+  /* a hinted segment will most likely use the same initialization as the
+   * last one */
+  if (parent == NULL)
+    parent = last;
+  if (parent->init_file)
+    file->init_file = gst_m3u8_init_file_ref (parent->init_file);
+
+  return file;
+}
+
+/* call with M3U8_LOCK held */
+static gboolean
+m3u8_part_is_pending (GstM3U8 * m3u8)
+{
+  GstM3U8MediaFile *last = g_list_last (m3u8->files)->data;
+
+  /* past the complete segments, the part just isn't out yet */
+  return m3u8->sequence > last->sequence;
+}
+
 GstM3U8MediaFile *
 gst_m3u8_get_next_fragment (GstM3U8 * m3u8, gboolean forward,
     GstClockTime * sequence_position, gboolean * discont)
@@ -932,6 +1411,36 @@ gst_m3u8_get_next_fragment (GstM3U8 * m3u8, gboolean forward,
   if (m3u8->sequence < 0)       /* can't happen really */
     goto out;
 
+  if (m3u8->part >= 0 && forward && m3u8->files) {
+    GstM3U8PartialSegment *part;
+    GstM3U8MediaFile *parent;
+
+    part = m3u8_find_part (m3u8, &m3u8->sequence, &m3u8->part, &parent);
+    if (part) {
+      file = m3u8_media_file_new_for_part (m3u8, part, m3u8->sequence,
+          m3u8->part, parent);
+
+      GST_DEBUG ("Got part %d of sequence %u", m3u8->part,
+          (guint) file->sequence);
+
+      if (sequence_position)
+        *sequence_position = m3u8->sequence_position;
+      if (discont)
+        *discont = file->discont;
+
+      m3u8->current_file_duration = file->duration;
+      goto out;
+    }
+
+    if (m3u8_part_is_pending (m3u8))
+      goto out;
+
+    /* the segment is complete but wasn't listed as parts, or it expired */
+    GST_DEBUG ("No parts for sequence %u, using whole segments",
+        (guint) m3u8->sequence);
+    m3u8->part = -1;
+  }
+
   if (m3u8->current_file == NULL)
     m3u8->current_file = m3u8_find_next_fragment (m3u8, forward);
 
@@ -958,6 +1467,49 @@ out:
   return file;
 }
 
+/* Returns the fragment @n positions after the current one, without
+ * advancing */
+GstM3U8MediaFile *
+gst_m3u8_peek_fragment (GstM3U8 * m3u8, gboolean forward, guint n)
+{
+  GstM3U8MediaFile *file = NULL;
+  GList *l;
+
+  g_return_val_if_fail (m3u8 != NULL, NULL);
+
+  GST_M3U8_LOCK (m3u8);
+
+  if (m3u8->part >= 0 && forward) {
+    GstM3U8PartialSegment *part;
+    GstM3U8MediaFile *parent;
+    gint64 sequence;
+    gint index;
+
+    part = m3u8_peek_part (m3u8, n, &sequence, &index, &parent);
+    if (part)
+      file = m3u8_media_file_new_for_part (m3u8, part, sequence, index,
+          parent);
+    goto out;
+  }
+
+  if (m3u8->current_file) {
+    l = m3u8->current_file;
+  } else {
+    l = m3u8_find_next_fragment (m3u8, forward);
+  }
+
+  while (l && n-- > 0)
+    l = forward ? l->next : l->prev;
+
+  if (l)
+    file = gst_m3u8_media_file_ref (l->data);
+
+out:
+  GST_M3U8_UNLOCK (m3u8);
+
+  return file;
+}
+
 gboolean
 gst_m3u8_has_next_fragment (GstM3U8 * m3u8, gboolean forward)
 {
@@ -971,6 +1523,15 @@ gst_m3u8_has_next_fragment (GstM3U8 * m3u8, gboolean forward)
   GST_DEBUG ("Checking next fragment %" G_GINT64_FORMAT,
       m3u8->sequence + (forward ? 1 : -1));
 
+  if (m3u8->part >= 0 && forward) {
+    GstM3U8MediaFile *parent;
+    gint64 sequence;
+    gint index;
+
+    have_next = m3u8_peek_part (m3u8, 1, &sequence, &index, &parent) != NULL;
+    goto out;
+  }
+
   if (m3u8->current_file) {
     cur = m3u8->current_file;
   } else {
@@ -979,6 +1540,7 @@ gst_m3u8_has_next_fragment (GstM3U8 * m3u8, gboolean forward)
 
   have_next = cur && ((forward && cur->next) || (!forward && cur->prev));
 
+out:
   GST_M3U8_UNLOCK (m3u8);
 
   return have_next;
@@ -1035,6 +1597,27 @@ gst_m3u8_advance_fragment (GstM3U8 * m3u8, gboolean forward)
     GST_DEBUG ("Sequence position now %" GST_TIME_FORMAT,
         GST_TIME_ARGS (m3u8->sequence_position));
   }
+  if (m3u8->part >= 0) {
+    GstM3U8PartialSegment *part;
+    GstM3U8MediaFile *parent;
+
+    if (forward) {
+      m3u8->part++;
+      /* moves on to the next segment if this one is complete */
+      part = m3u8_find_part (m3u8, &m3u8->sequence, &m3u8->part, &parent);
+      if (part && GST_CLOCK_TIME_IS_VALID (part->duration))
+        m3u8->current_file_duration = part->duration;
+      else if (part)
+        m3u8->current_file_duration = m3u8->part_target;
+      GST_DEBUG ("Advanced to part %d of sequence %u", m3u8->part,
+          (guint) m3u8->sequence);
+      goto out;
+    }
+
+    /* parts are only played forward */
+    m3u8->part = -1;
+    m3u8->current_file = NULL;
+  }
   if (!m3u8->current_file) {
     GList *l;
 
@@ -1262,6 +1845,98 @@ out:
   return (duration > 0);
 }
 
+/* Whether the fragments are the parts of a low-latency playlist */
+gboolean
+gst_m3u8_is_low_latency (GstM3U8 * m3u8)
+{
+  gboolean ret;
+
+  g_return_val_if_fail (m3u8 != NULL, FALSE);
+
+  GST_M3U8_LOCK (m3u8);
+  ret = m3u8->part >= 0;
+  GST_M3U8_UNLOCK (m3u8);
+
+  return ret;
+}
+
+GstClockTime
+gst_m3u8_get_part_target (GstM3U8 * m3u8)
+{
+  GstClockTime part_target;
+
+  g_return_val_if_fail (m3u8 != NULL, 0);
+
+  GST_M3U8_LOCK (m3u8);
+  part_target = m3u8->part_target;
+  GST_M3U8_UNLOCK (m3u8);
+
+  return part_target;
+}
+
+/* Media sequence number and part a blocking playlist reload should wait
+ * for, the ones right after what the playlist has. @part is -1 if the
+ * playlist has no parts. Returns FALSE if the server can't block */
+gboolean
+gst_m3u8_get_blocking_reload_position (GstM3U8 * m3u8, gint64 * msn,
+    gint * part)
+{
+  GstM3U8MediaFile *last;
+  gboolean ret = FALSE;
+
+  g_return_val_if_fail (m3u8 != NULL, FALSE);
+
+  GST_M3U8_LOCK (m3u8);
+
+  if (!m3u8->can_block_reload || !GST_M3U8_IS_LIVE (m3u8) || !m3u8->files)
+    goto out;
+
+  if (m3u8->partial_file) {
+    *msn = m3u8->partial_file->sequence;
+    *part = m3u8->partial_file->partial_segments->len;
+  } else {
+    last = g_list_last (m3u8->files)->data;
+    *msn = last->sequence + 1;
+    *part = m3u8->part_target > 0 ? 0 : -1;
+  }
+  ret = TRUE;
+
+out:
+  GST_M3U8_UNLOCK (m3u8);
+
+  return ret;
+}
+
+/* Last segment and part of the rendition at @uri, as reported by the
+ * EXT-X-RENDITION-REPORT of @m3u8 */
+gboolean
+gst_m3u8_get_rendition_report (GstM3U8 * m3u8, const gchar * uri,
+    gint64 * last_msn, gint * last_part)
+{
+  gboolean ret = FALSE;
+  GList *l;
+
+  g_return_val_if_fail (m3u8 != NULL, FALSE);
+  g_return_val_if_fail (uri != NULL, FALSE);
+
+  GST_M3U8_LOCK (m3u8);
+
+  for (l = m3u8->rendition_reports; l; l = l->next) {
+    GstM3U8RenditionReport *report = l->data;
+
+    if (report->last_msn >= 0 && g_str_equal (report->uri, uri)) {
+      *last_msn = report->last_msn;
+      *last_part = report->last_part;
+      ret = TRUE;
+      break;
+    }
+  }
+
+  GST_M3U8_UNLOCK (m3u8);
+
+  return ret;
+}
+
 GstHLSMedia *
 gst_hls_media_ref (GstHLSMedia * media)
 {
@@ -31,6 +31,8 @@ G_BEGIN_DECLS
 typedef struct _GstM3U8 GstM3U8;
 typedef struct _GstM3U8MediaFile GstM3U8MediaFile;
 typedef struct _GstM3U8InitFile GstM3U8InitFile;
+typedef struct _GstM3U8PartialSegment GstM3U8PartialSegment;
+typedef struct _GstM3U8RenditionReport GstM3U8RenditionReport;
 typedef struct _GstHLSMedia GstHLSMedia;
 typedef struct _GstM3U8Client GstM3U8Client;
 typedef struct _GstHLSVariantStream GstHLSVariantStream;
@@ -77,8 +79,20 @@ struct _GstM3U8
   GstClockTime duration;              /* cached total duration */
   gint discont_sequence;              /* currently expected EXT-X-DISCONTINUITY-SEQUENCE */
 
+  /* Low-latency HLS */
+  GstClockTime part_target;           /* PART-TARGET, 0 if no parts */
+  gboolean can_block_reload;          /* CAN-BLOCK-RELOAD */
+  GstClockTime part_hold_back;        /* PART-HOLD-BACK */
+  GstM3U8MediaFile *partial_file;     /* segment in progress, NULL if none */
+  GstM3U8PartialSegment *preload_hint; /* EXT-X-PRELOAD-HINT of TYPE=PART */
+  gint64 preload_hint_sequence;       /* segment and part the hint is for */
+  gint preload_hint_part;
+  GList *rendition_reports;           /* GstM3U8RenditionReport */
+  gint part;                          /* current part, -1 for whole segments */
+
   /*< private > */
-  gchar *last_data;
+  guint64 last_data_hash;       /* of the last playlist parsed, to skip */
+  gsize last_data_len;          /* updates that don't change anything */
   GMutex lock;
 
   gint ref_count;               /* ATOMIC */
@@ -101,6 +115,24 @@ struct _GstM3U8MediaFile
   gint64 offset, size;
   gint ref_count;               /* ATOMIC */
   GstM3U8InitFile *init_file;   /* Media Initialization (hold ref) */
+  GPtrArray *partial_segments;  /* EXT-X-PART of this segment, NULL if none */
+  gboolean incomplete;          /* preload hint, still being produced */
+};
+
+struct _GstM3U8PartialSegment
+{
+  gchar *uri;
+  GstClockTime duration;        /* GST_CLOCK_TIME_NONE for preload hints */
+  gint64 offset, size;
+  gboolean independent;         /* INDEPENDENT=YES */
+  gint ref_count;               /* ATOMIC */
+};
+
+struct _GstM3U8RenditionReport
+{
+  gchar *uri;
+  gint64 last_msn;
+  gint last_part;               /* -1 if not given */
 };
 
 struct _GstM3U8InitFile
@@ -129,6 +161,10 @@ GstM3U8MediaFile * gst_m3u8_get_next_fragment    (GstM3U8      * m3u8,
                                                   GstClockTime * sequence_position,
                                                   gboolean     * discont);
 
+GstM3U8MediaFile * gst_m3u8_peek_fragment        (GstM3U8      * m3u8,
+                                                  gboolean       forward,
+                                                  guint          n);
+
 gboolean           gst_m3u8_has_next_fragment    (GstM3U8 * m3u8,
                                                   gboolean  forward);
 
@@ -147,6 +183,19 @@ gboolean           gst_m3u8_get_seek_range       (GstM3U8 * m3u8,
                                                   gint64  * start,
                                                   gint64  * stop);
 
+gboolean           gst_m3u8_is_low_latency       (GstM3U8 * m3u8);
+
+GstClockTime       gst_m3u8_get_part_target      (GstM3U8 * m3u8);
+
+gboolean           gst_m3u8_get_blocking_reload_position (GstM3U8 * m3u8,
+                                                  gint64  * msn,
+                                                  gint    * part);
+
+gboolean           gst_m3u8_get_rendition_report (GstM3U8     * m3u8,
+                                                  const gchar * uri,
+                                                  gint64      * last_msn,
+                                                  gint        * last_part);
+
 typedef enum
 {
   GST_HLS_MEDIA_TYPE_INVALID = -1,
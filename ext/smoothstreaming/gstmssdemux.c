@@ -131,8 +131,13 @@ static GstFlowReturn
 gst_mss_demux_stream_advance_fragment (GstAdaptiveDemuxStream * stream);
 static gboolean gst_mss_demux_stream_select_bitrate (GstAdaptiveDemuxStream *
     stream, guint64 bitrate);
+static GArray *gst_mss_demux_stream_get_bitrates (GstAdaptiveDemuxStream *
+    stream);
 static GstFlowReturn
 gst_mss_demux_stream_update_fragment_info (GstAdaptiveDemuxStream * stream);
+static GstFlowReturn
+gst_mss_demux_stream_peek_fragment (GstAdaptiveDemuxStream * stream, guint n,
+    GstAdaptiveDemuxStreamFragment * fragment);
 static gboolean gst_mss_demux_seek (GstAdaptiveDemux * demux, GstEvent * seek);
 static gint64
 gst_mss_demux_get_manifest_update_interval (GstAdaptiveDemux * demux);
@@ -198,8 +203,12 @@ gst_mss_demux_class_init (GstMssDemuxClass * klass)
       gst_mss_demux_stream_has_next_fragment;
   gstadaptivedemux_class->stream_select_bitrate =
       gst_mss_demux_stream_select_bitrate;
+  gstadaptivedemux_class->stream_get_bitrates =
+      gst_mss_demux_stream_get_bitrates;
   gstadaptivedemux_class->stream_update_fragment_info =
       gst_mss_demux_stream_update_fragment_info;
+  gstadaptivedemux_class->stream_peek_fragment =
+      gst_mss_demux_stream_peek_fragment;
   gstadaptivedemux_class->stream_get_fragment_waiting_time =
       gst_mss_demux_stream_get_fragment_waiting_time;
   gstadaptivedemux_class->update_manifest_data =
@@ -321,6 +330,25 @@ gst_mss_demux_stream_update_fragment_info (GstAdaptiveDemuxStream * stream)
   return ret;
 }
 
+static GstFlowReturn
+gst_mss_demux_stream_peek_fragment (GstAdaptiveDemuxStream * stream, guint n,
+    GstAdaptiveDemuxStreamFragment * fragment)
+{
+  GstMssDemuxStream *mssstream = (GstMssDemuxStream *) stream;
+  GstMssDemux *mssdemux = GST_MSS_DEMUX_CAST (stream->demux);
+  GstFlowReturn ret;
+  gchar *path = NULL;
+
+  ret = gst_mss_stream_peek_fragment (mssstream->manifest_stream, n, &path,
+      &fragment->duration);
+
+  if (ret == GST_FLOW_OK)
+    fragment->uri = g_strdup_printf ("%s/%s", mssdemux->base_url, path);
+  g_free (path);
+
+  return ret;
+}
+
 static GstFlowReturn
 gst_mss_demux_stream_seek (GstAdaptiveDemuxStream * stream, gboolean forward,
     GstSeekFlags flags, GstClockTime ts, GstClockTime * final_ts)
@@ -612,6 +640,14 @@ gst_mss_demux_stream_select_bitrate (GstAdaptiveDemuxStream * stream,
   return ret;
 }
 
+static GArray *
+gst_mss_demux_stream_get_bitrates (GstAdaptiveDemuxStream * stream)
+{
+  GstMssDemuxStream *mssstream = (GstMssDemuxStream *) stream;
+
+  return gst_mss_stream_get_bitrates (mssstream->manifest_stream);
+}
+
 #define SEEK_UPDATES_PLAY_POSITION(r, start_type, stop_type) \
   ((r >= 0 && start_type != GST_SEEK_TYPE_NONE) || \
    (r < 0 && stop_type != GST_SEEK_TYPE_NONE))
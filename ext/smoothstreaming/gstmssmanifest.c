@@ -1050,15 +1050,34 @@ gst_mss_stream_get_caps (GstMssStream * stream)
   return caps;
 }
 
-GstFlowReturn
-gst_mss_stream_get_fragment_url (GstMssStream * stream, gchar ** url)
+static gchar *
+gst_mss_stream_build_fragment_url (GstMssStream * stream,
+    GstMssStreamFragment * fragment, guint repetition)
 {
-  gchar *tmp;
+  gchar *tmp, *url;
   gchar *start_time_str;
   guint64 time;
-  GstMssStreamFragment *fragment;
   GstMssStreamQuality *quality = stream->current_quality->data;
 
+  time = fragment->time + fragment->duration * repetition;
+  start_time_str = g_strdup_printf ("%" G_GUINT64_FORMAT, time);
+
+  tmp = g_regex_replace_literal (stream->regex_bitrate, stream->url,
+      strlen (stream->url), 0, quality->bitrate_str, 0, NULL);
+  url = g_regex_replace_literal (stream->regex_position, tmp,
+      strlen (tmp), 0, start_time_str, 0, NULL);
+
+  g_free (tmp);
+  g_free (start_time_str);
+
+  return url;
+}
+
+GstFlowReturn
+gst_mss_stream_get_fragment_url (GstMssStream * stream, gchar ** url)
+{
+  GstMssStreamFragment *fragment;
+
   g_return_val_if_fail (stream->active, GST_FLOW_ERROR);
 
   if (stream->current_fragment == NULL) /* stream is over */
@@ -1066,21 +1085,47 @@ gst_mss_stream_get_fragment_url (GstMssStream * stream, gchar ** url)
 
   fragment = stream->current_fragment->data;
 
-  time =
-      fragment->time + fragment->duration * stream->fragment_repetition_index;
-  start_time_str = g_strdup_printf ("%" G_GUINT64_FORMAT, time);
+  *url = gst_mss_stream_build_fragment_url (stream, fragment,
+      stream->fragment_repetition_index);
+  if (*url == NULL)
+    return GST_FLOW_ERROR;
 
-  tmp = g_regex_replace_literal (stream->regex_bitrate, stream->url,
-      strlen (stream->url), 0, quality->bitrate_str, 0, NULL);
-  *url = g_regex_replace_literal (stream->regex_position, tmp,
-      strlen (tmp), 0, start_time_str, 0, NULL);
+  return GST_FLOW_OK;
+}
 
-  g_free (tmp);
-  g_free (start_time_str);
+/* Gets the url and duration of the fragment @n positions after the current
+ * one, without advancing the stream */
+GstFlowReturn
+gst_mss_stream_peek_fragment (GstMssStream * stream, guint n, gchar ** url,
+    GstClockTime * duration)
+{
+  GstMssStreamFragment *fragment;
+  GList *current = stream->current_fragment;
+  guint repetition = stream->fragment_repetition_index;
+
+  g_return_val_if_fail (stream->active, GST_FLOW_ERROR);
+
+  while (current && n > 0) {
+    fragment = current->data;
+    n--;
+    if (++repetition >= fragment->repetitions) {
+      repetition = 0;
+      current = g_list_next (current);
+    }
+  }
 
+  if (current == NULL)
+    return GST_FLOW_EOS;
+
+  fragment = current->data;
+
+  *url = gst_mss_stream_build_fragment_url (stream, fragment, repetition);
   if (*url == NULL)
     return GST_FLOW_ERROR;
 
+  *duration = gst_util_uint64_scale_round (fragment->duration, GST_SECOND,
+      gst_mss_stream_get_timescale (stream));
+
   return GST_FLOW_OK;
 }
 
@@ -1426,7 +1471,7 @@ gst_mss_stream_select_bitrate (GstMssStream * stream, guint64 bitrate)
     next = g_list_next (iter);
     if (next) {
       next_q = next->data;
-      if (next_q->bitrate < bitrate) {
+      if (next_q->bitrate <= bitrate) {
         iter = next;
         q = iter->data;
       } else {
@@ -1454,6 +1499,21 @@ gst_mss_stream_get_current_bitrate (GstMssStream * stream)
   return q->bitrate;
 }
 
+GArray *
+gst_mss_stream_get_bitrates (GstMssStream * stream)
+{
+  GArray *bitrates = g_array_new (FALSE, FALSE, sizeof (guint64));
+  GList *iter;
+
+  for (iter = stream->qualities; iter; iter = g_list_next (iter)) {
+    GstMssStreamQuality *q = iter->data;
+
+    g_array_append_val (bitrates, q->bitrate);
+  }
+
+  return bitrates;
+}
+
 /**
  * gst_mss_manifest_change_bitrate:
  * @manifest: the manifest
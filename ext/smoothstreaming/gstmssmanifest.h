@@ -61,11 +61,13 @@ GstMssStreamType gst_mss_stream_get_type (GstMssStream *stream);
 GstCaps * gst_mss_stream_get_caps (GstMssStream * stream);
 gboolean gst_mss_stream_select_bitrate (GstMssStream * stream, guint64 bitrate);
 guint64 gst_mss_stream_get_current_bitrate (GstMssStream * stream);
+GArray * gst_mss_stream_get_bitrates (GstMssStream * stream);
 void gst_mss_stream_set_active (GstMssStream * stream, gboolean active);
 guint64 gst_mss_stream_get_timescale (GstMssStream * stream);
 GstFlowReturn gst_mss_stream_get_fragment_url (GstMssStream * stream, gchar ** url);
 GstClockTime gst_mss_stream_get_fragment_gst_timestamp (GstMssStream * stream);
 GstClockTime gst_mss_stream_get_fragment_gst_duration (GstMssStream * stream);
+GstFlowReturn gst_mss_stream_peek_fragment (GstMssStream * stream, guint n, gchar ** url, GstClockTime * duration);
 gboolean gst_mss_stream_has_next_fragment (GstMssStream * stream);
 GstFlowReturn gst_mss_stream_advance_fragment (GstMssStream * stream);
 GstFlowReturn gst_mss_stream_regress_fragment (GstMssStream * stream);
@@ -119,6 +119,7 @@ that the demux object and its streams are not changed by anybody else.
 #endif
 
 #include "gstadaptivedemux.h"
+#include "gstadaptivedemuxabr.h"
 #include "gst/gst-i18n-plugin.h"
 #include <gst/base/gstadapter.h>
 
@@ -130,7 +131,13 @@ GST_DEBUG_CATEGORY (adaptivedemux_debug);
 #define DEFAULT_CONNECTION_SPEED 0
 #define DEFAULT_BITRATE_LIMIT 0.8f
 #define SRC_QUEUE_MAX_BYTES 20 * 1024 * 1024    /* For safety. Large enough to hold a segment. */
-#define NUM_LOOKBACK_FRAGMENTS 3
+#define DEFAULT_ABR_ALGORITHM GST_ADAPTIVE_DEMUX_ABR_MOVING_AVERAGE
+#define DEFAULT_PREFETCH_FRAGMENTS 0
+#define MAX_PREFETCH_FRAGMENTS 16
+#define DEFAULT_PREFETCH_MAX_BYTES (32 * 1024 * 1024)
+#define DEFAULT_PREFETCH_MAX_TIME (30 * GST_SECOND)
+/* size of the buffers a prefetched fragment is handed over in */
+#define PREFETCH_CHUNK_SIZE (64 * 1024)
 
 #define GST_MANIFEST_GET_LOCK(d) (&(GST_ADAPTIVE_DEMUX_CAST(d)->priv->manifest_lock))
 #define GST_MANIFEST_LOCK(d) G_STMT_START { \
@@ -157,6 +164,10 @@ enum
   PROP_0,
   PROP_CONNECTION_SPEED,
   PROP_BITRATE_LIMIT,
+  PROP_PREFETCH_FRAGMENTS,
+  PROP_PREFETCH_MAX_BYTES,
+  PROP_PREFETCH_MAX_TIME,
+  PROP_ABR_ALGORITHM,
   PROP_LAST
 };
 
@@ -207,8 +218,34 @@ struct _GstAdaptiveDemuxPrivate
   GMutex segment_lock;
 
   GstClockTime qos_earliest_time;
+
+  /* prefetch window, protected by manifest_lock */
+  guint prefetch_fragments;
+  guint64 prefetch_max_bytes;
+  GstClockTime prefetch_max_time;
+
+  GstAdaptiveDemuxAbrAlgorithm abr_algorithm;   /* protected by manifest_lock */
 };
 
+/* A fragment downloaded ahead of time in a stream's prefetch_pool */
+typedef struct _GstAdaptiveDemuxPrefetch
+{
+  gint ref_count;
+
+  gchar *uri;
+  gint64 range_start;
+  gint64 range_end;
+  GstClockTime duration;
+
+  /* protected by the stream's prefetch_lock */
+  GstUriDownloader *downloader; /* set while downloading */
+  gboolean cancelled;
+  gboolean done;
+  GstBuffer *buffer;            /* NULL if the download failed */
+  GstClockTime download_start;
+  GstClockTime download_time;
+} GstAdaptiveDemuxPrefetch;
+
 typedef struct _GstAdaptiveDemuxTimer
 {
   gint ref_count;
@@ -271,6 +308,8 @@ static gboolean gst_adaptive_demux_has_next_period (GstAdaptiveDemux * demux);
 static void gst_adaptive_demux_advance_period (GstAdaptiveDemux * demux);
 
 static void gst_adaptive_demux_stream_free (GstAdaptiveDemuxStream * stream);
+static void gst_adaptive_demux_stream_prefetch_clear (GstAdaptiveDemuxStream *
+    stream);
 static GstFlowReturn
 gst_adaptive_demux_stream_push_event (GstAdaptiveDemuxStream * stream,
     GstEvent * event);
@@ -363,6 +402,32 @@ gst_adaptive_demux_set_property (GObject * object, guint prop_id,
     case PROP_BITRATE_LIMIT:
       demux->bitrate_limit = g_value_get_float (value);
       break;
+    case PROP_PREFETCH_FRAGMENTS:
+      demux->priv->prefetch_fragments = g_value_get_uint (value);
+      break;
+    case PROP_PREFETCH_MAX_BYTES:
+      demux->priv->prefetch_max_bytes = g_value_get_uint64 (value);
+      break;
+    case PROP_PREFETCH_MAX_TIME:
+      demux->priv->prefetch_max_time = g_value_get_uint64 (value);
+      break;
+    case PROP_ABR_ALGORITHM:{
+      GList *lists[] =
+          { demux->streams, demux->prepared_streams, demux->next_streams };
+      GList *iter;
+      gint i;
+
+      demux->priv->abr_algorithm = g_value_get_enum (value);
+      for (i = 0; i < G_N_ELEMENTS (lists); i++) {
+        for (iter = lists[i]; iter; iter = g_list_next (iter)) {
+          GstAdaptiveDemuxStream *stream = iter->data;
+
+          gst_adaptive_demux_abr_set_algorithm (stream->abr,
+              demux->priv->abr_algorithm);
+        }
+      }
+      break;
+    }
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -387,6 +452,18 @@ gst_adaptive_demux_get_property (GObject * object, guint prop_id,
     case PROP_BITRATE_LIMIT:
       g_value_set_float (value, demux->bitrate_limit);
       break;
+    case PROP_PREFETCH_FRAGMENTS:
+      g_value_set_uint (value, demux->priv->prefetch_fragments);
+      break;
+    case PROP_PREFETCH_MAX_BYTES:
+      g_value_set_uint64 (value, demux->priv->prefetch_max_bytes);
+      break;
+    case PROP_PREFETCH_MAX_TIME:
+      g_value_set_uint64 (value, demux->priv->prefetch_max_time);
+      break;
+    case PROP_ABR_ALGORITHM:
+      g_value_set_enum (value, demux->priv->abr_algorithm);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -432,6 +509,70 @@ gst_adaptive_demux_class_init (GstAdaptiveDemuxClass * klass)
           0, 1, DEFAULT_BITRATE_LIMIT,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * GstAdaptiveDemux:prefetch-fragments:
+   *
+   * Number of fragments following the current one to download in parallel
+   * ahead of time, for each stream. Hides the request round-trip between
+   * fragments on high latency links. Prefetched fragments are still handed
+   * over in order, and the window is dropped on seeks and bitrate switches.
+   *
+   * Only used by subclasses implementing
+   * #GstAdaptiveDemuxClass.stream_peek_fragment().
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_PREFETCH_FRAGMENTS,
+      g_param_spec_uint ("prefetch-fragments", "Prefetch fragments",
+          "Number of upcoming fragments to download in advance per stream "
+          "(0 = disabled)", 0, MAX_PREFETCH_FRAGMENTS,
+          DEFAULT_PREFETCH_FRAGMENTS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstAdaptiveDemux:prefetch-max-bytes:
+   *
+   * Stop prefetching fragments of a stream once that many bytes are
+   * downloaded, or expected, ahead of the current fragment.
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_PREFETCH_MAX_BYTES,
+      g_param_spec_uint64 ("prefetch-max-bytes", "Prefetch max bytes",
+          "Maximum amount of prefetched data per stream", 0, G_MAXUINT64,
+          DEFAULT_PREFETCH_MAX_BYTES,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstAdaptiveDemux:prefetch-max-time:
+   *
+   * Stop prefetching fragments of a stream once that much media duration is
+   * prefetched ahead of the current fragment.
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_PREFETCH_MAX_TIME,
+      g_param_spec_uint64 ("prefetch-max-time", "Prefetch max time",
+          "Maximum duration of prefetched fragments per stream (in ns)",
+          0, G_MAXUINT64, DEFAULT_PREFETCH_MAX_TIME,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstAdaptiveDemux:abr-algorithm:
+   *
+   * How the bitrate of the next fragments is selected, when
+   * #GstAdaptiveDemux:connection-speed isn't set. The buffer level based
+   * algorithm needs the subclass to implement
+   * #GstAdaptiveDemuxClass.stream_get_bitrates() and otherwise behaves like
+   * the throughput based one.
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_ABR_ALGORITHM,
+      g_param_spec_enum ("abr-algorithm", "ABR algorithm",
+          "Bitrate adaptation algorithm", GST_TYPE_ADAPTIVE_DEMUX_ABR_ALGORITHM,
+          DEFAULT_ABR_ALGORITHM, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gstelement_class->change_state = gst_adaptive_demux_change_state;
 
   gstbin_class->handle_message = gst_adaptive_demux_handle_message;
@@ -522,6 +663,10 @@ gst_adaptive_demux_init (GstAdaptiveDemux * demux,
   /* Properties */
   demux->bitrate_limit = DEFAULT_BITRATE_LIMIT;
   demux->connection_speed = DEFAULT_CONNECTION_SPEED;
+  demux->priv->prefetch_fragments = DEFAULT_PREFETCH_FRAGMENTS;
+  demux->priv->prefetch_max_bytes = DEFAULT_PREFETCH_MAX_BYTES;
+  demux->priv->prefetch_max_time = DEFAULT_PREFETCH_MAX_TIME;
+  demux->priv->abr_algorithm = DEFAULT_ABR_ALGORITHM;
 
   gst_element_add_pad (GST_ELEMENT (demux), demux->sinkpad);
 }
@@ -1284,6 +1429,7 @@ gst_adaptive_demux_expose_streams (GstAdaptiveDemux * demux)
       stream->replaced = TRUE;
       g_cond_signal (&stream->fragment_download_cond);
       g_mutex_unlock (&stream->fragment_download_lock);
+      gst_adaptive_demux_stream_prefetch_clear (stream);
     }
     gst_event_unref (eos);
 
@@ -1321,8 +1467,7 @@ gst_adaptive_demux_stream_new (GstAdaptiveDemux * demux, GstPad * pad)
 
   stream->pad = pad;
   stream->demux = demux;
-  stream->fragment_bitrates =
-      g_malloc0 (sizeof (guint64) * NUM_LOOKBACK_FRAGMENTS);
+  stream->abr = gst_adaptive_demux_abr_new (demux->priv->abr_algorithm);
   gst_pad_set_element_private (pad, stream);
   stream->qos_earliest_time = GST_CLOCK_TIME_NONE;
 
@@ -1339,6 +1484,8 @@ gst_adaptive_demux_stream_new (GstAdaptiveDemux * demux, GstPad * pad)
   gst_segment_init (&stream->segment, GST_FORMAT_TIME);
   g_cond_init (&stream->fragment_download_cond);
   g_mutex_init (&stream->fragment_download_lock);
+  g_cond_init (&stream->prefetch_cond);
+  g_mutex_init (&stream->prefetch_lock);
 
   demux->next_streams = g_list_append (demux->next_streams, stream);
 
@@ -1387,6 +1534,7 @@ gst_adaptive_demux_stream_free (GstAdaptiveDemuxStream * stream)
       stream->cancelled = TRUE;
       g_cond_signal (&stream->fragment_download_cond);
       g_mutex_unlock (&stream->fragment_download_lock);
+      gst_adaptive_demux_stream_prefetch_clear (stream);
     }
     GST_LOG_OBJECT (demux, "Waiting for task to finish");
 
@@ -1403,6 +1551,21 @@ gst_adaptive_demux_stream_free (GstAdaptiveDemuxStream * stream)
     stream->download_task = NULL;
   }
 
+  if (stream->prefetch_pool) {
+    GstUriDownloader *downloader;
+
+    gst_adaptive_demux_stream_prefetch_clear (stream);
+
+    /* cancelled downloads return right away */
+    GST_MANIFEST_UNLOCK (demux);
+    g_thread_pool_free (stream->prefetch_pool, FALSE, TRUE);
+    GST_MANIFEST_LOCK (demux);
+    stream->prefetch_pool = NULL;
+
+    while ((downloader = g_queue_pop_head (&stream->prefetch_downloaders)))
+      g_object_unref (downloader);
+  }
+
   gst_adaptive_demux_stream_fragment_clear (&stream->fragment);
 
   if (stream->pending_segment) {
@@ -1438,7 +1601,9 @@ gst_adaptive_demux_stream_free (GstAdaptiveDemuxStream * stream)
 
   g_cond_clear (&stream->fragment_download_cond);
   g_mutex_clear (&stream->fragment_download_lock);
-  g_free (stream->fragment_bitrates);
+  g_cond_clear (&stream->prefetch_cond);
+  g_mutex_clear (&stream->prefetch_lock);
+  gst_adaptive_demux_abr_free (stream->abr);
 
   if (stream->pad) {
     gst_object_unref (stream->pad);
@@ -2145,6 +2310,10 @@ gst_adaptive_demux_stop_tasks (GstAdaptiveDemux * demux, gboolean stop_updates)
       gst_task_stop (stream->download_task);
       g_cond_signal (&stream->fragment_download_cond);
       g_mutex_unlock (&stream->fragment_download_lock);
+
+      /* restarting from another position, also wakes up the download
+       * task if it's waiting for a prefetched fragment */
+      gst_adaptive_demux_stream_prefetch_clear (stream);
     }
     list_to_process = demux->prepared_streams;
   }
@@ -2254,22 +2423,41 @@ gst_adaptive_demux_stream_queue_event (GstAdaptiveDemuxStream * stream,
   stream->pending_events = g_list_append (stream->pending_events, event);
 }
 
-/* must be called with manifest_lock taken */
-static guint64
-_update_average_bitrate (GstAdaptiveDemux * demux,
-    GstAdaptiveDemuxStream * stream, guint64 new_bitrate)
+static gint
+_compare_bitrates (gconstpointer a, gconstpointer b)
 {
-  gint index = stream->moving_index % NUM_LOOKBACK_FRAGMENTS;
+  guint64 bitrate_a = *(const guint64 *) a, bitrate_b = *(const guint64 *) b;
 
-  stream->moving_bitrate -= stream->fragment_bitrates[index];
-  stream->fragment_bitrates[index] = new_bitrate;
-  stream->moving_bitrate += new_bitrate;
+  return bitrate_a < bitrate_b ? -1 : bitrate_a > bitrate_b;
+}
 
-  stream->moving_index += 1;
+/* Estimates how much of the data pushed on @stream is still waiting to be
+ * played downstream, from how far the pushed data is ahead of the running
+ * time of the pipeline. Only possible while playing.
+ * must be called with manifest_lock taken */
+static GstClockTime
+gst_adaptive_demux_stream_get_buffer_level (GstAdaptiveDemux * demux,
+    GstAdaptiveDemuxStream * stream)
+{
+  GstClockTime pushed, now;
 
-  if (stream->moving_index > NUM_LOOKBACK_FRAGMENTS)
-    return stream->moving_bitrate / NUM_LOOKBACK_FRAGMENTS;
-  return stream->moving_bitrate / stream->moving_index;
+  GST_OBJECT_LOCK (demux);
+  if (GST_STATE (demux) != GST_STATE_PLAYING) {
+    GST_OBJECT_UNLOCK (demux);
+    return GST_CLOCK_TIME_NONE;
+  }
+  GST_OBJECT_UNLOCK (demux);
+
+  GST_ADAPTIVE_DEMUX_SEGMENT_LOCK (demux);
+  pushed = gst_segment_to_running_time (&stream->segment, GST_FORMAT_TIME,
+      stream->segment.position);
+  GST_ADAPTIVE_DEMUX_SEGMENT_UNLOCK (demux);
+
+  now = gst_element_get_current_running_time (GST_ELEMENT_CAST (demux));
+  if (!GST_CLOCK_TIME_IS_VALID (pushed) || !GST_CLOCK_TIME_IS_VALID (now))
+    return GST_CLOCK_TIME_NONE;
+
+  return pushed > now ? pushed - now : 0;
 }
 
 /* must be called with manifest_lock taken */
@@ -2277,8 +2465,9 @@ static guint64
 gst_adaptive_demux_stream_update_current_bitrate (GstAdaptiveDemux * demux,
     GstAdaptiveDemuxStream * stream)
 {
-  guint64 average_bitrate;
-  guint64 fragment_bitrate;
+  GstAdaptiveDemuxClass *klass = GST_ADAPTIVE_DEMUX_GET_CLASS (demux);
+  GstAdaptiveDemuxAbrState state = { 0, };
+  GArray *bitrates = NULL;
 
   if (demux->connection_speed) {
     GST_LOG_OBJECT (demux, "Connection-speed is set to %u kbps, using it",
@@ -2287,36 +2476,47 @@ gst_adaptive_demux_stream_update_current_bitrate (GstAdaptiveDemux * demux,
     return demux->connection_speed;
   }
 
-  fragment_bitrate = stream->last_bitrate;
   GST_DEBUG_OBJECT (demux, "Download bitrate is : %" G_GUINT64_FORMAT " bps",
-      fragment_bitrate);
+      stream->last_bitrate);
+  gst_adaptive_demux_abr_fragment_finished (stream->abr, stream->last_bitrate,
+      stream->last_download_time);
+
+  if (klass->stream_get_bitrates &&
+      gst_adaptive_demux_abr_needs_bitrates (stream->abr))
+    bitrates = klass->stream_get_bitrates (stream);
+  if (bitrates && bitrates->len > 0) {
+    guint64 *values;
+    guint i, n = 0;
+
+    /* variants can share a bitrate (different codecs or resolutions), the
+     * algorithms want distinct levels */
+    g_array_sort (bitrates, _compare_bitrates);
+    values = (guint64 *) bitrates->data;
+    for (i = 0; i < bitrates->len; i++) {
+      if (values[i] > 0 && (n == 0 || values[i] != values[n - 1]))
+        values[n++] = values[i];
+    }
 
-  average_bitrate = _update_average_bitrate (demux, stream, fragment_bitrate);
+    if (n > 0) {
+      state.bitrates = values;
+      state.n_bitrates = n;
+    }
+  }
 
-  GST_INFO_OBJECT (GST_ADAPTIVE_DEMUX_STREAM_PAD (stream),
-      "last fragment bitrate was %" G_GUINT64_FORMAT, fragment_bitrate);
-  GST_INFO_OBJECT (GST_ADAPTIVE_DEMUX_STREAM_PAD (stream),
-      "Last %u fragments average bitrate is %" G_GUINT64_FORMAT,
-      NUM_LOOKBACK_FRAGMENTS, average_bitrate);
+  state.buffer_level =
+      gst_adaptive_demux_stream_get_buffer_level (demux, stream);
+  state.fragment_duration = stream->fragment.duration;
+  state.bitrate_limit = demux->bitrate_limit;
+  state.rate = demux->segment.rate;
 
-  /* Conservative approach, make sure we don't upgrade too fast */
-  stream->current_download_rate = MIN (average_bitrate, fragment_bitrate);
+  stream->current_download_rate =
+      gst_adaptive_demux_abr_select_bitrate (stream->abr, &state);
 
-  stream->current_download_rate *= demux->bitrate_limit;
-  GST_DEBUG_OBJECT (demux, "Bitrate after bitrate limit (%0.2f): %"
-      G_GUINT64_FORMAT, demux->bitrate_limit, stream->current_download_rate);
+  if (bitrates)
+    g_array_unref (bitrates);
 
-#if 0
-  /* Debugging code, modulate the bitrate every few fragments */
-  {
-    static guint ctr = 0;
-    if (ctr % 3 == 0) {
-      GST_INFO_OBJECT (demux, "Halving reported bitrate for debugging");
-      stream->current_download_rate /= 2;
-    }
-    ctr++;
-  }
-#endif
+  GST_INFO_OBJECT (GST_ADAPTIVE_DEMUX_STREAM_PAD (stream),
+      "Selected bitrate %" G_GUINT64_FORMAT, stream->current_download_rate);
 
   return stream->current_download_rate;
 }
@@ -2578,18 +2778,16 @@ gst_adaptive_demux_requires_periodical_playlist_update_default (GstAdaptiveDemux
   return TRUE;
 }
 
+/* Handles the downloaded data of the current fragment, either from the src
+ * element or from a prefetched download */
 static GstFlowReturn
-_src_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+gst_adaptive_demux_stream_chain (GstAdaptiveDemuxStream * stream,
+    GstBuffer * buffer)
 {
-  GstAdaptiveDemuxStream *stream;
-  GstAdaptiveDemux *demux;
-  GstAdaptiveDemuxClass *klass;
+  GstAdaptiveDemux *demux = stream->demux;
+  GstAdaptiveDemuxClass *klass = GST_ADAPTIVE_DEMUX_GET_CLASS (demux);
   GstFlowReturn ret = GST_FLOW_OK;
 
-  demux = GST_ADAPTIVE_DEMUX_CAST (parent);
-  stream = gst_pad_get_element_private (pad);
-  klass = GST_ADAPTIVE_DEMUX_GET_CLASS (demux);
-
   GST_MANIFEST_LOCK (demux);
 
   /* do not make any changes if the stream is cancelled */
@@ -2664,7 +2862,7 @@ _src_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
        * and we don't have a birate from the sub-class, then see if we
        * can work it out from the fragment size and duration */
       if (stream->fragment.bitrate == 0 &&
-          stream->fragment.duration != 0 &&
+          stream->fragment.duration != 0 && stream->uri_handler &&
           gst_element_query_duration (stream->uri_handler, GST_FORMAT_BYTES,
               &chunk_size) && chunk_size != -1) {
         guint bitrate = MIN (G_MAXUINT, gst_util_uint64_scale (chunk_size,
@@ -2740,6 +2938,13 @@ error:
   return ret;
 }
 
+static GstFlowReturn
+_src_chain (GstPad * pad, GstObject * parent, GstBuffer * buffer)
+{
+  return gst_adaptive_demux_stream_chain (gst_pad_get_element_private (pad),
+      buffer);
+}
+
 /* must be called with manifest_lock taken */
 static void
 gst_adaptive_demux_stream_fragment_download_finish (GstAdaptiveDemuxStream *
@@ -2863,6 +3068,9 @@ _uri_handler_probe (GstPad * pad, GstPadProbeInfo * info,
           GST_TIME_ARGS (stream->last_latency));
     }
     stream->fragment_bytes_downloaded += gst_buffer_get_size (buf);
+    gst_adaptive_demux_abr_data_received (stream->abr,
+        gst_buffer_get_size (buf),
+        gst_adaptive_demux_get_monotonic_time (stream->demux));
     GST_LOG_OBJECT (pad,
         "Received buffer, size %" G_GSIZE_FORMAT " total %" G_GUINT64_FORMAT,
         gst_buffer_get_size (buf), stream->fragment_bytes_downloaded);
@@ -2874,6 +3082,8 @@ _uri_handler_probe (GstPad * pad, GstPadProbeInfo * info,
     switch (GST_EVENT_TYPE (ev)) {
       case GST_EVENT_SEGMENT:
         stream->fragment_bytes_downloaded = 0;
+        gst_adaptive_demux_abr_download_started (stream->abr,
+            stream->fragment.incomplete);
         break;
       case GST_EVENT_EOS:
       {
@@ -3181,6 +3391,358 @@ uritype (GstAdaptiveDemuxStream * s)
 }
 #endif
 
+static GstAdaptiveDemuxPrefetch *
+gst_adaptive_demux_prefetch_new (GstAdaptiveDemuxStreamFragment * fragment)
+{
+  GstAdaptiveDemuxPrefetch *prefetch = g_slice_new0 (GstAdaptiveDemuxPrefetch);
+
+  prefetch->ref_count = 1;
+  prefetch->uri = g_strdup (fragment->uri);
+  prefetch->range_start = fragment->range_start;
+  prefetch->range_end = fragment->range_end;
+  prefetch->duration = fragment->duration;
+
+  return prefetch;
+}
+
+static GstAdaptiveDemuxPrefetch *
+gst_adaptive_demux_prefetch_ref (GstAdaptiveDemuxPrefetch * prefetch)
+{
+  g_atomic_int_inc (&prefetch->ref_count);
+  return prefetch;
+}
+
+static void
+gst_adaptive_demux_prefetch_unref (GstAdaptiveDemuxPrefetch * prefetch)
+{
+  if (g_atomic_int_dec_and_test (&prefetch->ref_count)) {
+    g_free (prefetch->uri);
+    if (prefetch->buffer)
+      gst_buffer_unref (prefetch->buffer);
+    g_slice_free (GstAdaptiveDemuxPrefetch, prefetch);
+  }
+}
+
+static gboolean
+gst_adaptive_demux_prefetch_matches (GstAdaptiveDemuxPrefetch * prefetch,
+    const gchar * uri, gint64 range_start, gint64 range_end)
+{
+  return g_strcmp0 (prefetch->uri, uri) == 0 &&
+      prefetch->range_start == range_start && prefetch->range_end == range_end;
+}
+
+/* Runs in the stream's prefetch_pool. Downloaders are kept around once
+ * done, so that connections can be reused from one fragment to the next */
+static void
+gst_adaptive_demux_stream_prefetch_func (GstAdaptiveDemuxPrefetch * prefetch,
+    GstAdaptiveDemuxStream * stream)
+{
+  GstAdaptiveDemux *demux = stream->demux;
+  GstUriDownloader *downloader;
+  GstFragment *download;
+  GstClockTime start, stop;
+  GError *err = NULL;
+
+  g_mutex_lock (&stream->prefetch_lock);
+  if (prefetch->cancelled) {
+    g_mutex_unlock (&stream->prefetch_lock);
+    gst_adaptive_demux_prefetch_unref (prefetch);
+    return;
+  }
+
+  downloader = g_queue_pop_head (&stream->prefetch_downloaders);
+  if (downloader == NULL) {
+    downloader = gst_uri_downloader_new ();
+    gst_uri_downloader_set_parent (downloader, GST_ELEMENT_CAST (demux));
+  }
+  prefetch->downloader = downloader;
+  g_mutex_unlock (&stream->prefetch_lock);
+
+  GST_DEBUG_OBJECT (stream->pad,
+      "Prefetching uri: %s, range:%" G_GINT64_FORMAT " - %" G_GINT64_FORMAT,
+      prefetch->uri, prefetch->range_start, prefetch->range_end);
+
+  /* HTTP ranges are inclusive, GStreamer segments are exclusive for the
+   * stop position */
+  start = gst_adaptive_demux_get_monotonic_time (demux);
+  download = gst_uri_downloader_fetch_uri_with_range (downloader,
+      prefetch->uri, NULL, FALSE, FALSE, TRUE, prefetch->range_start,
+      prefetch->range_end != -1 ? prefetch->range_end + 1 : -1, &err);
+  stop = gst_adaptive_demux_get_monotonic_time (demux);
+
+  g_mutex_lock (&stream->prefetch_lock);
+  prefetch->downloader = NULL;
+  /* a cancellation coming after the end of the download would abort the
+   * next one */
+  gst_uri_downloader_reset (downloader);
+  g_queue_push_tail (&stream->prefetch_downloaders, downloader);
+
+  if (!prefetch->cancelled) {
+    if (download)
+      prefetch->buffer = gst_fragment_get_buffer (download);
+
+    if (prefetch->buffer) {
+      prefetch->download_start = start;
+      prefetch->download_time = stop - start;
+      GST_DEBUG_OBJECT (stream->pad, "Prefetched %s: %" G_GSIZE_FORMAT
+          " bytes in %" GST_TIME_FORMAT, prefetch->uri,
+          gst_buffer_get_size (prefetch->buffer),
+          GST_TIME_ARGS (prefetch->download_time));
+    } else {
+      GST_INFO_OBJECT (stream->pad, "Failed to prefetch %s: %s",
+          prefetch->uri, err ? err->message : "no data");
+    }
+  }
+  prefetch->done = TRUE;
+  g_cond_broadcast (&stream->prefetch_cond);
+  g_mutex_unlock (&stream->prefetch_lock);
+
+  if (download)
+    g_object_unref (download);
+  g_clear_error (&err);
+  gst_adaptive_demux_prefetch_unref (prefetch);
+}
+
+/* must be called with manifest_lock and prefetch_lock taken.
+ * Drops a prefetched fragment, interrupting its download */
+static void
+gst_adaptive_demux_stream_prefetch_drop (GstAdaptiveDemuxStream * stream,
+    GList * link)
+{
+  GstAdaptiveDemuxPrefetch *prefetch = link->data;
+
+  GST_LOG_OBJECT (stream->pad, "Dropping prefetched %s", prefetch->uri);
+
+  prefetch->cancelled = TRUE;
+  if (prefetch->downloader)
+    gst_uri_downloader_cancel (prefetch->downloader);
+
+  g_queue_delete_link (&stream->prefetch_queue, link);
+  gst_adaptive_demux_prefetch_unref (prefetch);
+}
+
+/* must be called with manifest_lock taken.
+ * Drops @link and all the following prefetched fragments */
+static void
+gst_adaptive_demux_stream_prefetch_truncate (GstAdaptiveDemuxStream * stream,
+    GList * link)
+{
+  if (link == NULL)
+    return;
+
+  g_mutex_lock (&stream->prefetch_lock);
+  while (link) {
+    GList *next = link->next;
+
+    gst_adaptive_demux_stream_prefetch_drop (stream, link);
+    link = next;
+  }
+  g_cond_broadcast (&stream->prefetch_cond);
+  g_mutex_unlock (&stream->prefetch_lock);
+}
+
+/* must be called with manifest_lock taken */
+static void
+gst_adaptive_demux_stream_prefetch_clear (GstAdaptiveDemuxStream * stream)
+{
+  gst_adaptive_demux_stream_prefetch_truncate (stream,
+      stream->prefetch_queue.head);
+}
+
+/* must be called with manifest_lock taken, once the current fragment is
+ * known. Makes sure the following fragments are being downloaded, within
+ * the limits of the prefetch window */
+static void
+gst_adaptive_demux_stream_prefetch_schedule (GstAdaptiveDemux * demux,
+    GstAdaptiveDemuxStream * stream)
+{
+  GstAdaptiveDemuxClass *klass = GST_ADAPTIVE_DEMUX_GET_CLASS (demux);
+  GstAdaptiveDemuxPrivate *priv = demux->priv;
+  GstClockTime queued_time = 0;
+  guint64 queued_bytes = 0;
+  GList *link;
+  guint n;
+
+  /* key unit trick modes download parts of fragments only */
+  if (priv->prefetch_fragments == 0 || klass->stream_peek_fragment == NULL
+      || demux->segment.rate <= 0
+      || GST_ADAPTIVE_DEMUX_IN_TRICKMODE_KEY_UNITS (demux)
+      || stream->fragment.uri == NULL) {
+    gst_adaptive_demux_stream_prefetch_clear (stream);
+    return;
+  }
+
+  if (stream->prefetch_pool == NULL) {
+    stream->prefetch_pool =
+        g_thread_pool_new ((GFunc) gst_adaptive_demux_stream_prefetch_func,
+        stream, priv->prefetch_fragments, FALSE, NULL);
+  } else if (g_thread_pool_get_max_threads (stream->prefetch_pool) !=
+      priv->prefetch_fragments) {
+    g_thread_pool_set_max_threads (stream->prefetch_pool,
+        priv->prefetch_fragments, NULL);
+  }
+
+  /* the current fragment might have been prefetched already */
+  link = stream->prefetch_queue.head;
+  if (link && gst_adaptive_demux_prefetch_matches (link->data,
+          stream->fragment.uri, stream->fragment.range_start,
+          stream->fragment.range_end))
+    link = link->next;
+
+  for (n = 1; n <= priv->prefetch_fragments; n++) {
+    GstAdaptiveDemuxStreamFragment fragment = { 0, };
+    GstAdaptiveDemuxPrefetch *prefetch;
+
+    if (queued_time >= priv->prefetch_max_time
+        || queued_bytes >= priv->prefetch_max_bytes)
+      break;
+
+    fragment.range_end = -1;
+    fragment.duration = GST_CLOCK_TIME_NONE;
+    if (klass->stream_peek_fragment (stream, n, &fragment) != GST_FLOW_OK
+        || fragment.uri == NULL) {
+      gst_adaptive_demux_stream_fragment_clear (&fragment);
+      break;
+    }
+
+    if (link && gst_adaptive_demux_prefetch_matches (link->data,
+            fragment.uri, fragment.range_start, fragment.range_end)) {
+      prefetch = link->data;
+      link = link->next;
+    } else {
+      /* the fragments changed, e.g. after a playlist update */
+      gst_adaptive_demux_stream_prefetch_truncate (stream, link);
+      link = NULL;
+
+      prefetch = gst_adaptive_demux_prefetch_new (&fragment);
+      g_queue_push_tail (&stream->prefetch_queue, prefetch);
+      g_thread_pool_push (stream->prefetch_pool,
+          gst_adaptive_demux_prefetch_ref (prefetch), NULL);
+    }
+    gst_adaptive_demux_stream_fragment_clear (&fragment);
+
+    if (GST_CLOCK_TIME_IS_VALID (prefetch->duration))
+      queued_time += prefetch->duration;
+
+    g_mutex_lock (&stream->prefetch_lock);
+    if (prefetch->buffer)
+      queued_bytes += gst_buffer_get_size (prefetch->buffer);
+    else if (prefetch->range_end != -1)
+      queued_bytes += prefetch->range_end - prefetch->range_start + 1;
+    g_mutex_unlock (&stream->prefetch_lock);
+  }
+}
+
+/* must be called with manifest_lock taken. Can temporarily release it.
+ * Returns the prefetched data of the given fragment once its download is
+ * over, or NULL if it wasn't prefetched or the download failed */
+static GstAdaptiveDemuxPrefetch *
+gst_adaptive_demux_stream_prefetch_take (GstAdaptiveDemux * demux,
+    GstAdaptiveDemuxStream * stream, const gchar * uri, gint64 start,
+    gint64 end)
+{
+  GstAdaptiveDemuxPrefetch *prefetch;
+  gboolean usable;
+
+  /* anything queued before the requested fragment is of no use anymore */
+  g_mutex_lock (&stream->prefetch_lock);
+  while ((prefetch = g_queue_peek_head (&stream->prefetch_queue)) &&
+      !gst_adaptive_demux_prefetch_matches (prefetch, uri, start, end))
+    gst_adaptive_demux_stream_prefetch_drop (stream,
+        stream->prefetch_queue.head);
+
+  if (prefetch == NULL) {
+    g_mutex_unlock (&stream->prefetch_lock);
+    return NULL;
+  }
+
+  gst_adaptive_demux_prefetch_ref (prefetch);
+
+  if (!prefetch->done) {
+    GST_DEBUG_OBJECT (stream->pad, "Waiting for prefetch of %s to finish",
+        uri);
+
+    g_mutex_unlock (&stream->prefetch_lock);
+    GST_MANIFEST_UNLOCK (demux);
+    g_mutex_lock (&stream->prefetch_lock);
+    while (!prefetch->done && !prefetch->cancelled)
+      g_cond_wait (&stream->prefetch_cond, &stream->prefetch_lock);
+    g_mutex_unlock (&stream->prefetch_lock);
+    GST_MANIFEST_LOCK (demux);
+    g_mutex_lock (&stream->prefetch_lock);
+  }
+
+  /* a cancelled fragment was already removed from the queue */
+  usable = !prefetch->cancelled && prefetch->buffer != NULL;
+  if (!prefetch->cancelled)
+    gst_adaptive_demux_stream_prefetch_drop (stream,
+        stream->prefetch_queue.head);
+  g_mutex_unlock (&stream->prefetch_lock);
+
+  if (!usable) {
+    gst_adaptive_demux_prefetch_unref (prefetch);
+    return NULL;
+  }
+
+  return prefetch;
+}
+
+/* must be called with manifest_lock taken.
+ * Hands a prefetched fragment over as if it was being downloaded by the
+ * src element, and returns once it was fully handled */
+static GstFlowReturn
+gst_adaptive_demux_stream_push_prefetched (GstAdaptiveDemux * demux,
+    GstAdaptiveDemuxStream * stream, GstAdaptiveDemuxPrefetch * prefetch)
+{
+  gsize size = gst_buffer_get_size (prefetch->buffer);
+  gsize offset = 0;
+  GstFlowReturn ret = GST_FLOW_OK;
+
+  GST_DEBUG_OBJECT (stream->pad, "Using prefetched %s: %" G_GSIZE_FORMAT
+      " bytes", prefetch->uri, size);
+
+  stream->download_start_time = GST_TIME_AS_USECONDS (prefetch->download_start);
+  stream->fragment_bytes_downloaded = size;
+  stream->last_latency = GST_CLOCK_TIME_NONE;
+  stream->last_download_time = prefetch->download_time;
+  stream->last_bitrate = gst_util_uint64_scale (size, 8 * GST_SECOND,
+      MAX (prefetch->download_time, 1));
+
+  g_mutex_lock (&stream->fragment_download_lock);
+  stream->download_finished = FALSE;
+  stream->downloading_first_buffer = TRUE;
+  g_mutex_unlock (&stream->fragment_download_lock);
+
+  /* there is no source element to get the size from */
+  if (stream->fragment.bitrate == 0 && stream->fragment.duration != 0
+      && GST_CLOCK_TIME_IS_VALID (stream->fragment.duration))
+    stream->fragment.bitrate = MIN (G_MAXUINT, gst_util_uint64_scale (size,
+            8 * GST_SECOND, stream->fragment.duration));
+
+  while (offset < size && ret == GST_FLOW_OK) {
+    gsize chunk = MIN (size - offset, PREFETCH_CHUNK_SIZE);
+
+    ret = gst_adaptive_demux_stream_chain (stream,
+        gst_buffer_copy_region (prefetch->buffer, GST_BUFFER_COPY_MEMORY,
+            offset, chunk));
+    offset += chunk;
+  }
+
+  /* the whole fragment went through, behave as on EOS from the source */
+  if (ret == GST_FLOW_OK)
+    gst_adaptive_demux_eos_handling (stream);
+
+  g_mutex_lock (&stream->fragment_download_lock);
+  if (G_UNLIKELY (stream->cancelled)) {
+    g_mutex_unlock (&stream->fragment_download_lock);
+    ret = stream->last_ret = GST_FLOW_FLUSHING;
+    return ret;
+  }
+  g_mutex_unlock (&stream->fragment_download_lock);
+
+  return stream->last_ret;
+}
+
 /* must be called with manifest_lock taken.
  * Can temporarily release manifest_lock
  *
@@ -3199,6 +3761,29 @@ gst_adaptive_demux_stream_download_uri (GstAdaptiveDemux * demux,
   if (http_status)
     *http_status = 200;         /* default to ok if no further information */
 
+  if (!stream->downloading_header && !stream->downloading_index &&
+      !g_queue_is_empty (&stream->prefetch_queue)) {
+    GstAdaptiveDemuxPrefetch *prefetch;
+
+    prefetch = gst_adaptive_demux_stream_prefetch_take (demux, stream, uri,
+        start, end);
+    if (prefetch) {
+      ret = gst_adaptive_demux_stream_push_prefetched (demux, stream,
+          prefetch);
+      gst_adaptive_demux_prefetch_unref (prefetch);
+      return ret;
+    }
+
+    /* the manifest_lock might have been released while waiting */
+    g_mutex_lock (&stream->fragment_download_lock);
+    if (G_UNLIKELY (stream->cancelled)) {
+      g_mutex_unlock (&stream->fragment_download_lock);
+      ret = stream->last_ret = GST_FLOW_FLUSHING;
+      return ret;
+    }
+    g_mutex_unlock (&stream->fragment_download_lock);
+  }
+
   if (!gst_adaptive_demux_stream_update_source (stream, uri, NULL, FALSE, TRUE)) {
     ret = stream->last_ret = GST_FLOW_ERROR;
     return ret;
@@ -3821,6 +4406,8 @@ gst_adaptive_demux_stream_download_loop (GstAdaptiveDemuxStream * stream)
 
     stream->last_ret = GST_FLOW_OK;
 
+    gst_adaptive_demux_stream_prefetch_schedule (demux, stream);
+
     next_download = gst_adaptive_demux_get_monotonic_time (demux);
     ret = gst_adaptive_demux_stream_download_fragment (stream);
 
@@ -4294,6 +4881,7 @@ gst_adaptive_demux_stream_advance_fragment_unlocked (GstAdaptiveDemux * demux,
     if (gst_adaptive_demux_stream_select_bitrate (demux, stream,
             gst_adaptive_demux_stream_update_current_bitrate (demux, stream))) {
       stream->need_header = TRUE;
+      gst_adaptive_demux_stream_prefetch_clear (stream);
       ret = (GstFlowReturn) GST_ADAPTIVE_DEMUX_FLOW_SWITCH;
     }
 
@@ -4489,6 +5077,7 @@ gst_adaptive_demux_stream_fragment_clear (GstAdaptiveDemuxStreamFragment * f)
   f->index_range_end = -1;
 
   f->finished = FALSE;
+  f->incomplete = FALSE;
 }
 
 /* must be called with manifest_lock taken */
@@ -4568,6 +5157,57 @@ gst_adaptive_demux_is_running (GstAdaptiveDemux * demux)
   return g_atomic_int_get (&demux->running);
 }
 
+/**
+ * gst_adaptive_demux_fetch_uri_unlocked:
+ * @demux: #GstAdaptiveDemux
+ * @uri: the URI to download
+ * @referer: (nullable): the referer of the request
+ * @compress: whether the server may compress the response
+ * @refresh: whether intermediate caches must revalidate their copy
+ * @allow_cache: whether intermediate caches may be used
+ * @err: return location for a #GError, or %NULL
+ *
+ * Downloads @uri with the manifest downloader, without holding the manifest
+ * lock, for requests the server can hold for a while like blocking playlist
+ * reloads. Only to be called from #GstAdaptiveDemuxClass.update_manifest()
+ * in the periodic manifest updates. The streams and seeks go on meanwhile,
+ * so the subclass must check that what it downloaded is still of use.
+ *
+ * Returns: (transfer full) (nullable): the downloaded #GstFragment, or %NULL
+ *     if the download failed or the updates were stopped meanwhile
+ *
+ * Since: 1.20
+ */
+GstFragment *
+gst_adaptive_demux_fetch_uri_unlocked (GstAdaptiveDemux * demux,
+    const gchar * uri, const gchar * referer, gboolean compress,
+    gboolean refresh, gboolean allow_cache, GError ** err)
+{
+  GstFragment *download;
+  gboolean stopped;
+
+  /* stopping the updates cancels the downloader, the download then returns
+   * and the manifest lock is taken again */
+  GST_MANIFEST_UNLOCK (demux);
+  download = gst_uri_downloader_fetch_uri (demux->downloader, uri, referer,
+      compress, refresh, allow_cache, err);
+  GST_MANIFEST_LOCK (demux);
+
+  g_mutex_lock (&demux->priv->updates_timed_lock);
+  stopped = demux->priv->stop_updates_task;
+  g_mutex_unlock (&demux->priv->updates_timed_lock);
+
+  if (stopped && download) {
+    GST_DEBUG_OBJECT (demux, "Updates stopped while downloading %s", uri);
+    g_object_unref (download);
+    download = NULL;
+    g_set_error (err, GST_RESOURCE_ERROR, GST_RESOURCE_ERROR_READ,
+        "Manifest updates stopped");
+  }
+
+  return download;
+}
+
 static GstAdaptiveDemuxTimer *
 gst_adaptive_demux_timer_new (GCond * cond, GMutex * mutex)
 {
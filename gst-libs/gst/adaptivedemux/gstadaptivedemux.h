@@ -84,6 +84,31 @@ G_BEGIN_DECLS
   g_clear_error (&err); \
 } G_STMT_END
 
+/**
+ * GstAdaptiveDemuxAbrAlgorithm:
+ * @GST_ADAPTIVE_DEMUX_ABR_MOVING_AVERAGE: use the lowest of the last
+ *     fragment's and the last fragments' average download bitrate
+ * @GST_ADAPTIVE_DEMUX_ABR_THROUGHPUT: use a throughput estimate that follows
+ *     the network while fragments are downloaded, smoothed to avoid
+ *     switching back and forth
+ * @GST_ADAPTIVE_DEMUX_ABR_BOLA: pick the bitrate from the amount of
+ *     buffered media (BOLA), never going up further than the throughput
+ *     allows
+ *
+ * How the bitrate of the next fragment is selected.
+ *
+ * Since: 1.20
+ */
+typedef enum
+{
+  GST_ADAPTIVE_DEMUX_ABR_MOVING_AVERAGE,
+  GST_ADAPTIVE_DEMUX_ABR_THROUGHPUT,
+  GST_ADAPTIVE_DEMUX_ABR_BOLA,
+} GstAdaptiveDemuxAbrAlgorithm;
+
+#define GST_TYPE_ADAPTIVE_DEMUX_ABR_ALGORITHM \
+  (gst_adaptive_demux_abr_algorithm_get_type())
+
 /* DEPRECATED */
 #define GST_ADAPTIVE_DEMUX_FLOW_END_OF_FRAGMENT GST_FLOW_CUSTOM_SUCCESS_1
 
@@ -120,6 +145,11 @@ struct _GstAdaptiveDemuxStreamFragment
   guint bitrate;
 
   gboolean finished;
+
+  /* Set by the sub-class when the fragment is requested before the server
+   * has all of it (low latency live), its data then arrives in bursts as it
+   * gets produced */
+  gboolean incomplete;
 };
 
 struct _GstAdaptiveDemuxStream
@@ -179,10 +209,8 @@ struct _GstAdaptiveDemuxStream
   GstClockTime last_latency;
   GstClockTime last_download_time;
 
-  /* Average for the last fragments */
-  guint64 moving_bitrate;
-  guint moving_index;
-  guint64 *fragment_bitrates;
+  /* bitrate adaptation state, private */
+  gpointer abr;
 
   /* QoS data : UNUSED !!! */
   GstClockTime qos_earliest_time;
@@ -195,6 +223,15 @@ struct _GstAdaptiveDemuxStream
   gboolean eos;
 
   gboolean do_block; /* TRUE if stream should block on preroll */
+
+  /* upcoming fragments downloaded ahead of time, in fragment order. The
+   * queue is protected by manifest_lock, the state of its items by
+   * prefetch_lock */
+  GQueue prefetch_queue;
+  GMutex prefetch_lock;
+  GCond prefetch_cond;
+  GThreadPool *prefetch_pool;
+  GQueue prefetch_downloaders; /* idle downloaders, protected by prefetch_lock */
 };
 
 /**
@@ -371,6 +408,24 @@ struct _GstAdaptiveDemuxClass
    *          if there is no fragment.
    */
   GstFlowReturn (*stream_update_fragment_info) (GstAdaptiveDemuxStream * stream);
+
+  /**
+   * stream_peek_fragment:
+   * @stream: #GstAdaptiveDemuxStream
+   * @n: position of the fragment after the current one, starting at 1
+   * @fragment: the #GstAdaptiveDemuxStreamFragment to fill
+   *
+   * Optional. Sets the uri, range and duration of the @n-th fragment after
+   * the current one in @fragment, without advancing the stream. Used to
+   * download upcoming fragments in advance, see the prefetch-fragments
+   * property.
+   *
+   * Returns: #GST_FLOW_OK in success, #GST_FLOW_EOS if the fragment isn't
+   *          known yet or can't be downloaded ahead of time.
+   *
+   * Since: 1.20
+   */
+  GstFlowReturn (*stream_peek_fragment) (GstAdaptiveDemuxStream * stream, guint n, GstAdaptiveDemuxStreamFragment * fragment);
   /**
    * stream_select_bitrate:
    * @stream: #GstAdaptiveDemuxStream
@@ -385,6 +440,22 @@ struct _GstAdaptiveDemuxClass
    * Returns: %TRUE if the stream changed bitrate, %FALSE otherwise
    */
   gboolean      (*stream_select_bitrate) (GstAdaptiveDemuxStream * stream, guint64 bitrate);
+
+  /**
+   * stream_get_bitrates:
+   * @stream: #GstAdaptiveDemuxStream
+   *
+   * Optional. Returns the bitrates, in bits per second, that
+   * stream_select_bitrate() can currently switch @stream to, in any order.
+   * Needed by the algorithms that pick one of them rather than just
+   * estimating the available bandwidth, see the abr-algorithm property.
+   *
+   * Returns: (transfer full) (nullable): a #GArray of #guint64, or %NULL if
+   *          @stream can't switch bitrates
+   *
+   * Since: 1.20
+   */
+  GArray *      (*stream_get_bitrates) (GstAdaptiveDemuxStream * stream);
   /**
    * stream_get_fragment_waiting_time:
    * @stream: #GstAdaptiveDemuxStream
@@ -487,6 +558,9 @@ struct _GstAdaptiveDemuxClass
 GST_ADAPTIVE_DEMUX_API
 GType    gst_adaptive_demux_get_type (void);
 
+GST_ADAPTIVE_DEMUX_API
+GType    gst_adaptive_demux_abr_algorithm_get_type (void);
+
 GST_ADAPTIVE_DEMUX_API
 void     gst_adaptive_demux_set_stream_struct_size (GstAdaptiveDemux * demux,
                                                     gsize struct_size);
@@ -535,6 +609,15 @@ gboolean gst_adaptive_demux_is_running (GstAdaptiveDemux * demux);
 GST_ADAPTIVE_DEMUX_API
 GstClockTime gst_adaptive_demux_get_qos_earliest_time (GstAdaptiveDemux *demux);
 
+GST_ADAPTIVE_DEMUX_API
+GstFragment *gst_adaptive_demux_fetch_uri_unlocked (GstAdaptiveDemux * demux,
+                                                    const gchar * uri,
+                                                    const gchar * referer,
+                                                    gboolean compress,
+                                                    gboolean refresh,
+                                                    gboolean allow_cache,
+                                                    GError ** err);
+
 G_END_DECLS
 
 #endif
@@ -0,0 +1,524 @@
+/* GStreamer
+ *
+ * gstadaptivedemuxabr.c: bitrate adaptation for adaptive demuxers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Each stream has its own controller, fed with the data received while
+ * fragments are downloaded and asked for the bitrate to use once a fragment
+ * is done. The throughput measurements are shared by all the algorithms,
+ * an algorithm only decides how to turn them (and the state of the stream)
+ * into a bitrate, so adding one only means adding a select function to
+ * abr_algorithms.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+
+#include "gstadaptivedemuxabr.h"
+
+GST_DEBUG_CATEGORY_EXTERN (adaptivedemux_debug);
+#define GST_CAT_DEFAULT adaptivedemux_debug
+
+/* number of fragments the moving average is computed on */
+#define NUM_LOOKBACK_FRAGMENTS 3
+/* number of fragments the harmonic mean is computed on */
+#define NUM_HARMONIC_FRAGMENTS 5
+
+/* Throughput samples are taken over at least that much data and time while
+ * a fragment is downloaded, so that they don't just measure how fast
+ * buffers are passed around */
+#define MIN_SAMPLE_BYTES (16 * 1024)
+#define MIN_SAMPLE_TIME (10 * GST_MSECOND)
+
+/* When a fragment is downloaded while it is being produced, pauses longer
+ * than that between two buffers are the server waiting for media, not the
+ * network being slow */
+#define MAX_BURST_GAP (50 * GST_MSECOND)
+
+/* half-lives of the fast and slow moving averages of the samples, in
+ * seconds of download time */
+#define EWMA_FAST_HALF_LIFE 2.0
+#define EWMA_SLOW_HALF_LIFE 5.0
+
+/* BOLA parameters, in seconds: the buffer level under which the lowest
+ * bitrate is always used, and the one it aims for */
+#define BOLA_MIN_BUFFER 10.0
+#define BOLA_STABLE_BUFFER 12.0
+#define BOLA_BUFFER_PER_LEVEL 2.0
+
+typedef struct
+{
+  gdouble alpha;
+  gdouble estimate;
+  gdouble total_weight;
+} AbrEwma;
+
+struct _GstAdaptiveDemuxAbr
+{
+  GMutex lock;
+
+  GstAdaptiveDemuxAbrAlgorithm algorithm;
+
+  /* bitrates of the last fragments */
+  guint64 fragment_bitrates[NUM_HARMONIC_FRAGMENTS];
+  guint n_fragments;
+
+  /* sample being accumulated for the current fragment */
+  GstClockTime sample_start;
+  guint64 sample_bytes;
+  guint n_fragment_samples;
+
+  /* for fragments downloaded before they are complete: when the last
+   * buffer was received and how long the download was idle so far */
+  gboolean incomplete;
+  GstClockTime last_received;
+  GstClockTime idle_time;
+
+  AbrEwma fast;
+  AbrEwma slow;
+
+  /* index of the last bitrate picked by BOLA, G_MAXUINT if none, and the
+   * buffer levels it used, in seconds */
+  guint last_index;
+  gdouble last_buffer_level;
+  gdouble placeholder;
+};
+
+typedef guint64 (*AbrSelectFunc) (GstAdaptiveDemuxAbr * abr,
+    const GstAdaptiveDemuxAbrState * state);
+
+typedef struct
+{
+  gboolean needs_bitrates;
+  AbrSelectFunc select;
+} AbrAlgorithm;
+
+static void
+abr_ewma_init (AbrEwma * ewma, gdouble half_life)
+{
+  ewma->alpha = exp (log (0.5) / half_life);
+  ewma->estimate = 0;
+  ewma->total_weight = 0;
+}
+
+static void
+abr_ewma_add (AbrEwma * ewma, gdouble weight, gdouble value)
+{
+  gdouble alpha = pow (ewma->alpha, weight);
+
+  ewma->estimate = value * (1 - alpha) + alpha * ewma->estimate;
+  ewma->total_weight += weight;
+}
+
+static gdouble
+abr_ewma_get (AbrEwma * ewma)
+{
+  /* the estimate starts at 0, correct for that bias */
+  return ewma->estimate / (1 - pow (ewma->alpha, ewma->total_weight));
+}
+
+static void
+abr_add_sample (GstAdaptiveDemuxAbr * abr, guint64 bytes,
+    GstClockTime duration)
+{
+  gdouble seconds = (gdouble) duration / GST_SECOND;
+  gdouble bitrate = bytes * 8 / seconds;
+
+  abr_ewma_add (&abr->fast, seconds, bitrate);
+  abr_ewma_add (&abr->slow, seconds, bitrate);
+}
+
+/* Average of the last fragments, the way adaptivedemux always did it */
+static guint64
+abr_moving_average (GstAdaptiveDemuxAbr * abr)
+{
+  guint n = MIN (abr->n_fragments, NUM_LOOKBACK_FRAGMENTS);
+  guint64 sum = 0;
+  guint i;
+
+  if (n == 0)
+    return 0;
+
+  for (i = 0; i < n; i++)
+    sum += abr->fragment_bitrates[(abr->n_fragments - 1 - i) %
+        NUM_HARMONIC_FRAGMENTS];
+
+  return sum / n;
+}
+
+/* Harmonic mean of the last fragments, which is dominated by the slow ones
+ * and so is robust to the occasional fragment coming in very fast */
+static guint64
+abr_harmonic_mean (GstAdaptiveDemuxAbr * abr)
+{
+  guint n = MIN (abr->n_fragments, NUM_HARMONIC_FRAGMENTS);
+  gdouble sum = 0;
+  guint i, count = 0;
+
+  for (i = 0; i < n; i++) {
+    guint64 bitrate = abr->fragment_bitrates[i];
+
+    if (bitrate) {
+      sum += 1.0 / bitrate;
+      count++;
+    }
+  }
+
+  return count ? count / sum : 0;
+}
+
+static guint64
+abr_estimate_throughput (GstAdaptiveDemuxAbr * abr)
+{
+  guint64 harmonic = abr_harmonic_mean (abr);
+  guint64 ewma;
+
+  if (abr->fast.total_weight == 0)
+    return harmonic;
+
+  ewma = MIN (abr_ewma_get (&abr->fast), abr_ewma_get (&abr->slow));
+
+  GST_LOG ("Throughput: harmonic mean %" G_GUINT64_FORMAT ", EWMA %"
+      G_GUINT64_FORMAT, harmonic, ewma);
+
+  return harmonic ? MIN (harmonic, ewma) : ewma;
+}
+
+static guint64
+abr_select_moving_average (GstAdaptiveDemuxAbr * abr,
+    const GstAdaptiveDemuxAbrState * state)
+{
+  guint64 last, average;
+
+  if (abr->n_fragments == 0)
+    return 0;
+
+  last = abr->fragment_bitrates[(abr->n_fragments - 1) %
+      NUM_HARMONIC_FRAGMENTS];
+  average = abr_moving_average (abr);
+
+  GST_DEBUG ("Last fragment bitrate was %" G_GUINT64_FORMAT ", last %u "
+      "fragments average is %" G_GUINT64_FORMAT, last,
+      NUM_LOOKBACK_FRAGMENTS, average);
+
+  /* Conservative approach, make sure we don't upgrade too fast */
+  return MIN (average, last) * state->bitrate_limit;
+}
+
+static guint64
+abr_select_throughput (GstAdaptiveDemuxAbr * abr,
+    const GstAdaptiveDemuxAbrState * state)
+{
+  return abr_estimate_throughput (abr) * state->bitrate_limit;
+}
+
+/* Highest of @bitrates that can be downloaded at @throughput, or the
+ * lowest one */
+static guint
+abr_index_for_throughput (const GstAdaptiveDemuxAbrState * state,
+    guint64 throughput)
+{
+  guint i;
+
+  for (i = state->n_bitrates - 1; i > 0; i--) {
+    if (state->bitrates[i] <= throughput)
+      break;
+  }
+
+  return i;
+}
+
+/* Buffer level from which BOLA picks @index, in seconds */
+static gdouble
+abr_bola_min_buffer (const GstAdaptiveDemuxAbrState * state, gdouble vp,
+    gdouble gp, guint index)
+{
+  gdouble b0, b1, u0, u1;
+
+  if (index == 0)
+    return 0;
+
+  b0 = state->bitrates[index - 1];
+  b1 = state->bitrates[index];
+  u0 = log (b0 / state->bitrates[0]) + 1;
+  u1 = log (b1 / state->bitrates[0]) + 1;
+
+  return vp * (b1 * (u0 + gp) - b0 * (u1 + gp)) / (b1 - b0);
+}
+
+/* BOLA (Spiteri et al., "BOLA: Near-Optimal Bitrate Adaptation for Online
+ * Videos"): picks the bitrate maximizing (V * (utility + gamma) - buffer) /
+ * size, with utility = log (size / lowest size), so that the buffer level
+ * alone drives the decision.
+ *
+ * Like dash.js does, the throughput is used while the buffer fills up at
+ * startup or after a seek, and BOLA then starts from a placeholder buffer
+ * level matching that bitrate, replaced by actual data as it gets
+ * buffered. BOLA also never goes up further than the throughput allows, to
+ * avoid the oscillations it is prone to with bursty downloads. */
+static guint64
+abr_select_bola (GstAdaptiveDemuxAbr * abr,
+    const GstAdaptiveDemuxAbrState * state)
+{
+  gdouble speed = MAX (1.0, ABS (state->rate));
+  gdouble buffer_level, duration, buffer_target, gp, vp, best_score = 0;
+  guint64 throughput;
+  guint i, index, throughput_index;
+
+  if (state->n_bitrates < 2 || !GST_CLOCK_TIME_IS_VALID (state->buffer_level)
+      || !GST_CLOCK_TIME_IS_VALID (state->fragment_duration)) {
+    abr->last_index = G_MAXUINT;
+    return abr_select_throughput (abr, state);
+  }
+
+  throughput = abr_estimate_throughput (abr) * state->bitrate_limit / speed;
+  throughput_index = abr_index_for_throughput (state, throughput);
+
+  buffer_level = (gdouble) state->buffer_level / GST_SECOND;
+  duration = (gdouble) state->fragment_duration / GST_SECOND;
+  buffer_target = MAX (BOLA_STABLE_BUFFER,
+      BOLA_MIN_BUFFER + BOLA_BUFFER_PER_LEVEL * state->n_bitrates);
+  gp = log ((gdouble) state->bitrates[state->n_bitrates - 1] /
+      state->bitrates[0]) / (buffer_target / BOLA_MIN_BUFFER - 1);
+  vp = BOLA_MIN_BUFFER / gp;
+
+  if (abr->last_index >= state->n_bitrates || buffer_level < duration) {
+    GST_DEBUG ("Buffer level %" GST_TIME_FORMAT ", still filling up",
+        GST_TIME_ARGS (state->buffer_level));
+    index = throughput_index;
+    /* with a fragment of margin, to not sit right on the threshold */
+    abr->placeholder = MAX (0.0,
+        abr_bola_min_buffer (state, vp, gp, index) + duration - buffer_level);
+    goto done;
+  }
+
+  if (buffer_level > abr->last_buffer_level)
+    abr->placeholder = MAX (0.0,
+        abr->placeholder - (buffer_level - abr->last_buffer_level));
+
+  index = 0;
+  for (i = 0; i < state->n_bitrates; i++) {
+    gdouble utility = log ((gdouble) state->bitrates[i] /
+        state->bitrates[0]) + 1;
+    gdouble score = (vp * (utility + gp) - buffer_level - abr->placeholder) /
+        state->bitrates[i];
+
+    if (i == 0 || score >= best_score) {
+      best_score = score;
+      index = i;
+    }
+  }
+
+  if (index > throughput_index && index > abr->last_index)
+    index = MAX (throughput_index, abr->last_index);
+
+  /* don't keep more placeholder than what makes BOLA stay at @index */
+  abr->placeholder = CLAMP (vp * (log ((gdouble) state->bitrates[index] /
+              state->bitrates[0]) + 1 + gp) - buffer_level, 0.0,
+      abr->placeholder);
+
+  GST_DEBUG ("Buffer level %" GST_TIME_FORMAT " (+ %.3fs), BOLA picks "
+      "bitrate %" G_GUINT64_FORMAT " (throughput allows %" G_GUINT64_FORMAT
+      ")", GST_TIME_ARGS (state->buffer_level), abr->placeholder,
+      state->bitrates[index], state->bitrates[throughput_index]);
+
+done:
+  abr->last_index = index;
+  abr->last_buffer_level = buffer_level;
+  return state->bitrates[index] * speed;
+}
+
+static const AbrAlgorithm abr_algorithms[] = {
+  [GST_ADAPTIVE_DEMUX_ABR_MOVING_AVERAGE] = {FALSE, abr_select_moving_average},
+  [GST_ADAPTIVE_DEMUX_ABR_THROUGHPUT] = {FALSE, abr_select_throughput},
+  [GST_ADAPTIVE_DEMUX_ABR_BOLA] = {TRUE, abr_select_bola},
+};
+
+GType
+gst_adaptive_demux_abr_algorithm_get_type (void)
+{
+  static gsize id = 0;
+  static const GEnumValue values[] = {
+    {GST_ADAPTIVE_DEMUX_ABR_MOVING_AVERAGE,
+        "Average throughput of the last fragments", "moving-average"},
+    {GST_ADAPTIVE_DEMUX_ABR_THROUGHPUT,
+        "Smoothed throughput measured while downloading", "throughput"},
+    {GST_ADAPTIVE_DEMUX_ABR_BOLA, "Buffer level based (BOLA)", "bola"},
+    {0, NULL, NULL}
+  };
+
+  if (g_once_init_enter (&id)) {
+    GType tmp = g_enum_register_static ("GstAdaptiveDemuxAbrAlgorithm",
+        values);
+    g_once_init_leave (&id, tmp);
+  }
+
+  return (GType) id;
+}
+
+GstAdaptiveDemuxAbr *
+gst_adaptive_demux_abr_new (GstAdaptiveDemuxAbrAlgorithm algorithm)
+{
+  GstAdaptiveDemuxAbr *abr = g_slice_new0 (GstAdaptiveDemuxAbr);
+
+  g_mutex_init (&abr->lock);
+  abr->algorithm = algorithm;
+  abr->sample_start = GST_CLOCK_TIME_NONE;
+  abr->last_received = GST_CLOCK_TIME_NONE;
+  abr->last_index = G_MAXUINT;
+  abr_ewma_init (&abr->fast, EWMA_FAST_HALF_LIFE);
+  abr_ewma_init (&abr->slow, EWMA_SLOW_HALF_LIFE);
+
+  return abr;
+}
+
+void
+gst_adaptive_demux_abr_free (GstAdaptiveDemuxAbr * abr)
+{
+  g_mutex_clear (&abr->lock);
+  g_slice_free (GstAdaptiveDemuxAbr, abr);
+}
+
+void
+gst_adaptive_demux_abr_set_algorithm (GstAdaptiveDemuxAbr * abr,
+    GstAdaptiveDemuxAbrAlgorithm algorithm)
+{
+  g_mutex_lock (&abr->lock);
+  abr->algorithm = algorithm;
+  abr->last_index = G_MAXUINT;
+  g_mutex_unlock (&abr->lock);
+}
+
+/* Whether the bitrates available to the stream are needed to select one */
+gboolean
+gst_adaptive_demux_abr_needs_bitrates (GstAdaptiveDemuxAbr * abr)
+{
+  gboolean ret;
+
+  g_mutex_lock (&abr->lock);
+  ret = abr_algorithms[abr->algorithm].needs_bitrates;
+  g_mutex_unlock (&abr->lock);
+
+  return ret;
+}
+
+/* Called when the src element starts a new download, which may also be
+ * the header or index of the fragment. @incomplete tells if the server
+ * may still be producing the data */
+void
+gst_adaptive_demux_abr_download_started (GstAdaptiveDemuxAbr * abr,
+    gboolean incomplete)
+{
+  g_mutex_lock (&abr->lock);
+  abr->sample_start = GST_CLOCK_TIME_NONE;
+  abr->sample_bytes = 0;
+  abr->incomplete = incomplete;
+  abr->last_received = GST_CLOCK_TIME_NONE;
+  g_mutex_unlock (&abr->lock);
+}
+
+/* Called for each buffer of a fragment coming from the network, @now being
+ * the time it was received at */
+void
+gst_adaptive_demux_abr_data_received (GstAdaptiveDemuxAbr * abr, gsize size,
+    GstClockTime now)
+{
+  g_mutex_lock (&abr->lock);
+
+  /* the data of a fragment still being produced comes in bursts, only
+   * measure the throughput within them */
+  if (abr->incomplete && GST_CLOCK_TIME_IS_VALID (abr->last_received) &&
+      now > abr->last_received + MAX_BURST_GAP) {
+    abr->idle_time += now - abr->last_received;
+    abr->sample_start = GST_CLOCK_TIME_NONE;
+  }
+  abr->last_received = now;
+
+  /* the first buffer only tells when the data started flowing, the time it
+   * took to get there is latency, not throughput */
+  if (!GST_CLOCK_TIME_IS_VALID (abr->sample_start) || now < abr->sample_start) {
+    abr->sample_start = now;
+    abr->sample_bytes = 0;
+    goto done;
+  }
+
+  abr->sample_bytes += size;
+  if (abr->sample_bytes >= MIN_SAMPLE_BYTES &&
+      now - abr->sample_start >= MIN_SAMPLE_TIME) {
+    abr_add_sample (abr, abr->sample_bytes, now - abr->sample_start);
+    abr->n_fragment_samples++;
+    abr->sample_start = now;
+    abr->sample_bytes = 0;
+  }
+
+done:
+  g_mutex_unlock (&abr->lock);
+}
+
+/* Called once a fragment is done, with its overall download bitrate */
+void
+gst_adaptive_demux_abr_fragment_finished (GstAdaptiveDemuxAbr * abr,
+    guint64 bitrate, GstClockTime download_time)
+{
+  g_mutex_lock (&abr->lock);
+
+  /* leave out the time spent waiting for the server to produce the data */
+  if (abr->idle_time > 0 && GST_CLOCK_TIME_IS_VALID (download_time) &&
+      download_time > abr->idle_time) {
+    bitrate = gst_util_uint64_scale (bitrate, download_time,
+        download_time - abr->idle_time);
+    download_time -= abr->idle_time;
+  }
+
+  abr->fragment_bitrates[abr->n_fragments % NUM_HARMONIC_FRAGMENTS] = bitrate;
+  abr->n_fragments++;
+
+  /* Fragments too small or received too fast to get samples from, or that
+   * weren't downloaded by the src element, still count as a whole */
+  if (abr->n_fragment_samples == 0 && bitrate > 0 &&
+      GST_CLOCK_TIME_IS_VALID (download_time) && download_time > 0)
+    abr_add_sample (abr, gst_util_uint64_scale (bitrate, download_time,
+            8 * GST_SECOND), download_time);
+
+  abr->sample_start = GST_CLOCK_TIME_NONE;
+  abr->sample_bytes = 0;
+  abr->n_fragment_samples = 0;
+  abr->last_received = GST_CLOCK_TIME_NONE;
+  abr->idle_time = 0;
+
+  g_mutex_unlock (&abr->lock);
+}
+
+/* Returns the bitrate the stream should switch to for its next fragment,
+ * as passed to GstAdaptiveDemuxClass.stream_select_bitrate() */
+guint64
+gst_adaptive_demux_abr_select_bitrate (GstAdaptiveDemuxAbr * abr,
+    const GstAdaptiveDemuxAbrState * state)
+{
+  guint64 ret;
+
+  g_mutex_lock (&abr->lock);
+  ret = abr_algorithms[abr->algorithm].select (abr, state);
+  g_mutex_unlock (&abr->lock);
+
+  return ret;
+}
@@ -0,0 +1,81 @@
+/* GStreamer
+ *
+ * gstadaptivedemuxabr.h: bitrate adaptation for adaptive demuxers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_ADAPTIVE_DEMUX_ABR_H__
+#define __GST_ADAPTIVE_DEMUX_ABR_H__
+
+#include "gstadaptivedemux.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GstAdaptiveDemuxAbr GstAdaptiveDemuxAbr;
+
+/* What is known about a stream when picking the bitrate of its next
+ * fragment */
+typedef struct
+{
+  /* media pushed downstream but not played yet, GST_CLOCK_TIME_NONE if
+   * unknown */
+  GstClockTime buffer_level;
+  GstClockTime fragment_duration;
+
+  /* distinct non-zero bitrates the stream can switch to in ascending
+   * order, NULL if unknown */
+  const guint64 *bitrates;
+  guint n_bitrates;
+
+  /* share of the estimated throughput that may be used */
+  gfloat bitrate_limit;
+  gdouble rate;
+} GstAdaptiveDemuxAbrState;
+
+G_GNUC_INTERNAL
+GstAdaptiveDemuxAbr *gst_adaptive_demux_abr_new
+    (GstAdaptiveDemuxAbrAlgorithm algorithm);
+
+G_GNUC_INTERNAL
+void gst_adaptive_demux_abr_free (GstAdaptiveDemuxAbr * abr);
+
+G_GNUC_INTERNAL
+void gst_adaptive_demux_abr_set_algorithm (GstAdaptiveDemuxAbr * abr,
+    GstAdaptiveDemuxAbrAlgorithm algorithm);
+
+G_GNUC_INTERNAL
+gboolean gst_adaptive_demux_abr_needs_bitrates (GstAdaptiveDemuxAbr * abr);
+
+G_GNUC_INTERNAL
+void gst_adaptive_demux_abr_download_started (GstAdaptiveDemuxAbr * abr,
+    gboolean incomplete);
+
+G_GNUC_INTERNAL
+void gst_adaptive_demux_abr_data_received (GstAdaptiveDemuxAbr * abr,
+    gsize size, GstClockTime now);
+
+G_GNUC_INTERNAL
+void gst_adaptive_demux_abr_fragment_finished (GstAdaptiveDemuxAbr * abr,
+    guint64 bitrate, GstClockTime download_time);
+
+G_GNUC_INTERNAL
+guint64 gst_adaptive_demux_abr_select_bitrate (GstAdaptiveDemuxAbr * abr,
+    const GstAdaptiveDemuxAbrState * state);
+
+G_END_DECLS
+
+#endif /* __GST_ADAPTIVE_DEMUX_ABR_H__ */
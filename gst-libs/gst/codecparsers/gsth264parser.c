@@ -1042,7 +1042,6 @@ gst_h264_parser_parse_registered_user_data (GstH264NalParser * nalparser,
     GstH264RegisteredUserData * rud, NalReader * nr, guint payload_size)
 {
   guint8 *data = NULL;
-  guint i;
 
   rud->data = NULL;
   rud->size = 0;
@@ -1068,9 +1067,7 @@ gst_h264_parser_parse_registered_user_data (GstH264NalParser * nalparser,
   }
 
   data = g_malloc (payload_size);
-  for (i = 0; i < payload_size; ++i) {
-    READ_UINT8 (nr, data[i], 8);
-  }
+  READ_BYTES (nr, data, payload_size);
 
   GST_MEMDUMP ("SEI user data", data, payload_size);
 
@@ -1240,14 +1237,11 @@ gst_h264_parser_parse_sei_unhandled_payload (GstH264NalParser * parser,
     guint payload_size)
 {
   guint8 *data = NULL;
-  gint i;
 
   payload->payloadType = payload_type;
 
   data = g_malloc0 (payload_size);
-  for (i = 0; i < payload_size; ++i) {
-    READ_UINT8 (nr, data[i], 8);
-  }
+  READ_BYTES (nr, data, payload_size);
 
   payload->size = payload_size;
   payload->data = data;
@@ -1196,7 +1196,6 @@ gst_h265_parser_parse_registered_user_data (GstH265Parser * parser,
     GstH265RegisteredUserData * rud, NalReader * nr, guint payload_size)
 {
   guint8 *data = NULL;
-  guint i;
 
   rud->data = NULL;
   rud->size = 0;
@@ -1222,9 +1221,7 @@ gst_h265_parser_parse_registered_user_data (GstH265Parser * parser,
   }
 
   data = g_malloc (payload_size);
-  for (i = 0; i < payload_size; ++i) {
-    READ_UINT8 (nr, data[i], 8);
-  }
+  READ_BYTES (nr, data, payload_size);
 
   GST_MEMDUMP ("SEI user data", data, payload_size);
 
@@ -36,6 +36,7 @@
 #endif
 
 #include "nalutils.h"
+#include "scanutils.h"
 #include <string.h>
 
 /* Compute Ceil(Log2(v)) */
@@ -64,6 +65,107 @@ ceil_log2 (guint32 v)
 
 /****** Nal parser ******/
 
+/* Emulation prevention bytes are searched for in chunks of this size ahead of
+ * the read position, so that reading a header doesn't scan the whole NAL */
+#define NAL_READER_EPB_SCAN_SIZE 128
+
+static inline guint
+nal_reader_clz64 (guint64 v)
+{
+#if defined(__GNUC__)
+  return __builtin_clzll (v);
+#else
+  guint n = 0;
+
+  while (!(v & G_GUINT64_CONSTANT (0x8000000000000000))) {
+    v <<= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+/* Updates epb_stop with the next emulation prevention byte found in the raw
+ * data from @from, or with the end of the scanned area if none */
+static void
+nal_reader_scan_epb (NalReader * nr, guint from)
+{
+  guint len = MIN (NAL_READER_EPB_SCAN_SIZE, nr->size - from);
+  gint off;
+
+  off = scan_for_emulation_prevention (nr->data + from, len);
+  if (off >= 0) {
+    nr->epb_stop = from + off + 2;
+    nr->epb_at_stop = TRUE;
+  } else {
+    /* the last two bytes may start a pattern finishing in the next chunk */
+    nr->epb_stop = from + len;
+    nr->epb_at_stop = FALSE;
+  }
+}
+
+/* Number of raw bytes and emulation prevention bytes which were loaded in
+ * the cache ahead of the byte holding the next bit to read */
+static inline void
+nal_reader_get_lookahead (const NalReader * nr, guint * bytes, guint * epb)
+{
+  guint unread = nr->bits_in_cache >> 3;
+  guint mask = nr->epb_mask & ((1 << unread) - 1);
+  guint n_epb = nr->epb_pending ? 1 : 0;
+
+  while (mask) {
+    n_epb++;
+    mask &= mask - 1;
+  }
+
+  *bytes = unread + n_epb;
+  *epb = n_epb;
+}
+
+/* Fills the cache with as many RBSP bytes as it can hold. Runs of bytes
+ * without emulation prevention bytes in them are loaded at once. */
+static void
+nal_reader_refill (NalReader * nr)
+{
+  while (nr->bits_in_cache <= 56) {
+    guint n, i;
+
+    if (nr->byte == nr->epb_stop) {
+      if (nr->byte >= nr->size)
+        break;
+
+      if (!nr->epb_at_stop) {
+        nal_reader_scan_epb (nr, nr->byte - 2);
+        continue;
+      }
+
+      /* a trailing emulation prevention byte is never followed by data */
+      if (nr->byte + 1 >= nr->size)
+        break;
+
+      nr->byte++;
+      nr->n_epb++;
+      nr->epb_pending = TRUE;
+      nal_reader_scan_epb (nr, nr->byte);
+      continue;
+    }
+
+    n = MIN ((64 - nr->bits_in_cache) >> 3, nr->epb_stop - nr->byte);
+
+    if (n == 8) {
+      nr->cache = GST_READ_UINT64_BE (nr->data + nr->byte);
+    } else {
+      for (i = 0; i < n; i++)
+        nr->cache = (nr->cache << 8) | nr->data[nr->byte + i];
+    }
+
+    nr->epb_mask = (nr->epb_mask << n) | (nr->epb_pending << (n - 1));
+    nr->epb_pending = FALSE;
+    nr->byte += n;
+    nr->bits_in_cache += n * 8;
+  }
+}
+
 void
 nal_reader_init (NalReader * nr, const guint8 * data, guint size)
 {
@@ -73,39 +175,24 @@ nal_reader_init (NalReader * nr, const guint8 * data, guint size)
 
   nr->byte = 0;
   nr->bits_in_cache = 0;
-  /* fill with something other than 0 to detect emulation prevention bytes */
-  nr->first_byte = 0xff;
-  nr->epb_cache = 0xff;
-  nr->cache = 0xff;
+  nr->cache = 0;
+
+  nr->epb_pending = FALSE;
+  nr->epb_mask = 0;
+  nal_reader_scan_epb (nr, 0);
 }
 
 gboolean
 nal_reader_read (NalReader * nr, guint nbits)
 {
-  if (G_UNLIKELY (nr->byte * 8 + (nbits - nr->bits_in_cache) > nr->size * 8)) {
-    GST_DEBUG ("Can not read %u bits, bits in cache %u, Byte * 8 %u, size in "
-        "bits %u", nbits, nr->bits_in_cache, nr->byte * 8, nr->size * 8);
-    return FALSE;
-  }
-
-  while (nr->bits_in_cache < nbits) {
-    guint8 byte;
+  if (G_UNLIKELY (nr->bits_in_cache < nbits)) {
+    nal_reader_refill (nr);
 
-  next_byte:
-    if (G_UNLIKELY (nr->byte >= nr->size))
+    if (G_UNLIKELY (nr->bits_in_cache < nbits)) {
+      GST_DEBUG ("Can not read %u bits, bits in cache %u, Byte * 8 %u, size in "
+          "bits %u", nbits, nr->bits_in_cache, nr->byte * 8, nr->size * 8);
       return FALSE;
-
-    byte = nr->data[nr->byte++];
-    nr->epb_cache = (nr->epb_cache << 8) | byte;
-
-    /* check if the byte is a emulation_prevention_three_byte */
-    if ((nr->epb_cache & 0xffffff) == 0x3) {
-      nr->n_epb++;
-      goto next_byte;
     }
-    nr->cache = (nr->cache << 8) | nr->first_byte;
-    nr->first_byte = byte;
-    nr->bits_in_cache += 8;
   }
 
   return TRUE;
@@ -118,6 +205,14 @@ nal_reader_skip (NalReader * nr, guint nbits)
 {
   g_assert (nbits <= 8 * sizeof (nr->cache));
 
+  /* the cache might not be refilled with a whole 64 bits */
+  if (nbits > 32) {
+    if (G_UNLIKELY (!nal_reader_read (nr, 32)))
+      return FALSE;
+    nr->bits_in_cache -= 32;
+    nbits -= 32;
+  }
+
   if (G_UNLIKELY (!nal_reader_read (nr, nbits)))
     return FALSE;
 
@@ -144,43 +239,53 @@ nal_reader_skip_long (NalReader * nr, guint nbits)
   return TRUE;
 }
 
+/* Positions and counts are reported as if only the bytes up to the one
+ * holding the next bit had been read, the prefetched ones don't count */
 guint
 nal_reader_get_pos (const NalReader * nr)
 {
-  return nr->byte * 8 - nr->bits_in_cache;
+  guint bytes, epb;
+
+  nal_reader_get_lookahead (nr, &bytes, &epb);
+
+  return (nr->byte - bytes) * 8 - (nr->bits_in_cache & 7);
 }
 
 guint
 nal_reader_get_remaining (const NalReader * nr)
 {
-  return (nr->size - nr->byte) * 8 + nr->bits_in_cache;
+  guint bytes, epb;
+
+  nal_reader_get_lookahead (nr, &bytes, &epb);
+
+  return (nr->size - nr->byte + bytes) * 8 + (nr->bits_in_cache & 7);
 }
 
 guint
 nal_reader_get_epb_count (const NalReader * nr)
 {
-  return nr->n_epb;
+  guint bytes, epb;
+
+  nal_reader_get_lookahead (nr, &bytes, &epb);
+
+  return nr->n_epb - epb;
 }
 
 #define NAL_READER_READ_BITS(bits) \
 gboolean \
 nal_reader_get_bits_uint##bits (NalReader *nr, guint##bits *val, guint nbits) \
 { \
-  guint shift; \
+  if (G_UNLIKELY (nbits == 0)) { \
+    *val = 0; \
+    return TRUE; \
+  } \
   \
   if (!nal_reader_read (nr, nbits)) \
     return FALSE; \
   \
-  /* bring the required bits down and truncate */ \
-  shift = nr->bits_in_cache - nbits; \
-  *val = nr->first_byte >> shift; \
-  \
-  *val |= nr->cache << (8 - shift); \
-  /* mask out required bits */ \
-  if (nbits < bits) \
-    *val &= ((guint##bits)1 << nbits) - 1; \
-  \
-  nr->bits_in_cache = shift; \
+  /* bring the required bits down and mask them out */ \
+  nr->bits_in_cache -= nbits; \
+  *val = (nr->cache >> nr->bits_in_cache) & (G_MAXUINT64 >> (64 - nbits)); \
   \
   return TRUE; \
 } \
@@ -204,22 +309,28 @@ NAL_READER_PEEK_BITS (8);
 gboolean
 nal_reader_get_ue (NalReader * nr, guint32 * val)
 {
-  guint i = 0;
-  guint8 bit;
+  guint i;
   guint32 value;
 
-  if (G_UNLIKELY (!nal_reader_get_bits_uint8 (nr, &bit, 1)))
+  /* the prefix can be up to 32 bits, followed by the stop bit */
+  if (nr->bits_in_cache < 33)
+    nal_reader_refill (nr);
+
+  if (G_UNLIKELY (nr->bits_in_cache == 0))
     return FALSE;
 
-  while (bit == 0) {
-    i++;
-    if (G_UNLIKELY (!nal_reader_get_bits_uint8 (nr, &bit, 1)))
-      return FALSE;
-  }
+  /* count the leading zero bits in one go instead of bit by bit */
+  value = 0;
+  i = nr->bits_in_cache;
+  if (nr->cache << (64 - nr->bits_in_cache))
+    i = nal_reader_clz64 (nr->cache << (64 - nr->bits_in_cache));
 
-  if (G_UNLIKELY (i > 31))
+  if (G_UNLIKELY (i > 31 || i >= nr->bits_in_cache))
     return FALSE;
 
+  /* skip the zeros and the stop bit */
+  nr->bits_in_cache -= i + 1;
+
   if (G_UNLIKELY (!nal_reader_get_bits_uint32 (nr, &value, i)))
     return FALSE;
 
@@ -247,7 +358,7 @@ nal_reader_get_se (NalReader * nr, gint32 * val)
 gboolean
 nal_reader_is_byte_aligned (NalReader * nr)
 {
-  if (nr->bits_in_cache != 0)
+  if ((nr->bits_in_cache & 7) != 0)
     return FALSE;
   return TRUE;
 }
@@ -293,17 +404,42 @@ nal_reader_has_more_data (NalReader * nr)
   return FALSE;
 }
 
+/* Copies @nbytes RBSP bytes to @dest. Runs of bytes between emulation
+ * prevention bytes are copied at once when the cache is empty. */
+gboolean
+nal_reader_get_bytes (NalReader * nr, guint8 * dest, guint nbytes)
+{
+  while (nbytes > 0) {
+    guint n;
+
+    /* the cache takes care of unaligned data and emulation prevention
+     * bytes */
+    if (nr->bits_in_cache > 0 || nr->byte == nr->epb_stop) {
+      if (!nal_reader_get_bits_uint8 (nr, dest, 8))
+        return FALSE;
+      dest++;
+      nbytes--;
+      continue;
+    }
+
+    n = MIN (nbytes, nr->epb_stop - nr->byte);
+    memcpy (dest, nr->data + nr->byte, n);
+    nr->byte += n;
+    nr->epb_pending = FALSE;
+    dest += n;
+    nbytes -= n;
+  }
+
+  return TRUE;
+}
+
 /***********  end of nal parser ***************/
 
 gint
 scan_for_start_codes (const guint8 * data, guint size)
 {
-  GstByteReader br;
-  gst_byte_reader_init (&br, data, size);
-
   /* NALU not empty, so we can at least expect 1 (even 2) bytes following sc */
-  return gst_byte_reader_masked_scan_uint32 (&br, 0xffffff00, 0x00000100,
-      0, size);
+  return scan_for_start_code_prefix (data, size);
 }
 
 void
@@ -50,9 +50,16 @@ typedef struct
   guint n_epb;                  /* Number of emulation prevention bytes */
   guint byte;                   /* Byte position */
   guint bits_in_cache;          /* bitpos in the cache of next bit */
-  guint8 first_byte;
-  guint32 epb_cache;            /* cache 3 bytes to check emulation prevention bytes */
-  guint64 cache;                /* cached bytes */
+  guint64 cache;                /* cached RBSP bits, right aligned */
+
+  guint epb_stop;               /* next emulation prevention byte, or end of
+                                 * the area scanned for them so far */
+  gboolean epb_at_stop;         /* whether epb_stop is an emulation
+                                 * prevention byte */
+  gboolean epb_pending;         /* an emulation prevention byte was skipped
+                                 * but the byte after it is not cached yet */
+  guint8 epb_mask;              /* one bit per cached byte, set if it
+                                 * followed an emulation prevention byte */
 } NalReader;
 
 typedef struct
@@ -90,6 +97,9 @@ gboolean nal_reader_is_byte_aligned (NalReader * nr);
 G_GNUC_INTERNAL
 gboolean nal_reader_has_more_data (NalReader * nr);
 
+G_GNUC_INTERNAL
+gboolean nal_reader_get_bytes (NalReader * nr, guint8 * dest, guint nbytes);
+
 #define NAL_READER_READ_BITS_H(bits) \
 G_GNUC_INTERNAL \
 gboolean nal_reader_get_bits_uint##bits (NalReader *nr, guint##bits *val, guint nbits)
@@ -158,6 +168,13 @@ gboolean nal_reader_get_se (NalReader * nr, gint32 * val);
   } \
 }
 
+#define READ_BYTES(nr, data, nbytes) { \
+  if (!nal_reader_get_bytes (nr, data, nbytes)) { \
+    GST_WARNING ("failed to read %u bytes for '" G_STRINGIFY (data) "'", nbytes); \
+    goto error; \
+  } \
+}
+
 #define READ_UE(nr, val) { \
   if (!nal_reader_get_ue (nr, &val)) { \
     GST_WARNING ("failed to read UE for '" G_STRINGIFY (val) "'"); \
@@ -0,0 +1,240 @@
+/* GStreamer
+ *
+ * scanutils.c: start code and emulation prevention byte scanners
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Start code and emulation prevention byte scanners.
+ *
+ * Both searches look for a 0x00 0x00 0xXX pattern, so they share a single
+ * set of kernels parametrized on the third byte. A vector kernel is picked
+ * once at runtime depending on the CPU (SSE2/AVX2 on x86, NEON on ARM) and
+ * a portable C version is used everywhere else, as well as for the tail of
+ * the data that doesn't fill a whole vector.
+ */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#include "scanutils.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  include <immintrin.h>
+#  define HAVE_SCAN_SSE2 1
+#  define HAVE_SCAN_AVX2 1
+#  define SCAN_TARGET(t) __attribute__ ((target (t)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64))
+#  include <emmintrin.h>
+#  define HAVE_SCAN_SSE2 1
+#  define SCAN_TARGET(t)
+#elif defined(__GNUC__) && defined(__ARM_NEON)
+#  include <arm_neon.h>
+#  define HAVE_SCAN_NEON 1
+#endif
+
+/* @need is the number of bytes that must be available from the start of a
+ * match: 4 for start codes (the NAL/packet header byte must follow), 3 for
+ * emulation prevention bytes, which may terminate the data */
+typedef gint (*ScanFunc) (const guint8 * data, guint size, guint8 third,
+    guint need);
+
+typedef struct
+{
+  const gchar *name;
+  ScanFunc scan;
+} ScanKernel;
+
+static gint
+scan_pattern_c (const guint8 * data, guint size, guint8 third, guint need)
+{
+  guint i = 0;
+
+  if (G_UNLIKELY (size < need))
+    return -1;
+
+  while (i <= size - need) {
+    guint8 c = data[i + 2];
+
+    /* data[i + 2] is neither part of a match starting at i, i + 1 nor i + 2,
+     * skip ahead as far as possible */
+    if (c != 0 && c != third) {
+      i += 3;
+    } else if (data[i + 1]) {
+      i += 2;
+    } else if (data[i] || c != third) {
+      i++;
+    } else {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+#ifdef HAVE_SCAN_SSE2
+static gint SCAN_TARGET ("sse2")
+scan_pattern_sse2 (const guint8 * data, guint size, guint8 third, guint need)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i pattern = _mm_set1_epi8 ((char) third);
+  guint i = 0;
+  gint ret;
+
+  /* all 16 candidate positions must be complete matches if found */
+  while (i + 15 + need <= size) {
+    __m128i b0 = _mm_loadu_si128 ((const __m128i *) (data + i));
+    __m128i b1 = _mm_loadu_si128 ((const __m128i *) (data + i + 1));
+    __m128i b2 = _mm_loadu_si128 ((const __m128i *) (data + i + 2));
+    __m128i m;
+    gint mask;
+
+    m = _mm_and_si128 (_mm_cmpeq_epi8 (b0, zero), _mm_cmpeq_epi8 (b1, zero));
+    m = _mm_and_si128 (m, _mm_cmpeq_epi8 (b2, pattern));
+    mask = _mm_movemask_epi8 (m);
+    if (mask)
+      return i + g_bit_nth_lsf (mask, -1);
+
+    i += 16;
+  }
+
+  ret = scan_pattern_c (data + i, size - i, third, need);
+  return ret < 0 ? -1 : i + ret;
+}
+#endif
+
+#ifdef HAVE_SCAN_AVX2
+static gint SCAN_TARGET ("avx2")
+scan_pattern_avx2 (const guint8 * data, guint size, guint8 third, guint need)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  const __m256i pattern = _mm256_set1_epi8 ((char) third);
+  guint i = 0;
+  gint ret;
+
+  while (i + 31 + need <= size) {
+    __m256i b0 = _mm256_loadu_si256 ((const __m256i *) (data + i));
+    __m256i b1 = _mm256_loadu_si256 ((const __m256i *) (data + i + 1));
+    __m256i b2 = _mm256_loadu_si256 ((const __m256i *) (data + i + 2));
+    __m256i m;
+    guint32 mask;
+
+    m = _mm256_and_si256 (_mm256_cmpeq_epi8 (b0, zero),
+        _mm256_cmpeq_epi8 (b1, zero));
+    m = _mm256_and_si256 (m, _mm256_cmpeq_epi8 (b2, pattern));
+    mask = (guint32) _mm256_movemask_epi8 (m);
+    if (mask)
+      return i + __builtin_ctz (mask);
+
+    i += 32;
+  }
+
+  ret = scan_pattern_c (data + i, size - i, third, need);
+  return ret < 0 ? -1 : i + ret;
+}
+#endif
+
+#ifdef HAVE_SCAN_NEON
+static gint
+scan_pattern_neon (const guint8 * data, guint size, guint8 third, guint need)
+{
+  const uint8x16_t zero = vdupq_n_u8 (0);
+  const uint8x16_t pattern = vdupq_n_u8 (third);
+  guint i = 0;
+  gint ret;
+
+  while (i + 15 + need <= size) {
+    uint8x16_t b0 = vld1q_u8 (data + i);
+    uint8x16_t b1 = vld1q_u8 (data + i + 1);
+    uint8x16_t b2 = vld1q_u8 (data + i + 2);
+    uint8x16_t m;
+    guint64 mask;
+
+    m = vandq_u8 (vceqq_u8 (b0, zero), vceqq_u8 (b1, zero));
+    m = vandq_u8 (m, vceqq_u8 (b2, pattern));
+    /* narrow to 4 bits per lane, there is no movemask on NEON */
+    mask = vget_lane_u64 (vreinterpret_u64_u8 (vshrn_n_u16
+            (vreinterpretq_u16_u8 (m), 4)), 0);
+    if (mask)
+      return i + (__builtin_ctzll (mask) >> 2);
+
+    i += 16;
+  }
+
+  ret = scan_pattern_c (data + i, size - i, third, need);
+  return ret < 0 ? -1 : i + ret;
+}
+#endif
+
+static const ScanKernel *
+scan_utils_get_kernel (void)
+{
+  static gsize init = 0;
+  static const ScanKernel *kernel = NULL;
+
+  if (g_once_init_enter (&init)) {
+    static const ScanKernel c_kernel = { "c", scan_pattern_c };
+#ifdef HAVE_SCAN_SSE2
+    static const ScanKernel sse2_kernel = { "sse2", scan_pattern_sse2 };
+#endif
+#ifdef HAVE_SCAN_AVX2
+    static const ScanKernel avx2_kernel = { "avx2", scan_pattern_avx2 };
+#endif
+#ifdef HAVE_SCAN_NEON
+    static const ScanKernel neon_kernel = { "neon", scan_pattern_neon };
+#endif
+
+    kernel = &c_kernel;
+
+#if defined(HAVE_SCAN_AVX2)
+    __builtin_cpu_init ();
+    if (__builtin_cpu_supports ("avx2"))
+      kernel = &avx2_kernel;
+    else if (__builtin_cpu_supports ("sse2"))
+      kernel = &sse2_kernel;
+#elif defined(HAVE_SCAN_SSE2)
+    /* SSE2 is part of the x86-64 baseline */
+    kernel = &sse2_kernel;
+#elif defined(HAVE_SCAN_NEON)
+    kernel = &neon_kernel;
+#endif
+
+    g_once_init_leave (&init, 1);
+  }
+
+  return kernel;
+}
+
+gint
+scan_for_start_code_prefix (const guint8 * data, guint size)
+{
+  /* NALU not empty, so we can at least expect 1 (even 2) bytes following sc */
+  return scan_utils_get_kernel ()->scan (data, size, 0x01, 4);
+}
+
+gint
+scan_for_emulation_prevention (const guint8 * data, guint size)
+{
+  return scan_utils_get_kernel ()->scan (data, size, 0x03, 3);
+}
+
+const gchar *
+scan_utils_get_kernel_name (void)
+{
+  return scan_utils_get_kernel ()->name;
+}
@@ -0,0 +1,51 @@
+/* GStreamer
+ *
+ * scanutils.h: start code and emulation prevention byte scanners
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * Byte pattern scanners shared by the start code based parsers
+ * (H.264, H.265, MPEG-1/2 video, VC-1).
+ */
+
+#ifndef __SCAN_UTILS_H__
+#define __SCAN_UTILS_H__
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/* Returns the offset of the first 0x000001 start code prefix in @data which
+ * is followed by at least one more byte, or -1 if there is none. */
+G_GNUC_INTERNAL
+gint scan_for_start_code_prefix (const guint8 * data, guint size);
+
+/* Returns the offset of the first 0x000003 sequence in @data, i.e. the
+ * position of the emulation_prevention_three_byte minus 2, or -1 if there
+ * is none. */
+G_GNUC_INTERNAL
+gint scan_for_emulation_prevention (const guint8 * data, guint size);
+
+/* Name of the kernel selected at runtime ("c", "sse2", "avx2", "neon"),
+ * for debugging and benchmarks */
+G_GNUC_INTERNAL
+const gchar * scan_utils_get_kernel_name (void);
+
+G_END_DECLS
+
+#endif /* __SCAN_UTILS_H__ */
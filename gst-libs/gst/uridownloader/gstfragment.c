@@ -160,6 +160,7 @@ gst_fragment_init (GstFragment * fragment)
   g_mutex_init (&fragment->priv->lock);
   priv->buffer = NULL;
   fragment->download_start_time = gst_util_get_timestamp ();
+  fragment->first_byte_time = GST_CLOCK_TIME_NONE;
   fragment->start_time = 0;
   fragment->stop_time = 0;
   fragment->index = 0;
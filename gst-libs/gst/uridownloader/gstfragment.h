@@ -52,6 +52,9 @@ struct _GstFragment
   gboolean completed;           /* Whether the fragment is complete or not */
   guint64 download_start_time;  /* Epoch time when the download started */
   guint64 download_stop_time;   /* Epoch time when the download finished */
+  guint64 first_byte_time;      /* Epoch time when the first byte was received */
+  gboolean reused_source;       /* Whether the source of a previous download,
+                                 * and so its connection, was reused */
   guint64 start_time;           /* Start time of the fragment */
   guint64 stop_time;            /* Stop time of the fragment */
   gboolean index;               /* Index of the fragment */
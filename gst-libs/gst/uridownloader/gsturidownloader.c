@@ -46,6 +46,13 @@ struct _GstUriDownloaderPrivate
 
   GCond cond;
   gboolean cancelled;
+
+  /* statistics, protected by the object lock */
+  guint64 n_requests;
+  guint64 n_sources_created;
+  guint64 n_sources_reused;
+  guint64 n_shared_contexts;
+  guint64 n_bytes;
 };
 
 static void gst_uri_downloader_finalize (GObject * object);
@@ -55,6 +62,8 @@ static GstFlowReturn gst_uri_downloader_chain (GstPad * pad, GstObject * parent,
     GstBuffer * buf);
 static gboolean gst_uri_downloader_sink_event (GstPad * pad, GstObject * parent,
     GstEvent * event);
+static gboolean gst_uri_downloader_sink_query (GstPad * pad, GstObject * parent,
+    GstQuery * query);
 static GstBusSyncReply gst_uri_downloader_bus_handler (GstBus * bus,
     GstMessage * message, gpointer data);
 
@@ -100,6 +109,8 @@ gst_uri_downloader_init (GstUriDownloader * downloader)
       GST_DEBUG_FUNCPTR (gst_uri_downloader_chain));
   gst_pad_set_event_function (downloader->priv->pad,
       GST_DEBUG_FUNCPTR (gst_uri_downloader_sink_event));
+  gst_pad_set_query_function (downloader->priv->pad,
+      GST_DEBUG_FUNCPTR (gst_uri_downloader_sink_query));
   gst_pad_set_element_private (downloader->priv->pad, downloader);
   gst_pad_set_active (downloader->priv->pad, TRUE);
 
@@ -167,6 +178,10 @@ gst_uri_downloader_new (void)
  * Sets an element as parent of this #GstUriDownloader so that context
  * requests from the underlying source are proxied to the main pipeline
  * and set back if a context was provided.
+ *
+ * Contexts posted by the underlying source are set on the parent as well.
+ * This lets all the downloaders and sources of the parent share the HTTP
+ * session of the first one, and with it its persistent connections.
  */
 void
 gst_uri_downloader_set_parent (GstUriDownloader * downloader,
@@ -175,6 +190,45 @@ gst_uri_downloader_set_parent (GstUriDownloader * downloader,
   g_weak_ref_set (&downloader->priv->parent, parent);
 }
 
+/**
+ * gst_uri_downloader_get_stats:
+ * @downloader: the #GstUriDownloader
+ *
+ * Returns statistics about the requests done by @downloader so far:
+ *
+ *  - "requests", #G_TYPE_UINT64: number of fetches
+ *  - "sources-created", #G_TYPE_UINT64: number of source elements created,
+ *    each of them opening its own connections unless it got a shared session
+ *  - "sources-reused", #G_TYPE_UINT64: number of fetches that reused the
+ *    source of a previous one, and so its persistent connection
+ *  - "shared-contexts", #G_TYPE_UINT64: number of contexts, such as the HTTP
+ *    session, given to a source from the parent set with
+ *    gst_uri_downloader_set_parent()
+ *  - "bytes", #G_TYPE_UINT64: number of bytes received
+ *
+ * Returns: (transfer full): a new #GstStructure
+ *
+ * Since: 1.20
+ */
+GstStructure *
+gst_uri_downloader_get_stats (GstUriDownloader * downloader)
+{
+  GstStructure *stats;
+
+  g_return_val_if_fail (GST_IS_URI_DOWNLOADER (downloader), NULL);
+
+  GST_OBJECT_LOCK (downloader);
+  stats = gst_structure_new ("GstUriDownloaderStats",
+      "requests", G_TYPE_UINT64, downloader->priv->n_requests,
+      "sources-created", G_TYPE_UINT64, downloader->priv->n_sources_created,
+      "sources-reused", G_TYPE_UINT64, downloader->priv->n_sources_reused,
+      "shared-contexts", G_TYPE_UINT64, downloader->priv->n_shared_contexts,
+      "bytes", G_TYPE_UINT64, downloader->priv->n_bytes, NULL);
+  GST_OBJECT_UNLOCK (downloader);
+
+  return stats;
+}
+
 static gboolean
 gst_uri_downloader_sink_event (GstPad * pad, GstObject * parent,
     GstEvent * event)
@@ -222,6 +276,43 @@ gst_uri_downloader_sink_event (GstPad * pad, GstObject * parent,
   return ret;
 }
 
+static gboolean
+gst_uri_downloader_sink_query (GstPad * pad, GstObject * parent,
+    GstQuery * query)
+{
+  GstUriDownloader *downloader;
+  GstElement *element;
+  GstContext *context = NULL;
+  const gchar *context_type;
+
+  downloader = GST_URI_DOWNLOADER (gst_pad_get_element_private (pad));
+
+  if (GST_QUERY_TYPE (query) != GST_QUERY_CONTEXT)
+    return gst_pad_query_default (pad, parent, query);
+
+  /* answer with the context of the parent, e.g. the HTTP session shared by
+   * its sources, before the source falls back to a need-context message */
+  gst_query_parse_context_type (query, &context_type);
+  element = g_weak_ref_get (&downloader->priv->parent);
+  if (element) {
+    context = gst_element_get_context (element, context_type);
+    gst_object_unref (element);
+  }
+
+  if (context == NULL)
+    return FALSE;
+
+  GST_DEBUG_OBJECT (downloader, "Answering %s context query", context_type);
+  gst_query_set_context (query, context);
+  gst_context_unref (context);
+
+  GST_OBJECT_LOCK (downloader);
+  downloader->priv->n_shared_contexts++;
+  GST_OBJECT_UNLOCK (downloader);
+
+  return TRUE;
+}
+
 static GstBusSyncReply
 gst_uri_downloader_bus_handler (GstBus * bus,
     GstMessage * message, gpointer data)
@@ -302,10 +393,29 @@ gst_uri_downloader_bus_handler (GstBus * bus,
       if (context) {
         gst_element_set_context (msg_src, context);
         gst_context_unref (context);
+
+        GST_OBJECT_LOCK (downloader);
+        downloader->priv->n_shared_contexts++;
+        GST_OBJECT_UNLOCK (downloader);
       }
     }
     if (parent)
       gst_object_unref (parent);
+  } else if (GST_MESSAGE_TYPE (message) == GST_MESSAGE_HAVE_CONTEXT) {
+    GstElement *parent = g_weak_ref_get (&downloader->priv->parent);
+
+    /* keep the context of our source, typically its HTTP session, on the
+     * parent so that its other sources reuse the same connections */
+    if (parent) {
+      GstContext *context;
+
+      gst_message_parse_have_context (message, &context);
+      GST_DEBUG_OBJECT (downloader, "Sharing %s context with %s",
+          gst_context_get_context_type (context), GST_ELEMENT_NAME (parent));
+      gst_element_set_context (parent, context);
+      gst_context_unref (context);
+      gst_object_unref (parent);
+    }
   }
 
   gst_message_unref (message);
@@ -333,7 +443,10 @@ gst_uri_downloader_chain (GstPad * pad, GstObject * parent, GstBuffer * buf)
 
   GST_LOG_OBJECT (downloader, "The uri fetcher received a new buffer "
       "of size %" G_GSIZE_FORMAT, gst_buffer_get_size (buf));
+  if (!downloader->priv->got_buffer)
+    downloader->priv->download->first_byte_time = gst_util_get_timestamp ();
   downloader->priv->got_buffer = TRUE;
+  downloader->priv->n_bytes += gst_buffer_get_size (buf);
   if (!gst_fragment_add_buffer (downloader->priv->download, buf)) {
     GST_WARNING_OBJECT (downloader, "Could not add buffer to fragment");
     gst_buffer_unref (buf);
@@ -422,6 +535,8 @@ gst_uri_downloader_ensure_src (GstUriDownloader * downloader, const gchar * uri)
             "Failed to re-use old source element: %s", err->message);
         g_clear_error (&err);
         gst_uri_downloader_destroy_src (downloader);
+      } else {
+        downloader->priv->n_sources_reused++;
       }
     }
     g_free (old_uri);
@@ -440,6 +555,7 @@ gst_uri_downloader_ensure_src (GstUriDownloader * downloader, const gchar * uri)
        * should take it.
        */
       gst_object_ref_sink (downloader->priv->urisrc);
+      downloader->priv->n_sources_created++;
     }
   }
 
@@ -557,6 +673,7 @@ gst_uri_downloader_fetch_uri_with_range (GstUriDownloader *
 {
   GstStateChangeReturn ret;
   GstFragment *download = NULL;
+  guint64 n_sources_created;
 
   GST_DEBUG_OBJECT (downloader, "Fetching URI %s", uri);
 
@@ -570,6 +687,9 @@ gst_uri_downloader_fetch_uri_with_range (GstUriDownloader *
     goto quit;
   }
 
+  downloader->priv->n_requests++;
+  n_sources_created = downloader->priv->n_sources_created;
+
   if (!gst_uri_downloader_set_uri (downloader, uri, referer, compress, refresh,
           allow_cache)) {
     GST_WARNING_OBJECT (downloader, "Failed to set URI");
@@ -580,6 +700,8 @@ gst_uri_downloader_fetch_uri_with_range (GstUriDownloader *
   if (downloader->priv->download)
     g_object_unref (downloader->priv->download);
   downloader->priv->download = gst_fragment_new ();
+  downloader->priv->download->reused_source =
+      downloader->priv->n_sources_created == n_sources_created;
   downloader->priv->download->range_start = range_start;
   downloader->priv->download->range_end = range_end;
   GST_OBJECT_UNLOCK (downloader);
@@ -652,9 +774,17 @@ gst_uri_downloader_fetch_uri_with_range (GstUriDownloader *
     }
   }
 
-  if (download != NULL)
-    GST_INFO_OBJECT (downloader, "URI fetched successfully");
-  else
+  if (download != NULL) {
+    GstClockTime first_byte = GST_CLOCK_TIME_NONE;
+
+    if (GST_CLOCK_TIME_IS_VALID (download->first_byte_time))
+      first_byte = download->first_byte_time - download->download_start_time;
+    GST_INFO_OBJECT (downloader, "URI fetched successfully with a %s source, "
+        "first byte after %" GST_TIME_FORMAT ", done after %" GST_TIME_FORMAT,
+        download->reused_source ? "reused" : "new", GST_TIME_ARGS (first_byte),
+        GST_TIME_ARGS (download->download_stop_time -
+            download->download_start_time));
+  } else
     GST_INFO_OBJECT (downloader, "Error fetching URI");
 
 quit:
@@ -48,10 +48,12 @@ gst_inter_surface_get (const char *name)
   surface->ref_count = 1;
   surface->name = g_strdup (name);
   g_mutex_init (&surface->mutex);
+  g_rw_lock_init (&surface->video_ring_lock);
   surface->audio_adapter = gst_adapter_new ();
   surface->audio_buffer_time = DEFAULT_AUDIO_BUFFER_TIME;
   surface->audio_latency_time = DEFAULT_AUDIO_LATENCY_TIME;
   surface->audio_period_time = DEFAULT_AUDIO_PERIOD_TIME;
+  surface->video_ring_size = DEFAULT_VIDEO_RING_SIZE;
 
   list = g_list_append (list, surface);
   g_mutex_unlock (&mutex);
@@ -78,7 +80,8 @@ gst_inter_surface_unref (GstInterSurface * surface)
     }
 
     g_mutex_clear (&surface->mutex);
-    gst_buffer_replace (&surface->video_buffer, NULL);
+    gst_inter_surface_clear_video_ring (surface);
+    g_rw_lock_clear (&surface->video_ring_lock);
     gst_buffer_replace (&surface->sub_buffer, NULL);
     gst_object_unref (surface->audio_adapter);
     g_free (surface->name);
@@ -86,3 +89,120 @@ gst_inter_surface_unref (GstInterSurface * surface)
   }
   g_mutex_unlock (&mutex);
 }
+
+GstInterFrame *
+gst_inter_frame_ref (GstInterFrame * frame)
+{
+  g_atomic_int_inc (&frame->ref_count);
+
+  return frame;
+}
+
+void
+gst_inter_frame_unref (GstInterFrame * frame)
+{
+  if (g_atomic_int_dec_and_test (&frame->ref_count)) {
+    gst_buffer_unref (frame->buffer);
+    g_slice_free (GstInterFrame, frame);
+  }
+}
+
+/* Called by the sink when it starts, @size is rounded up to a power of
+ * two */
+void
+gst_inter_surface_set_video_ring_size (GstInterSurface * surface, guint size)
+{
+  size = CLAMP (size, 1, GST_INTER_VIDEO_RING_MAX_SIZE);
+  if (size > 1)
+    size = 1 << g_bit_storage (size - 1);
+
+  gst_inter_surface_clear_video_ring (surface);
+  g_rw_lock_writer_lock (&surface->video_ring_lock);
+  g_atomic_int_set (&surface->video_ring_size, size);
+  g_rw_lock_writer_unlock (&surface->video_ring_lock);
+}
+
+void
+gst_inter_surface_clear_video_ring (GstInterSurface * surface)
+{
+  GstInterFrame *frames[GST_INTER_VIDEO_RING_MAX_SIZE];
+  gint i;
+
+  g_rw_lock_writer_lock (&surface->video_ring_lock);
+  for (i = 0; i < GST_INTER_VIDEO_RING_MAX_SIZE; i++) {
+    frames[i] = surface->video_ring[i];
+    surface->video_ring[i] = NULL;
+  }
+  g_rw_lock_writer_unlock (&surface->video_ring_lock);
+
+  for (i = 0; i < GST_INTER_VIDEO_RING_MAX_SIZE; i++) {
+    if (frames[i])
+      gst_inter_frame_unref (frames[i]);
+  }
+}
+
+/* Called by the sink for each frame. When the ring is full, the oldest
+ * frame is replaced, the sources that already read it keep their
+ * reference */
+void
+gst_inter_surface_push_video_frame (GstInterSurface * surface,
+    GstBuffer * buffer, GstClockTime time)
+{
+  GstInterFrame *frame, *old;
+  guint index, size;
+
+  frame = g_slice_new (GstInterFrame);
+  frame->ref_count = 1;
+  frame->buffer = gst_buffer_ref (buffer);
+  frame->time = time;
+
+  g_rw_lock_writer_lock (&surface->video_ring_lock);
+  index = surface->video_write_index;
+  size = surface->video_ring_size;
+  old = surface->video_ring[index & (size - 1)];
+  surface->video_ring[index & (size - 1)] = frame;
+  g_atomic_int_set (&surface->video_write_index, index + 1);
+  g_rw_lock_writer_unlock (&surface->video_ring_lock);
+
+  if (old)
+    gst_inter_frame_unref (old);
+}
+
+/* Called by the sources, returns a reference to the oldest frame the
+ * source did not read yet, the frame stays in the ring for the other
+ * sources. @read_index is the index of the next frame to read, private to
+ * the source, and @lost is increased by the number of frames that were
+ * replaced before the source could read them. Returns %NULL if there is
+ * no new frame */
+GstInterFrame *
+gst_inter_surface_read_video_frame (GstInterSurface * surface,
+    guint * read_index, guint64 * lost)
+{
+  GstInterFrame *frame = NULL;
+  guint write_index, size;
+
+  /* no need to lock when the sink did not put any new frame */
+  if (g_atomic_int_get (&surface->video_write_index) == *read_index)
+    return NULL;
+
+  g_rw_lock_reader_lock (&surface->video_ring_lock);
+  write_index = surface->video_write_index;
+  size = surface->video_ring_size;
+
+  if (write_index - *read_index > size) {
+    *lost += write_index - *read_index - size;
+    *read_index = write_index - size;
+  }
+
+  while (frame == NULL && *read_index != write_index) {
+    /* NULL if the ring was cleared since */
+    frame = surface->video_ring[*read_index & (size - 1)];
+    (*read_index)++;
+  }
+
+  if (frame)
+    gst_inter_frame_ref (frame);
+  g_rw_lock_reader_unlock (&surface->video_ring_lock);
+
+  return frame;
+}
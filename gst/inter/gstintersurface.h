@@ -27,6 +27,17 @@
 G_BEGIN_DECLS
 
 typedef struct _GstInterSurface GstInterSurface;
+typedef struct _GstInterFrame GstInterFrame;
+
+#define GST_INTER_VIDEO_RING_MAX_SIZE 64
+
+struct _GstInterFrame
+{
+  gint ref_count;
+  GstBuffer *buffer;
+  /* clock time at which the sink rendered it, or GST_CLOCK_TIME_NONE */
+  GstClockTime time;
+};
 
 struct _GstInterSurface
 {
@@ -37,7 +48,21 @@ struct _GstInterSurface
 
   /* video */
   GstVideoInfo video_info;
-  int video_buffer_count;
+  /* incremented whenever video_info changes */
+  gint video_info_cookie;
+
+  /* Ring of the frames rendered by the sink. Each source reads them with
+   * its own read index and takes a reference, so all the sources of the
+   * channel see all the frames. The lock is only held to replace or
+   * reference a frame. The size is a power of two, set when the sink
+   * starts. */
+  GRWLock video_ring_lock;
+  GstInterFrame *video_ring[GST_INTER_VIDEO_RING_MAX_SIZE];
+  guint video_ring_size;
+  /* number of frames put in the ring so far, only written by the sink */
+  guint video_write_index;
+  /* incremented when the sink stops, the source drops its frames */
+  gint video_epoch;
 
   /* audio */
   GstAudioInfo audio_info;
@@ -45,7 +70,6 @@ struct _GstInterSurface
   guint64 audio_latency_time;
   guint64 audio_period_time;
 
-  GstBuffer *video_buffer;
   GstBuffer *sub_buffer;
   GstAdapter *audio_adapter;
 };
@@ -53,11 +77,23 @@ struct _GstInterSurface
 #define DEFAULT_AUDIO_BUFFER_TIME  (GST_SECOND)
 #define DEFAULT_AUDIO_LATENCY_TIME (100 * GST_MSECOND)
 #define DEFAULT_AUDIO_PERIOD_TIME  (25 * GST_MSECOND)
+#define DEFAULT_VIDEO_RING_SIZE    4
 
 
 GstInterSurface * gst_inter_surface_get (const char *name);
 void gst_inter_surface_unref (GstInterSurface *surface);
 
+void gst_inter_surface_set_video_ring_size (GstInterSurface *surface,
+    guint size);
+void gst_inter_surface_clear_video_ring (GstInterSurface *surface);
+void gst_inter_surface_push_video_frame (GstInterSurface *surface,
+    GstBuffer *buffer, GstClockTime time);
+GstInterFrame * gst_inter_surface_read_video_frame (GstInterSurface *surface,
+    guint *read_index, guint64 *lost);
+
+GstInterFrame * gst_inter_frame_ref (GstInterFrame *frame);
+void gst_inter_frame_unref (GstInterFrame *frame);
+
 
 G_END_DECLS
 
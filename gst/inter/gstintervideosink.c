@@ -66,7 +66,8 @@ static GstFlowReturn gst_inter_video_sink_show_frame (GstVideoSink * sink,
 enum
 {
   PROP_0,
-  PROP_CHANNEL
+  PROP_CHANNEL,
+  PROP_RING_SIZE
 };
 
 #define DEFAULT_CHANNEL ("default")
@@ -120,12 +121,29 @@ gst_inter_video_sink_class_init (GstInterVideoSinkClass * klass)
       g_param_spec_string ("channel", "Channel",
           "Channel name to match inter src and sink elements",
           DEFAULT_CHANNEL, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstInterVideoSink:ring-size:
+   *
+   * Number of frames queued for the intervideosrc, rounded up to a power
+   * of two. When the source is slower, the oldest frames are dropped. The
+   * source picks the frames by running time, which requires the two
+   * pipelines to use the same clock, e.g. the default system clock.
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_RING_SIZE,
+      g_param_spec_uint ("ring-size", "Ring size",
+          "Number of frames queued for the source (rounded up to a power "
+          "of two)", 1, GST_INTER_VIDEO_RING_MAX_SIZE, DEFAULT_VIDEO_RING_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
 gst_inter_video_sink_init (GstInterVideoSink * intervideosink)
 {
   intervideosink->channel = g_strdup (DEFAULT_CHANNEL);
+  intervideosink->ring_size = DEFAULT_VIDEO_RING_SIZE;
 }
 
 void
@@ -139,6 +157,9 @@ gst_inter_video_sink_set_property (GObject * object, guint property_id,
       g_free (intervideosink->channel);
       intervideosink->channel = g_value_dup_string (value);
       break;
+    case PROP_RING_SIZE:
+      intervideosink->ring_size = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -155,6 +176,9 @@ gst_inter_video_sink_get_property (GObject * object, guint property_id,
     case PROP_CHANNEL:
       g_value_set_string (value, intervideosink->channel);
       break;
+    case PROP_RING_SIZE:
+      g_value_set_uint (value, intervideosink->ring_size);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -201,8 +225,12 @@ gst_inter_video_sink_start (GstBaseSink * sink)
   intervideosink->surface = gst_inter_surface_get (intervideosink->channel);
   g_mutex_lock (&intervideosink->surface->mutex);
   memset (&intervideosink->surface->video_info, 0, sizeof (GstVideoInfo));
+  g_atomic_int_inc (&intervideosink->surface->video_info_cookie);
   g_mutex_unlock (&intervideosink->surface->mutex);
 
+  gst_inter_surface_set_video_ring_size (intervideosink->surface,
+      intervideosink->ring_size);
+
   return TRUE;
 }
 
@@ -211,12 +239,12 @@ gst_inter_video_sink_stop (GstBaseSink * sink)
 {
   GstInterVideoSink *intervideosink = GST_INTER_VIDEO_SINK (sink);
 
+  gst_inter_surface_clear_video_ring (intervideosink->surface);
+  g_atomic_int_inc (&intervideosink->surface->video_epoch);
+
   g_mutex_lock (&intervideosink->surface->mutex);
-  if (intervideosink->surface->video_buffer) {
-    gst_buffer_unref (intervideosink->surface->video_buffer);
-  }
-  intervideosink->surface->video_buffer = NULL;
   memset (&intervideosink->surface->video_info, 0, sizeof (GstVideoInfo));
+  g_atomic_int_inc (&intervideosink->surface->video_info_cookie);
   g_mutex_unlock (&intervideosink->surface->mutex);
 
   gst_inter_surface_unref (intervideosink->surface);
@@ -239,6 +267,7 @@ gst_inter_video_sink_set_caps (GstBaseSink * sink, GstCaps * caps)
   g_mutex_lock (&intervideosink->surface->mutex);
   intervideosink->surface->video_info = info;
   intervideosink->info = info;
+  g_atomic_int_inc (&intervideosink->surface->video_info_cookie);
   g_mutex_unlock (&intervideosink->surface->mutex);
 
   return TRUE;
@@ -248,17 +277,25 @@ static GstFlowReturn
 gst_inter_video_sink_show_frame (GstVideoSink * sink, GstBuffer * buffer)
 {
   GstInterVideoSink *intervideosink = GST_INTER_VIDEO_SINK (sink);
-
-  GST_DEBUG_OBJECT (intervideosink, "render ts %" GST_TIME_FORMAT,
-      GST_TIME_ARGS (GST_BUFFER_PTS (buffer)));
-
-  g_mutex_lock (&intervideosink->surface->mutex);
-  if (intervideosink->surface->video_buffer) {
-    gst_buffer_unref (intervideosink->surface->video_buffer);
-  }
-  intervideosink->surface->video_buffer = gst_buffer_ref (buffer);
-  intervideosink->surface->video_buffer_count = 0;
-  g_mutex_unlock (&intervideosink->surface->mutex);
+  GstClockTime running_time, time = GST_CLOCK_TIME_NONE;
+  GstClock *clock;
+
+  /* the source picks the frames by clock time, which is comparable
+   * between pipelines using the same clock */
+  running_time =
+      gst_segment_to_running_time (&GST_BASE_SINK_CAST (sink)->segment,
+      GST_FORMAT_TIME, GST_BUFFER_PTS (buffer));
+  clock = gst_element_get_clock (GST_ELEMENT_CAST (sink));
+  if (clock && GST_CLOCK_TIME_IS_VALID (running_time))
+    time = running_time + gst_element_get_base_time (GST_ELEMENT_CAST (sink));
+  if (clock)
+    gst_object_unref (clock);
+
+  GST_DEBUG_OBJECT (intervideosink, "render ts %" GST_TIME_FORMAT
+      " clock time %" GST_TIME_FORMAT, GST_TIME_ARGS (GST_BUFFER_PTS (buffer)),
+      GST_TIME_ARGS (time));
+
+  gst_inter_surface_push_video_frame (intervideosink->surface, buffer, time);
 
   return GST_FLOW_OK;
 }
@@ -71,7 +71,9 @@ enum
 {
   PROP_0,
   PROP_CHANNEL,
-  PROP_TIMEOUT
+  PROP_TIMEOUT,
+  PROP_DROP,
+  PROP_DUPLICATE
 };
 
 #define DEFAULT_CHANNEL ("default")
@@ -132,6 +134,30 @@ gst_inter_video_src_class_init (GstInterVideoSrcClass * klass)
           "Timeout after which to start outputting black frames",
           0, G_MAXUINT64, DEFAULT_TIMEOUT,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstInterVideoSrc:drop:
+   *
+   * Number of frames from the intervideosink that were not output.
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_DROP,
+      g_param_spec_uint64 ("drop", "Drop", "Number of dropped frames",
+          0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstInterVideoSrc:duplicate:
+   *
+   * Number of times a frame from the intervideosink was output again
+   * because no newer one was due.
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_DUPLICATE,
+      g_param_spec_uint64 ("duplicate", "Duplicate",
+          "Number of duplicated frames", 0, G_MAXUINT64, 0,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -142,6 +168,7 @@ gst_inter_video_src_init (GstInterVideoSrc * intervideosrc)
 
   intervideosrc->channel = g_strdup (DEFAULT_CHANNEL);
   intervideosrc->timeout = DEFAULT_TIMEOUT;
+  g_queue_init (&intervideosrc->frames);
 }
 
 void
@@ -177,6 +204,16 @@ gst_inter_video_src_get_property (GObject * object, guint property_id,
     case PROP_TIMEOUT:
       g_value_set_uint64 (value, intervideosrc->timeout);
       break;
+    case PROP_DROP:
+      GST_OBJECT_LOCK (intervideosrc);
+      g_value_set_uint64 (value, intervideosrc->dropped);
+      GST_OBJECT_UNLOCK (intervideosrc);
+      break;
+    case PROP_DUPLICATE:
+      GST_OBJECT_LOCK (intervideosrc);
+      g_value_set_uint64 (value, intervideosrc->duplicated);
+      GST_OBJECT_UNLOCK (intervideosrc);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -279,9 +316,37 @@ gst_inter_video_src_start (GstBaseSrc * src)
   intervideosrc->timestamp_offset = 0;
   intervideosrc->n_frames = 0;
 
+  /* check the caps on the first frame, and start with the frames already
+   * in the ring */
+  intervideosrc->video_info_cookie =
+      g_atomic_int_get (&intervideosrc->surface->video_info_cookie) - 1;
+  intervideosrc->video_epoch =
+      g_atomic_int_get (&intervideosrc->surface->video_epoch);
+  intervideosrc->read_index =
+      g_atomic_int_get (&intervideosrc->surface->video_write_index) -
+      g_atomic_int_get (&intervideosrc->surface->video_ring_size);
+  intervideosrc->current_count = 0;
+
+  GST_OBJECT_LOCK (intervideosrc);
+  intervideosrc->dropped = 0;
+  intervideosrc->duplicated = 0;
+  GST_OBJECT_UNLOCK (intervideosrc);
+
   return TRUE;
 }
 
+static void
+gst_inter_video_src_clear_frames (GstInterVideoSrc * intervideosrc)
+{
+  GstInterFrame *frame;
+
+  while ((frame = g_queue_pop_head (&intervideosrc->frames)))
+    gst_inter_frame_unref (frame);
+  if (intervideosrc->current)
+    gst_inter_frame_unref (intervideosrc->current);
+  intervideosrc->current = NULL;
+}
+
 static gboolean
 gst_inter_video_src_stop (GstBaseSrc * src)
 {
@@ -289,6 +354,7 @@ gst_inter_video_src_stop (GstBaseSrc * src)
 
   GST_DEBUG_OBJECT (intervideosrc, "stop");
 
+  gst_inter_video_src_clear_frames (intervideosrc);
   gst_inter_surface_unref (intervideosrc->surface);
   intervideosrc->surface = NULL;
   gst_buffer_replace (&intervideosrc->black_frame, NULL);
@@ -321,26 +387,13 @@ gst_inter_video_src_get_times (GstBaseSrc * src, GstBuffer * buffer,
   }
 }
 
-static GstFlowReturn
-gst_inter_video_src_create (GstBaseSrc * src, guint64 offset, guint size,
-    GstBuffer ** buf)
+/* Called with the surface mutex, returns the caps to negotiate if the
+ * video info of the sink changed */
+static GstCaps *
+gst_inter_video_src_check_caps (GstInterVideoSrc * intervideosrc)
 {
-  GstInterVideoSrc *intervideosrc = GST_INTER_VIDEO_SRC (src);
-  GstCaps *caps;
-  GstBuffer *buffer;
-  guint64 frames;
-  gboolean is_gap = FALSE;
-
-  GST_DEBUG_OBJECT (intervideosrc, "create");
+  GstCaps *caps = NULL;
 
-  caps = NULL;
-  buffer = NULL;
-
-  frames = gst_util_uint64_scale_ceil (intervideosrc->timeout,
-      GST_VIDEO_INFO_FPS_N (&intervideosrc->info),
-      GST_VIDEO_INFO_FPS_D (&intervideosrc->info) * GST_SECOND);
-
-  g_mutex_lock (&intervideosrc->surface->mutex);
   if (intervideosrc->surface->video_info.finfo) {
     GstVideoInfo tmp_info = intervideosrc->surface->video_info;
 
@@ -362,25 +415,147 @@ gst_inter_video_src_create (GstBaseSrc * src, guint64 offset, guint size,
     }
   }
 
-  if (intervideosrc->surface->video_buffer) {
+  return caps;
+}
+
+static gint
+compare_frames (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  const GstInterFrame *frame_a = a, *frame_b = b;
+
+  /* frames without time stay in the order they were rendered */
+  if (GST_CLOCK_TIME_IS_VALID (frame_a->time) &&
+      GST_CLOCK_TIME_IS_VALID (frame_b->time) &&
+      frame_a->time > frame_b->time)
+    return 1;
+
+  return -1;
+}
+
+/* Reads the new frames from the ring and moves to the most recent one
+ * that is due at the clock time @time, the others are kept for the next
+ * frames. Without a clock, or when too many frames are ahead, moves to the
+ * latest one. Returns the number of frames dropped */
+static guint64
+gst_inter_video_src_update_current (GstInterVideoSrc * intervideosrc,
+    GstClockTime time)
+{
+  GstInterSurface *surface = intervideosrc->surface;
+  GstInterFrame *frame;
+  guint64 dropped = 0;
+  guint max_frames;
+  gint epoch;
+
+  /* the sink stopped, its frames are not to be shown anymore */
+  epoch = g_atomic_int_get (&surface->video_epoch);
+  if (epoch != intervideosrc->video_epoch) {
+    gst_inter_video_src_clear_frames (intervideosrc);
+    intervideosrc->video_epoch = epoch;
+  }
+
+  while ((frame = gst_inter_surface_read_video_frame (surface,
+              &intervideosrc->read_index, &dropped)))
+    g_queue_insert_sorted (&intervideosrc->frames, frame, compare_frames,
+        NULL);
+
+  max_frames = g_atomic_int_get (&surface->video_ring_size);
+  while ((frame = g_queue_peek_head (&intervideosrc->frames))) {
+    if (GST_CLOCK_TIME_IS_VALID (time) && GST_CLOCK_TIME_IS_VALID (frame->time)
+        && frame->time > time
+        && g_queue_get_length (&intervideosrc->frames) <= max_frames)
+      break;
+
+    g_queue_pop_head (&intervideosrc->frames);
+    if (intervideosrc->current) {
+      if (intervideosrc->current_count == 0)
+        dropped++;
+      gst_inter_frame_unref (intervideosrc->current);
+    }
+    intervideosrc->current = frame;
+    intervideosrc->current_count = 0;
+  }
+
+  return dropped;
+}
+
+static GstFlowReturn
+gst_inter_video_src_create (GstBaseSrc * src, guint64 offset, guint size,
+    GstBuffer ** buf)
+{
+  GstInterVideoSrc *intervideosrc = GST_INTER_VIDEO_SRC (src);
+  GstCaps *caps;
+  GstBuffer *buffer;
+  guint64 frames;
+  gboolean is_gap = FALSE;
+  gint cookie;
+  GstClock *clock;
+  GstClockTime pts, duration, time = GST_CLOCK_TIME_NONE;
+  guint64 dropped, duplicated = 0;
+
+  GST_DEBUG_OBJECT (intervideosrc, "create");
+
+  caps = NULL;
+  buffer = NULL;
+
+  frames = gst_util_uint64_scale_ceil (intervideosrc->timeout,
+      GST_VIDEO_INFO_FPS_N (&intervideosrc->info),
+      GST_VIDEO_INFO_FPS_D (&intervideosrc->info) * GST_SECOND);
+
+  /* only take the mutex when the sink changed the video info */
+  cookie = g_atomic_int_get (&intervideosrc->surface->video_info_cookie);
+  if (cookie != intervideosrc->video_info_cookie) {
+    g_mutex_lock (&intervideosrc->surface->mutex);
+    caps = gst_inter_video_src_check_caps (intervideosrc);
+    g_mutex_unlock (&intervideosrc->surface->mutex);
+    intervideosrc->video_info_cookie = cookie;
+  }
+
+  /* clock time at which this frame is going to be output */
+  pts = intervideosrc->timestamp_offset +
+      gst_util_uint64_scale (GST_SECOND * intervideosrc->n_frames,
+      GST_VIDEO_INFO_FPS_D (&intervideosrc->info),
+      GST_VIDEO_INFO_FPS_N (&intervideosrc->info));
+  duration = gst_util_uint64_scale (GST_SECOND,
+      GST_VIDEO_INFO_FPS_D (&intervideosrc->info),
+      GST_VIDEO_INFO_FPS_N (&intervideosrc->info));
+  clock = gst_element_get_clock (GST_ELEMENT_CAST (src));
+  if (clock) {
+    time = pts + gst_element_get_base_time (GST_ELEMENT_CAST (src)) +
+        duration / 2;
+    gst_object_unref (clock);
+  }
+
+  dropped = gst_inter_video_src_update_current (intervideosrc, time);
+
+  if (intervideosrc->current) {
     /* We have a buffer to push */
-    buffer = gst_buffer_ref (intervideosrc->surface->video_buffer);
+    buffer = gst_buffer_ref (intervideosrc->current->buffer);
+    if (intervideosrc->current_count > 0)
+      duplicated = 1;
 
     /* Can only be true if timeout > 0 */
-    if (intervideosrc->surface->video_buffer_count == frames) {
-      gst_buffer_unref (intervideosrc->surface->video_buffer);
-      intervideosrc->surface->video_buffer = NULL;
+    if (intervideosrc->current_count == frames) {
+      gst_inter_frame_unref (intervideosrc->current);
+      intervideosrc->current = NULL;
     }
   }
 
-  if (intervideosrc->surface->video_buffer_count != 0 &&
-      intervideosrc->surface->video_buffer_count != (frames + 1)) {
+  if (intervideosrc->current_count != 0 &&
+      intervideosrc->current_count != (frames + 1)) {
     /* This is a repeat of the stored buffer or of a black frame */
     is_gap = TRUE;
   }
 
-  intervideosrc->surface->video_buffer_count++;
-  g_mutex_unlock (&intervideosrc->surface->mutex);
+  intervideosrc->current_count++;
+
+  if (dropped || duplicated) {
+    GST_LOG_OBJECT (intervideosrc, "dropped %" G_GUINT64_FORMAT
+        " frames, duplicated %" G_GUINT64_FORMAT, dropped, duplicated);
+    GST_OBJECT_LOCK (intervideosrc);
+    intervideosrc->dropped += dropped;
+    intervideosrc->duplicated += duplicated;
+    GST_OBJECT_UNLOCK (intervideosrc);
+  }
 
   if (caps) {
     gboolean ret;
@@ -48,6 +48,20 @@ struct _GstInterVideoSrc
   GstBuffer *black_frame;
   int n_frames;
   GstClockTime timestamp_offset;
+
+  /* state of the surface seen by the source */
+  gint video_info_cookie;
+  gint video_epoch;
+  guint read_index;
+
+  /* frames read from the ring, sorted by time, and the frame currently
+   * output with the number of times it was output */
+  GQueue frames;
+  GstInterFrame *current;
+  guint64 current_count;
+
+  guint64 dropped;
+  guint64 duplicated;
 };
 
 struct _GstInterVideoSrcClass
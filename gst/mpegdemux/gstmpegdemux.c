@@ -64,6 +64,11 @@
 
 #define DURATION_SCAN_LIMIT         4 * 1024 * 1024
 
+/* Minimum SCR distance between two entries of the SCR index */
+#define SCR_INDEX_INTERVAL          CLOCK_FREQ
+/* Don't restart from a keyframe further away than this before the target */
+#define KEYFRAME_MAX_DISTANCE       (10 * CLOCK_FREQ)
+
 typedef enum
 {
   SCAN_SCR,
@@ -94,10 +99,19 @@ enum
 {
   PROP_0,
   PROP_IGNORE_SCR,
+  PROP_TRACK_KEYFRAMES,
   /* FILL ME */
 };
 
 #define DEFAULT_IGNORE_SCR FALSE
+#define DEFAULT_TRACK_KEYFRAMES FALSE
+
+/* Entry of the SCR and keyframe indexes */
+typedef struct
+{
+  guint64 scr;
+  guint64 offset;
+} GstPsDemuxIndexEntry;
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
@@ -279,6 +293,23 @@ gst_ps_demux_class_init (GstPsDemuxClass * klass)
           "Ignore SCR data for timing", DEFAULT_IGNORE_SCR,
           G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
           G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstPsDemux:track-keyframes:
+   *
+   * Remember the position of the MPEG-1/2 and H.264 keyframes seen while
+   * playing in pull mode, so that accurate and key unit seeks close to an
+   * already played position restart from a keyframe instead of from the
+   * requested position.
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_TRACK_KEYFRAMES,
+      g_param_spec_boolean ("track-keyframes", "Track keyframes",
+          "Remember keyframe positions to seek to them",
+          DEFAULT_TRACK_KEYFRAMES,
+          G_PARAM_READWRITE | GST_PARAM_MUTABLE_READY |
+          G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -307,10 +338,14 @@ gst_ps_demux_init (GstPsDemux * demux)
   demux->adapter = gst_adapter_new ();
   demux->rev_adapter = gst_adapter_new ();
   demux->flowcombiner = gst_flow_combiner_new ();
+  demux->scr_index = g_array_new (FALSE, FALSE, sizeof (GstPsDemuxIndexEntry));
+  demux->keyframe_index =
+      g_array_new (FALSE, FALSE, sizeof (GstPsDemuxIndexEntry));
 
   gst_ps_demux_reset (demux);
 
   demux->ignore_scr = DEFAULT_IGNORE_SCR;
+  demux->track_keyframes = DEFAULT_TRACK_KEYFRAMES;
 }
 
 static void
@@ -323,6 +358,8 @@ gst_ps_demux_finalize (GstPsDemux * demux)
   gst_flow_combiner_free (demux->flowcombiner);
   g_object_unref (demux->adapter);
   g_object_unref (demux->rev_adapter);
+  g_array_free (demux->scr_index, TRUE);
+  g_array_free (demux->keyframe_index, TRUE);
 
   G_OBJECT_CLASS (parent_class)->finalize (G_OBJECT (demux));
 }
@@ -337,6 +374,9 @@ gst_ps_demux_set_property (GObject * object, guint prop_id,
     case PROP_IGNORE_SCR:
       demux->ignore_scr = g_value_get_boolean (value);
       break;
+    case PROP_TRACK_KEYFRAMES:
+      demux->track_keyframes = g_value_get_boolean (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
   }
@@ -352,6 +392,9 @@ gst_ps_demux_get_property (GObject * object, guint prop_id,
     case PROP_IGNORE_SCR:
       g_value_set_boolean (value, demux->ignore_scr);
       break;
+    case PROP_TRACK_KEYFRAMES:
+      g_value_set_boolean (value, demux->track_keyframes);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
   }
@@ -400,6 +443,10 @@ gst_ps_demux_reset (GstPsDemux * demux)
   demux->next_pts = G_MAXUINT64;
   demux->next_dts = G_MAXUINT64;
   demux->need_no_more_pads = TRUE;
+  demux->pack_scr = G_MAXUINT64;
+  demux->pack_offset = G_MAXUINT64;
+  g_array_set_size (demux->scr_index, 0);
+  g_array_set_size (demux->keyframe_index, 0);
   gst_ps_demux_reset_psm (demux);
   gst_segment_init (&demux->sink_segment, GST_FORMAT_UNDEFINED);
   gst_segment_init (&demux->src_segment, GST_FORMAT_TIME);
@@ -1189,6 +1236,157 @@ not_supported:
   }
 }
 
+/* Returns the index of the first entry with a SCR > @scr */
+static guint
+gst_ps_demux_index_upper_bound (GArray * index, guint64 scr)
+{
+  GstPsDemuxIndexEntry *entries = (GstPsDemuxIndexEntry *) index->data;
+  guint lo = 0, hi = index->len;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (entries[mid].scr <= scr)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+/* Adds the pack at @offset to @index, unless a pack closer than @interval
+ * is already known. Entries must grow with the SCR, anything else (SCR
+ * wrap-around, concatenated files) is not indexed. */
+static void
+gst_ps_demux_index_add (GArray * index, guint64 scr, guint64 offset,
+    guint64 interval)
+{
+  GstPsDemuxIndexEntry *entries = (GstPsDemuxIndexEntry *) index->data;
+  GstPsDemuxIndexEntry entry;
+  guint pos = gst_ps_demux_index_upper_bound (index, scr);
+
+  if (pos > 0) {
+    GstPsDemuxIndexEntry *prev = &entries[pos - 1];
+
+    if (prev->offset == offset || scr - prev->scr < interval)
+      return;
+    if (prev->offset > offset)
+      return;
+  }
+
+  if (pos < index->len) {
+    GstPsDemuxIndexEntry *next = &entries[pos];
+
+    if (next->offset == offset || next->scr - scr < interval)
+      return;
+    if (next->offset < offset)
+      return;
+  }
+
+  entry.scr = scr;
+  entry.offset = offset;
+  g_array_insert_val (index, pos, entry);
+}
+
+static inline void
+gst_ps_demux_index_scr (GstPsDemux * demux, guint64 scr, guint64 offset)
+{
+  gst_ps_demux_index_add (demux->scr_index, scr, offset, SCR_INDEX_INTERVAL);
+}
+
+/* Narrows the initial search interval of find_offset() to the indexed packs
+ * around @scr */
+static void
+gst_ps_demux_index_get_bounds (GstPsDemux * demux, guint64 scr,
+    guint64 * min_scr, guint64 * min_scr_offset,
+    guint64 * max_scr, guint64 * max_scr_offset)
+{
+  GstPsDemuxIndexEntry *entries =
+      (GstPsDemuxIndexEntry *) demux->scr_index->data;
+  guint pos = gst_ps_demux_index_upper_bound (demux->scr_index, scr);
+
+  if (pos > 0 && entries[pos - 1].scr > *min_scr &&
+      entries[pos - 1].offset > *min_scr_offset) {
+    *min_scr = entries[pos - 1].scr;
+    *min_scr_offset = entries[pos - 1].offset;
+  }
+
+  if (pos < demux->scr_index->len && entries[pos].scr < *max_scr &&
+      entries[pos].offset < *max_scr_offset) {
+    *max_scr = entries[pos].scr;
+    *max_scr_offset = entries[pos].offset;
+  }
+}
+
+/* Returns the offset of the pack of the last known keyframe at or before
+ * @scr, or -1. The SCR of that pack is stored in @kf_scr */
+static guint64
+gst_ps_demux_index_find_keyframe (GstPsDemux * demux, guint64 scr,
+    guint64 * kf_scr)
+{
+  GstPsDemuxIndexEntry *entry;
+  guint pos = gst_ps_demux_index_upper_bound (demux->keyframe_index, scr);
+
+  if (pos == 0)
+    return -1;
+
+  entry = &g_array_index (demux->keyframe_index, GstPsDemuxIndexEntry,
+      pos - 1);
+  if (scr - entry->scr > KEYFRAME_MAX_DISTANCE)
+    return -1;
+
+  *kf_scr = entry->scr;
+  return entry->offset;
+}
+
+/* Checks whether a chunk of video elementary stream contains the start of
+ * a keyframe */
+static gboolean
+gst_ps_demux_is_keyframe (gint stream_type, const guint8 * data, gsize size)
+{
+  GstByteReader br;
+  gint off;
+
+  if (size < 6)
+    return FALSE;
+
+  gst_byte_reader_init (&br, data, size);
+
+  switch (stream_type) {
+    case ST_VIDEO_MPEG1:
+    case ST_VIDEO_MPEG2:
+    case ST_GST_VIDEO_MPEG1_OR_2:
+      /* picture start code, temporal_reference:10 ! picture_coding_type:3 */
+      off = gst_byte_reader_masked_scan_uint32 (&br, 0xffffffff, 0x00000100,
+          0, size);
+      if (off < 0 || (gsize) off + 6 > size)
+        return FALSE;
+      return ((data[off + 5] >> 3) & 0x07) == 1;
+    case ST_VIDEO_H264:
+      off = 0;
+      while (size - off >= 4) {
+        guint8 nal_type;
+
+        off = gst_byte_reader_masked_scan_uint32 (&br, 0xffffff00, 0x00000100,
+            off, size - off);
+        if (off < 0)
+          return FALSE;
+
+        nal_type = data[off + 3] & 0x1f;
+        /* first slice decides */
+        if (nal_type == 5)
+          return TRUE;
+        if (nal_type == 1)
+          return FALSE;
+        off += 4;
+      }
+      return FALSE;
+    default:
+      return FALSE;
+  }
+}
+
 #define MAX_RECURSION_COUNT 100
 
 /* Binary search for requested SCR */
@@ -1201,6 +1399,7 @@ find_offset (GstPsDemux * demux, guint64 scr,
   guint64 scr_rate_d = max_scr - min_scr;
   guint64 fscr = scr;
   guint64 offset;
+  gboolean found;
 
   if (recursion_count > MAX_RECURSION_COUNT) {
     return -1;
@@ -1210,9 +1409,13 @@ find_offset (GstPsDemux * demux, guint64 scr,
       MIN (gst_util_uint64_scale (scr - min_scr, scr_rate_n,
           scr_rate_d), demux->sink_segment.stop);
 
-  if (!gst_ps_demux_scan_forward_ts (demux, &offset, SCAN_SCR, &fscr, 0)) {
-    gst_ps_demux_scan_backward_ts (demux, &offset, SCAN_SCR, &fscr, 0);
-  }
+  found = gst_ps_demux_scan_forward_ts (demux, &offset, SCAN_SCR, &fscr, 0);
+  if (!found)
+    found = gst_ps_demux_scan_backward_ts (demux, &offset, SCAN_SCR, &fscr, 0);
+
+  /* every probe makes the next seeks shorter */
+  if (found)
+    gst_ps_demux_index_scr (demux, fscr, offset);
 
   if (fscr == scr || fscr == min_scr || fscr == max_scr) {
     return offset;
@@ -1228,10 +1431,12 @@ find_offset (GstPsDemux * demux, guint64 scr,
 }
 
 static inline gboolean
-gst_ps_demux_do_seek (GstPsDemux * demux, GstSegment * seeksegment)
+gst_ps_demux_do_seek (GstPsDemux * demux, GstSegment * seeksegment,
+    GstSeekFlags flags)
 {
   gboolean found;
-  guint64 fscr, offset;
+  guint64 fscr, offset, kf_offset, kf_scr;
+  guint64 min_scr, min_scr_offset, max_scr, max_scr_offset;
   guint64 scr = GSTTIME_TO_MPEGTIME (seeksegment->position + demux->base_time);
 
   /* In some clips the PTS values are completely unaligned with SCR values.
@@ -1247,9 +1452,19 @@ gst_ps_demux_do_seek (GstPsDemux * demux, GstSegment * seeksegment)
   GST_INFO_OBJECT (demux, "sink segment configured %" GST_SEGMENT_FORMAT
       ", trying to go at SCR: %" G_GUINT64_FORMAT, &demux->sink_segment, scr);
 
-  offset =
-      find_offset (demux, scr, demux->first_scr, demux->first_scr_offset,
-      demux->last_scr, demux->last_scr_offset, 0);
+  min_scr = demux->first_scr;
+  min_scr_offset = demux->first_scr_offset;
+  max_scr = demux->last_scr;
+  max_scr_offset = demux->last_scr_offset;
+  gst_ps_demux_index_get_bounds (demux, scr, &min_scr, &min_scr_offset,
+      &max_scr, &max_scr_offset);
+
+  GST_DEBUG_OBJECT (demux, "searching between SCR %" G_GUINT64_FORMAT
+      " at %" G_GUINT64_FORMAT " and %" G_GUINT64_FORMAT " at %"
+      G_GUINT64_FORMAT, min_scr, min_scr_offset, max_scr, max_scr_offset);
+
+  offset = find_offset (demux, scr, min_scr, min_scr_offset, max_scr,
+      max_scr_offset, 0);
 
   if (offset == (guint64) - 1) {
     return FALSE;
@@ -1269,6 +1484,38 @@ gst_ps_demux_do_seek (GstPsDemux * demux, GstSegment * seeksegment)
     found = gst_ps_demux_scan_backward_ts (demux, &offset, SCAN_SCR, &fscr, 0);
   }
 
+  /* Restart decoding from the previous keyframe if we know where it is */
+  if (found && (flags & (GST_SEEK_FLAG_ACCURATE | GST_SEEK_FLAG_KEY_UNIT))) {
+    kf_offset = gst_ps_demux_index_find_keyframe (demux, scr, &kf_scr);
+    if (kf_offset != (guint64) - 1 && kf_offset < offset) {
+      GST_DEBUG_OBJECT (demux, "starting from keyframe at %" G_GUINT64_FORMAT,
+          kf_offset);
+      offset = kf_offset;
+
+      /* Key unit seeks start the segment at the keyframe too, otherwise
+       * downstream would clip up to the requested position */
+      if ((flags & GST_SEEK_FLAG_KEY_UNIT) && !(flags & GST_SEEK_FLAG_ACCURATE)
+          && seeksegment->rate > 0.0) {
+        GstClockTime kf_time;
+
+        if (demux->last_scr > demux->last_pts)
+          kf_scr = gst_util_uint64_scale (kf_scr, demux->last_pts,
+              demux->last_scr);
+        kf_time = MPEGTIME_TO_GSTTIME (kf_scr);
+        if (GST_CLOCK_TIME_IS_VALID (demux->base_time))
+          kf_time = kf_time > demux->base_time ? kf_time - demux->base_time : 0;
+
+        if (kf_time < seeksegment->start) {
+          GST_DEBUG_OBJECT (demux, "snapping segment start to keyframe at %"
+              GST_TIME_FORMAT, GST_TIME_ARGS (kf_time));
+          seeksegment->start = kf_time;
+          seeksegment->time = kf_time;
+          seeksegment->position = kf_time;
+        }
+      }
+    }
+  }
+
   GST_INFO_OBJECT (demux, "doing seek at offset %" G_GUINT64_FORMAT
       " SCR: %" G_GUINT64_FORMAT " %" GST_TIME_FORMAT,
       offset, fscr, GST_TIME_ARGS (MPEGTIME_TO_GSTTIME (fscr)));
@@ -1347,7 +1594,7 @@ gst_ps_demux_handle_seek_pull (GstPsDemux * demux, GstEvent * event)
 
   if (flush || seeksegment.position != demux->src_segment.position) {
     /* Do the actual seeking */
-    if (!gst_ps_demux_do_seek (demux, &seeksegment)) {
+    if (!gst_ps_demux_do_seek (demux, &seeksegment, flags)) {
       return FALSE;
     }
   }
@@ -1803,6 +2050,11 @@ gst_ps_demux_parse_pack_start (GstPsDemux * demux)
     data += 8;
   }
 
+  demux->pack_scr = scr;
+  demux->pack_offset = demux->adapter_offset;
+  if (demux->random_access && demux->sink_segment.rate >= 0.0)
+    gst_ps_demux_index_scr (demux, scr, demux->pack_offset);
+
   if (demux->ignore_scr) {
     /* update only first/current_scr with raw scr value to start streaming
      * after parsing 2 seconds long data with no-more-pad */
@@ -2424,6 +2676,16 @@ gst_ps_demux_data_cb (GstPESFilter * filter, gboolean first,
     demux->current_stream->notlinked = FALSE;
   }
 
+  if (demux->track_keyframes && demux->random_access &&
+      demux->sink_segment.rate >= 0.0 && demux->pack_offset != G_MAXUINT64 &&
+      gst_ps_demux_is_keyframe (demux->current_stream->type,
+          map.data + offset, datalen)) {
+    GST_LOG_OBJECT (demux, "keyframe in pack at %" G_GUINT64_FORMAT,
+        demux->pack_offset);
+    gst_ps_demux_index_add (demux->keyframe_index, demux->pack_scr,
+        demux->pack_offset, 0);
+  }
+
   if (demux->current_stream->notlinked == FALSE) {
     out_buf =
         gst_buffer_copy_region (buffer, GST_BUFFER_COPY_ALL, offset, datalen);
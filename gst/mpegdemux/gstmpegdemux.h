@@ -157,8 +157,17 @@ struct _GstPsDemux
   /* Indicates an MPEG-2 stream */
   gboolean is_mpeg2_pack;
 
+  /* Seek indexes, only filled in pull mode. Both map a raw SCR to the offset
+   * of a pack start code and are sorted by SCR */
+  GArray *scr_index;
+  GArray *keyframe_index;
+  /* Raw SCR and offset of the pack being parsed */
+  guint64 pack_scr;
+  guint64 pack_offset;
+
   /* properties */
   gboolean ignore_scr;
+  gboolean track_keyframes;
 };
 
 struct _GstPsDemuxClass
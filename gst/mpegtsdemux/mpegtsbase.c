@@ -96,6 +96,7 @@ static gboolean mpegts_base_get_tags_from_eit (MpegTSBase * base,
     GstMpegtsSection * section);
 static gboolean mpegts_base_parse_atsc_mgt (MpegTSBase * base,
     GstMpegtsSection * section);
+static void mpegts_base_update_pid_filter (MpegTSBase * base);
 static gboolean remove_each_program (gpointer key, MpegTSBaseProgram * program,
     MpegTSBase * base);
 
@@ -209,6 +210,8 @@ mpegts_base_reset (MpegTSBase * base)
   MpegTSBaseClass *klass = GST_MPEGTS_BASE_GET_CLASS (base);
 
   mpegts_packetizer_clear (base->packetizer);
+  base->packetizer->n_packets = 0;
+  base->packetizer->n_filtered = 0;
   memset (base->is_pes, 0, 1024);
   memset (base->known_psi, 0, 1024);
 
@@ -250,6 +253,8 @@ mpegts_base_reset (MpegTSBase * base)
 
   if (klass->reset)
     klass->reset (base);
+
+  mpegts_base_update_pid_filter (base);
 }
 
 static void
@@ -543,6 +548,7 @@ mpegts_base_deactivate_and_free_program (MpegTSBase * base,
 
   mpegts_base_deactivate_program (base, program);
   mpegts_base_free_program (program);
+  mpegts_base_update_pid_filter (base);
 }
 
 static void
@@ -1238,6 +1244,9 @@ mpegts_base_handle_psi (MpegTSBase * base, GstMpegtsSection * section)
       break;
   }
 
+  /* Programs and streams might have come and gone */
+  mpegts_base_update_pid_filter (base);
+
   /* Finally post message (if it wasn't corrupted) */
   if (post_message)
     gst_element_post_message (GST_ELEMENT_CAST (base),
@@ -1245,6 +1254,43 @@ mpegts_base_handle_psi (MpegTSBase * base, GstMpegtsSection * section)
   gst_mpegts_section_unref (section);
 }
 
+/* Once the subclass has selected programs, only the PSI and the PIDs of the
+ * selected programs are of interest: let the packetizer drop the rest before
+ * parsing them. */
+static void
+mpegts_base_update_pid_filter (MpegTSBase * base)
+{
+  GHashTableIter iter;
+  MpegTSBaseProgram *program;
+  guint8 pids[8192 / 8];
+  gboolean have_selected = FALSE;
+  GList *tmp;
+
+  /* Elements outputting unknown PIDs want to see everything */
+  if (base->push_unknown) {
+    mpegts_packetizer_set_pid_filter (base->packetizer, NULL);
+    return;
+  }
+
+  memcpy (pids, base->known_psi, sizeof (pids));
+
+  g_hash_table_iter_init (&iter, base->programs);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) & program)) {
+    if (!program->active || !program->selected)
+      continue;
+
+    have_selected = TRUE;
+    MPEGTS_BIT_SET (pids, program->pmt_pid);
+    MPEGTS_BIT_SET (pids, program->pcr_pid);
+    for (tmp = program->stream_list; tmp; tmp = tmp->next)
+      MPEGTS_BIT_SET (pids, ((MpegTSBaseStream *) tmp->data)->pid);
+  }
+
+  GST_LOG_OBJECT (base, "PID filtering %s", have_selected ? "on" : "off");
+  mpegts_packetizer_set_pid_filter (base->packetizer,
+      have_selected ? pids : NULL);
+}
+
 static gboolean
 mpegts_base_parse_atsc_mgt (MpegTSBase * base, GstMpegtsSection * section)
 {
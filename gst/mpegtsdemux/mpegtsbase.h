@@ -95,6 +95,10 @@ struct _MpegTSBaseProgram
   gboolean active;
   /* TRUE if this is the first program created */
   gboolean initial_program;
+  /* TRUE if the subclass outputs this program. As soon as one program is
+   * selected, the packets of the PIDs of the other programs are dropped by
+   * the packetizer */
+  gboolean selected;
 };
 
 typedef enum {
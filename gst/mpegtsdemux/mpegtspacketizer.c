@@ -55,6 +55,8 @@ static GstClockTime calculate_skew (MpegTSPacketizer2 * packetizer,
 static void _close_current_group (MpegTSPCR * pcrtable);
 static void record_pcr (MpegTSPacketizer2 * packetizer, MpegTSPCR * pcrtable,
     guint64 pcr, guint64 offset);
+static void mpegts_packetizer_clear_section_cache (MpegTSPacketizer2 *
+    packetizer);
 
 #define CONTINUITY_UNSET 255
 #define VERSION_NUMBER_UNSET 255
@@ -261,9 +263,15 @@ mpegts_packetizer_init (MpegTSPacketizer2 * packetizer)
   packetizer->map_size = 0;
   packetizer->map_offset = 0;
   packetizer->need_sync = FALSE;
+  packetizer->batch_start = 0;
+  packetizer->batch_len = 0;
+  packetizer->filter_pids = FALSE;
+  packetizer->n_packets = 0;
+  packetizer->n_filtered = 0;
 
   memset (packetizer->pcrtablelut, 0xff, 0x2000);
   memset (packetizer->observations, 0x0, sizeof (packetizer->observations));
+  memset (packetizer->section_cache, 0, sizeof (packetizer->section_cache));
   packetizer->lastobsid = 0;
 
   packetizer->nb_seen_offsets = 0;
@@ -290,6 +298,7 @@ mpegts_packetizer_dispose (GObject * object)
       }
       g_free (packetizer->streams);
     }
+    mpegts_packetizer_clear_section_cache (packetizer);
 
     gst_adapter_clear (packetizer->adapter);
     g_object_unref (packetizer->adapter);
@@ -457,35 +466,31 @@ mpegts_packetizer_parse_adaptation_field_control (MpegTSPacketizer2 *
   return TRUE;
 }
 
+/* @header is the first 4 bytes of the packet, already checked for the sync
+ * byte */
 static MpegTSPacketizerPacketReturn
 mpegts_packetizer_parse_packet (MpegTSPacketizer2 * packetizer,
-    MpegTSPacketizerPacket * packet)
+    MpegTSPacketizerPacket * packet, guint32 header)
 {
-  guint8 *data;
   guint8 tmp;
 
-  data = packet->data_start;
-  data += 1;
-  tmp = *data;
-
   /* transport_error_indicator 1 */
-  if (G_UNLIKELY (tmp & 0x80))
+  if (G_UNLIKELY (header & 0x800000))
     return PACKET_BAD;
 
   /* payload_unit_start_indicator 1 */
-  packet->payload_unit_start_indicator = tmp & 0x40;
+  packet->payload_unit_start_indicator = (header >> 16) & 0x40;
 
   /* transport_priority 1 */
   /* PID 13 */
-  packet->pid = GST_READ_UINT16_BE (data) & 0x1FFF;
-  data += 2;
+  packet->pid = (header >> 8) & 0x1FFF;
 
-  packet->scram_afc_cc = tmp = *data++;
+  packet->scram_afc_cc = tmp = header & 0xff;
   /* transport_scrambling_control 2 */
   if (G_UNLIKELY (tmp & 0xc0))
     return PACKET_BAD;
 
-  packet->data = data;
+  packet->data = packet->data_start + 4;
 
   packet->afc_flags = 0;
   packet->pcr = G_MAXUINT64;
@@ -503,6 +508,61 @@ mpegts_packetizer_parse_packet (MpegTSPacketizer2 * packetizer,
   return PACKET_OK;
 }
 
+static void
+mpegts_packetizer_clear_section_cache (MpegTSPacketizer2 * packetizer)
+{
+  guint i;
+
+  for (i = 0; i < MPEGTS_PACKETIZER_SECTION_CACHE_SIZE; i++) {
+    if (packetizer->section_cache[i]) {
+      gst_mpegts_section_unref (packetizer->section_cache[i]);
+      packetizer->section_cache[i] = NULL;
+    }
+  }
+}
+
+/* Takes ownership of stream->section_data */
+static GstMpegtsSection *
+mpegts_packetizer_new_section (MpegTSPacketizer2 * packetizer,
+    MpegTSPacketizerStream * stream)
+{
+  guint8 *data = stream->section_data;
+  guint length = stream->section_length;
+  GstMpegtsSection *cached, *res;
+  guint32 crc;
+  guint slot;
+
+  /* Only long sections carry a CRC worth skipping */
+  if (!(data[1] & 0x80) || length < 12)
+    return gst_mpegts_section_new (stream->pid, data, length);
+
+  crc = GST_READ_UINT32_BE (data + length - 4);
+  slot = (crc ^ (stream->pid << 8) ^ data[0]) %
+      MPEGTS_PACKETIZER_SECTION_CACHE_SIZE;
+  cached = packetizer->section_cache[slot];
+
+  /* Only reuse an entry nobody else holds, since its offset gets updated
+   * below, and only once it was parsed, which validated its CRC */
+  if (cached && cached->pid == stream->pid && cached->table_id == data[0]
+      && cached->section_length == length && cached->crc == crc
+      && gst_mini_object_is_writable (GST_MINI_OBJECT_CAST (cached))
+      && cached->cached_parsed && memcmp (cached->data, data, length) == 0) {
+    GST_LOG ("PID 0x%04x table_id 0x%02x: reusing validated section",
+        stream->pid, data[0]);
+    g_free (data);
+    return gst_mpegts_section_ref (cached);
+  }
+
+  res = gst_mpegts_section_new (stream->pid, data, length);
+  if (res) {
+    if (cached)
+      gst_mpegts_section_unref (cached);
+    packetizer->section_cache[slot] = gst_mpegts_section_ref (res);
+  }
+
+  return res;
+}
+
 static GstMpegtsSection *
 mpegts_packetizer_parse_section_header (MpegTSPacketizer2 * packetizer,
     MpegTSPacketizerStream * stream)
@@ -536,9 +596,7 @@ mpegts_packetizer_parse_section_header (MpegTSPacketizer2 * packetizer,
       stream->section_length);
   /* TODO ? : Replace this by an efficient version (where we provide all
    * pre-parsed header data) */
-  res =
-      gst_mpegts_section_new (stream->pid, stream->section_data,
-      stream->section_length);
+  res = mpegts_packetizer_new_section (packetizer, stream);
   stream->section_data = NULL;
   mpegts_packetizer_clear_section (stream);
 
@@ -583,6 +641,7 @@ mpegts_packetizer_clear (MpegTSPacketizer2 * packetizer)
     }
     memset (packetizer->streams, 0, 8192 * sizeof (MpegTSPacketizerStream *));
   }
+  mpegts_packetizer_clear_section_cache (packetizer);
 
   gst_adapter_clear (packetizer->adapter);
   packetizer->offset = 0;
@@ -591,6 +650,7 @@ mpegts_packetizer_clear (MpegTSPacketizer2 * packetizer)
   packetizer->map_data = NULL;
   packetizer->map_size = 0;
   packetizer->map_offset = 0;
+  packetizer->batch_len = 0;
   packetizer->last_in_time = GST_CLOCK_TIME_NONE;
   packetizer->last_pts = GST_CLOCK_TIME_NONE;
   packetizer->last_dts = GST_CLOCK_TIME_NONE;
@@ -633,6 +693,7 @@ mpegts_packetizer_flush (MpegTSPacketizer2 * packetizer, gboolean hard)
   packetizer->map_data = NULL;
   packetizer->map_size = 0;
   packetizer->map_offset = 0;
+  packetizer->batch_len = 0;
   packetizer->last_in_time = GST_CLOCK_TIME_NONE;
   packetizer->last_pts = GST_CLOCK_TIME_NONE;
   packetizer->last_dts = GST_CLOCK_TIME_NONE;
@@ -712,6 +773,7 @@ mpegts_packetizer_flush_bytes (MpegTSPacketizer2 * packetizer, gsize size)
   packetizer->map_data = NULL;
   packetizer->map_size = 0;
   packetizer->map_offset = 0;
+  packetizer->batch_len = 0;
 }
 
 static gboolean
@@ -828,6 +890,7 @@ mpegts_packetizer_sync (MpegTSPacketizer2 * packetizer)
   }
 
   packetizer->map_offset += i - sync_offset;
+  packetizer->batch_len = 0;
 
   if (!found)
     mpegts_packetizer_flush_bytes (packetizer, packetizer->map_offset);
@@ -835,13 +898,63 @@ mpegts_packetizer_sync (MpegTSPacketizer2 * packetizer)
   return found;
 }
 
+/* Extracts the headers of as many packets as possible from the mapped data,
+ * stopping at the first one without a sync byte. Headers are loaded and
+ * checked four packets at a time without branching on each one. */
+static void
+mpegts_packetizer_fill_batch (MpegTSPacketizer2 * packetizer,
+    gsize sync_offset)
+{
+  const guint32 sync_mask = 0xff000000;
+  const guint32 sync = PACKET_SYNC_BYTE << 24;
+  guint packet_size = packetizer->packet_size;
+  guint8 *data;
+  guint32 *batch = packetizer->batch;
+  guint i, n;
+
+  data = &packetizer->map_data[packetizer->map_offset + sync_offset];
+  n = MIN ((packetizer->map_size - packetizer->map_offset) / packet_size,
+      MPEGTS_PACKETIZER_BATCH_SIZE);
+
+  for (i = 0; i + 4 <= n; i += 4) {
+    guint32 h0 = GST_READ_UINT32_BE (data);
+    guint32 h1 = GST_READ_UINT32_BE (data + packet_size);
+    guint32 h2 = GST_READ_UINT32_BE (data + 2 * packet_size);
+    guint32 h3 = GST_READ_UINT32_BE (data + 3 * packet_size);
+
+    if (((h0 ^ sync) | (h1 ^ sync) | (h2 ^ sync) | (h3 ^ sync)) & sync_mask)
+      break;
+
+    batch[i] = h0;
+    batch[i + 1] = h1;
+    batch[i + 2] = h2;
+    batch[i + 3] = h3;
+    data += 4 * packet_size;
+  }
+
+  for (; i < n; i++) {
+    guint32 h = GST_READ_UINT32_BE (data);
+
+    if ((h & sync_mask) != sync)
+      break;
+
+    batch[i] = h;
+    data += packet_size;
+  }
+
+  packetizer->batch_start = packetizer->map_offset;
+  packetizer->batch_len = i;
+
+  GST_LOG ("%u packet headers in batch", i);
+}
+
 MpegTSPacketizerPacketReturn
 mpegts_packetizer_next_packet (MpegTSPacketizer2 * packetizer,
     MpegTSPacketizerPacket * packet)
 {
   guint8 *packet_data;
   guint packet_size;
-  gsize sync_offset;
+  gsize sync_offset, idx;
 
   packet_size = packetizer->packet_size;
   if (G_UNLIKELY (!packet_size)) {
@@ -866,13 +979,30 @@ mpegts_packetizer_next_packet (MpegTSPacketizer2 * packetizer,
     if (!mpegts_packetizer_map (packetizer, packet_size))
       return PACKET_NEED_MORE;
 
-    packet_data = &packetizer->map_data[packetizer->map_offset + sync_offset];
+    idx = (packetizer->map_offset - packetizer->batch_start) / packet_size;
+    if (idx >= packetizer->batch_len) {
+      mpegts_packetizer_fill_batch (packetizer, sync_offset);
+      idx = 0;
+    }
 
     /* Check sync byte */
-    if (G_UNLIKELY (*packet_data != PACKET_SYNC_BYTE)) {
+    if (G_UNLIKELY (packetizer->batch_len == 0)) {
       GST_DEBUG ("lost sync");
       packetizer->need_sync = TRUE;
+    } else if (packetizer->filter_pids &&
+        !MPEGTS_BIT_IS_SET (packetizer->pid_filter,
+            (packetizer->batch[idx] >> 8) & 0x1FFF)) {
+      /* Nobody is interested in this PID, skip it without looking at the
+       * adaptation field */
+      packetizer->n_packets++;
+      packetizer->n_filtered++;
+      packetizer->offset += packet_size;
+      packetizer->map_offset += packet_size;
     } else {
+      packetizer->n_packets++;
+      packet_data =
+          &packetizer->map_data[packetizer->map_offset + sync_offset];
+
       /* ALL mpeg-ts variants contain 188 bytes of data. Those with bigger
        * packet sizes contain either extra data (timesync, FEC, ..) either
        * before or after the data */
@@ -883,7 +1013,8 @@ mpegts_packetizer_next_packet (MpegTSPacketizer2 * packetizer,
       packetizer->offset += packet_size;
       GST_MEMDUMP ("data_start", packet->data_start, 16);
 
-      return mpegts_packetizer_parse_packet (packetizer, packet);
+      return mpegts_packetizer_parse_packet (packetizer, packet,
+          packetizer->batch[idx]);
     }
   }
 }
@@ -2508,6 +2639,18 @@ mpegts_packetizer_set_pcr_discont_threshold (MpegTSPacketizer2 * packetizer,
   PACKETIZER_GROUP_UNLOCK (packetizer);
 }
 
+void
+mpegts_packetizer_set_pid_filter (MpegTSPacketizer2 * packetizer,
+    const guint8 * pids)
+{
+  if (pids) {
+    memcpy (packetizer->pid_filter, pids, sizeof (packetizer->pid_filter));
+    packetizer->filter_pids = TRUE;
+  } else {
+    packetizer->filter_pids = FALSE;
+  }
+}
+
 void
 mpegts_packetizer_set_current_pcr_offset (MpegTSPacketizer2 * packetizer,
     GstClockTime offset, guint16 pcr_pid)
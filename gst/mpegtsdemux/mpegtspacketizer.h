@@ -50,6 +50,12 @@
 
 #define MAX_WINDOW 512
 
+/* Number of packet headers extracted at once from the mapped data */
+#define MPEGTS_PACKETIZER_BATCH_SIZE 64
+
+/* Number of validated long sections kept around for reuse */
+#define MPEGTS_PACKETIZER_SECTION_CACHE_SIZE 32
+
 G_BEGIN_DECLS
 
 #define GST_TYPE_MPEGTS_PACKETIZER \
@@ -269,6 +275,27 @@ struct _MpegTSPacketizer2 {
   gsize map_size;
   gboolean need_sync;
 
+  /* Headers (4 bytes, big endian) of the packets following
+   * map_data[batch_start], all with a valid sync byte */
+  guint32 batch[MPEGTS_PACKETIZER_BATCH_SIZE];
+  gsize batch_start;
+  guint batch_len;
+
+  /* If TRUE, packets whose PID isn't set in pid_filter are skipped by
+   * next_packet() without being parsed */
+  gboolean filter_pids;
+  guint8 pid_filter[8192 / 8];
+
+  /* Recently seen long sections, indexed by a hash of their PID, table_id
+   * and CRC. A byte-identical repeat of an entry that was already parsed
+   * (and therefore passed its CRC check) reuses it instead of being
+   * validated and parsed again */
+  GstMpegtsSection *section_cache[MPEGTS_PACKETIZER_SECTION_CACHE_SIZE];
+
+  /* Statistics */
+  guint64 n_packets;
+  guint64 n_filtered;
+
   /* Reference offset */
   guint64 refoffset;
 
@@ -380,6 +407,10 @@ mpegts_packetizer_set_reference_offset (MpegTSPacketizer2 * packetizer,
 G_GNUC_INTERNAL void
 mpegts_packetizer_set_pcr_discont_threshold (MpegTSPacketizer2 * packetizer,
 					GstClockTime threshold);
+/* @pids is a 8192 bit PID bitmap (see MPEGTS_BIT_*), NULL disables filtering */
+G_GNUC_INTERNAL void
+mpegts_packetizer_set_pid_filter (MpegTSPacketizer2 * packetizer,
+				  const guint8 * pids);
 G_END_DECLS
 
 #endif /* GST_MPEGTS_PACKETIZER_H */
@@ -47,6 +47,7 @@
 #include "mpegtspacketizer.h"
 #include "pesparse.h"
 #include <gst/codecparsers/gsth264parser.h>
+#include <gst/codecparsers/gsth265parser.h>
 #include <gst/codecparsers/gstmpegvideoparser.h>
 #include <gst/video/video-color.h>
 
@@ -82,6 +83,12 @@
  * up to this size */
 #define MAX_PES_PAYLOAD (32 * 1024 * 1024)
 
+/* Maximum number of buffers (or buffer lists) waiting in the output queue
+ * of a stream when using output threads, before the streaming thread blocks */
+#define MAX_OUTPUT_QUEUE 32
+
+#define DEFAULT_OUTPUT_THREADS 0
+
 GST_DEBUG_CATEGORY_STATIC (ts_demux_debug);
 #define GST_CAT_DEFAULT ts_demux_debug
 
@@ -120,6 +127,7 @@ typedef struct
 typedef struct _TSDemuxStream TSDemuxStream;
 
 typedef struct _TSDemuxH264ParsingInfos TSDemuxH264ParsingInfos;
+typedef struct _TSDemuxH265ParsingInfos TSDemuxH265ParsingInfos;
 typedef struct _TSDemuxJP2KParsingInfos TSDemuxJP2KParsingInfos;
 typedef struct _TSDemuxADTSParsingInfos TSDemuxADTSParsingInfos;
 
@@ -143,6 +151,17 @@ struct _TSDemuxH264ParsingInfos
   SimpleBuffer framedata;
 };
 
+struct _TSDemuxH265ParsingInfos
+{
+  /* H265 parsing data */
+  GstH265Parser *parser;
+  GstByteWriter *vps;
+  GstByteWriter *sps;
+  GstByteWriter *pps;
+  GstByteWriter *sei;
+  SimpleBuffer framedata;
+};
+
 struct _TSDemuxJP2KParsingInfos
 {
   /* J2K parsing data */
@@ -197,6 +216,11 @@ struct _TSDemuxStream
   /* Current PTS/DTS for this stream (in 90kHz unit) */
   guint64 raw_pts, raw_dts;
 
+  /* Offset of the packet starting the current PES, and whether its
+   * random_access_indicator was set */
+  guint64 pes_offset;
+  gboolean pes_random_access;
+
   /* Whether this stream needs to send a newsegment */
   gboolean need_newsegment;
 
@@ -217,12 +241,25 @@ struct _TSDemuxStream
   guint8 target_pes_substream;
   gboolean needs_keyframe;
 
+  /* After a seek through the keyframe index, offset of the keyframe PES to
+   * start outputting from, or -1 */
+  guint64 keyframe_offset;
+
   GstClockTime seeked_pts, seeked_dts;
 
   GstTsDemuxKeyFrameScanFunction scan_function;
   TSDemuxH264ParsingInfos h264infos;
+  TSDemuxH265ParsingInfos h265infos;
   TSDemuxJP2KParsingInfos jp2kInfos;
   TSDemuxADTSParsingInfos atdsInfos;
+
+  /* Buffers and buffer lists waiting to be pushed by the output threads,
+   * protected by the demuxer output_lock */
+  GQueue output_queue;
+  /* TRUE while the stream is scheduled on or being drained by the pool */
+  gboolean output_scheduled;
+  /* Last flow return of the output threads for this stream */
+  GstFlowReturn output_flow;
 };
 
 #define VIDEO_CAPS \
@@ -297,6 +334,9 @@ enum
   PROP_PROGRAM_NUMBER,
   PROP_EMIT_STATS,
   PROP_LATENCY,
+  PROP_STATS,
+  PROP_OUTPUT_THREADS,
+  PROP_INDEX_LOCATION,
   /* FILL ME */
 };
 
@@ -340,6 +380,8 @@ static gboolean push_event (MpegTSBase * base, GstEvent * event);
 static gboolean sink_query (MpegTSBase * base, GstQuery * query);
 static void gst_ts_demux_check_and_sync_streams (GstTSDemux * demux,
     GstClockTime time);
+static GstStateChangeReturn gst_ts_demux_change_state (GstElement * element,
+    GstStateChange transition);
 
 static void
 _extra_init (void)
@@ -373,6 +415,18 @@ gst_ts_demux_dispose (GObject * object)
   GST_CALL_PARENT (G_OBJECT_CLASS, dispose, (object));
 }
 
+static void
+gst_ts_demux_finalize (GObject * object)
+{
+  GstTSDemux *demux = GST_TS_DEMUX_CAST (object);
+
+  g_mutex_clear (&demux->output_lock);
+  g_cond_clear (&demux->output_cond);
+  g_free (demux->index_location);
+
+  GST_CALL_PARENT (G_OBJECT_CLASS, finalize, (object));
+}
+
 static void
 gst_ts_demux_class_init (GstTSDemuxClass * klass)
 {
@@ -384,6 +438,7 @@ gst_ts_demux_class_init (GstTSDemuxClass * klass)
   gobject_class->set_property = gst_ts_demux_set_property;
   gobject_class->get_property = gst_ts_demux_get_property;
   gobject_class->dispose = gst_ts_demux_dispose;
+  gobject_class->finalize = gst_ts_demux_finalize;
 
   g_object_class_install_property (gobject_class, PROP_PROGRAM_NUMBER,
       g_param_spec_int ("program-number", "Program number",
@@ -401,7 +456,58 @@ gst_ts_demux_class_init (GstTSDemuxClass * klass)
           G_MAXINT, DEFAULT_LATENCY,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * GstTSDemux:stats:
+   *
+   * Packet counters: "packets" is the number of packets seen and
+   * "filtered-packets" the number of them that belonged to PIDs of programs
+   * that aren't being demuxed and were dropped without being parsed.
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_STATS,
+      g_param_spec_boxed ("stats", "Statistics",
+          "Packet statistics", GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstTSDemux:output-threads:
+   *
+   * Number of threads used to push the elementary streams downstream.
+   * With 0, everything is pushed from the streaming thread. Otherwise each
+   * stream gets its own output queue, drained by a pool of up to this many
+   * threads, so that the downstream elements of different streams run in
+   * parallel while the buffers of each stream stay in order.
+   *
+   * Only taken into account when going from READY to PAUSED.
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_OUTPUT_THREADS,
+      g_param_spec_uint ("output-threads", "Output threads",
+          "Number of threads pushing the streams downstream "
+          "(0 = use the streaming thread)", 0, 64, DEFAULT_OUTPUT_THREADS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstTSDemux:index-location:
+   *
+   * When pulling from upstream, tsdemux indexes the keyframes of the video
+   * stream as it plays, and seeks straight to the right keyframe when the
+   * index covers the seek target instead of bisecting the PCRs and scanning
+   * for a keyframe. If set, the index is loaded from this file when the
+   * program starts (if it was built for the same file) and saved back when
+   * going to READY.
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_INDEX_LOCATION,
+      g_param_spec_string ("index-location", "Index location",
+          "File to load and save the keyframe index (pull mode only)", NULL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   element_class = GST_ELEMENT_CLASS (klass);
+  element_class->change_state = GST_DEBUG_FUNCPTR (gst_ts_demux_change_state);
   gst_element_class_add_pad_template (element_class,
       gst_static_pad_template_get (&video_template));
   gst_element_class_add_pad_template (element_class,
@@ -476,6 +582,9 @@ gst_ts_demux_init (GstTSDemux * demux)
   demux->requested_program_number = -1;
   demux->program_number = -1;
   demux->latency = DEFAULT_LATENCY;
+  demux->output_threads = DEFAULT_OUTPUT_THREADS;
+  g_mutex_init (&demux->output_lock);
+  g_cond_init (&demux->output_cond);
   gst_ts_demux_reset (base);
 }
 
@@ -498,6 +607,17 @@ gst_ts_demux_set_property (GObject * object, guint prop_id,
     case PROP_LATENCY:
       demux->latency = g_value_get_int (value);
       break;
+    case PROP_OUTPUT_THREADS:
+      GST_OBJECT_LOCK (demux);
+      demux->output_threads = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_INDEX_LOCATION:
+      GST_OBJECT_LOCK (demux);
+      g_free (demux->index_location);
+      demux->index_location = g_value_dup_string (value);
+      GST_OBJECT_UNLOCK (demux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
   }
@@ -519,11 +639,304 @@ gst_ts_demux_get_property (GObject * object, guint prop_id,
     case PROP_LATENCY:
       g_value_set_int (value, demux->latency);
       break;
+    case PROP_STATS:
+    {
+      MpegTSPacketizer2 *packetizer = ((MpegTSBase *) demux)->packetizer;
+
+      g_value_take_boxed (value, gst_structure_new ("GstTSDemuxStats",
+              "packets", G_TYPE_UINT64, packetizer->n_packets,
+              "filtered-packets", G_TYPE_UINT64, packetizer->n_filtered,
+              NULL));
+      break;
+    }
+    case PROP_OUTPUT_THREADS:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_uint (value, demux->output_threads);
+      GST_OBJECT_UNLOCK (demux);
+      break;
+    case PROP_INDEX_LOCATION:
+      GST_OBJECT_LOCK (demux);
+      g_value_set_string (value, demux->index_location);
+      GST_OBJECT_UNLOCK (demux);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
   }
 }
 
+static void
+clear_output_queue (GQueue * queue)
+{
+  GstMiniObject *obj;
+
+  while ((obj = g_queue_pop_head (queue)))
+    gst_mini_object_unref (obj);
+}
+
+static void
+gst_ts_demux_output_thread_func (TSDemuxStream * stream, GstTSDemux * demux)
+{
+  GstFlowReturn res = GST_FLOW_OK;
+  guint n;
+
+  g_mutex_lock (&demux->output_lock);
+  /* Only push what was queued so far before giving the thread back to the
+   * pool, so that a busy stream doesn't starve the others */
+  n = stream->output_queue.length;
+  while (n-- > 0 && (res == GST_FLOW_OK || res == GST_FLOW_NOT_LINKED)) {
+    GstMiniObject *obj = g_queue_pop_head (&stream->output_queue);
+    GstPad *pad;
+
+    /* The queue is emptied on flush-start */
+    if (obj == NULL)
+      break;
+
+    pad = gst_object_ref (stream->pad);
+
+    g_cond_broadcast (&demux->output_cond);
+    g_mutex_unlock (&demux->output_lock);
+
+    if (GST_IS_BUFFER_LIST (obj))
+      res = gst_pad_push_list (pad, GST_BUFFER_LIST_CAST (obj));
+    else
+      res = gst_pad_push (pad, GST_BUFFER_CAST (obj));
+    GST_LOG_OBJECT (pad, "Returned %s", gst_flow_get_name (res));
+    gst_object_unref (pad);
+
+    g_mutex_lock (&demux->output_lock);
+    /* don't let a push that returned before a flush-start undo it */
+    if (stream->output_flow == GST_FLOW_FLUSHING)
+      res = GST_FLOW_FLUSHING;
+    else
+      stream->output_flow = res;
+  }
+
+  if (res != GST_FLOW_OK && res != GST_FLOW_NOT_LINKED) {
+    /* Flushing, EOS or error, nothing else will get through */
+    clear_output_queue (&stream->output_queue);
+  }
+
+  if (g_queue_is_empty (&stream->output_queue)) {
+    stream->output_scheduled = FALSE;
+  } else {
+    /* Reschedule behind the streams that are already waiting */
+    g_thread_pool_push (demux->output_pool, stream, NULL);
+  }
+  g_cond_broadcast (&demux->output_cond);
+  g_mutex_unlock (&demux->output_lock);
+}
+
+/* Pushes a buffer or buffer list on the pad of @stream, or queues it for the
+ * output threads. In the latter case, the returned flow is the last one
+ * returned downstream for this stream. Takes ownership of @obj */
+static GstFlowReturn
+gst_ts_demux_push_output (GstTSDemux * demux, TSDemuxStream * stream,
+    GstMiniObject * obj)
+{
+  GstFlowReturn res;
+
+  if (demux->output_pool == NULL) {
+    if (GST_IS_BUFFER_LIST (obj))
+      return gst_pad_push_list (stream->pad, GST_BUFFER_LIST_CAST (obj));
+    return gst_pad_push (stream->pad, GST_BUFFER_CAST (obj));
+  }
+
+  g_mutex_lock (&demux->output_lock);
+  while (stream->output_queue.length >= MAX_OUTPUT_QUEUE)
+    g_cond_wait (&demux->output_cond, &demux->output_lock);
+
+  res = stream->output_flow;
+  if (res == GST_FLOW_OK || res == GST_FLOW_NOT_LINKED) {
+    g_queue_push_tail (&stream->output_queue, obj);
+    if (!stream->output_scheduled) {
+      stream->output_scheduled = TRUE;
+      g_thread_pool_push (demux->output_pool, stream, NULL);
+    }
+  } else {
+    GST_DEBUG_OBJECT (stream->pad, "Dropping, output returned %s",
+        gst_flow_get_name (res));
+    gst_mini_object_unref (obj);
+  }
+  g_mutex_unlock (&demux->output_lock);
+
+  return res;
+}
+
+/* Waits until the output threads are done with @stream, after dropping
+ * everything still queued if @discard is set */
+static void
+gst_ts_demux_stream_sync_output (GstTSDemux * demux, TSDemuxStream * stream,
+    gboolean discard)
+{
+  if (demux->output_pool == NULL)
+    return;
+
+  g_mutex_lock (&demux->output_lock);
+  if (discard)
+    clear_output_queue (&stream->output_queue);
+  while (stream->output_scheduled)
+    g_cond_wait (&demux->output_cond, &demux->output_lock);
+  g_mutex_unlock (&demux->output_lock);
+}
+
+/* Pushes @event on the pad of @stream. Serialized events are pushed once
+ * all the buffers queued before them went out */
+static gboolean
+gst_ts_demux_push_stream_event (GstTSDemux * demux, TSDemuxStream * stream,
+    GstEvent * event)
+{
+  if (GST_EVENT_IS_SERIALIZED (event))
+    gst_ts_demux_stream_sync_output (demux, stream, FALSE);
+
+  return gst_pad_push_event (stream->pad, event);
+}
+
+/* Saves the keyframe index if needed and frees it */
+static void
+gst_ts_demux_clear_index (GstTSDemux * demux)
+{
+  gchar *location;
+
+  if (demux->index == NULL)
+    return;
+
+  GST_OBJECT_LOCK (demux);
+  location = g_strdup (demux->index_location);
+  GST_OBJECT_UNLOCK (demux);
+
+  if (location && demux->index->dirty) {
+    GError *err = NULL;
+
+    GST_DEBUG_OBJECT (demux, "Saving index with %u keyframes to %s",
+        demux->index->entries->len, location);
+    if (!ts_demux_index_save (demux->index, location, &err)) {
+      GST_WARNING_OBJECT (demux, "Failed to save index: %s", err->message);
+      g_clear_error (&err);
+    }
+  }
+  g_free (location);
+
+  ts_demux_index_free (demux->index);
+  demux->index = NULL;
+}
+
+/* Sets up the keyframe index for the video stream of @program, loading it
+ * from the index-location if there is one */
+static void
+gst_ts_demux_setup_index (GstTSDemux * demux, MpegTSBaseProgram * program)
+{
+  MpegTSBase *base = (MpegTSBase *) demux;
+  MpegTSBaseStream *video = NULL;
+  gint64 upstream_size;
+  gchar *location;
+  GList *tmp;
+
+  /* Offsets only make sense if we can get back to them */
+  if (base->mode == BASE_MODE_PUSHING)
+    return;
+
+  for (tmp = program->stream_list; tmp && !video; tmp = tmp->next) {
+    MpegTSBaseStream *bs = (MpegTSBaseStream *) tmp->data;
+
+    switch (bs->stream_type) {
+      case GST_MPEGTS_STREAM_TYPE_VIDEO_MPEG1:
+      case GST_MPEGTS_STREAM_TYPE_VIDEO_MPEG2:
+      case GST_MPEGTS_STREAM_TYPE_VIDEO_H264:
+      case GST_MPEGTS_STREAM_TYPE_VIDEO_HEVC:
+        if (((TSDemuxStream *) bs)->pad)
+          video = bs;
+        break;
+      default:
+        break;
+    }
+  }
+
+  if (demux->index && (video == NULL || demux->index->pid != video->pid))
+    gst_ts_demux_clear_index (demux);
+
+  if (video == NULL || demux->index != NULL)
+    return;
+
+  if (!gst_pad_peer_query_duration (base->sinkpad, GST_FORMAT_BYTES,
+          &upstream_size) || upstream_size <= 0) {
+    GST_DEBUG_OBJECT (demux, "Unknown upstream size, not indexing");
+    return;
+  }
+
+  GST_OBJECT_LOCK (demux);
+  location = g_strdup (demux->index_location);
+  GST_OBJECT_UNLOCK (demux);
+
+  if (location && g_file_test (location, G_FILE_TEST_EXISTS)) {
+    GError *err = NULL;
+
+    demux->index = ts_demux_index_load (location, upstream_size, video->pid,
+        &err);
+    if (demux->index) {
+      GST_INFO_OBJECT (demux, "Loaded index with %u keyframes from %s",
+          demux->index->entries->len, location);
+    } else {
+      GST_WARNING_OBJECT (demux, "Not using saved index: %s", err->message);
+      g_clear_error (&err);
+    }
+  }
+  g_free (location);
+
+  if (demux->index == NULL)
+    demux->index = ts_demux_index_new (upstream_size, video->pid);
+}
+
+static GstStateChangeReturn
+gst_ts_demux_change_state (GstElement * element, GstStateChange transition)
+{
+  GstTSDemux *demux = GST_TS_DEMUX_CAST (element);
+  GstStateChangeReturn ret;
+
+  switch (transition) {
+    case GST_STATE_CHANGE_READY_TO_PAUSED:
+    {
+      guint n_threads;
+
+      GST_OBJECT_LOCK (demux);
+      n_threads = demux->output_threads;
+      GST_OBJECT_UNLOCK (demux);
+
+      if (n_threads > 0) {
+        GError *err = NULL;
+
+        demux->output_pool =
+            g_thread_pool_new ((GFunc) gst_ts_demux_output_thread_func, demux,
+            n_threads, FALSE, &err);
+        if (demux->output_pool == NULL) {
+          GST_WARNING_OBJECT (demux, "Failed to create output threads: %s, "
+              "pushing from the streaming thread", err->message);
+          g_clear_error (&err);
+        }
+      }
+      break;
+    }
+    default:
+      break;
+  }
+
+  ret = GST_ELEMENT_CLASS (parent_class)->change_state (element, transition);
+
+  switch (transition) {
+    case GST_STATE_CHANGE_PAUSED_TO_READY:
+      gst_ts_demux_clear_index (demux);
+      /* All streams were removed (and their output synced) by the reset */
+      if (demux->output_pool) {
+        g_thread_pool_free (demux->output_pool, FALSE, TRUE);
+        demux->output_pool = NULL;
+      }
+      break;
+    default:
+      break;
+  }
+
+  return ret;
+}
+
 static gboolean
 gst_ts_demux_get_duration (GstTSDemux * demux, GstClockTime * dur)
 {
@@ -833,6 +1246,172 @@ scan_keyframe_h264 (TSDemuxStream * stream, const guint8 * data,
   return FALSE;
 }
 
+static gboolean
+scan_keyframe_h265 (TSDemuxStream * stream, const guint8 * data,
+    const gsize data_size, const gsize max_frame_offset)
+{
+  gint offset = 0;
+  GstH265NalUnit unit, frame_unit = { 0, };
+  GstH265ParserResult res = GST_H265_PARSER_OK;
+  TSDemuxH265ParsingInfos *h265infos = &stream->h265infos;
+
+  GstH265Parser *parser = h265infos->parser;
+
+  if (G_UNLIKELY (parser == NULL)) {
+    parser = h265infos->parser = gst_h265_parser_new ();
+    h265infos->vps = gst_byte_writer_new ();
+    h265infos->sps = gst_byte_writer_new ();
+    h265infos->pps = gst_byte_writer_new ();
+    h265infos->sei = gst_byte_writer_new ();
+  }
+
+  while (res == GST_H265_PARSER_OK) {
+    GstByteWriter *writer = NULL;
+
+    res =
+        gst_h265_parser_identify_nalu (parser, data, offset, data_size, &unit);
+
+    if (res != GST_H265_PARSER_OK && res != GST_H265_PARSER_NO_NAL_END) {
+      GST_INFO_OBJECT (stream->pad, "Error identifying nalu: %i", res);
+      break;
+    }
+
+    switch (unit.type) {
+      case GST_H265_NAL_VPS:
+        writer = h265infos->vps;
+        break;
+      case GST_H265_NAL_SPS:
+        writer = h265infos->sps;
+        break;
+      case GST_H265_NAL_PPS:
+        writer = h265infos->pps;
+        break;
+      case GST_H265_NAL_PREFIX_SEI:
+        writer = h265infos->sei;
+        break;
+      default:
+        /* IRAP pictures (IDR, CRA, BLA) are keyframes */
+        if (h265infos->framedata.size || frame_unit.size)
+          break;
+
+        if (GST_H265_IS_NAL_TYPE_IRAP (unit.type) && unit.size > 2 &&
+            (unit.data[unit.offset + 2] & 0x80)) {
+          /* means first_slice_segment_in_pic_flag == 1 */
+          GST_DEBUG_OBJECT (stream->pad, "Found keyframe at: %u",
+              unit.sc_offset);
+          frame_unit = unit;
+        }
+        break;
+    }
+
+    /* Parameter sets and SEI are only needed before the keyframe */
+    if (writer && !frame_unit.size) {
+      if (!gst_byte_writer_put_data (writer, unit.data + unit.sc_offset,
+              unit.size + unit.offset - unit.sc_offset))
+        GST_WARNING ("Could not write NAL of type %d", unit.type);
+    }
+
+    if (offset == unit.sc_offset + unit.size)
+      break;
+
+    offset = unit.sc_offset + unit.size;
+  }
+
+  /* We've got all the infos we need (VPS / SPS / PPS and a keyframe, plus
+   * possibly SEI units. We can stop rewinding the stream
+   */
+  if (gst_byte_writer_get_size (h265infos->vps) &&
+      gst_byte_writer_get_size (h265infos->sps) &&
+      gst_byte_writer_get_size (h265infos->pps) &&
+      (h265infos->framedata.size || frame_unit.size)) {
+    GstByteWriter *others[] = { h265infos->sps, h265infos->pps,
+      h265infos->sei
+    };
+    guint8 *data = NULL;
+    gsize tmpsize;
+    guint i;
+
+    /* Put everything after the VPS */
+    for (i = 0; i < G_N_ELEMENTS (others); i++) {
+      tmpsize = gst_byte_writer_get_size (others[i]);
+      if (tmpsize == 0)
+        continue;
+      data = gst_byte_writer_reset_and_get_data (others[i]);
+      gst_byte_writer_put_data (h265infos->vps, data, tmpsize);
+      g_free (data);
+    }
+
+    GST_DEBUG ("Adding Keyframe");
+    if (frame_unit.size) {      /*  We found the everything in one go! */
+      gst_byte_writer_put_data (h265infos->vps,
+          frame_unit.data + frame_unit.sc_offset,
+          stream->current_size - frame_unit.sc_offset);
+    } else {
+      gst_byte_writer_put_data (h265infos->vps,
+          h265infos->framedata.data, h265infos->framedata.size);
+      clear_simple_buffer (&h265infos->framedata);
+    }
+
+    g_free (stream->data);
+    stream->current_size = gst_byte_writer_get_size (h265infos->vps);
+    stream->data = gst_byte_writer_reset_and_get_data (h265infos->vps);
+
+    return TRUE;
+  }
+
+  if (frame_unit.size) {
+    GST_DEBUG_OBJECT (stream->pad, "Keep the keyframe as this is the one"
+        " we will push later");
+
+    h265infos->framedata.data =
+        g_memdup (frame_unit.data + frame_unit.sc_offset,
+        stream->current_size - frame_unit.sc_offset);
+    h265infos->framedata.size = stream->current_size - frame_unit.sc_offset;
+  }
+
+  return FALSE;
+}
+
+/* Cheap check of whether the PES currently collected in @stream starts a
+ * keyframe, for the seek index. Only looks at the first picture of H.264
+ * and H.265 streams, other codecs rely on the random_access_indicator */
+static gboolean
+gst_ts_demux_pes_is_keyframe (TSDemuxStream * stream)
+{
+  guint8 stream_type = ((MpegTSBaseStream *) stream)->stream_type;
+  GstByteReader br;
+  gint off;
+
+  if (stream_type != GST_MPEGTS_STREAM_TYPE_VIDEO_H264 &&
+      stream_type != GST_MPEGTS_STREAM_TYPE_VIDEO_HEVC)
+    return stream->pes_random_access;
+
+  gst_byte_reader_init (&br, stream->data, stream->current_size);
+
+  while (gst_byte_reader_get_remaining (&br) >= 4 &&
+      (off = gst_byte_reader_masked_scan_uint32 (&br, 0xffffff00,
+              0x00000100, 0, gst_byte_reader_get_remaining (&br))) >= 0) {
+    guint8 type;
+
+    if (!gst_byte_reader_skip (&br, off + 3) ||
+        !gst_byte_reader_peek_uint8 (&br, &type))
+      break;
+
+    if (stream_type == GST_MPEGTS_STREAM_TYPE_VIDEO_H264) {
+      type &= 0x1f;
+      /* The first slice decides */
+      if (type >= GST_H264_NAL_SLICE && type <= GST_H264_NAL_SLICE_IDR)
+        return type == GST_H264_NAL_SLICE_IDR;
+    } else {
+      type = (type >> 1) & 0x3f;
+      if (type < GST_H265_NAL_VPS)
+        return GST_H265_IS_NAL_TYPE_IRAP (type);
+    }
+  }
+
+  return FALSE;
+}
+
 /* We merge data from TS packets so that the scanning methods get a continuous chunk,
  however the scanning method will return keyframe offset which needs to be translated
  back to actual offset in file */
@@ -911,6 +1490,21 @@ gst_ts_demux_do_seek (MpegTSBase * base, GstEvent * event)
   /* If the position actually changed, update == TRUE */
   if (update) {
     GstClockTime target = seeksegment.start;
+    TSDemuxIndexEntry entry = { 0, };
+    gint index_pid = -1;
+
+    if (demux->index
+        && ts_demux_index_lookup (demux->index, seeksegment.start, &entry)) {
+      /* The video stream can start right from the keyframe preceding the
+       * target, but the other streams are muxed ahead of it: still start
+       * reading SEEK_TIMESTAMP_OFFSET before the keyframe for them */
+      GST_DEBUG_OBJECT (demux, "Found keyframe at %" GST_TIME_FORMAT
+          " offset %" G_GUINT64_FORMAT " in the index",
+          GST_TIME_ARGS (entry.ts), entry.offset);
+      index_pid = demux->index->pid;
+      target = entry.ts;
+    }
+
     if (target >= SEEK_TIMESTAMP_OFFSET)
       target -= SEEK_TIMESTAMP_OFFSET;
     else
@@ -919,6 +1513,8 @@ gst_ts_demux_do_seek (MpegTSBase * base, GstEvent * event)
     start_offset =
         mpegts_packetizer_ts_to_offset (base->packetizer, target,
         demux->program->pcr_pid);
+    if (index_pid != -1 && (start_offset == -1 || start_offset > entry.offset))
+      start_offset = entry.offset;
     if (G_UNLIKELY (start_offset == -1)) {
       GST_WARNING ("Couldn't convert start position to an offset");
       goto done;
@@ -935,8 +1531,14 @@ gst_ts_demux_do_seek (MpegTSBase * base, GstEvent * event)
     for (tmp = demux->program->stream_list; tmp; tmp = tmp->next) {
       TSDemuxStream *stream = tmp->data;
 
-      if (flags & GST_SEEK_FLAG_ACCURATE)
+      stream->keyframe_offset = -1;
+      if (stream->stream.pid == index_pid) {
+        /* No need to look for the keyframe, just drop what precedes it */
+        stream->needs_keyframe = FALSE;
+        stream->keyframe_offset = entry.offset;
+      } else if (flags & GST_SEEK_FLAG_ACCURATE) {
         stream->needs_keyframe = TRUE;
+      }
 
       stream->seeked_pts = GST_CLOCK_TIME_NONE;
       stream->seeked_dts = GST_CLOCK_TIME_NONE;
@@ -1045,8 +1647,30 @@ push_event (MpegTSBase * base, GstEvent * event)
           gst_pad_is_active (stream->pad))
         gst_ts_demux_push_pending_data (demux, stream, NULL);
 
+      if (demux->output_pool) {
+        switch (GST_EVENT_TYPE (event)) {
+          case GST_EVENT_FLUSH_START:
+            /* Unblock the streaming thread if it waits for room in the
+             * output queue, the flush-start will unblock the output thread */
+            g_mutex_lock (&demux->output_lock);
+            clear_output_queue (&stream->output_queue);
+            stream->output_flow = GST_FLOW_FLUSHING;
+            g_cond_broadcast (&demux->output_cond);
+            g_mutex_unlock (&demux->output_lock);
+            break;
+          case GST_EVENT_FLUSH_STOP:
+            gst_ts_demux_stream_sync_output (demux, stream, TRUE);
+            g_mutex_lock (&demux->output_lock);
+            stream->output_flow = GST_FLOW_OK;
+            g_mutex_unlock (&demux->output_lock);
+            break;
+          default:
+            break;
+        }
+      }
+
       gst_event_ref (event);
-      gst_pad_push_event (stream->pad, event);
+      gst_ts_demux_push_stream_event (demux, stream, event);
     }
   }
 
@@ -1885,6 +2509,10 @@ gst_ts_demux_stream_added (MpegTSBase * base, MpegTSBaseStream * bstream,
         && bstream->stream_type == GST_MPEGTS_STREAM_TYPE_VIDEO_H264) {
       stream->scan_function =
           (GstTsDemuxKeyFrameScanFunction) scan_keyframe_h264;
+    } else if (base->mode != BASE_MODE_PUSHING
+        && bstream->stream_type == GST_MPEGTS_STREAM_TYPE_VIDEO_HEVC) {
+      stream->scan_function =
+          (GstTsDemuxKeyFrameScanFunction) scan_keyframe_h265;
     } else {
       stream->scan_function = NULL;
     }
@@ -1896,6 +2524,7 @@ gst_ts_demux_stream_added (MpegTSBase * base, MpegTSBaseStream * bstream,
     demux->reset_segment =
         (!(base->out_segment.flags & GST_SEEK_FLAG_ACCURATE));
     stream->needs_keyframe = FALSE;
+    stream->keyframe_offset = -1;
     stream->discont = TRUE;
     stream->pts = GST_CLOCK_TIME_NONE;
     stream->dts = GST_CLOCK_TIME_NONE;
@@ -1927,6 +2556,20 @@ tsdemux_h264_parsing_info_clear (TSDemuxH264ParsingInfos * h264infos)
   }
 }
 
+static void
+tsdemux_h265_parsing_info_clear (TSDemuxH265ParsingInfos * h265infos)
+{
+  clear_simple_buffer (&h265infos->framedata);
+
+  if (h265infos->parser) {
+    gst_h265_parser_free (h265infos->parser);
+    gst_byte_writer_free (h265infos->vps);
+    gst_byte_writer_free (h265infos->sps);
+    gst_byte_writer_free (h265infos->pps);
+    gst_byte_writer_free (h265infos->sei);
+  }
+}
+
 static void
 gst_ts_demux_stream_removed (MpegTSBase * base, MpegTSBaseStream * bstream)
 {
@@ -1943,10 +2586,14 @@ gst_ts_demux_stream_removed (MpegTSBase * base, MpegTSBaseStream * bstream)
         gst_ts_demux_push_pending_data ((GstTSDemux *) base, stream, NULL);
 
         GST_DEBUG_OBJECT (stream->pad, "Pushing out EOS");
-        gst_pad_push_event (stream->pad, gst_event_new_eos ());
+        gst_ts_demux_push_stream_event ((GstTSDemux *) base, stream,
+            gst_event_new_eos ());
         gst_pad_set_active (stream->pad, FALSE);
       }
 
+      /* Whatever couldn't be pushed out is dropped with the pad */
+      gst_ts_demux_stream_sync_output ((GstTSDemux *) base, stream, TRUE);
+
       GST_DEBUG_OBJECT (stream->pad, "Removing pad");
       gst_element_remove_pad (GST_ELEMENT_CAST (base), stream->pad);
       stream->active = FALSE;
@@ -1964,6 +2611,7 @@ gst_ts_demux_stream_removed (MpegTSBase * base, MpegTSBaseStream * bstream)
   }
 
   tsdemux_h264_parsing_info_clear (&stream->h264infos);
+  tsdemux_h265_parsing_info_clear (&stream->h265infos);
 }
 
 static void
@@ -2006,6 +2654,9 @@ gst_ts_demux_stream_flush (TSDemuxStream * stream, GstTSDemux * tsdemux,
   stream->gap_ref_pts = GST_CLOCK_TIME_NONE;
   stream->continuity_counter = CONTINUITY_UNSET;
 
+  if (tsdemux->index && tsdemux->index->pid == stream->stream.pid)
+    ts_demux_index_discont (tsdemux->index);
+
   if (G_UNLIKELY (stream->pending)) {
     GList *tmp;
 
@@ -2076,7 +2727,8 @@ gst_ts_demux_update_program (MpegTSBase * base, MpegTSBaseProgram * program)
          * or serialized event (which means very late in case of subtitle streams),
          * and playsink waits for stream-start or another serialized event */
         GST_DEBUG_OBJECT (stream->pad, "sparse stream, pushing GAP event");
-        gst_pad_push_event (stream->pad, gst_event_new_gap (0, 0));
+        gst_ts_demux_push_stream_event (demux, stream,
+            gst_event_new_gap (0, 0));
       }
     }
   }
@@ -2099,6 +2751,7 @@ gst_ts_demux_program_started (MpegTSBase * base, MpegTSBaseProgram * program)
     GST_LOG ("program %d started", program->program_number);
     demux->program_number = program->program_number;
     demux->program = program;
+    program->selected = TRUE;
 
     /* Increment the program_generation counter */
     demux->program_generation = (demux->program_generation + 1) & 0xf;
@@ -2135,6 +2788,8 @@ gst_ts_demux_program_started (MpegTSBase * base, MpegTSBaseProgram * program)
         have_pads = TRUE;
     }
 
+    gst_ts_demux_setup_index (demux, program);
+
     /* If there was a previous program, now is the time to deactivate it
      * and remove old pads (including pushing EOS) */
     if (demux->previous_program) {
@@ -2164,7 +2819,8 @@ gst_ts_demux_program_started (MpegTSBase * base, MpegTSBaseProgram * program)
          * or serialized event (which means very late in case of subtitle streams),
          * and playsink waits for stream-start or another serialized event */
         GST_DEBUG_OBJECT (stream->pad, "sparse stream, pushing GAP event");
-        gst_pad_push_event (stream->pad, gst_event_new_gap (0, 0));
+        gst_ts_demux_push_stream_event (demux, stream,
+            gst_event_new_gap (0, 0));
       }
     }
 
@@ -2181,6 +2837,7 @@ gst_ts_demux_program_stopped (MpegTSBase * base, MpegTSBaseProgram * program)
     demux->program = NULL;
     demux->program_number = -1;
   }
+  program->selected = FALSE;
 }
 
 
@@ -2524,6 +3181,10 @@ gst_ts_demux_queue_data (GstTSDemux * demux, TSDemuxStream * stream,
     {
       GST_LOG ("HEADER: Parsing PES header");
 
+      stream->pes_offset = packet->offset;
+      stream->pes_random_access =
+          (packet->afc_flags & MPEGTS_AFC_RANDOM_ACCESS_FLAG) != 0;
+
       /* parse the header */
       gst_ts_demux_parse_pes_header (demux, stream, data, size, packet->offset);
       break;
@@ -2550,6 +3211,9 @@ gst_ts_demux_queue_data (GstTSDemux * demux, TSDemuxStream * stream,
         stream->data = NULL;
       }
       stream->continuity_counter = CONTINUITY_UNSET;
+      /* A keyframe might have been lost */
+      if (demux->index && demux->index->pid == stream->stream.pid)
+        ts_demux_index_discont (demux->index);
       break;
     }
     default:
@@ -2643,11 +3307,11 @@ push_new_segment:
       GST_DEBUG_OBJECT (stream->pad, "Pushing newsegment event");
 
       gst_event_ref (demux->segment_event);
-      gst_pad_push_event (stream->pad, demux->segment_event);
+      gst_ts_demux_push_stream_event (demux, stream, demux->segment_event);
     }
 
     if (demux->global_tags) {
-      gst_pad_push_event (stream->pad,
+      gst_ts_demux_push_stream_event (demux, stream,
           gst_event_new_tag (gst_tag_list_ref (demux->global_tags)));
     }
 
@@ -2655,7 +3319,8 @@ push_new_segment:
     if (stream->taglist) {
       GST_DEBUG_OBJECT (stream->pad, "Sending tags %" GST_PTR_FORMAT,
           stream->taglist);
-      gst_pad_push_event (stream->pad, gst_event_new_tag (stream->taglist));
+      gst_ts_demux_push_stream_event (demux, stream,
+          gst_event_new_tag (stream->taglist));
       stream->taglist = NULL;
     }
 
@@ -2713,7 +3378,7 @@ gst_ts_demux_check_and_sync_streams (GstTSDemux * demux, GstClockTime time)
         calculate_and_push_newsegment (demux, ps, NULL);
 
       /* Now send gap event */
-      gst_pad_push_event (ps->pad, gst_event_new_gap (time, 0));
+      gst_ts_demux_push_stream_event (demux, ps, gst_event_new_gap (time, 0));
     }
 
     /* Update GAP tracking vars so we don't re-check this stream for a while */
@@ -2978,7 +3643,7 @@ error:
 }
 
 static GstBuffer *
-parse_aac_adts_frame (TSDemuxStream * stream)
+parse_aac_adts_frame (GstTSDemux * demux, TSDemuxStream * stream)
 {
   gint data_location = -1;
   guint frame_len;
@@ -3042,6 +3707,8 @@ out:
 
     gst_caps_set_simple (caps, "mpegversion", G_TYPE_INT, mpegversion, NULL);
     gst_stream_set_caps (bstream->stream_object, caps);
+    /* the new caps only apply to the data following them */
+    gst_ts_demux_stream_sync_output (demux, stream, FALSE);
     gst_pad_set_caps (stream->pad, caps);
     gst_caps_unref (caps);
   }
@@ -3086,6 +3753,22 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream,
     goto beach;
   }
 
+  if (G_UNLIKELY (stream->keyframe_offset != -1)) {
+    if (stream->pes_offset < stream->keyframe_offset) {
+      GST_LOG_OBJECT (stream->pad, "Dropping PES at offset %" G_GUINT64_FORMAT
+          " before the indexed keyframe", stream->pes_offset);
+      g_free (stream->data);
+      goto beach;
+    }
+
+    GST_DEBUG_OBJECT (stream->pad,
+        "Reached indexed keyframe, ready to go at %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (stream->pts));
+    stream->keyframe_offset = -1;
+    stream->seeked_pts = stream->pts;
+    stream->seeked_dts = stream->dts;
+  }
+
   if (stream->needs_keyframe) {
     MpegTSBase *base = (MpegTSBase *) demux;
 
@@ -3155,7 +3838,7 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream,
         goto beach;
       }
     } else if (bs->stream_type == GST_MPEGTS_STREAM_TYPE_AUDIO_AAC_ADTS) {
-      buffer = parse_aac_adts_frame (stream);
+      buffer = parse_aac_adts_frame (demux, stream);
       if (!buffer) {
         res = GST_FLOW_ERROR;
         goto beach;
@@ -3209,7 +3892,8 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream,
         GST_BUFFER_FLAG_SET (pend->buffer, GST_BUFFER_FLAG_DISCONT);
       stream->discont = FALSE;
 
-      res = gst_pad_push (stream->pad, pend->buffer);
+      res = gst_ts_demux_push_output (demux, stream,
+          GST_MINI_OBJECT_CAST (pend->buffer));
       stream->nb_out_buffers += 1;
       g_slice_free (PendingBuffer, pend);
     }
@@ -3237,6 +3921,14 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream,
   GST_DEBUG_OBJECT (stream->pad, "stream->pts %" GST_TIME_FORMAT,
       GST_TIME_ARGS (stream->pts));
 
+  if (demux->index && demux->index->pid == bs->pid &&
+      GST_CLOCK_TIME_IS_VALID (stream->pts) &&
+      gst_ts_demux_pes_is_keyframe (stream)) {
+    GST_LOG_OBJECT (stream->pad, "Indexing keyframe at offset %"
+        G_GUINT64_FORMAT, stream->pes_offset);
+    ts_demux_index_add (demux->index, stream->pts, stream->pes_offset);
+  }
+
   /* Decorate buffer or first buffer of the buffer list */
   if (buffer_list)
     buffer = gst_buffer_list_get (buffer_list, 0);
@@ -3268,12 +3960,14 @@ gst_ts_demux_push_pending_data (GstTSDemux * demux, TSDemuxStream * stream,
   }
 
   if (buffer) {
-    res = gst_pad_push (stream->pad, buffer);
+    res = gst_ts_demux_push_output (demux, stream,
+        GST_MINI_OBJECT_CAST (buffer));
     /* Record that a buffer was pushed */
     stream->nb_out_buffers += 1;
   } else {
     guint n = gst_buffer_list_length (buffer_list);
-    res = gst_pad_push_list (stream->pad, buffer_list);
+    res = gst_ts_demux_push_output (demux, stream,
+        GST_MINI_OBJECT_CAST (buffer_list));
     /* Record that a buffer was pushed */
     stream->nb_out_buffers += n;
   }
@@ -32,6 +32,7 @@
 #include <gst/base/gstflowcombiner.h>
 #include "mpegtsbase.h"
 #include "mpegtspacketizer.h"
+#include "tsdemuxindex.h"
 
 /* color specifications for JPEG 2000 stream over MPEG TS */
 typedef enum
@@ -77,6 +78,8 @@ struct _GstTSDemux
   guint program_number;
   gboolean emit_statistics;
   gint latency; /* latency in ms */
+  guint output_threads; /* 0: push from the streaming thread */
+  gchar *index_location; /* Where to load/save the keyframe index */
 
   /*< private >*/
   gint program_generation; /* Incremented each time we switch program 0..15 */
@@ -101,6 +104,16 @@ struct _GstTSDemux
 
   /* Used when seeking for a keyframe to go backward in the stream */
   guint64 last_seek_offset;
+
+  /* Keyframe index of the video stream of the program, in pull mode */
+  TSDemuxIndex *index;
+
+  /* Output threads pushing the buffers of each stream downstream, NULL if
+   * the streaming thread pushes them itself. The output queues of the
+   * streams are protected by output_lock */
+  GThreadPool *output_pool;
+  GMutex output_lock;
+  GCond output_cond;
 };
 
 struct _GstTSDemuxClass
@@ -0,0 +1,260 @@
+/*
+ * tsdemuxindex.c : keyframe index for the MPEG-TS demuxer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include <gst/base/base.h>
+
+#include "tsdemuxindex.h"
+
+/* Saved index layout, all values big endian:
+ *
+ *   "GSTTSIDX"             magic
+ *   guint32                version
+ *   guint64                size of the indexed file
+ *   guint16                PID of the indexed stream
+ *   guint32                number of entries
+ *   n * (guint64 ts, guint64 offset, guint8 flags)
+ */
+#define INDEX_MAGIC "GSTTSIDX"
+#define INDEX_VERSION 1
+#define INDEX_HEADER_SIZE (8 + 4 + 8 + 2 + 4)
+#define INDEX_ENTRY_SIZE (8 + 8 + 1)
+
+TSDemuxIndex *
+ts_demux_index_new (guint64 upstream_size, guint16 pid)
+{
+  TSDemuxIndex *index = g_slice_new0 (TSDemuxIndex);
+
+  index->entries = g_array_new (FALSE, FALSE, sizeof (TSDemuxIndexEntry));
+  index->last_added = G_MAXUINT;
+  index->upstream_size = upstream_size;
+  index->pid = pid;
+
+  return index;
+}
+
+void
+ts_demux_index_free (TSDemuxIndex * index)
+{
+  g_array_free (index->entries, TRUE);
+  g_slice_free (TSDemuxIndex, index);
+}
+
+/* The next added keyframe doesn't directly follow the previous one */
+void
+ts_demux_index_discont (TSDemuxIndex * index)
+{
+  index->last_added = G_MAXUINT;
+}
+
+/* Returns the index of the first entry with a timestamp > @ts */
+static guint
+ts_demux_index_upper_bound (TSDemuxIndex * index, GstClockTime ts)
+{
+  TSDemuxIndexEntry *entries = (TSDemuxIndexEntry *) index->entries->data;
+  guint lo = 0, hi = index->entries->len;
+
+  while (lo < hi) {
+    guint mid = lo + (hi - lo) / 2;
+
+    if (entries[mid].ts <= ts)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+}
+
+void
+ts_demux_index_add (TSDemuxIndex * index, GstClockTime ts, guint64 offset)
+{
+  TSDemuxIndexEntry *entries = (TSDemuxIndexEntry *) index->entries->data;
+  TSDemuxIndexEntry entry;
+  guint pos, known = G_MAXUINT, len = index->entries->len;
+  gboolean contiguous;
+
+  g_return_if_fail (GST_CLOCK_TIME_IS_VALID (ts));
+
+  pos = ts_demux_index_upper_bound (index, ts);
+
+  /* Timestamps of a given PES can vary a bit from one pass to another as
+   * more PCR get known, but not its offset */
+  if (pos > 0 && entries[pos - 1].offset == offset)
+    known = pos - 1;
+  else if (pos < len && entries[pos].offset == offset)
+    known = pos;
+
+  if (known != G_MAXUINT) {
+    if (index->last_added != G_MAXUINT && index->last_added + 1 == known &&
+        !(entries[known].flags & TS_DEMUX_INDEX_ENTRY_CONTIGUOUS)) {
+      entries[known].flags |= TS_DEMUX_INDEX_ENTRY_CONTIGUOUS;
+      index->dirty = TRUE;
+    }
+    index->last_added = known;
+    return;
+  }
+
+  contiguous = index->last_added != G_MAXUINT && index->last_added + 1 == pos;
+
+  entry.ts = ts;
+  entry.offset = offset;
+  entry.flags = contiguous ? TS_DEMUX_INDEX_ENTRY_CONTIGUOUS : 0;
+  g_array_insert_val (index->entries, pos, entry);
+
+  /* Whatever came after it isn't known to follow this new entry */
+  if (pos + 1 < index->entries->len)
+    g_array_index (index->entries, TSDemuxIndexEntry, pos + 1).flags &=
+        ~TS_DEMUX_INDEX_ENTRY_CONTIGUOUS;
+
+  index->last_added = pos;
+  index->dirty = TRUE;
+}
+
+/* Looks for the last keyframe at or before @target. Only succeeds if the
+ * index is known to be complete around @target, i.e. the following
+ * keyframe is also indexed and directly follows the returned one. */
+gboolean
+ts_demux_index_lookup (TSDemuxIndex * index, GstClockTime target,
+    TSDemuxIndexEntry * entry)
+{
+  TSDemuxIndexEntry *entries = (TSDemuxIndexEntry *) index->entries->data;
+  guint pos;
+
+  pos = ts_demux_index_upper_bound (index, target);
+  if (pos == 0 || pos >= index->entries->len)
+    return FALSE;
+
+  if (!(entries[pos].flags & TS_DEMUX_INDEX_ENTRY_CONTIGUOUS))
+    return FALSE;
+
+  *entry = entries[pos - 1];
+  return TRUE;
+}
+
+gboolean
+ts_demux_index_save (TSDemuxIndex * index, const gchar * location,
+    GError ** error)
+{
+  GstByteWriter writer;
+  gboolean ret;
+  guint8 *data;
+  gsize size;
+  guint i;
+
+  size = INDEX_HEADER_SIZE + index->entries->len * INDEX_ENTRY_SIZE;
+  gst_byte_writer_init_with_size (&writer, size, TRUE);
+
+  gst_byte_writer_put_data_unchecked (&writer, (const guint8 *) INDEX_MAGIC,
+      8);
+  gst_byte_writer_put_uint32_be_unchecked (&writer, INDEX_VERSION);
+  gst_byte_writer_put_uint64_be_unchecked (&writer, index->upstream_size);
+  gst_byte_writer_put_uint16_be_unchecked (&writer, index->pid);
+  gst_byte_writer_put_uint32_be_unchecked (&writer, index->entries->len);
+
+  for (i = 0; i < index->entries->len; i++) {
+    TSDemuxIndexEntry *entry =
+        &g_array_index (index->entries, TSDemuxIndexEntry, i);
+
+    gst_byte_writer_put_uint64_be_unchecked (&writer, entry->ts);
+    gst_byte_writer_put_uint64_be_unchecked (&writer, entry->offset);
+    gst_byte_writer_put_uint8_unchecked (&writer, entry->flags);
+  }
+
+  data = gst_byte_writer_reset_and_get_data (&writer);
+  ret = g_file_set_contents (location, (const gchar *) data, size, error);
+  g_free (data);
+
+  if (ret)
+    index->dirty = FALSE;
+
+  return ret;
+}
+
+TSDemuxIndex *
+ts_demux_index_load (const gchar * location, guint64 upstream_size,
+    guint16 pid, GError ** error)
+{
+  TSDemuxIndex *index = NULL;
+  GstByteReader reader;
+  const guint8 *magic;
+  gchar *contents;
+  guint32 version, n_entries, i;
+  guint64 saved_size;
+  guint16 saved_pid;
+  gsize size;
+
+  if (!g_file_get_contents (location, &contents, &size, error))
+    return NULL;
+
+  gst_byte_reader_init (&reader, (const guint8 *) contents, size);
+
+  if (size < INDEX_HEADER_SIZE)
+    goto invalid;
+
+  magic = gst_byte_reader_get_data_unchecked (&reader, 8);
+  version = gst_byte_reader_get_uint32_be_unchecked (&reader);
+  saved_size = gst_byte_reader_get_uint64_be_unchecked (&reader);
+  saved_pid = gst_byte_reader_get_uint16_be_unchecked (&reader);
+  n_entries = gst_byte_reader_get_uint32_be_unchecked (&reader);
+
+  if (memcmp (magic, INDEX_MAGIC, 8) != 0 || version != INDEX_VERSION ||
+      gst_byte_reader_get_remaining (&reader) !=
+      (guint64) n_entries * INDEX_ENTRY_SIZE)
+    goto invalid;
+
+  if (saved_size != upstream_size || saved_pid != pid) {
+    g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+        "Index %s was built for another stream", location);
+    goto done;
+  }
+
+  index = ts_demux_index_new (upstream_size, pid);
+  g_array_set_size (index->entries, n_entries);
+
+  for (i = 0; i < n_entries; i++) {
+    TSDemuxIndexEntry *entry =
+        &g_array_index (index->entries, TSDemuxIndexEntry, i);
+
+    entry->ts = gst_byte_reader_get_uint64_be_unchecked (&reader);
+    entry->offset = gst_byte_reader_get_uint64_be_unchecked (&reader);
+    entry->flags = gst_byte_reader_get_uint8_unchecked (&reader);
+
+    if (!GST_CLOCK_TIME_IS_VALID (entry->ts) || entry->offset >= upstream_size
+        || (i > 0 && entry->ts < (entry - 1)->ts)) {
+      ts_demux_index_free (index);
+      index = NULL;
+      goto invalid;
+    }
+  }
+
+done:
+  g_free (contents);
+  return index;
+
+invalid:
+  g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+      "%s is not a valid index", location);
+  goto done;
+}
@@ -0,0 +1,81 @@
+/*
+ * tsdemuxindex.h : keyframe index for the MPEG-TS demuxer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __TS_DEMUX_INDEX_H__
+#define __TS_DEMUX_INDEX_H__
+
+#include <gst/gst.h>
+
+G_BEGIN_DECLS
+
+/* The entry is known to directly follow the previous one: there is no other
+ * keyframe between them */
+#define TS_DEMUX_INDEX_ENTRY_CONTIGUOUS (1 << 0)
+
+typedef struct
+{
+  GstClockTime ts;              /* PTS of the keyframe, in stream time */
+  guint64 offset;               /* Offset of the packet starting its PES */
+  guint8 flags;
+} TSDemuxIndexEntry;
+
+/* Sorted keyframe index of one elementary stream (the video stream of the
+ * demuxed program), filled as the stream gets played. Since playback can
+ * jump around, the index can have holes: an entry is only trusted for seeking
+ * if the next one is flagged as contiguous. */
+typedef struct
+{
+  GArray *entries;              /* TSDemuxIndexEntry sorted by ts */
+  guint last_added;             /* Index of the last added entry, or G_MAXUINT */
+
+  /* What the index was built for, to validate saved indexes */
+  guint64 upstream_size;
+  guint16 pid;
+
+  gboolean dirty;
+} TSDemuxIndex;
+
+G_GNUC_INTERNAL
+TSDemuxIndex *ts_demux_index_new (guint64 upstream_size, guint16 pid);
+
+G_GNUC_INTERNAL
+void ts_demux_index_free (TSDemuxIndex * index);
+
+G_GNUC_INTERNAL
+void ts_demux_index_discont (TSDemuxIndex * index);
+
+G_GNUC_INTERNAL
+void ts_demux_index_add (TSDemuxIndex * index, GstClockTime ts,
+    guint64 offset);
+
+G_GNUC_INTERNAL
+gboolean ts_demux_index_lookup (TSDemuxIndex * index, GstClockTime target,
+    TSDemuxIndexEntry * entry);
+
+G_GNUC_INTERNAL
+gboolean ts_demux_index_save (TSDemuxIndex * index, const gchar * location,
+    GError ** error);
+
+G_GNUC_INTERNAL
+TSDemuxIndex *ts_demux_index_load (const gchar * location,
+    guint64 upstream_size, guint16 pid, GError ** error);
+
+G_END_DECLS
+
+#endif /* __TS_DEMUX_INDEX_H__ */
@@ -105,6 +105,8 @@ GST_DEBUG_CATEGORY (gst_base_ts_mux_debug);
 
 G_DEFINE_TYPE (GstBaseTsMuxPad, gst_base_ts_mux_pad, GST_TYPE_AGGREGATOR_PAD);
 
+static void gst_base_ts_mux_clear_output (GstBaseTsMux * mux);
+
 /* Internals */
 
 static void
@@ -144,6 +146,10 @@ gst_base_ts_mux_pad_flush (GstAggregatorPad * agg_pad, GstAggregator * agg)
    * header sections */
   mux->first = TRUE;
 
+  /* Packets collected before the flush must not end up in front of the
+   * new data */
+  gst_base_ts_mux_clear_output (mux);
+
   /* output PAT, SI tables */
   tsmux_resend_pat (mux->tsmux);
   tsmux_resend_si (mux->tsmux);
@@ -300,6 +306,72 @@ gst_base_ts_mux_set_header_on_caps (GstBaseTsMux * mux)
   gst_caps_unref (caps);
 }
 
+/* Buffers are taken from a pool of @size bytes buffers, which is recreated if
+ * the size changed */
+static GstBuffer *
+gst_base_ts_mux_acquire_buffer (GstBaseTsMux * mux, GstBufferPool ** pool,
+    gsize size)
+{
+  GstBuffer *buf = NULL;
+  GstStructure *config;
+
+  if (*pool) {
+    if (gst_buffer_pool_acquire_buffer (*pool, &buf, NULL) == GST_FLOW_OK) {
+      if (gst_buffer_get_size (buf) == size)
+        return buf;
+      gst_buffer_unref (buf);
+      buf = NULL;
+    }
+
+    gst_buffer_pool_set_active (*pool, FALSE);
+    gst_object_unref (*pool);
+  }
+
+  GST_DEBUG_OBJECT (mux, "creating pool of %" G_GSIZE_FORMAT " bytes buffers",
+      size);
+
+  *pool = gst_buffer_pool_new ();
+  config = gst_buffer_pool_get_config (*pool);
+  gst_buffer_pool_config_set_params (config, NULL, size, 0, 0);
+
+  if (!gst_buffer_pool_set_config (*pool, config) ||
+      !gst_buffer_pool_set_active (*pool, TRUE) ||
+      gst_buffer_pool_acquire_buffer (*pool, &buf, NULL) != GST_FLOW_OK) {
+    GST_WARNING_OBJECT (mux, "failed to set up buffer pool");
+    gst_object_unref (*pool);
+    *pool = NULL;
+    buf = gst_buffer_new_and_alloc (size);
+  }
+
+  return buf;
+}
+
+static void
+gst_base_ts_mux_clear_pool (GstBufferPool ** pool)
+{
+  if (*pool) {
+    gst_buffer_pool_set_active (*pool, FALSE);
+    gst_object_unref (*pool);
+    *pool = NULL;
+  }
+}
+
+static void
+gst_base_ts_mux_clear_output (GstBaseTsMux * mux)
+{
+  if (mux->out_buffer) {
+    gst_buffer_unmap (mux->out_buffer, &mux->out_map);
+    gst_buffer_unref (mux->out_buffer);
+    mux->out_buffer = NULL;
+  }
+  mux->out_offset = 0;
+
+  if (mux->out_list) {
+    gst_buffer_list_unref (mux->out_list);
+    mux->out_list = NULL;
+  }
+}
+
 static gboolean
 steal_si_section (GstMpegtsSectionType * type, TsMuxSection * section,
     TsMux * mux)
@@ -327,8 +399,9 @@ gst_base_ts_mux_reset (GstBaseTsMux * mux, gboolean alloc)
   mux->pending_key_unit_ts = GST_CLOCK_TIME_NONE;
   gst_event_replace (&mux->force_key_unit_event, NULL);
 
-  if (mux->out_adapter)
-    gst_adapter_clear (mux->out_adapter);
+  gst_base_ts_mux_clear_output (mux);
+  gst_base_ts_mux_clear_pool (&mux->packet_pool);
+  gst_base_ts_mux_clear_pool (&mux->out_pool);
   mux->output_ts_offset = GST_CLOCK_TIME_NONE;
 
   if (mux->tsmux) {
@@ -348,7 +421,6 @@ gst_base_ts_mux_reset (GstBaseTsMux * mux, gboolean alloc)
     gst_buffer_unref (buf);
 
   gst_event_replace (&mux->force_key_unit_event, NULL);
-  gst_buffer_replace (&mux->out_buffer, NULL);
 
   GST_OBJECT_LOCK (mux);
 
@@ -887,7 +959,8 @@ new_packet_common_init (GstBaseTsMux * mux, GstBuffer * buf, guint8 * data,
         hbuf = gst_buffer_new_and_alloc (len);
         gst_buffer_fill (hbuf, 0, data, len);
       } else {
-        hbuf = gst_buffer_copy (buf);
+        /* don't keep the pooled memory around */
+        hbuf = gst_buffer_copy_deep (buf);
       }
       GST_LOG_OBJECT (mux,
           "Collecting packet with pid 0x%04x into streamheaders", pid);
@@ -914,79 +987,26 @@ new_packet_common_init (GstBaseTsMux * mux, GstBuffer * buf, guint8 * data,
   }
 }
 
-static GstFlowReturn
-gst_base_ts_mux_push_packets (GstBaseTsMux * mux, gboolean force)
+/* Queue the current output buffer for pushing, filling it up with null
+ * packets first if it isn't complete */
+static void
+gst_base_ts_mux_finish_out_buffer (GstBaseTsMux * mux)
 {
-  GstBufferList *buffer_list;
-  gint align = mux->alignment;
-  gint av, packet_size;
-
-  packet_size = mux->packet_size;
-
-  if (align < 0)
-    align = mux->automatic_alignment;
-
-  av = gst_adapter_available (mux->out_adapter);
-  GST_LOG_OBJECT (mux, "align %d, av %d", align, av);
-
-  if (av == 0)
-    return GST_FLOW_OK;
-
-  /* no alignment, just push all available data */
-  if (align == 0) {
-    buffer_list = gst_adapter_take_buffer_list (mux->out_adapter, av);
-    return gst_aggregator_finish_buffer_list (GST_AGGREGATOR (mux),
-        buffer_list);
-  }
-
-  align *= packet_size;
-
-  if (!force && align > av)
-    return GST_FLOW_OK;
+  gsize packet_size = mux->packet_size;
+  guint8 *data;
+  gint dummy;
 
-  buffer_list = gst_buffer_list_new_sized ((av / align) + 1);
+  data = mux->out_map.data + mux->out_offset;
+  dummy = (mux->out_map.size - mux->out_offset) / packet_size;
 
-  GST_LOG_OBJECT (mux, "aligning to %d bytes", align);
-  while (align <= av) {
-    GstBuffer *buf;
-    GstClockTime pts;
+  if (dummy > 0) {
+    guint32 header = 0;
 
-    pts = gst_adapter_prev_pts (mux->out_adapter, NULL);
-    buf = gst_adapter_take_buffer (mux->out_adapter, align);
-
-    GST_BUFFER_PTS (buf) = pts;
-
-    gst_buffer_list_add (buffer_list, buf);
-    av -= align;
-  }
-
-  if (av > 0 && force) {
-    GstBuffer *buf;
-    GstClockTime pts;
-    guint8 *data;
-    guint32 header;
-    gint dummy;
-    GstMapInfo map;
-
-    GST_LOG_OBJECT (mux, "handling %d leftover bytes", av);
-
-    pts = gst_adapter_prev_pts (mux->out_adapter, NULL);
-    buf = gst_buffer_new_and_alloc (align);
-
-    GST_BUFFER_PTS (buf) = pts;
-
-    gst_buffer_map (buf, &map, GST_MAP_READ);
-    data = map.data;
-
-    gst_adapter_copy (mux->out_adapter, data, 0, av);
-    gst_adapter_clear (mux->out_adapter);
-
-    data += av;
-    header = GST_READ_UINT32_BE (data - packet_size);
-
-    dummy = (map.size - av) / packet_size;
     GST_LOG_OBJECT (mux, "adding %d null packets", dummy);
 
+    if (mux->out_offset >= packet_size)
+      header = GST_READ_UINT32_BE (data - packet_size);
+
     for (; dummy > 0; dummy--) {
       gint offset;
 
@@ -1007,20 +1027,79 @@ gst_base_ts_mux_push_packets (GstBaseTsMux * mux, gboolean force)
       memset (data + offset + 4, 0, GST_BASE_TS_MUX_NORMAL_PACKET_LENGTH - 4);
       data += packet_size;
     }
-
-    gst_buffer_unmap (buf, &map);
-    gst_buffer_list_add (buffer_list, buf);
   }
 
+  gst_buffer_unmap (mux->out_buffer, &mux->out_map);
+  gst_buffer_list_add (mux->out_list, mux->out_buffer);
+  mux->out_buffer = NULL;
+  mux->out_offset = 0;
+}
+
+static GstFlowReturn
+gst_base_ts_mux_push_packets (GstBaseTsMux * mux, gboolean force)
+{
+  GstBufferList *buffer_list;
+
+  /* complete the last aligned buffer with padding */
+  if (force && mux->out_buffer)
+    gst_base_ts_mux_finish_out_buffer (mux);
+
+  if (mux->out_list == NULL)
+    return GST_FLOW_OK;
+
+  buffer_list = mux->out_list;
+  mux->out_list = NULL;
+
+  GST_LOG_OBJECT (mux, "pushing list of %u buffers",
+      gst_buffer_list_length (buffer_list));
+
   return gst_aggregator_finish_buffer_list (GST_AGGREGATOR (mux), buffer_list);
 }
 
 static GstFlowReturn
 gst_base_ts_mux_collect_packet (GstBaseTsMux * mux, GstBuffer * buf)
 {
-  GST_LOG_OBJECT (mux, "collecting packet size %" G_GSIZE_FORMAT,
-      gst_buffer_get_size (buf));
-  gst_adapter_push (mux->out_adapter, buf);
+  gint align = mux->alignment;
+  gsize size;
+
+  if (align < 0)
+    align = mux->automatic_alignment;
+
+  size = gst_buffer_get_size (buf);
+  GST_LOG_OBJECT (mux, "collecting packet size %" G_GSIZE_FORMAT, size);
+
+  if (mux->out_list == NULL)
+    mux->out_list = gst_buffer_list_new ();
+
+  /* no alignment, the packets are output as they are */
+  if (align == 0) {
+    gst_buffer_list_add (mux->out_list, buf);
+    return GST_FLOW_OK;
+  }
+
+  /* otherwise copy them into buffers of align packets */
+  if (mux->out_buffer == NULL) {
+    mux->out_buffer = gst_base_ts_mux_acquire_buffer (mux, &mux->out_pool,
+        align * mux->packet_size);
+    gst_buffer_map (mux->out_buffer, &mux->out_map, GST_MAP_WRITE);
+    mux->out_offset = 0;
+
+    GST_BUFFER_PTS (mux->out_buffer) = GST_BUFFER_PTS (buf);
+    GST_BUFFER_FLAG_SET (mux->out_buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+    if (GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_HEADER))
+      GST_BUFFER_FLAG_SET (mux->out_buffer, GST_BUFFER_FLAG_HEADER);
+  }
+
+  if (!GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT))
+    GST_BUFFER_FLAG_UNSET (mux->out_buffer, GST_BUFFER_FLAG_DELTA_UNIT);
+
+  size = MIN (size, mux->out_map.size - mux->out_offset);
+  gst_buffer_extract (buf, 0, mux->out_map.data + mux->out_offset, size);
+  mux->out_offset += size;
+  gst_buffer_unref (buf);
+
+  if (mux->out_offset == mux->out_map.size)
+    gst_base_ts_mux_finish_out_buffer (mux);
 
   return GST_FLOW_OK;
 }
@@ -1826,10 +1905,6 @@ gst_base_ts_mux_dispose (GObject * object)
 
   gst_base_ts_mux_reset (mux, FALSE);
 
-  if (mux->out_adapter) {
-    g_object_unref (mux->out_adapter);
-    mux->out_adapter = NULL;
-  }
   if (mux->prog_map) {
     gst_structure_free (mux->prog_map);
     mux->prog_map = NULL;
@@ -1974,11 +2049,8 @@ static void
 gst_base_ts_mux_default_allocate_packet (GstBaseTsMux * mux,
     GstBuffer ** buffer)
 {
-  GstBuffer *buf;
-
-  buf = gst_buffer_new_and_alloc (mux->packet_size);
-
-  *buffer = buf;
+  *buffer = gst_base_ts_mux_acquire_buffer (mux, &mux->packet_pool,
+      mux->packet_size);
 }
 
 static gboolean
@@ -2109,8 +2181,6 @@ gst_base_ts_mux_class_init (GstBaseTsMuxClass * klass)
 static void
 gst_base_ts_mux_init (GstBaseTsMux * mux)
 {
-  mux->out_adapter = gst_adapter_new ();
-
   /* properties */
   mux->pat_interval = TSMUX_DEFAULT_PAT_INTERVAL;
   mux->pmt_interval = TSMUX_DEFAULT_PMT_INTERVAL;
@@ -194,9 +194,17 @@ struct GstBaseTsMux {
   gsize packet_size;
   gsize automatic_alignment;
 
-  /* output buffer aggregation */
-  GstAdapter *out_adapter;
+  /* pools for the individual packets and the aligned output buffers */
+  GstBufferPool *packet_pool;
+  GstBufferPool *out_pool;
+
+  /* output buffer aggregation: out_buffer is being filled with aligned
+   * packets (out_offset bytes so far), out_list holds what is ready to be
+   * pushed */
   GstBuffer *out_buffer;
+  GstMapInfo out_map;
+  gsize out_offset;
+  GstBufferList *out_list;
   GstClockTimeDiff output_ts_offset;
 };
 
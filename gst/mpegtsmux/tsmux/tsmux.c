@@ -125,10 +125,21 @@ static gboolean tsmux_write_ts_header (TsMux * mux, guint8 * buf,
     TsMuxPacketInfo * pi, guint * payload_len_out, guint * payload_offset_out,
     guint stream_avail);
 
+/* Drop the pre-packetized copy, to be called whenever the section
+ * changes */
+static void
+tsmux_section_clear_packets (TsMuxSection * section)
+{
+  g_free (section->packets);
+  section->packets = NULL;
+  section->n_packets = 0;
+}
+
 static void
 tsmux_section_free (TsMuxSection * section)
 {
   gst_mpegts_section_unref (section->section);
+  tsmux_section_clear_packets (section);
   g_slice_free (TsMuxSection, section);
 }
 
@@ -394,6 +405,7 @@ tsmux_free (TsMux * mux)
   /* Free PAT section */
   if (mux->pat.section)
     gst_mpegts_section_unref (mux->pat.section);
+  tsmux_section_clear_packets (&mux->pat);
 
   /* Free all programs */
   for (cur = mux->programs; cur; cur = cur->next) {
@@ -1133,26 +1145,15 @@ tsmux_write_ts_header (TsMux * mux, guint8 * buf, TsMuxPacketInfo * pi,
   return TRUE;
 }
 
-/* The unused_arg is needed for g_hash_table_foreach() */
+/* Split the section into TS packets. The continuity counters are left to
+ * 0, they are filled in when the packets are sent */
 static gboolean
-tsmux_section_write_packet (gpointer unused_arg,
-    TsMuxSection * section, TsMux * mux)
+tsmux_section_build_packets (TsMux * mux, TsMuxSection * section)
 {
-  GstBuffer *section_buffer;
-  GstBuffer *packet_buffer = NULL;
-  GstMemory *mem;
-  guint8 *packet;
-  guint8 *data;
+  guint8 *data, *packet;
   gsize data_size = 0;
-  gsize payload_written;
-  guint len = 0, offset = 0, payload_len = 0;
-  guint extra_alloc_bytes = 0;
-
-  g_return_val_if_fail (section != NULL, FALSE);
-  g_return_val_if_fail (mux != NULL, FALSE);
-
-  /* Mark the start of new PES unit */
-  section->pi.packet_start_unit_indicator = TRUE;
+  guint len = 0, offset = 0, payload_len;
+  guint8 counter;
 
   data = gst_mpegts_section_packetize (section->section, &data_size);
 
@@ -1161,106 +1162,101 @@ tsmux_section_write_packet (gpointer unused_arg,
     return FALSE;
   }
 
-  /* Mark payload data size */
-  section->pi.stream_avail = data_size;
-  payload_written = 0;
+  /* We need room for a pointer byte in the first packet */
+  section->n_packets =
+      (data_size + 1 + TSMUX_PAYLOAD_LENGTH - 1) / TSMUX_PAYLOAD_LENGTH;
+  section->packets = packet =
+      g_malloc (section->n_packets * TSMUX_PACKET_LENGTH);
 
-  /* Wrap section data in a buffer without free function.
-     The data will be freed when the GstMpegtsSection is destroyed. */
-  section_buffer = gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
-      data, data_size, 0, data_size, NULL, NULL);
+  /* Writing the headers bumps the counter, restore it afterwards */
+  counter = mux->pid_packet_counts[section->pi.pid];
 
-  TS_DEBUG ("Section buffer with size %" G_GSIZE_FORMAT " created",
-      gst_buffer_get_size (section_buffer));
+  /* Mark the start of new PES unit */
+  section->pi.packet_start_unit_indicator = TRUE;
+  section->pi.stream_avail = data_size + 1;
 
   while (section->pi.stream_avail > 0) {
+    if (!tsmux_write_ts_header (mux, packet, &section->pi, &len, &offset,
+            section->pi.stream_avail))
+      goto fail;
 
-    packet = g_malloc (TSMUX_PACKET_LENGTH);
-
+    payload_len = len;
     if (section->pi.packet_start_unit_indicator) {
-      /* Wee need room for a pointer byte */
-      section->pi.stream_avail++;
-
-      if (!tsmux_write_ts_header (mux, packet, &section->pi, &len, &offset,
-              section->pi.stream_avail))
-        goto fail;
-
       /* Write the pointer byte */
       packet[offset++] = 0x00;
-      payload_len = len - 1;
-
-    } else {
-      if (!tsmux_write_ts_header (mux, packet, &section->pi, &len, &offset,
-              section->pi.stream_avail))
-        goto fail;
-      payload_len = len;
+      payload_len--;
     }
 
-    /* Wrap the TS header and adaption field in a GstMemory */
-    mem = gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY,
-        packet, TSMUX_PACKET_LENGTH, 0, offset, packet, g_free);
-
-    TS_DEBUG ("Creating packet buffer at offset "
-        "%" G_GSIZE_FORMAT " with length %u", payload_written, payload_len);
-
-    /* If in M2TS mode, we will need to resize to 4 bytes after the end
-       of the buffer. For performance reasons, we will now try to include
-       4 extra bytes from the source buffer, then resize down, to avoid
-       having an extra 4 byte GstMemory appended. If the source buffer
-       does not have enough data for this, a new GstMemory will be used */
-    if (gst_buffer_get_size (section_buffer) - (payload_written +
-            payload_len) >= 4) {
-      /* enough space */
-      extra_alloc_bytes = 4;
-    } else {
-      extra_alloc_bytes = 0;
-    }
-    packet_buffer = gst_buffer_copy_region (section_buffer, GST_BUFFER_COPY_ALL,
-        payload_written, payload_len + extra_alloc_bytes);
-
-    /* Prepend the header to the section data */
-    gst_buffer_prepend_memory (packet_buffer, mem);
-
-    /* add an extra 4 bytes if it could not be reserved already */
-    if (extra_alloc_bytes == 4) {
-      /* we allocated those already, resize */
-      gst_buffer_set_size (packet_buffer,
-          gst_buffer_get_size (packet_buffer) - extra_alloc_bytes);
-    } else {
-      void *ptr = g_malloc (4);
-      GstMemory *extra =
-          gst_memory_new_wrapped (GST_MEMORY_FLAG_READONLY, ptr, 4, 0, 0, ptr,
-          g_free);
-      gst_buffer_append_memory (packet_buffer, extra);
-    }
+    memcpy (packet + offset, data, payload_len);
+    data += payload_len;
+    packet[3] &= 0xf0;
 
     TS_DEBUG ("Writing %d bytes to section. %d bytes remaining",
         len, section->pi.stream_avail - len);
 
-    /* Push the packet without PCR */
-    if (G_UNLIKELY (!tsmux_packet_out (mux, packet_buffer, -1))) {
-      /* Buffer given away */
-      packet_buffer = NULL;
-      goto fail;
-    }
-
-    packet_buffer = NULL;
     section->pi.stream_avail -= len;
-    payload_written += payload_len;
     section->pi.packet_start_unit_indicator = FALSE;
+    packet += TSMUX_PACKET_LENGTH;
   }
 
-  gst_buffer_unref (section_buffer);
+  mux->pid_packet_counts[section->pi.pid] = counter;
+
+  TS_DEBUG ("Section of size %" G_GSIZE_FORMAT " split in %u packets",
+      data_size, section->n_packets);
 
   return TRUE;
 
 fail:
-  g_free (packet);
-  if (section_buffer)
-    gst_buffer_unref (section_buffer);
+  mux->pid_packet_counts[section->pi.pid] = counter;
+  tsmux_section_clear_packets (section);
   return FALSE;
 }
 
+/* The unused_arg is needed for g_hash_table_foreach() */
+static gboolean
+tsmux_section_write_packet (gpointer unused_arg,
+    TsMuxSection * section, TsMux * mux)
+{
+  guint8 *counter;
+  guint i;
+
+  g_return_val_if_fail (section != NULL, FALSE);
+  g_return_val_if_fail (mux != NULL, FALSE);
+
+  if (!section->packets && !tsmux_section_build_packets (mux, section))
+    return FALSE;
+
+  counter = &mux->pid_packet_counts[section->pi.pid];
+
+  for (i = 0; i < section->n_packets; i++) {
+    GstBuffer *packet_buffer = NULL;
+    GstMapInfo map;
+
+    if (!tsmux_get_buffer (mux, &packet_buffer))
+      return FALSE;
+
+    if (!gst_buffer_map (packet_buffer, &map, GST_MAP_WRITE)) {
+      GST_ERROR ("Failed to map section packet buffer");
+      gst_buffer_unref (packet_buffer);
+      return FALSE;
+    }
+
+    memcpy (map.data, section->packets + i * TSMUX_PACKET_LENGTH,
+        TSMUX_PACKET_LENGTH);
+
+    /* All section packets carry payload, increment the continuity counter */
+    (*counter)++;
+    map.data[3] |= *counter & 0x0f;
+    gst_buffer_unmap (packet_buffer, &map);
+
+    /* Push the packet without PCR */
+    if (G_UNLIKELY (!tsmux_packet_out (mux, packet_buffer, -1)))
+      return FALSE;
+  }
+
+  return TRUE;
+}
+
 /**
  * tsmux_send_section:
  * @mux: a #TsMux
@@ -1288,6 +1284,7 @@ tsmux_send_section (TsMux * mux, GstMpegtsSection * section)
   tsmux_section.pi.pid = section->pid;
 
   ret = tsmux_section_write_packet (NULL, &tsmux_section, mux);
+  tsmux_section_clear_packets (&tsmux_section);
   gst_mpegts_section_unref (section);
 
   return ret;
@@ -1666,6 +1663,7 @@ tsmux_program_free (TsMuxProgram * program)
   /* Free PMT section */
   if (program->pmt.section)
     gst_mpegts_section_unref (program->pmt.section);
+  tsmux_section_clear_packets (&program->pmt);
   if (program->scte35_null_section)
     tsmux_section_free (program->scte35_null_section);
 
@@ -1715,6 +1713,7 @@ tsmux_write_pat (TsMux * mux)
 
     if (mux->pat.section)
       gst_mpegts_section_unref (mux->pat.section);
+    tsmux_section_clear_packets (&mux->pat);
 
     mux->pat.section = gst_mpegts_section_from_pat (pat, mux->transport_id);
 
@@ -1819,6 +1818,7 @@ tsmux_write_pmt (TsMux * mux, TsMuxProgram * program)
 
     if (program->pmt.section)
       gst_mpegts_section_unref (program->pmt.section);
+    tsmux_section_clear_packets (&program->pmt);
 
     program->pmt.section = gst_mpegts_section_from_pmt (pmt, program->pmt_pid);
     program->pmt.section->version_number = program->pmt_version++;
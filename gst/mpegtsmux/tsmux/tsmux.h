@@ -107,6 +107,11 @@ typedef TsMuxStream * (*TsMuxNewStreamFunc) (guint16 new_pid, guint stream_type,
 struct TsMuxSection {
   TsMuxPacketInfo pi;
   GstMpegtsSection *section;
+
+  /* The section split into complete TS packets, built on first use. Only
+   * the continuity counters are updated when resending it */
+  guint8 *packets;
+  guint n_packets;
 };
 
 /* Information for the streams associated with one program */
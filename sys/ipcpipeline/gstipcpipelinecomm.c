@@ -27,6 +27,9 @@
 #ifdef HAVE_UNISTD_H
 #  include <unistd.h>
 #endif
+#ifdef HAVE_SYS_SOCKET_H
+#  include <sys/socket.h>
+#endif
 #ifdef _MSC_VER
 /* ssize_t is not available, so match return value of read()/write() on MSVC */
 #define ssize_t int
@@ -35,6 +38,7 @@
 #include <string.h>
 #include <gst/base/gstbytewriter.h>
 #include <gst/gstprotection.h>
+#include <gst/allocators/allocators.h>
 #include "gstipcpipelinecomm.h"
 
 GST_DEBUG_CATEGORY_STATIC (gst_ipc_pipeline_comm_debug);
@@ -42,7 +46,11 @@ GST_DEBUG_CATEGORY_STATIC (gst_ipc_pipeline_comm_debug);
 
 #define DEFAULT_ACK_TIME (10 * G_TIME_SPAN_SECOND)
 
+/* Maximum number of memories, hence of file descriptors, of a buffer */
+#define MAX_BUFFER_FDS 16
+
 GQuark QUARK_ID;
+static GQuark QUARK_RELEASE;
 
 typedef enum
 {
@@ -69,6 +77,9 @@ typedef struct
   GstQuery *query;
   CommRequestType type;
   GCond cond;
+
+  /* buffer requests whose flow return is not waited for */
+  gboolean async;
 } CommRequest;
 
 static const gchar *comm_request_ret_get_name (CommRequestType type,
@@ -88,6 +99,7 @@ comm_request_new (guint32 id, CommRequestType type, GstQuery * query)
   req->query = query;
   req->ret = comm_request_ret_get_failure_value (type);
   req->type = type;
+  req->async = FALSE;
 
   return req;
 }
@@ -192,6 +204,10 @@ gst_ipc_pipeline_comm_data_type_get_name (GstIpcPipelineCommDataType type)
       return "MESSAGE";
     case GST_IPC_PIPELINE_COMM_DATA_TYPE_GERROR_MESSAGE:
       return "GERROR_MESSAGE";
+    case GST_IPC_PIPELINE_COMM_DATA_TYPE_BUFFER_FD:
+      return "BUFFER_FD";
+    case GST_IPC_PIPELINE_COMM_DATA_TYPE_BUFFER_RELEASE:
+      return "BUFFER_RELEASE";
     default:
       return "UNKNOWN";
   }
@@ -218,6 +234,47 @@ gst_ipc_pipeline_comm_sync_fd (GstIpcPipelineComm * comm, guint32 id,
   return !comm_error;
 }
 
+/* Waits until fewer than max_pending_buffers buffers are waiting for their
+ * flow return, for at most ack_time. Returns FALSE if the requests got
+ * cancelled meanwhile or if no ack came in time, in which case timed_out
+ * is set. */
+static gboolean
+gst_ipc_pipeline_comm_wait_pending_buffers (GstIpcPipelineComm * comm,
+    gboolean * timed_out)
+{
+  guint cookie = comm->cancel_cookie;
+  gint64 end_time = g_get_monotonic_time () + comm->ack_time;
+
+  *timed_out = FALSE;
+  while (comm->pending_buffers >= comm->max_pending_buffers &&
+      cookie == comm->cancel_cookie) {
+    GST_TRACE_OBJECT (comm->element, "Waiting for one of %u pending buffers",
+        comm->pending_buffers);
+    if (!g_cond_wait_until (&comm->pending_cond, &comm->mutex, end_time)) {
+      GST_ERROR_OBJECT (comm->element, "Timeout waiting for one of %u "
+          "pending buffers", comm->pending_buffers);
+      *timed_out = TRUE;
+      return FALSE;
+    }
+  }
+
+  return cookie == comm->cancel_cookie;
+}
+
+/* Registers a buffer request whose ack will be handled by the reader
+ * thread */
+static void
+gst_ipc_pipeline_comm_add_pending_buffer (GstIpcPipelineComm * comm,
+    guint32 id)
+{
+  CommRequest *req;
+
+  req = comm_request_new (id, COMM_REQUEST_TYPE_BUFFER, NULL);
+  req->async = TRUE;
+  g_hash_table_insert (comm->waiting_ids, GINT_TO_POINTER (id), req);
+  comm->pending_buffers++;
+}
+
 static gboolean
 write_to_fd_raw (GstIpcPipelineComm * comm, const void *data, size_t size)
 {
@@ -246,6 +303,56 @@ done:
   return ret;
 }
 
+#ifdef HAVE_SYS_SOCKET_H
+/* Writes data like write_to_fd_raw, with the file descriptors attached to
+ * its first byte. fdout has to be a unix socket for this to work. */
+static gboolean
+write_to_fd_with_fds (GstIpcPipelineComm * comm, const guint8 * data,
+    size_t size, const int *fds, guint n_fds)
+{
+  union
+  {
+    char buf[CMSG_SPACE (sizeof (int) * MAX_BUFFER_FDS)];
+    struct cmsghdr align;
+  } control;
+  struct msghdr msg = { 0, };
+  struct cmsghdr *cmsg;
+  struct iovec iov;
+  ssize_t written;
+
+  g_return_val_if_fail (n_fds > 0 && n_fds <= MAX_BUFFER_FDS, FALSE);
+
+  iov.iov_base = (void *) data;
+  iov.iov_len = size;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  memset (&control, 0, sizeof (control));
+  msg.msg_control = control.buf;
+  msg.msg_controllen = CMSG_SPACE (sizeof (int) * n_fds);
+
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (sizeof (int) * n_fds);
+  memcpy (CMSG_DATA (cmsg), fds, sizeof (int) * n_fds);
+
+  GST_TRACE_OBJECT (comm->element, "Writing %u bytes and %u fds to fdout",
+      (unsigned) size, n_fds);
+  do {
+    written = sendmsg (comm->fdout, &msg, 0);
+  } while (written < 0 && (errno == EAGAIN || errno == EINTR));
+
+  if (written < 0) {
+    GST_ERROR_OBJECT (comm->element, "Failed to send fds: %s",
+        strerror (errno));
+    return FALSE;
+  }
+
+  /* the descriptors went with the first chunk, the rest is plain data */
+  return write_to_fd_raw (comm, data + written, size - written);
+}
+#endif
+
 static gboolean
 write_byte_writer_to_fd (GstIpcPipelineComm * comm, GstByteWriter * bw)
 {
@@ -503,6 +610,173 @@ typedef struct
   guint64 flags;
 } CommBufferMetadata;
 
+/* Appends the list of GstMeta described by repr, see protocol.txt */
+static gboolean
+put_meta_list (GstByteWriter * bw, const MetaListRepresentation * repr)
+{
+  guint32 n;
+
+  if (!gst_byte_writer_put_uint32_le (bw, repr->n_meta))
+    return FALSE;
+  for (n = 0; n < repr->n_meta; ++n) {
+    const MetaBuildInfo *info = repr->info + n;
+    guint32 len;
+    const char *s;
+
+    if (!gst_byte_writer_put_uint32_le (bw, info->bytes))
+      return FALSE;
+
+    if (!gst_byte_writer_put_uint32_le (bw, info->flags))
+      return FALSE;
+
+    s = g_type_name (info->api);
+    len = strlen (s) + 1;
+    if (!gst_byte_writer_put_uint32_le (bw, len))
+      return FALSE;
+    if (!gst_byte_writer_put_data (bw, (const guint8 *) s, len))
+      return FALSE;
+
+    if (!gst_byte_writer_put_uint64_le (bw, info->size))
+      return FALSE;
+
+    s = info->str;
+    len = s ? (strlen (s) + 1) : 0;
+    if (!gst_byte_writer_put_uint32_le (bw, len))
+      return FALSE;
+    if (len)
+      if (!gst_byte_writer_put_data (bw, (const guint8 *) s, len))
+        return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Returns the number of memories of the buffer if they can all be sent as
+ * file descriptors, 0 otherwise */
+static guint
+buffer_get_n_fd_memories (GstBuffer * buffer)
+{
+  guint n, n_mem;
+
+  n_mem = gst_buffer_n_memory (buffer);
+  if (n_mem == 0 || n_mem > MAX_BUFFER_FDS)
+    return 0;
+
+  for (n = 0; n < n_mem; ++n) {
+    if (!gst_is_fd_memory (gst_buffer_peek_memory (buffer, n)))
+      return 0;
+  }
+
+  return n_mem;
+}
+
+/* Tells the peer that all the memories of the BUFFER_FD chunk id are freed.
+ * Called from whatever thread drops the last of them, errors are not fatal
+ * as the peer may be gone already. */
+static void
+gst_ipc_pipeline_comm_write_buffer_release_to_fd (GstIpcPipelineComm * comm,
+    guint32 id)
+{
+  const unsigned char payload_type =
+      GST_IPC_PIPELINE_COMM_DATA_TYPE_BUFFER_RELEASE;
+  GstByteWriter bw;
+
+  g_mutex_lock (&comm->mutex);
+
+  if (comm->fdout < 0)
+    goto done;
+
+  GST_TRACE_OBJECT (comm->element, "Writing release for buffer %u", id);
+  gst_byte_writer_init (&bw);
+  if (!gst_byte_writer_put_uint8 (&bw, payload_type) ||
+      !gst_byte_writer_put_uint32_le (&bw, id) ||
+      !gst_byte_writer_put_uint32_le (&bw, 0) ||
+      !write_byte_writer_to_fd (comm, &bw))
+    GST_WARNING_OBJECT (comm->element, "Failed to release buffer %u", id);
+  gst_byte_writer_reset (&bw);
+
+done:
+  g_mutex_unlock (&comm->mutex);
+}
+
+typedef struct
+{
+  GstElement *element;
+  GstIpcPipelineComm *comm;
+  guint32 id;
+  gint n_memories;
+} FdBufferRelease;
+
+/* Destroy notify of the memories of a received BUFFER_FD chunk, also
+ * called once by the reader when it is done creating them */
+static void
+fd_buffer_release_memory (FdBufferRelease * release)
+{
+  if (!g_atomic_int_dec_and_test (&release->n_memories))
+    return;
+
+  gst_ipc_pipeline_comm_write_buffer_release_to_fd (release->comm,
+      release->id);
+  gst_object_unref (release->element);
+  g_free (release);
+}
+
+static gboolean
+write_fd_buffer_to_fd (GstIpcPipelineComm * comm, GstBuffer * buffer,
+    guint n_mem, const CommBufferMetadata * meta,
+    const MetaListRepresentation * repr, GstByteWriter * bw)
+{
+  const unsigned char payload_type =
+      GST_IPC_PIPELINE_COMM_DATA_TYPE_BUFFER_FD;
+  int fds[MAX_BUFFER_FDS];
+  guint8 *data;
+  guint32 size;
+  gboolean ret;
+  guint n;
+
+  if (!gst_byte_writer_put_uint8 (bw, payload_type))
+    return FALSE;
+  if (!gst_byte_writer_put_uint32_le (bw, comm->send_id))
+    return FALSE;
+  size =
+      sizeof (CommBufferMetadata) + sizeof (guint32) +
+      n_mem * (1 + 3 * sizeof (guint64)) + repr->total_bytes;
+  if (!gst_byte_writer_put_uint32_le (bw, size))
+    return FALSE;
+  if (!gst_byte_writer_put_data (bw, (const guint8 *) meta, sizeof (*meta)))
+    return FALSE;
+  if (!gst_byte_writer_put_uint32_le (bw, n_mem))
+    return FALSE;
+  for (n = 0; n < n_mem; ++n) {
+    GstMemory *mem = gst_buffer_peek_memory (buffer, n);
+
+    fds[n] = gst_fd_memory_get_fd (mem);
+    if (!gst_byte_writer_put_uint8 (bw, gst_is_dmabuf_memory (mem) ? 1 : 0))
+      return FALSE;
+    if (!gst_byte_writer_put_uint64_le (bw, mem->offset))
+      return FALSE;
+    if (!gst_byte_writer_put_uint64_le (bw, mem->size))
+      return FALSE;
+    if (!gst_byte_writer_put_uint64_le (bw, mem->maxsize))
+      return FALSE;
+  }
+  if (!put_meta_list (bw, repr))
+    return FALSE;
+
+  size = gst_byte_writer_get_size (bw);
+  data = gst_byte_writer_reset_and_get_data (bw);
+  if (!data)
+    return FALSE;
+#ifdef HAVE_SYS_SOCKET_H
+  ret = write_to_fd_with_fds (comm, data, size, fds, n_mem);
+#else
+  GST_ERROR_OBJECT (comm->element, "Passing fds is not supported");
+  ret = FALSE;
+#endif
+  g_free (data);
+  return ret;
+}
+
 GstFlowReturn
 gst_ipc_pipeline_comm_write_buffer_to_fd (GstIpcPipelineComm * comm,
     GstBuffer * buffer)
@@ -511,19 +785,41 @@ gst_ipc_pipeline_comm_write_buffer_to_fd (GstIpcPipelineComm * comm,
   GstMapInfo map;
   guint32 ret32 = GST_FLOW_OK;
   guint32 size, n;
+  guint n_fds = 0;
   CommBufferMetadata meta;
   GstFlowReturn ret;
   MetaListRepresentation repr = { comm, 0, 4, NULL };   /* starts a 4 for n_meta */
   GstByteWriter bw;
 
   g_mutex_lock (&comm->mutex);
+  gst_byte_writer_init (&bw);
+
+  if (comm->max_pending_buffers > 1) {
+    gboolean timed_out;
+
+    /* no need to wait for a free slot if we already know the flow return */
+    if (comm->pending_ret == GST_FLOW_OK &&
+        !gst_ipc_pipeline_comm_wait_pending_buffers (comm, &timed_out)) {
+      if (timed_out)
+        goto wait_failed;
+      ret = GST_FLOW_COMM_ERROR;
+      goto done;
+    }
+    /* the peer keeps replying this until it gets flushed, don't bother
+     * sending it more buffers */
+    if (comm->pending_ret != GST_FLOW_OK) {
+      ret = comm->pending_ret;
+      GST_DEBUG_OBJECT (comm->element, "Not writing buffer, peer returned %s",
+          gst_flow_get_name (ret));
+      goto done;
+    }
+  }
+
   ++comm->send_id;
 
   GST_TRACE_OBJECT (comm->element, "Writing buffer %u: %" GST_PTR_FORMAT,
       comm->send_id, buffer);
 
-  gst_byte_writer_init (&bw);
-
   meta.pts = GST_BUFFER_PTS (buffer);
   meta.dts = GST_BUFFER_DTS (buffer);
   meta.duration = GST_BUFFER_DURATION (buffer);
@@ -534,71 +830,61 @@ gst_ipc_pipeline_comm_write_buffer_to_fd (GstIpcPipelineComm * comm,
   /* work out meta size */
   gst_buffer_foreach_meta (buffer, build_meta, &repr);
 
-  if (!gst_byte_writer_put_uint8 (&bw, payload_type))
-    goto write_failed;
-  if (!gst_byte_writer_put_uint32_le (&bw, comm->send_id))
-    goto write_failed;
-  size =
-      gst_buffer_get_size (buffer) + sizeof (guint32) +
-      sizeof (CommBufferMetadata) + repr.total_bytes;
-  if (!gst_byte_writer_put_uint32_le (&bw, size))
-    goto write_failed;
-  if (!gst_byte_writer_put_data (&bw, (const guint8 *) &meta, sizeof (meta)))
-    goto write_failed;
-  size = gst_buffer_get_size (buffer);
-  if (!gst_byte_writer_put_uint32_le (&bw, size))
-    goto write_failed;
-  if (!write_byte_writer_to_fd (comm, &bw))
-    goto write_failed;
-
-  if (!gst_buffer_map (buffer, &map, GST_MAP_READ))
-    goto map_failed;
-  ret = write_to_fd_raw (comm, map.data, map.size);
-  gst_buffer_unmap (buffer, &map);
-  if (!ret)
-    goto write_failed;
-
-  /* meta */
-  gst_byte_writer_init (&bw);
-  if (!gst_byte_writer_put_uint32_le (&bw, repr.n_meta))
-    goto write_failed;
-  for (n = 0; n < repr.n_meta; ++n) {
-    const MetaBuildInfo *info = repr.info + n;
-    guint32 len;
-    const char *s;
+  if (comm->pass_fds)
+    n_fds = buffer_get_n_fd_memories (buffer);
 
-    if (!gst_byte_writer_put_uint32_le (&bw, info->bytes))
+  if (n_fds > 0) {
+    /* only the metadata goes through the socket, the buffer is kept until
+     * the peer released its memories */
+    if (!write_fd_buffer_to_fd (comm, buffer, n_fds, &meta, &repr, &bw))
       goto write_failed;
-
-    if (!gst_byte_writer_put_uint32_le (&bw, info->flags))
+    g_hash_table_insert (comm->fd_buffers, GUINT_TO_POINTER (comm->send_id),
+        gst_buffer_ref (buffer));
+  } else {
+    if (!gst_byte_writer_put_uint8 (&bw, payload_type))
       goto write_failed;
-
-    s = g_type_name (info->api);
-    len = strlen (s) + 1;
-    if (!gst_byte_writer_put_uint32_le (&bw, len))
+    if (!gst_byte_writer_put_uint32_le (&bw, comm->send_id))
+      goto write_failed;
+    size =
+        gst_buffer_get_size (buffer) + sizeof (guint32) +
+        sizeof (CommBufferMetadata) + repr.total_bytes;
+    if (!gst_byte_writer_put_uint32_le (&bw, size))
+      goto write_failed;
+    if (!gst_byte_writer_put_data (&bw, (const guint8 *) &meta,
+            sizeof (meta)))
       goto write_failed;
-    if (!gst_byte_writer_put_data (&bw, (const guint8 *) s, len))
+    size = gst_buffer_get_size (buffer);
+    if (!gst_byte_writer_put_uint32_le (&bw, size))
+      goto write_failed;
+    if (!write_byte_writer_to_fd (comm, &bw))
       goto write_failed;
 
-    if (!gst_byte_writer_put_uint64_le (&bw, info->size))
+    if (!gst_buffer_map (buffer, &map, GST_MAP_READ))
+      goto map_failed;
+    ret = write_to_fd_raw (comm, map.data, map.size);
+    gst_buffer_unmap (buffer, &map);
+    if (!ret)
       goto write_failed;
 
-    s = info->str;
-    len = s ? (strlen (s) + 1) : 0;
-    if (!gst_byte_writer_put_uint32_le (&bw, len))
+    /* meta */
+    gst_byte_writer_init (&bw);
+    if (!put_meta_list (&bw, &repr))
+      goto write_failed;
+    if (!write_byte_writer_to_fd (comm, &bw))
       goto write_failed;
-    if (len)
-      if (!gst_byte_writer_put_data (&bw, (const guint8 *) s, len))
-        goto write_failed;
   }
 
-  if (!write_byte_writer_to_fd (comm, &bw))
-    goto write_failed;
-
-  if (!gst_ipc_pipeline_comm_sync_fd (comm, comm->send_id, NULL, &ret32,
-          ACK_TYPE_BLOCKING, COMM_REQUEST_TYPE_BUFFER))
-    goto wait_failed;
-  ret = ret32;
+  if (comm->max_pending_buffers > 1) {
+    /* the reader thread collects the flow return, which we will return
+     * for one of the next buffers if it is not OK */
+    gst_ipc_pipeline_comm_add_pending_buffer (comm, comm->send_id);
+    ret = GST_FLOW_OK;
+  } else {
+    if (!gst_ipc_pipeline_comm_sync_fd (comm, comm->send_id, NULL, &ret32,
+            ACK_TYPE_BLOCKING, COMM_REQUEST_TYPE_BUFFER))
+      goto wait_failed;
+    ret = ret32;
+  }
 
 done:
   g_mutex_unlock (&comm->mutex);
@@ -627,44 +913,15 @@ map_failed:
   goto done;
 }
 
-static GstBuffer *
-gst_ipc_pipeline_comm_read_buffer (GstIpcPipelineComm * comm, guint32 size)
+/* Reads the list of GstMeta ending a buffer payload and adds them to the
+ * buffer */
+static gboolean
+gst_ipc_pipeline_comm_read_meta_list (GstIpcPipelineComm * comm,
+    GstBuffer * buffer, guint32 size)
 {
-  GstBuffer *buffer;
-  CommBufferMetadata meta;
   guint32 n_meta, n;
   const guint8 *payload = NULL;
-  guint32 mapped_size, buffer_data_size;
-
-  /* this should not be called if we don't have enough yet */
-  g_return_val_if_fail (gst_adapter_available (comm->adapter) >= size, NULL);
-  g_return_val_if_fail (size >= sizeof (CommBufferMetadata), NULL);
-
-  mapped_size = sizeof (CommBufferMetadata) + sizeof (buffer_data_size);
-  payload = gst_adapter_map (comm->adapter, mapped_size);
-  if (!payload)
-    return NULL;
-  memcpy (&meta, payload, sizeof (CommBufferMetadata));
-  payload += sizeof (CommBufferMetadata);
-  memcpy (&buffer_data_size, payload, sizeof (buffer_data_size));
-  size -= mapped_size;
-  gst_adapter_unmap (comm->adapter);
-  gst_adapter_flush (comm->adapter, mapped_size);
-
-  if (buffer_data_size == 0) {
-    buffer = gst_buffer_new ();
-  } else {
-    buffer = gst_adapter_get_buffer (comm->adapter, buffer_data_size);
-    gst_adapter_flush (comm->adapter, buffer_data_size);
-  }
-  size -= buffer_data_size;
-
-  GST_BUFFER_PTS (buffer) = meta.pts;
-  GST_BUFFER_DTS (buffer) = meta.dts;
-  GST_BUFFER_DURATION (buffer) = meta.duration;
-  GST_BUFFER_OFFSET (buffer) = meta.offset;
-  GST_BUFFER_OFFSET_END (buffer) = meta.offset_end;
-  GST_BUFFER_FLAGS (buffer) = meta.flags;
+  guint32 mapped_size;
 
   /* If you don't call that, the GType isn't yet known at the
      g_type_from_name below */
@@ -672,10 +929,8 @@ gst_ipc_pipeline_comm_read_buffer (GstIpcPipelineComm * comm, guint32 size)
 
   mapped_size = size;
   payload = gst_adapter_map (comm->adapter, mapped_size);
-  if (!payload) {
-    gst_buffer_unref (buffer);
-    return NULL;
-  }
+  if (!payload)
+    return FALSE;
   memcpy (&n_meta, payload, sizeof (n_meta));
   payload += sizeof (n_meta);
 
@@ -724,6 +979,169 @@ gst_ipc_pipeline_comm_read_buffer (GstIpcPipelineComm * comm, guint32 size)
   gst_adapter_unmap (comm->adapter);
   gst_adapter_flush (comm->adapter, mapped_size);
 
+  return TRUE;
+}
+
+static void
+gst_ipc_pipeline_comm_set_buffer_metadata (GstBuffer * buffer,
+    const CommBufferMetadata * meta)
+{
+  GST_BUFFER_PTS (buffer) = meta->pts;
+  GST_BUFFER_DTS (buffer) = meta->dts;
+  GST_BUFFER_DURATION (buffer) = meta->duration;
+  GST_BUFFER_OFFSET (buffer) = meta->offset;
+  GST_BUFFER_OFFSET_END (buffer) = meta->offset_end;
+  GST_BUFFER_FLAGS (buffer) = meta->flags;
+}
+
+static GstBuffer *
+gst_ipc_pipeline_comm_read_buffer (GstIpcPipelineComm * comm, guint32 size)
+{
+  GstBuffer *buffer;
+  CommBufferMetadata meta;
+  const guint8 *payload = NULL;
+  guint32 mapped_size, buffer_data_size;
+
+  /* this should not be called if we don't have enough yet */
+  g_return_val_if_fail (gst_adapter_available (comm->adapter) >= size, NULL);
+  g_return_val_if_fail (size >= sizeof (CommBufferMetadata), NULL);
+
+  mapped_size = sizeof (CommBufferMetadata) + sizeof (buffer_data_size);
+  payload = gst_adapter_map (comm->adapter, mapped_size);
+  if (!payload)
+    return NULL;
+  memcpy (&meta, payload, sizeof (CommBufferMetadata));
+  payload += sizeof (CommBufferMetadata);
+  memcpy (&buffer_data_size, payload, sizeof (buffer_data_size));
+  size -= mapped_size;
+  gst_adapter_unmap (comm->adapter);
+  gst_adapter_flush (comm->adapter, mapped_size);
+
+  if (buffer_data_size == 0) {
+    buffer = gst_buffer_new ();
+  } else {
+    buffer = gst_adapter_get_buffer (comm->adapter, buffer_data_size);
+    gst_adapter_flush (comm->adapter, buffer_data_size);
+  }
+  size -= buffer_data_size;
+
+  gst_ipc_pipeline_comm_set_buffer_metadata (buffer, &meta);
+
+  if (!gst_ipc_pipeline_comm_read_meta_list (comm, buffer, size)) {
+    gst_buffer_unref (buffer);
+    return NULL;
+  }
+
+  return buffer;
+}
+
+static GstBuffer *
+gst_ipc_pipeline_comm_read_fd_buffer (GstIpcPipelineComm * comm,
+    guint32 size)
+{
+  GstBuffer *buffer;
+  CommBufferMetadata meta;
+  FdBufferRelease *release;
+  const guint8 *payload = NULL;
+  guint32 mapped_size, n_mem, n;
+
+  /* this should not be called if we don't have enough yet */
+  g_return_val_if_fail (gst_adapter_available (comm->adapter) >= size, NULL);
+  g_return_val_if_fail (size >= sizeof (CommBufferMetadata) + sizeof (n_mem),
+      NULL);
+
+  mapped_size = sizeof (CommBufferMetadata) + sizeof (n_mem);
+  payload = gst_adapter_map (comm->adapter, mapped_size);
+  if (!payload)
+    return NULL;
+  memcpy (&meta, payload, sizeof (CommBufferMetadata));
+  payload += sizeof (CommBufferMetadata);
+  memcpy (&n_mem, payload, sizeof (n_mem));
+  size -= mapped_size;
+  gst_adapter_unmap (comm->adapter);
+  gst_adapter_flush (comm->adapter, mapped_size);
+
+  mapped_size = n_mem * (1 + 3 * sizeof (guint64));
+  if (n_mem > MAX_BUFFER_FDS || size < mapped_size) {
+    GST_ERROR_OBJECT (comm->element, "Invalid number of memories: %u", n_mem);
+    return NULL;
+  }
+  if (g_queue_get_length (&comm->received_fds) < n_mem) {
+    GST_ERROR_OBJECT (comm->element, "Expected %u fds, got only %u", n_mem,
+        g_queue_get_length (&comm->received_fds));
+    return NULL;
+  }
+
+  payload = gst_adapter_map (comm->adapter, mapped_size);
+  if (!payload)
+    return NULL;
+
+  /* the sender keeps its buffer until all the memories are freed */
+  release = g_new (FdBufferRelease, 1);
+  release->element = gst_object_ref (comm->element);
+  release->comm = comm;
+  release->id = comm->id;
+  release->n_memories = 1;
+
+  buffer = gst_buffer_new ();
+  for (n = 0; n < n_mem; ++n) {
+    int fd = GPOINTER_TO_INT (g_queue_pop_head (&comm->received_fds));
+    guint64 offset, msize, maxsize;
+    GstMemory *mem;
+    guint8 dmabuf;
+
+    dmabuf = *payload++;
+    memcpy (&offset, payload, sizeof (offset));
+    payload += sizeof (offset);
+    memcpy (&msize, payload, sizeof (msize));
+    payload += sizeof (msize);
+    memcpy (&maxsize, payload, sizeof (maxsize));
+    payload += sizeof (maxsize);
+
+    if (dmabuf) {
+      if (!comm->dmabuf_allocator)
+        comm->dmabuf_allocator = gst_dmabuf_allocator_new ();
+      mem = gst_dmabuf_allocator_alloc (comm->dmabuf_allocator, fd, maxsize);
+    } else {
+      if (!comm->fd_allocator)
+        comm->fd_allocator = gst_fd_allocator_new ();
+      mem = gst_fd_allocator_alloc (comm->fd_allocator, fd, maxsize,
+          GST_FD_MEMORY_FLAG_NONE);
+    }
+
+    if (!mem) {
+      GST_ERROR_OBJECT (comm->element, "Could not wrap fd %d", fd);
+      close (fd);
+      /* drop the fds of the remaining memories too */
+      while (++n < n_mem)
+        close (GPOINTER_TO_INT (g_queue_pop_head (&comm->received_fds)));
+      gst_adapter_unmap (comm->adapter);
+      gst_adapter_flush (comm->adapter, mapped_size);
+      gst_buffer_unref (buffer);
+      fd_buffer_release_memory (release);
+      return NULL;
+    }
+
+    /* the sender may still be using this memory */
+    gst_memory_resize (mem, offset, msize);
+    GST_MINI_OBJECT_FLAG_SET (mem, GST_MEMORY_FLAG_READONLY);
+    g_atomic_int_inc (&release->n_memories);
+    gst_mini_object_set_qdata (GST_MINI_OBJECT (mem), QUARK_RELEASE, release,
+        (GDestroyNotify) fd_buffer_release_memory);
+    gst_buffer_append_memory (buffer, mem);
+  }
+  size -= mapped_size;
+  gst_adapter_unmap (comm->adapter);
+  gst_adapter_flush (comm->adapter, mapped_size);
+  fd_buffer_release_memory (release);
+
+  gst_ipc_pipeline_comm_set_buffer_metadata (buffer, &meta);
+
+  if (!gst_ipc_pipeline_comm_read_meta_list (comm, buffer, size)) {
+    gst_buffer_unref (buffer);
+    return NULL;
+  }
+
   return buffer;
 }
 
@@ -976,6 +1394,10 @@ gst_ipc_pipeline_comm_write_event_to_fd (GstIpcPipelineComm * comm,
     goto write_failed;
   ret = ret32;
 
+  /* the peer forgets about its last flow return when flushed */
+  if (!upstream && GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP)
+    comm->pending_ret = GST_FLOW_OK;
+
 done:
   g_mutex_unlock (&comm->mutex);
   g_free (str);
@@ -1217,6 +1639,9 @@ gst_ipc_pipeline_comm_write_state_change_to_fd (GstIpcPipelineComm * comm,
     goto write_failed;
   ret = ret32;
 
+  if (transition == GST_STATE_CHANGE_READY_TO_PAUSED)
+    comm->pending_ret = GST_FLOW_OK;
+
 done:
   g_mutex_unlock (&comm->mutex);
   gst_byte_writer_reset (&bw);
@@ -1614,6 +2039,20 @@ gst_ipc_pipeline_comm_init (GstIpcPipelineComm * comm, GstElement * element)
   comm->adapter = gst_adapter_new ();
   comm->poll = gst_poll_new (TRUE);
   gst_poll_fd_init (&comm->pollFDin);
+  g_queue_init (&comm->received_fds);
+  comm->fd_buffers =
+      g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+      (GDestroyNotify) gst_buffer_unref);
+  comm->max_pending_buffers = 1;
+  comm->pending_ret = GST_FLOW_OK;
+  g_cond_init (&comm->pending_cond);
+}
+
+static void
+gst_ipc_pipeline_comm_close_received_fds (GstIpcPipelineComm * comm)
+{
+  while (!g_queue_is_empty (&comm->received_fds))
+    close (GPOINTER_TO_INT (g_queue_pop_head (&comm->received_fds)));
 }
 
 void
@@ -1622,6 +2061,13 @@ gst_ipc_pipeline_comm_clear (GstIpcPipelineComm * comm)
   g_hash_table_destroy (comm->waiting_ids);
   gst_object_unref (comm->adapter);
   gst_poll_free (comm->poll);
+  gst_ipc_pipeline_comm_close_received_fds (comm);
+  if (comm->fd_allocator)
+    gst_object_unref (comm->fd_allocator);
+  if (comm->dmabuf_allocator)
+    gst_object_unref (comm->dmabuf_allocator);
+  g_hash_table_unref (comm->fd_buffers);
+  g_cond_clear (&comm->pending_cond);
   g_mutex_clear (&comm->mutex);
 }
 
@@ -1640,27 +2086,45 @@ cancel_request (gpointer key, gpointer value, gpointer user_data,
   g_cond_signal (&req->cond);
 }
 
-static void
+static gboolean
 cancel_request_error (gpointer key, gpointer value, gpointer user_data)
 {
   CommRequest *req = (CommRequest *) value;
   GstFlowReturn fret = comm_request_ret_get_failure_value (req->type);
 
+  /* nobody waits for these, just drop them */
+  if (req->async)
+    return TRUE;
+
   cancel_request (key, value, user_data, fret);
+  return FALSE;
 }
 
 void
 gst_ipc_pipeline_comm_cancel (GstIpcPipelineComm * comm, gboolean cleanup)
 {
+  GHashTable *fd_buffers;
+
   g_mutex_lock (&comm->mutex);
-  g_hash_table_foreach (comm->waiting_ids, cancel_request_error, comm);
+  g_hash_table_foreach_remove (comm->waiting_ids, cancel_request_error, comm);
+  comm->pending_buffers = 0;
+  comm->pending_ret = GST_FLOW_OK;
+  comm->cancel_cookie++;
+  g_cond_broadcast (&comm->pending_cond);
   if (cleanup) {
     g_hash_table_unref (comm->waiting_ids);
     comm->waiting_ids =
         g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
         (GDestroyNotify) comm_request_free);
   }
+  /* the peer won't release these anymore, unref them outside of the lock */
+  fd_buffers = comm->fd_buffers;
+  comm->fd_buffers =
+      g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+      (GDestroyNotify) gst_buffer_unref);
   g_mutex_unlock (&comm->mutex);
+
+  g_hash_table_unref (fd_buffers);
 }
 
 static gboolean
@@ -1687,6 +2151,17 @@ gst_ipc_pipeline_comm_reply_request (GstIpcPipelineComm * comm, guint32 id,
 
   GST_TRACE_OBJECT (comm->element, "Got reply %d (%s) for request %u", ret,
       comm_request_ret_get_name (req->type, ret), req->id);
+
+  if (req->async) {
+    /* keep the first error, it is returned for the next buffer */
+    if (ret != GST_FLOW_OK && comm->pending_ret == GST_FLOW_OK)
+      comm->pending_ret = ret;
+    comm->pending_buffers--;
+    g_hash_table_remove (comm->waiting_ids, GINT_TO_POINTER (id));
+    g_cond_broadcast (&comm->pending_cond);
+    return TRUE;
+  }
+
   req->replied = TRUE;
   req->ret = ret;
   if (query) {
@@ -1706,6 +2181,69 @@ gst_ipc_pipeline_comm_reply_request (GstIpcPipelineComm * comm, guint32 id,
   return TRUE;
 }
 
+/* Reads from fd like read(), queueing the file descriptors passed along
+ * with the data if fd is a unix socket */
+static ssize_t
+read_from_fd (GstIpcPipelineComm * comm, int fd, void *data, size_t size)
+{
+#ifdef HAVE_SYS_SOCKET_H
+  union
+  {
+    char buf[CMSG_SPACE (sizeof (int) * MAX_BUFFER_FDS)];
+    struct cmsghdr align;
+  } control;
+  struct msghdr msg = { 0, };
+  struct cmsghdr *cmsg;
+  struct iovec iov;
+  int flags = 0;
+  ssize_t sz;
+
+  if (comm->fdin_not_socket)
+    return read (fd, data, size);
+
+  iov.iov_base = data;
+  iov.iov_len = size;
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+#ifdef MSG_CMSG_CLOEXEC
+  flags |= MSG_CMSG_CLOEXEC;
+#endif
+
+  sz = recvmsg (fd, &msg, flags);
+  if (sz < 0 && errno == ENOTSOCK) {
+    GST_DEBUG_OBJECT (comm->element, "fd %d is not a socket", fd);
+    comm->fdin_not_socket = TRUE;
+    return read (fd, data, size);
+  }
+  if (sz < 0)
+    return sz;
+
+  for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+    const int *fds = (const int *) CMSG_DATA (cmsg);
+    guint n, n_fds;
+
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+    n_fds = (cmsg->cmsg_len - CMSG_LEN (0)) / sizeof (int);
+    GST_TRACE_OBJECT (comm->element, "Received %u fds", n_fds);
+    for (n = 0; n < n_fds; ++n) {
+      int received_fd;
+
+      memcpy (&received_fd, fds + n, sizeof (int));
+      g_queue_push_tail (&comm->received_fds, GINT_TO_POINTER (received_fd));
+    }
+  }
+  if (msg.msg_flags & MSG_CTRUNC)
+    GST_WARNING_OBJECT (comm->element, "Some received fds were dropped");
+
+  return sz;
+#else
+  return read (fd, data, size);
+#endif
+}
+
 static gint
 update_adapter (GstIpcPipelineComm * comm)
 {
@@ -1731,6 +2269,7 @@ again:
     if (comm->fdin != -1 && GST_OBJECT_PARENT (comm->element)) {
       GST_DEBUG_OBJECT (comm->element, "Start watching fd %d", comm->fdin);
       comm->pollFDin.fd = comm->fdin;
+      comm->fdin_not_socket = FALSE;
       gst_poll_add_fd (comm->poll, &comm->pollFDin);
       gst_poll_fd_ctl_read (comm->poll, &comm->pollFDin, TRUE);
     }
@@ -1752,7 +2291,7 @@ again:
       mem = gst_allocator_alloc (NULL, comm->read_chunk_size, NULL);
 
     gst_memory_map (mem, &map, GST_MAP_WRITE);
-    sz = read (comm->pollFDin.fd, map.data, map.size);
+    sz = read_from_fd (comm, comm->pollFDin.fd, map.data, map.size);
     gst_memory_unmap (mem, &map);
 
     if (sz <= 0) {
@@ -1817,6 +2356,8 @@ read_many (GstIpcPipelineComm * comm)
           case GST_IPC_PIPELINE_COMM_DATA_TYPE_STATE_LOST:
           case GST_IPC_PIPELINE_COMM_DATA_TYPE_MESSAGE:
           case GST_IPC_PIPELINE_COMM_DATA_TYPE_GERROR_MESSAGE:
+          case GST_IPC_PIPELINE_COMM_DATA_TYPE_BUFFER_FD:
+          case GST_IPC_PIPELINE_COMM_DATA_TYPE_BUFFER_RELEASE:
             GST_TRACE_OBJECT (comm->element, "switching to state %s",
                 gst_ipc_pipeline_comm_data_type_get_name (type));
             comm->state = type;
@@ -1881,6 +2422,7 @@ read_many (GstIpcPipelineComm * comm)
         break;
       }
       case GST_IPC_PIPELINE_COMM_DATA_TYPE_BUFFER:
+      case GST_IPC_PIPELINE_COMM_DATA_TYPE_BUFFER_FD:
       {
         GstBuffer *buf;
 
@@ -1888,7 +2430,11 @@ read_many (GstIpcPipelineComm * comm)
         if (available < comm->payload_length)
           goto done;
 
-        buf = gst_ipc_pipeline_comm_read_buffer (comm, comm->payload_length);
+        if (comm->state == GST_IPC_PIPELINE_COMM_DATA_TYPE_BUFFER_FD)
+          buf = gst_ipc_pipeline_comm_read_fd_buffer (comm,
+              comm->payload_length);
+        else
+          buf = gst_ipc_pipeline_comm_read_buffer (comm, comm->payload_length);
         if (!buf)
           goto buffer_failed;
 
@@ -1912,6 +2458,34 @@ read_many (GstIpcPipelineComm * comm)
         comm->state = GST_IPC_PIPELINE_COMM_STATE_TYPE;
         break;
       }
+      case GST_IPC_PIPELINE_COMM_DATA_TYPE_BUFFER_RELEASE:
+      {
+        GstBuffer *buf;
+
+        available = gst_adapter_available (comm->adapter);
+        if (available < comm->payload_length)
+          goto done;
+        gst_adapter_flush (comm->adapter, comm->payload_length);
+
+        g_mutex_lock (&comm->mutex);
+        buf = g_hash_table_lookup (comm->fd_buffers,
+            GUINT_TO_POINTER (comm->id));
+        if (buf)
+          g_hash_table_steal (comm->fd_buffers, GUINT_TO_POINTER (comm->id));
+        g_mutex_unlock (&comm->mutex);
+
+        GST_TRACE_OBJECT (comm->element, "Got release for buffer %u: %p",
+            comm->id, buf);
+        if (buf)
+          gst_buffer_unref (buf);
+        else
+          GST_DEBUG_OBJECT (comm->element, "Buffer %u was already dropped",
+              comm->id);
+
+        GST_TRACE_OBJECT (comm->element, "switching to state TYPE");
+        comm->state = GST_IPC_PIPELINE_COMM_STATE_TYPE;
+        break;
+      }
       case GST_IPC_PIPELINE_COMM_DATA_TYPE_EVENT:
       {
         GstEvent *event;
@@ -2203,6 +2777,7 @@ gst_ipc_pipeline_comm_stop_reader_thread (GstIpcPipelineComm * comm)
   gst_poll_set_flushing (comm->poll, TRUE);
   g_thread_join (comm->reader_thread);
   comm->reader_thread = NULL;
+  gst_ipc_pipeline_comm_close_received_fds (comm);
 }
 
 static gchar *
@@ -2324,6 +2899,7 @@ gst_ipc_pipeline_comm_plugin_init (void)
     GST_DEBUG_CATEGORY_INIT (gst_ipc_pipeline_comm_debug, "ipcpipelinecomm", 0,
         "ipc pipeline comm");
     QUARK_ID = g_quark_from_static_string ("ipcpipeline-id");
+    QUARK_RELEASE = g_quark_from_static_string ("ipcpipeline-release");
     REGISTER_SERIALIZATION_NO_COMPARE (gst_event_get_type (), event);
     g_once_init_leave (&once, (gsize) 1);
   }
@@ -51,6 +51,8 @@ typedef enum {
   GST_IPC_PIPELINE_COMM_DATA_TYPE_STATE_LOST,
   GST_IPC_PIPELINE_COMM_DATA_TYPE_MESSAGE,
   GST_IPC_PIPELINE_COMM_DATA_TYPE_GERROR_MESSAGE,
+  GST_IPC_PIPELINE_COMM_DATA_TYPE_BUFFER_FD,
+  GST_IPC_PIPELINE_COMM_DATA_TYPE_BUFFER_RELEASE,
 } GstIpcPipelineCommDataType;
 
 typedef struct
@@ -76,6 +78,22 @@ typedef struct
   guint read_chunk_size;
   GstClockTime ack_time;
 
+  /* buffers sent as file descriptors */
+  gboolean pass_fds;
+  gboolean fdin_not_socket;
+  GQueue received_fds;
+  GstAllocator *fd_allocator;
+  GstAllocator *dmabuf_allocator;
+  /* buffers sent as file descriptors, until the peer released them */
+  GHashTable *fd_buffers;
+
+  /* buffers waiting for their flow return */
+  guint max_pending_buffers;
+  guint pending_buffers;
+  GstFlowReturn pending_ret;
+  guint cancel_cookie;
+  GCond pending_cond;
+
   void (*on_buffer) (guint32, GstBuffer *, gpointer);
   void (*on_event) (guint32, GstEvent *, gboolean, gpointer);
   void (*on_query) (guint32, GstQuery *, gboolean, gpointer);
@@ -55,7 +55,11 @@
  * Communication with ipcpipelinesrc on the slave happens via a socket, using a
  * custom protocol. Each buffer, event, query, message or state change is
  * serialized in a "packet" and sent over the socket. The sender then
- * performs a blocking wait for a reply, if a return code is needed.
+ * performs a blocking wait for a reply, if a return code is needed. Buffers
+ * are an exception when #GstIpcPipelineSink:max-pending-buffers is more than
+ * one: up to that many buffers can then be waiting for their flow return,
+ * and a flow return other than %GST_FLOW_OK is returned for the buffer that
+ * follows it.
  *
  * All objects that contain a GstStructure (messages, queries, events) are
  * serialized by serializing the GstStructure to a string
@@ -66,7 +70,10 @@
  * GError are serialized differently).
  *
  * Buffers are transported by writing their content directly on the socket.
- * More efficient ways for memory sharing could be implemented in the future.
+ * When #GstIpcPipelineSink:pass-fds is set and the socket is a unix socket,
+ * buffers made of file descriptor backed memory (memfd, dmabuf, ...) are
+ * instead sent as file descriptors, with only their metadata going through
+ * the socket.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -99,11 +106,15 @@ enum
   PROP_FDOUT,
   PROP_READ_CHUNK_SIZE,
   PROP_ACK_TIME,
+  PROP_PASS_FDS,
+  PROP_MAX_PENDING_BUFFERS,
 };
 
 
 #define DEFAULT_READ_CHUNK_SIZE 4096
 #define DEFAULT_ACK_TIME (10 * G_TIME_SPAN_SECOND)
+#define DEFAULT_PASS_FDS FALSE
+#define DEFAULT_MAX_PENDING_BUFFERS 1
 
 #define _do_init \
     GST_DEBUG_CATEGORY_INIT (gst_ipc_pipeline_sink_debug, "ipcpipelinesink", 0, "ipcpipelinesink element");
@@ -179,6 +190,43 @@ gst_ipc_pipeline_sink_class_init (GstIpcPipelineSinkClass * klass)
           0, G_MAXUINT64, DEFAULT_ACK_TIME,
           G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * GstIpcPipelineSink:pass-fds:
+   *
+   * Send buffers whose memories are all backed by a file descriptor (memfd,
+   * dmabuf, ...) as file descriptors instead of copying their content over
+   * the socket. This requires fdout to be a unix socket and an
+   * ipcpipelinesrc that knows about this, so it is disabled by default.
+   * Other buffers are still copied.
+   *
+   * The sender keeps a reference on such buffers until the peer has freed
+   * all their memories, so buffer pools only reuse them once the peer is
+   * done with them.
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_PASS_FDS,
+      g_param_spec_boolean ("pass-fds", "Pass fds",
+          "Send fd backed buffers as file descriptors over a unix socket",
+          DEFAULT_PASS_FDS, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstIpcPipelineSink:max-pending-buffers:
+   *
+   * Maximum number of buffers sent to the peer without having received
+   * their flow return yet. With the default of 1, each buffer waits for
+   * the peer to push it. With more, a flow return other than %GST_FLOW_OK
+   * is only returned for the buffer that follows it, and waiting for a
+   * free slot fails after #GstIpcPipelineSink:ack-time.
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_MAX_PENDING_BUFFERS,
+      g_param_spec_uint ("max-pending-buffers", "Max pending buffers",
+          "Maximum number of buffers waiting for their flow return",
+          1, G_MAXUINT, DEFAULT_MAX_PENDING_BUFFERS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   gst_ipc_pipeline_sink_signals[SIGNAL_DISCONNECT] =
       g_signal_new ("disconnect",
       G_TYPE_FROM_CLASS (klass),
@@ -214,6 +262,8 @@ gst_ipc_pipeline_sink_init (GstIpcPipelineSink * sink)
   gst_ipc_pipeline_comm_init (&sink->comm, GST_ELEMENT (sink));
   sink->comm.read_chunk_size = DEFAULT_READ_CHUNK_SIZE;
   sink->comm.ack_time = DEFAULT_ACK_TIME;
+  sink->comm.pass_fds = DEFAULT_PASS_FDS;
+  sink->comm.max_pending_buffers = DEFAULT_MAX_PENDING_BUFFERS;
   sink->comm.fdin = -1;
   sink->comm.fdout = -1;
   sink->threads = g_thread_pool_new (pusher, sink, -1, FALSE, NULL);
@@ -275,6 +325,17 @@ gst_ipc_pipeline_sink_set_property (GObject * object, guint prop_id,
     case PROP_ACK_TIME:
       sink->comm.ack_time = g_value_get_uint64 (value);
       break;
+    case PROP_PASS_FDS:
+      g_mutex_lock (&sink->comm.mutex);
+      sink->comm.pass_fds = g_value_get_boolean (value);
+      g_mutex_unlock (&sink->comm.mutex);
+      break;
+    case PROP_MAX_PENDING_BUFFERS:
+      g_mutex_lock (&sink->comm.mutex);
+      sink->comm.max_pending_buffers = g_value_get_uint (value);
+      g_cond_broadcast (&sink->comm.pending_cond);
+      g_mutex_unlock (&sink->comm.mutex);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -300,6 +361,16 @@ gst_ipc_pipeline_sink_get_property (GObject * object, guint prop_id,
     case PROP_ACK_TIME:
       g_value_set_uint64 (value, sink->comm.ack_time);
       break;
+    case PROP_PASS_FDS:
+      g_mutex_lock (&sink->comm.mutex);
+      g_value_set_boolean (value, sink->comm.pass_fds);
+      g_mutex_unlock (&sink->comm.mutex);
+      break;
+    case PROP_MAX_PENDING_BUFFERS:
+      g_mutex_lock (&sink->comm.mutex);
+      g_value_set_uint (value, sink->comm.max_pending_buffers);
+      g_mutex_unlock (&sink->comm.mutex);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
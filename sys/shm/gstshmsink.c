@@ -39,6 +39,7 @@
 #include "gstshmsink.h"
 
 #include <gst/gst.h>
+#include <gst/allocators/allocators.h>
 
 #include <string.h>
 
@@ -47,6 +48,8 @@ enum
 {
   SIGNAL_CLIENT_CONNECTED,
   SIGNAL_CLIENT_DISCONNECTED,
+  SIGNAL_SET_CLIENT_POLICY,
+  SIGNAL_GET_STATS,
   LAST_SIGNAL
 };
 
@@ -58,17 +61,37 @@ enum
   PROP_PERMS,
   PROP_SHM_SIZE,
   PROP_WAIT_FOR_CONNECTION,
-  PROP_BUFFER_TIME
+  PROP_BUFFER_TIME,
+  PROP_PASS_FDS,
+  PROP_CLIENT_POLICY,
+  PROP_CLIENT_MAX_LAG,
+  PROP_CLIENT_TIMEOUT
 };
 
 struct GstShmClient
 {
   ShmClient *client;
   GstPollFD pollfd;
+
+  /* policy set with the set-client-policy action, if any */
+  gboolean has_policy;
+  GstShmSinkClientPolicy policy;
+
+  /* the current buffer is not sent to this client */
+  gboolean skip;
+  /* waiting for a keyframe to resume sending */
+  gboolean skipping;
+
+  guint64 sent;
+  guint64 dropped;
 };
 
 #define DEFAULT_SIZE ( 64 * 1024 * 1024 )
 #define DEFAULT_WAIT_FOR_CONNECTION (TRUE)
+#define DEFAULT_PASS_FDS (FALSE)
+#define DEFAULT_CLIENT_POLICY GST_SHM_SINK_CLIENT_POLICY_BLOCK
+#define DEFAULT_CLIENT_MAX_LAG 4
+#define DEFAULT_CLIENT_TIMEOUT GST_SECOND
 /* Default is user read/write, group read */
 #define DEFAULT_PERMS ( S_IRUSR | S_IWUSR | S_IRGRP )
 
@@ -76,6 +99,28 @@ struct GstShmClient
 GST_DEBUG_CATEGORY_STATIC (shmsink_debug);
 #define GST_CAT_DEFAULT shmsink_debug
 
+GType
+gst_shm_sink_client_policy_get_type (void)
+{
+  static GType type = 0;
+  static const GEnumValue values[] = {
+    {GST_SHM_SINK_CLIENT_POLICY_BLOCK, "Wait for the client", "block"},
+    {GST_SHM_SINK_CLIENT_POLICY_DROP,
+        "Drop buffers for the client while it lags", "drop"},
+    {GST_SHM_SINK_CLIENT_POLICY_KEYFRAME,
+        "Drop buffers for the client while it lags, resume at a keyframe",
+        "keyframe"},
+    {GST_SHM_SINK_CLIENT_POLICY_DISCONNECT,
+        "Disconnect the client when it lags for too long", "disconnect"},
+    {0, NULL, NULL}
+  };
+
+  if (!type)
+    type = g_enum_register_static ("GstShmSinkClientPolicy", values);
+
+  return type;
+}
+
 static GstStaticPadTemplate sinktemplate = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
@@ -102,6 +147,10 @@ static gboolean gst_shm_sink_unlock_stop (GstBaseSink * bsink);
 static gboolean gst_shm_sink_propose_allocation (GstBaseSink * sink,
     GstQuery * query);
 
+static gboolean gst_shm_sink_set_client_policy (GstShmSink * self, gint fd,
+    GstShmSinkClientPolicy policy);
+static GstStructure *gst_shm_sink_get_stats (GstShmSink * self, gint fd);
+
 static gpointer pollthread_func (gpointer data);
 
 static guint signals[LAST_SIGNAL] = { 0 };
@@ -357,6 +406,9 @@ gst_shm_sink_init (GstShmSink * self)
   self->unlock = FALSE;
   self->wait_for_connection = DEFAULT_WAIT_FOR_CONNECTION;
   self->perms = DEFAULT_PERMS;
+  self->client_policy = DEFAULT_CLIENT_POLICY;
+  self->client_max_lag = DEFAULT_CLIENT_MAX_LAG;
+  self->client_timeout = DEFAULT_CLIENT_TIMEOUT;
 
   gst_allocation_params_init (&self->params);
 }
@@ -419,6 +471,72 @@ gst_shm_sink_class_init (GstShmSinkClass * klass)
           -1, G_MAXINT64, -1,
           G_PARAM_CONSTRUCT | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 
+  /**
+   * GstShmSink:pass-fds:
+   *
+   * Send buffers backed by a file descriptor, e.g. memfd or dmabuf, by
+   * passing the file descriptor over the control socket instead of copying
+   * their data into the shared memory area. shmsrc then wraps them as fd
+   * memory. The clients must support this, older ones disconnect when they
+   * receive such a buffer.
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_PASS_FDS,
+      g_param_spec_boolean ("pass-fds",
+          "Pass file descriptors",
+          "Send fd-backed buffers by passing their file descriptor instead "
+          "of copying them", DEFAULT_PASS_FDS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstShmSink:client-policy:
+   *
+   * What to do with the clients that do not release the buffers fast
+   * enough, unless another policy was set for them with
+   * #GstShmSink::set-client-policy. With the default, one slow client
+   * stalls the stream for all of them.
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_CLIENT_POLICY,
+      g_param_spec_enum ("client-policy",
+          "Client policy",
+          "What to do with the clients that lag behind",
+          GST_TYPE_SHM_SINK_CLIENT_POLICY, DEFAULT_CLIENT_POLICY,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstShmSink:client-max-lag:
+   *
+   * Number of buffers a client can hold on to before it is considered
+   * lagging by the drop and keyframe policies.
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_CLIENT_MAX_LAG,
+      g_param_spec_uint ("client-max-lag",
+          "Client maximum lag",
+          "Number of buffers a client can hold before it is lagging",
+          1, G_MAXUINT, DEFAULT_CLIENT_MAX_LAG,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  /**
+   * GstShmSink:client-timeout:
+   *
+   * Time in nanoseconds after which a client with the disconnect policy
+   * that still holds a buffer is disconnected.
+   *
+   * Since: 1.20
+   */
+  g_object_class_install_property (gobject_class, PROP_CLIENT_TIMEOUT,
+      g_param_spec_uint64 ("client-timeout",
+          "Client timeout",
+          "Time after which a client holding a buffer is disconnected "
+          "with the disconnect policy (in nanoseconds)",
+          0, G_MAXUINT64, DEFAULT_CLIENT_TIMEOUT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
   signals[SIGNAL_CLIENT_CONNECTED] = g_signal_new ("client-connected",
       GST_TYPE_SHM_SINK, G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL,
       G_TYPE_NONE, 1, G_TYPE_INT);
@@ -427,6 +545,49 @@ gst_shm_sink_class_init (GstShmSinkClass * klass)
       GST_TYPE_SHM_SINK, G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL,
       G_TYPE_NONE, 1, G_TYPE_INT);
 
+  /**
+   * GstShmSink::set-client-policy:
+   * @shmsink: the shmsink element to emit this signal on
+   * @fd: the file descriptor of the client, as given by
+   *   #GstShmSink::client-connected
+   * @policy: the policy to use for this client
+   *
+   * Sets the policy of one client, overriding #GstShmSink:client-policy.
+   *
+   * Returns: %FALSE if there is no such client
+   *
+   * Since: 1.20
+   */
+  signals[SIGNAL_SET_CLIENT_POLICY] = g_signal_new ("set-client-policy",
+      GST_TYPE_SHM_SINK, G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (GstShmSinkClass, set_client_policy), NULL, NULL, NULL,
+      G_TYPE_BOOLEAN, 2, G_TYPE_INT, GST_TYPE_SHM_SINK_CLIENT_POLICY);
+
+  /**
+   * GstShmSink::get-stats:
+   * @shmsink: the shmsink element to emit this signal on
+   * @fd: the file descriptor of the client
+   *
+   * Gets the statistics of one client: its policy, the number of buffers
+   * sent to it and dropped for it, the number of buffers it holds and the
+   * highest number it held, and for how long it has been holding its
+   * oldest buffer in nanoseconds ("lag").
+   *
+   * Returns: (transfer full) (nullable): a #GstStructure with the
+   *   statistics, %NULL if there is no such client
+   *
+   * Since: 1.20
+   */
+  signals[SIGNAL_GET_STATS] = g_signal_new ("get-stats",
+      GST_TYPE_SHM_SINK, G_SIGNAL_RUN_LAST | G_SIGNAL_ACTION,
+      G_STRUCT_OFFSET (GstShmSinkClass, get_stats), NULL, NULL, NULL,
+      GST_TYPE_STRUCTURE, 1, G_TYPE_INT);
+
+  klass->set_client_policy = gst_shm_sink_set_client_policy;
+  klass->get_stats = gst_shm_sink_get_stats;
+
+  gst_type_mark_as_plugin_api (GST_TYPE_SHM_SINK_CLIENT_POLICY, 0);
+
   gst_element_class_add_static_pad_template (gstelement_class, &sinktemplate);
 
   gst_element_class_set_static_metadata (gstelement_class,
@@ -507,6 +668,29 @@ gst_shm_sink_set_property (GObject * object, guint prop_id,
       GST_OBJECT_UNLOCK (object);
       g_cond_broadcast (&self->cond);
       break;
+    case PROP_PASS_FDS:
+      GST_OBJECT_LOCK (object);
+      self->pass_fds = g_value_get_boolean (value);
+      GST_OBJECT_UNLOCK (object);
+      break;
+    case PROP_CLIENT_POLICY:
+      GST_OBJECT_LOCK (object);
+      self->client_policy = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (object);
+      g_cond_broadcast (&self->cond);
+      break;
+    case PROP_CLIENT_MAX_LAG:
+      GST_OBJECT_LOCK (object);
+      self->client_max_lag = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (object);
+      break;
+    case PROP_CLIENT_TIMEOUT:
+      GST_OBJECT_LOCK (object);
+      self->client_timeout = g_value_get_uint64 (value);
+      if (self->poll)
+        gst_poll_restart (self->poll);
+      GST_OBJECT_UNLOCK (object);
+      break;
     default:
       break;
   }
@@ -536,6 +720,18 @@ gst_shm_sink_get_property (GObject * object, guint prop_id,
     case PROP_BUFFER_TIME:
       g_value_set_int64 (value, self->buffer_time);
       break;
+    case PROP_PASS_FDS:
+      g_value_set_boolean (value, self->pass_fds);
+      break;
+    case PROP_CLIENT_POLICY:
+      g_value_set_enum (value, self->client_policy);
+      break;
+    case PROP_CLIENT_MAX_LAG:
+      g_value_set_uint (value, self->client_max_lag);
+      break;
+    case PROP_CLIENT_TIMEOUT:
+      g_value_set_uint64 (value, self->client_timeout);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -642,6 +838,205 @@ gst_shm_sink_stop (GstBaseSink * bsink)
   return TRUE;
 }
 
+static GstShmSinkClientPolicy
+gst_shm_sink_client_get_policy (GstShmSink * self,
+    struct GstShmClient *gclient)
+{
+  return gclient->has_policy ? gclient->policy : self->client_policy;
+}
+
+static struct GstShmClient *
+gst_shm_sink_find_client (GstShmSink * self, gint fd)
+{
+  GList *item;
+
+  for (item = self->clients; item; item = item->next) {
+    struct GstShmClient *gclient = item->data;
+
+    if (gclient->pollfd.fd == fd)
+      return gclient;
+  }
+
+  return NULL;
+}
+
+static gboolean
+gst_shm_sink_set_client_policy (GstShmSink * self, gint fd,
+    GstShmSinkClientPolicy policy)
+{
+  struct GstShmClient *gclient;
+
+  GST_OBJECT_LOCK (self);
+  gclient = gst_shm_sink_find_client (self, fd);
+  if (gclient) {
+    gclient->has_policy = TRUE;
+    gclient->policy = policy;
+    if (self->poll)
+      gst_poll_restart (self->poll);
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  if (!gclient) {
+    GST_WARNING_OBJECT (self, "No client with fd %d", fd);
+    return FALSE;
+  }
+
+  g_cond_broadcast (&self->cond);
+
+  return TRUE;
+}
+
+static GstStructure *
+gst_shm_sink_get_stats (GstShmSink * self, gint fd)
+{
+  struct GstShmClient *gclient;
+  GstStructure *s = NULL;
+  ShmClientStats stats;
+
+  GST_OBJECT_LOCK (self);
+  gclient = gst_shm_sink_find_client (self, fd);
+  if (gclient) {
+    sp_writer_get_client_stats (self->pipe, gclient->client, &stats);
+    s = gst_structure_new ("shmsink-client-stats",
+        "fd", G_TYPE_INT, fd,
+        "policy", GST_TYPE_SHM_SINK_CLIENT_POLICY,
+        gst_shm_sink_client_get_policy (self, gclient),
+        "buffers-sent", G_TYPE_UINT64, gclient->sent,
+        "buffers-dropped", G_TYPE_UINT64, gclient->dropped,
+        "pending-buffers", G_TYPE_UINT, stats.pending,
+        "max-pending-buffers", G_TYPE_UINT, stats.max_pending,
+        "lag", G_TYPE_UINT64, (guint64) stats.lag * GST_USECOND, NULL);
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  return s;
+}
+
+/* Sets which clients @buf will be sent to according to their policy.
+ * Returns the number of clients that will get it */
+static guint
+gst_shm_sink_select_clients (GstShmSink * self, GstBuffer * buf)
+{
+  GList *item;
+  guint n = 0;
+
+  for (item = self->clients; item; item = item->next) {
+    struct GstShmClient *gclient = item->data;
+    gboolean lagging;
+
+    lagging = sp_writer_client_get_pending (gclient->client) >=
+        self->client_max_lag;
+
+    switch (gst_shm_sink_client_get_policy (self, gclient)) {
+      case GST_SHM_SINK_CLIENT_POLICY_DROP:
+        gclient->skip = lagging;
+        break;
+      case GST_SHM_SINK_CLIENT_POLICY_KEYFRAME:
+        if (lagging)
+          gclient->skipping = TRUE;
+        else if (!GST_BUFFER_FLAG_IS_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT))
+          gclient->skipping = FALSE;
+        gclient->skip = gclient->skipping;
+        break;
+      default:
+        gclient->skip = FALSE;
+        break;
+    }
+
+    sp_writer_client_set_skip (gclient->client, gclient->skip);
+    if (!gclient->skip)
+      n++;
+  }
+
+  return n;
+}
+
+/* Counts the buffer as sent or dropped for each client once it has been
+ * sent, or dropped for all of them */
+static void
+gst_shm_sink_account_clients (GstShmSink * self, gboolean sent)
+{
+  GList *item;
+  gboolean wake_up = FALSE;
+
+  for (item = self->clients; item; item = item->next) {
+    struct GstShmClient *gclient = item->data;
+
+    if (gclient->skip) {
+      GST_LOG_OBJECT (self, "Dropped buffer for lagging client %d",
+          gclient->pollfd.fd);
+      gclient->dropped++;
+    } else if (sent) {
+      gclient->sent++;
+
+      /* the poll thread has to time the first buffer the client holds */
+      if (gst_shm_sink_client_get_policy (self, gclient) ==
+          GST_SHM_SINK_CLIENT_POLICY_DISCONNECT &&
+          sp_writer_client_get_pending (gclient->client) == 1)
+        wake_up = TRUE;
+    }
+  }
+
+  if (wake_up)
+    gst_poll_restart (self->poll);
+}
+
+/* Whether @b is held by a client that may stall the stream */
+static gboolean
+gst_shm_sink_buffer_is_blocking (GstShmSink * self, ShmBuffer * b)
+{
+  GList *item;
+
+  for (item = self->clients; item; item = item->next) {
+    struct GstShmClient *gclient = item->data;
+
+    switch (gst_shm_sink_client_get_policy (self, gclient)) {
+      case GST_SHM_SINK_CLIENT_POLICY_DROP:
+      case GST_SHM_SINK_CLIENT_POLICY_KEYFRAME:
+        break;
+      default:
+        if (sp_writer_buf_has_client (b, gclient->client))
+          return TRUE;
+        break;
+    }
+  }
+
+  return FALSE;
+}
+
+/* Whether @gclient has the disconnect policy and has been holding a buffer
+ * for longer than the client timeout. Otherwise @timeout is lowered to
+ * when that would happen, if needed */
+static gboolean
+gst_shm_sink_client_timed_out (GstShmSink * self,
+    struct GstShmClient *gclient, GstClockTime * timeout)
+{
+  ShmClientStats stats;
+  GstClockTime lag;
+  gboolean ret = FALSE;
+
+  GST_OBJECT_LOCK (self);
+  if (gst_shm_sink_client_get_policy (self, gclient) !=
+      GST_SHM_SINK_CLIENT_POLICY_DISCONNECT)
+    goto done;
+
+  sp_writer_get_client_stats (self->pipe, gclient->client, &stats);
+  if (stats.pending == 0)
+    goto done;
+
+  lag = stats.lag * GST_USECOND;
+  if (lag >= self->client_timeout)
+    ret = TRUE;
+  else if (!GST_CLOCK_TIME_IS_VALID (*timeout) ||
+      self->client_timeout - lag < *timeout)
+    *timeout = self->client_timeout - lag;
+
+done:
+  GST_OBJECT_UNLOCK (self);
+
+  return ret;
+}
+
 static gboolean
 gst_shm_sink_can_render (GstShmSink * self, GstClockTime time)
 {
@@ -653,7 +1048,8 @@ gst_shm_sink_can_render (GstShmSink * self, GstClockTime time)
   b = sp_writer_get_pending_buffers (self->pipe);
   for (; b != NULL; b = sp_writer_get_next_buffer (b)) {
     GstBuffer *buf = sp_writer_buf_get_tag (b);
-    if (GST_CLOCK_DIFF (time, GST_BUFFER_PTS (buf)) > self->buffer_time)
+    if (GST_CLOCK_DIFF (time, GST_BUFFER_PTS (buf)) > self->buffer_time &&
+        gst_shm_sink_buffer_is_blocking (self, b))
       return FALSE;
   }
 
@@ -690,6 +1086,15 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
     }
   }
 
+  /* Don't wait for space if no client is going to get it anyway */
+  if (self->clients && gst_shm_sink_select_clients (self, buf) == 0) {
+    gst_shm_sink_account_clients (self, FALSE);
+    GST_OBJECT_UNLOCK (self);
+    GST_LOG_OBJECT (self, "All the clients are lagging, dropping buffer %p",
+        buf);
+    return GST_FLOW_OK;
+  }
+
   while (!gst_shm_sink_can_render (self, GST_BUFFER_TIMESTAMP (buf))) {
     g_cond_wait (&self->cond, GST_OBJECT_GET_LOCK (self));
     if (self->unlock) {
@@ -702,6 +1107,30 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
     }
   }
 
+  if (self->pass_fds && gst_buffer_n_memory (buf) == 1 &&
+      gst_is_fd_memory (gst_buffer_peek_memory (buf, 0))) {
+    memory = gst_buffer_peek_memory (buf, 0);
+
+    GST_LOG_OBJECT (self, "Passing fd %d of buffer %p, %" G_GSIZE_FORMAT
+        " bytes at offset %" G_GSIZE_FORMAT, gst_fd_memory_get_fd (memory),
+        buf, memory->size, memory->offset);
+
+    /* The buffer is kept until all the clients are done with it */
+    sendbuf = gst_buffer_ref (buf);
+    gst_shm_sink_select_clients (self, buf);
+    rv = sp_writer_send_fd (self->pipe, gst_fd_memory_get_fd (memory),
+        memory->offset, memory->size, gst_is_dmabuf_memory (memory), sendbuf);
+    gst_shm_sink_account_clients (self, rv > 0);
+
+    GST_OBJECT_UNLOCK (self);
+
+    if (rv == 0) {
+      GST_DEBUG_OBJECT (self, "No clients connected, unreffing buffer");
+      gst_buffer_unref (sendbuf);
+    }
+
+    return ret;
+  }
 
   if (gst_buffer_n_memory (buf) > 1) {
     GST_LOG_OBJECT (self, "Buffer %p has %d GstMemory, we only support a single"
@@ -730,6 +1159,15 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
     while ((memory =
             gst_shm_sink_allocator_alloc_locked (self->allocator,
                 gst_buffer_get_size (buf), &self->params)) == NULL) {
+      ShmAllocStats stats;
+
+      sp_writer_get_alloc_stats (self->pipe, &stats);
+      GST_DEBUG_OBJECT (self, "No space for %" G_GSIZE_FORMAT " bytes, "
+          "waiting: %lu bytes used in %u blocks, %lu bytes free in %u blocks, "
+          "largest %lu bytes (fragmentation %u per mille)",
+          gst_buffer_get_size (buf), stats.used, stats.used_blocks,
+          stats.free, stats.free_blocks, stats.largest_free,
+          stats.fragmentation);
       g_cond_wait (&self->cond, GST_OBJECT_GET_LOCK (self));
       if (self->unlock) {
         GST_OBJECT_UNLOCK (self);
@@ -790,7 +1228,9 @@ gst_shm_sink_render (GstBaseSink * bsink, GstBuffer * buf)
    * We know it's not mapped for writing anywhere as we just mapped it for
    * reading
    */
+  gst_shm_sink_select_clients (self, buf);
   rv = sp_writer_send_buf (self->pipe, (char *) map.data, map.size, sendbuf);
+  gst_shm_sink_account_clients (self, rv > 0);
   if (rv == -1) {
     GST_ELEMENT_ERROR (self, STREAM, FAILED,
         (NULL), ("Failed to send data over SHM"));
@@ -828,7 +1268,7 @@ static gpointer
 pollthread_func (gpointer data)
 {
   GstShmSink *self = GST_SHM_SINK (data);
-  GList *item;
+  GList *item, *closed;
   GstClockTime timeout = GST_CLOCK_TIME_NONE;
   int rv = 0;
 
@@ -868,22 +1308,27 @@ pollthread_func (gpointer data)
 
       GST_OBJECT_LOCK (self);
       client = sp_writer_accept_client (self->pipe);
-      GST_OBJECT_UNLOCK (self);
 
       if (!client) {
+        GST_OBJECT_UNLOCK (self);
         GST_ELEMENT_ERROR (self, RESOURCE, READ,
             ("Failed to read from shmsink"),
             ("Control socket returns wrong data"));
         return NULL;
       }
 
-      gclient = g_slice_new (struct GstShmClient);
+      /* the clients are also used by the streaming thread when sending */
+      gclient = g_slice_new0 (struct GstShmClient);
       gclient->client = client;
       gst_poll_fd_init (&gclient->pollfd);
       gclient->pollfd.fd = sp_writer_get_client_fd (client);
+      /* with the keyframe policy, new clients start with a keyframe */
+      gclient->skipping = TRUE;
+      self->clients = g_list_prepend (self->clients, gclient);
+      GST_OBJECT_UNLOCK (self);
+
       gst_poll_add_fd (self->poll, &gclient->pollfd);
       gst_poll_fd_ctl_read (self->poll, &gclient->pollfd, TRUE);
-      self->clients = g_list_prepend (self->clients, gclient);
       g_signal_emit (self, signals[SIGNAL_CLIENT_CONNECTED], 0,
           gclient->pollfd.fd);
       /* we need to call gst_poll_wait before calling gst_poll_* status
@@ -894,7 +1339,10 @@ pollthread_func (gpointer data)
       continue;
     }
 
-  again:
+    /* Close the clients only once all of them have been serviced, each
+     * client must be read at most once per poll result or the read fails
+     * on a socket that has no data anymore */
+    closed = NULL;
     for (item = self->clients; item; item = item->next) {
       struct GstShmClient *gclient = item->data;
 
@@ -927,26 +1375,35 @@ pollthread_func (gpointer data)
         if (rv == 0)
           gst_buffer_unref (tag);
       }
+
+      if (gst_shm_sink_client_timed_out (self, gclient, &timeout)) {
+        GST_WARNING_OBJECT (self, "Client %d did not release its buffers in "
+            "time, closing", gclient->pollfd.fd);
+        goto close_client;
+      }
       continue;
     close_client:
-      {
-        GSList *list = NULL;
-        GST_OBJECT_LOCK (self);
-        sp_writer_close_client (self->pipe, gclient->client,
-            (sp_buffer_free_callback) free_buffer_locked, (void **) &list);
-        GST_OBJECT_UNLOCK (self);
-        g_slist_free_full (list, (GDestroyNotify) gst_buffer_unref);
-      }
+      closed = g_list_prepend (closed, gclient);
+    }
 
-      gst_poll_remove_fd (self->poll, &gclient->pollfd);
+    for (item = closed; item; item = item->next) {
+      struct GstShmClient *gclient = item->data;
+      GSList *list = NULL;
+
+      GST_OBJECT_LOCK (self);
+      sp_writer_close_client (self->pipe, gclient->client,
+          (sp_buffer_free_callback) free_buffer_locked, (void **) &list);
       self->clients = g_list_remove (self->clients, gclient);
+      GST_OBJECT_UNLOCK (self);
+      g_slist_free_full (list, (GDestroyNotify) gst_buffer_unref);
+
+      gst_poll_remove_fd (self->poll, &gclient->pollfd);
 
       g_signal_emit (self, signals[SIGNAL_CLIENT_DISCONNECTED], 0,
           gclient->pollfd.fd);
       g_slice_free (struct GstShmClient, gclient);
-
-      goto again;
     }
+    g_list_free (closed);
 
     g_cond_broadcast (&self->cond);
   }
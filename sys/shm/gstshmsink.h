@@ -42,6 +42,33 @@ typedef struct _GstShmSink GstShmSink;
 typedef struct _GstShmSinkClass GstShmSinkClass;
 typedef struct _GstShmSinkAllocator GstShmSinkAllocator;
 
+/**
+ * GstShmSinkClientPolicy:
+ * @GST_SHM_SINK_CLIENT_POLICY_BLOCK: wait for the client, a lagging
+ *   client stalls the stream
+ * @GST_SHM_SINK_CLIENT_POLICY_DROP: do not send buffers to the client while
+ *   it is lagging, it gets the latest one once it catches up
+ * @GST_SHM_SINK_CLIENT_POLICY_KEYFRAME: like
+ *   @GST_SHM_SINK_CLIENT_POLICY_DROP, but start and resume with a keyframe
+ * @GST_SHM_SINK_CLIENT_POLICY_DISCONNECT: disconnect the client when it
+ *   holds a buffer for longer than #GstShmSink:client-timeout
+ *
+ * What to do with a client that does not release its buffers fast enough.
+ *
+ * Since: 1.20
+ */
+typedef enum
+{
+  GST_SHM_SINK_CLIENT_POLICY_BLOCK,
+  GST_SHM_SINK_CLIENT_POLICY_DROP,
+  GST_SHM_SINK_CLIENT_POLICY_KEYFRAME,
+  GST_SHM_SINK_CLIENT_POLICY_DISCONNECT
+} GstShmSinkClientPolicy;
+
+#define GST_TYPE_SHM_SINK_CLIENT_POLICY \
+  (gst_shm_sink_client_policy_get_type())
+GType gst_shm_sink_client_policy_get_type (void);
+
 struct _GstShmSink
 {
   GstBaseSink element;
@@ -60,10 +87,15 @@ struct _GstShmSink
   GstPollFD serverpollfd;
 
   gboolean wait_for_connection;
+  gboolean pass_fds;
   gboolean stop;
   gboolean unlock;
   GstClockTimeDiff buffer_time;
 
+  GstShmSinkClientPolicy client_policy;
+  guint client_max_lag;
+  GstClockTime client_timeout;
+
   GCond cond;
 
   GstShmSinkAllocator *allocator;
@@ -74,6 +106,11 @@ struct _GstShmSink
 struct _GstShmSinkClass
 {
   GstBaseSinkClass parent_class;
+
+  /* actions */
+  gboolean (*set_client_policy) (GstShmSink * sink, gint fd,
+      GstShmSinkClientPolicy policy);
+  GstStructure *(*get_stats) (GstShmSink * sink, gint fd);
 };
 
 GType gst_shm_sink_get_type (void);
@@ -41,8 +41,10 @@
 #include "gstshmsrc.h"
 
 #include <gst/gst.h>
+#include <gst/allocators/allocators.h>
 
 #include <string.h>
+#include <unistd.h>
 
 /* signals */
 enum
@@ -63,12 +65,16 @@ struct GstShmBuffer
 {
   char *buf;
   GstShmPipe *pipe;
+  /* for buffers received as a file descriptor */
+  int id;
 };
 
 
 GST_DEBUG_CATEGORY_STATIC (shmsrc_debug);
 #define GST_CAT_DEFAULT shmsrc_debug
 
+static GQuark fd_buffer_quark;
+
 static GstStaticPadTemplate srctemplate = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
@@ -146,6 +152,8 @@ gst_shm_src_class_init (GstShmSrcClass * klass)
       "Olivier Crete <olivier.crete@collabora.co.uk>");
 
   GST_DEBUG_CATEGORY_INIT (shmsrc_debug, "shmsrc", 0, "Shared Memory Source");
+
+  fd_buffer_quark = g_quark_from_static_string ("GstShmSrcFdBuffer");
 }
 
 static void
@@ -153,6 +161,9 @@ gst_shm_src_init (GstShmSrc * self)
 {
   self->poll = gst_poll_new (TRUE);
   gst_poll_fd_init (&self->pollfd);
+
+  self->fd_allocator = gst_fd_allocator_new ();
+  self->dmabuf_allocator = gst_dmabuf_allocator_new ();
 }
 
 static void
@@ -162,6 +173,8 @@ gst_shm_src_finalize (GObject * object)
 
   gst_poll_free (self->poll);
   g_free (self->socket_path);
+  gst_object_unref (self->fd_allocator);
+  gst_object_unref (self->dmabuf_allocator);
 
   G_OBJECT_CLASS (parent_class)->finalize (object);
 }
@@ -319,6 +332,65 @@ free_buffer (gpointer data)
   g_slice_free (struct GstShmBuffer, gsb);
 }
 
+static void
+free_fd_buffer (gpointer data)
+{
+  struct GstShmBuffer *gsb = data;
+  g_return_if_fail (gsb->pipe != NULL);
+  g_return_if_fail (gsb->pipe->src != NULL);
+
+  GST_LOG ("Freeing fd buffer %d", gsb->id);
+
+  GST_OBJECT_LOCK (gsb->pipe->src);
+  sp_client_recv_finish_fd (gsb->pipe->pipe, gsb->id);
+  GST_OBJECT_UNLOCK (gsb->pipe->src);
+
+  gst_shm_pipe_dec (gsb->pipe);
+
+  g_slice_free (struct GstShmBuffer, gsb);
+}
+
+/* Wraps the @size bytes at @offset of @fd, the writer is told that we are
+ * done with them once the memory is freed */
+static GstBuffer *
+gst_shm_src_wrap_fd (GstShmSrc * self, GstShmPipe * pipe, int fd,
+    unsigned long offset, gsize size, int id, gboolean is_dmabuf)
+{
+  struct GstShmBuffer *gsb;
+  GstMemory *mem;
+  GstBuffer *buffer;
+
+  if (is_dmabuf)
+    mem = gst_dmabuf_allocator_alloc (self->dmabuf_allocator, fd,
+        offset + size);
+  else
+    mem = gst_fd_allocator_alloc (self->fd_allocator, fd, offset + size,
+        GST_FD_MEMORY_FLAG_NONE);
+
+  if (mem == NULL) {
+    close (fd);
+    GST_OBJECT_LOCK (self);
+    sp_client_recv_finish_fd (pipe->pipe, id);
+    GST_OBJECT_UNLOCK (self);
+    gst_shm_pipe_dec (pipe);
+    return NULL;
+  }
+
+  gst_memory_resize (mem, offset, size);
+  GST_MINI_OBJECT_FLAG_SET (mem, GST_MEMORY_FLAG_READONLY);
+
+  gsb = g_slice_new0 (struct GstShmBuffer);
+  gsb->pipe = pipe;
+  gsb->id = id;
+  gst_mini_object_set_qdata (GST_MINI_OBJECT_CAST (mem), fd_buffer_quark,
+      gsb, free_fd_buffer);
+
+  buffer = gst_buffer_new ();
+  gst_buffer_append_memory (buffer, mem);
+
+  return buffer;
+}
+
 static GstFlowReturn
 gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
 {
@@ -327,6 +399,8 @@ gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
   gchar *buf = NULL;
   int rv = 0;
   struct GstShmBuffer *gsb;
+  int fd = -1, id = 0, is_dmabuf = 0;
+  unsigned long offset = 0;
 
   GST_DEBUG_OBJECT (self, "Stopping %p", self);
 
@@ -368,7 +442,8 @@ gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
       buf = NULL;
       GST_LOG_OBJECT (self, "Reading from pipe");
       GST_OBJECT_LOCK (self);
-      rv = sp_client_recv (pipe->pipe, &buf);
+      rv = sp_client_recv_fd (pipe->pipe, &buf, &fd, &offset, &id,
+          &is_dmabuf);
       GST_OBJECT_UNLOCK (self);
       if (rv < 0) {
         GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
@@ -376,7 +451,21 @@ gst_shm_src_create (GstPushSrc * psrc, GstBuffer ** outbuf)
         goto error;
       }
     }
-  } while (buf == NULL);
+  } while (buf == NULL && fd < 0);
+
+  if (fd >= 0) {
+    GST_LOG_OBJECT (self, "Got %s fd %d with %d bytes at offset %lu",
+        is_dmabuf ? "dmabuf" : "memory", fd, rv, offset);
+
+    *outbuf = gst_shm_src_wrap_fd (self, pipe, fd, offset, rv, id, is_dmabuf);
+    if (*outbuf == NULL) {
+      GST_ELEMENT_ERROR (self, RESOURCE, READ, ("Failed to read from shmsrc"),
+          ("Could not wrap fd %d", fd));
+      return GST_FLOW_ERROR;
+    }
+
+    return GST_FLOW_OK;
+  }
 
   GST_LOG_OBJECT (self, "Got buffer %p of size %d", buf, rv);
 
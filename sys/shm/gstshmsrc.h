@@ -56,6 +56,10 @@ struct _GstShmSrc
 
   GstFlowReturn flow_return;
   gboolean unlocked;
+
+  /* to wrap the buffers received as a file descriptor */
+  GstAllocator *fd_allocator;
+  GstAllocator *dmabuf_allocator;
 };
 
 struct _GstShmSrcClass
@@ -33,14 +33,45 @@
 #include <string.h>
 #include <assert.h>
 
+/* Free blocks are kept in segregated lists by size class: the first level
+ * is the power of two of the size, the second level splits each power of
+ * two range in SL_COUNT classes. Bitmaps of the non-empty lists give a
+ * free block large enough in constant time, and each block knows its
+ * physical neighbours so that a freed block is merged with the free space
+ * around it in constant time as well. */
+#define SL_LOG2 4
+#define SL_COUNT (1 << SL_LOG2)
+#define FL_COUNT ((int) sizeof (unsigned long) * 8)
+
+/* Blocks start on a multiple of the granule, which grows with the size of
+ * the space so that it has at most MAX_GRANULES */
+#define MIN_GRANULE 64
+#define MAX_GRANULES 16384
+
+/* Number of free blocks of the size class of a request looked at when no
+ * larger class has any */
+#define FALLBACK_SCAN 8
+
 /* This is the allocated space to hold multiple blocks */
 struct _ShmAllocSpace
 {
   /* The total size of this space */
   size_t size;
 
-  /* chained list of the blocks contained in this space */
-  ShmAllocBlock *blocks;
+  unsigned long granule;
+
+  /* bitmaps of the non-empty free lists */
+  unsigned long fl_bitmap;
+  unsigned long sl_bitmap[FL_COUNT];
+  ShmAllocBlock *free_lists[FL_COUNT][SL_COUNT];
+
+  /* the allocated blocks, indexed by their first granule */
+  ShmAllocBlock **used;
+  unsigned long n_granules;
+
+  unsigned long used_size;
+  unsigned int used_blocks;
+  unsigned int free_blocks;
 };
 
 /* A single block of data */
@@ -56,27 +87,207 @@ struct _ShmAllocBlock
   /* The size of the block */
   unsigned long size;
 
-  /* Pointer to the next block in the chain */
-  ShmAllocBlock *next;
+  int is_free;
+
+  /* The blocks right before and after this one in the space */
+  ShmAllocBlock *prev_phys;
+  ShmAllocBlock *next_phys;
+
+  /* The other blocks of the same free list */
+  ShmAllocBlock *prev_free;
+  ShmAllocBlock *next_free;
 };
 
+/* Index of the most significant bit set, x must not be 0 */
+static inline int
+fls_ulong (unsigned long x)
+{
+#if defined(__GNUC__)
+  return FL_COUNT - 1 - __builtin_clzl (x);
+#else
+  int i = -1;
+
+  while (x) {
+    x >>= 1;
+    i++;
+  }
+  return i;
+#endif
+}
+
+/* Index of the least significant bit set, x must not be 0 */
+static inline int
+ffs_ulong (unsigned long x)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzl (x);
+#else
+  int i = 0;
+
+  while (!(x & 1)) {
+    x >>= 1;
+    i++;
+  }
+  return i;
+#endif
+}
+
+/* The size class a free block of @size goes in */
+static void
+mapping_insert (unsigned long size, int *fl, int *sl)
+{
+  int f = fls_ulong (size);
+
+  if (f < SL_LOG2) {
+    *fl = 0;
+    *sl = (int) size;
+  } else {
+    *fl = f - SL_LOG2 + 1;
+    *sl = (int) (size >> (f - SL_LOG2)) - SL_COUNT;
+  }
+}
+
+/* The first size class whose free blocks are all at least @size */
+static void
+mapping_search (unsigned long size, int *fl, int *sl)
+{
+  int f = fls_ulong (size);
+
+  if (f >= SL_LOG2)
+    size += (1UL << (f - SL_LOG2)) - 1;
+
+  mapping_insert (size, fl, sl);
+}
+
+static void
+insert_free_block (ShmAllocSpace * self, ShmAllocBlock * block)
+{
+  int fl, sl;
+
+  mapping_insert (block->size, &fl, &sl);
+
+  block->is_free = 1;
+  block->prev_free = NULL;
+  block->next_free = self->free_lists[fl][sl];
+  if (block->next_free)
+    block->next_free->prev_free = block;
+  self->free_lists[fl][sl] = block;
+
+  self->fl_bitmap |= 1UL << fl;
+  self->sl_bitmap[fl] |= 1UL << sl;
+  self->free_blocks++;
+}
+
+static void
+remove_free_block (ShmAllocSpace * self, ShmAllocBlock * block)
+{
+  int fl, sl;
+
+  mapping_insert (block->size, &fl, &sl);
+
+  if (block->prev_free)
+    block->prev_free->next_free = block->next_free;
+  else
+    self->free_lists[fl][sl] = block->next_free;
+  if (block->next_free)
+    block->next_free->prev_free = block->prev_free;
+
+  if (self->free_lists[fl][sl] == NULL) {
+    self->sl_bitmap[fl] &= ~(1UL << sl);
+    if (self->sl_bitmap[fl] == 0)
+      self->fl_bitmap &= ~(1UL << fl);
+  }
+
+  block->is_free = 0;
+  self->free_blocks--;
+}
+
+static ShmAllocBlock *
+find_free_block (ShmAllocSpace * self, int fl, int sl)
+{
+  unsigned long sl_map = self->sl_bitmap[fl] & (~0UL << sl);
+
+  if (sl_map == 0) {
+    unsigned long fl_map = 0;
+
+    if (fl + 1 < FL_COUNT)
+      fl_map = self->fl_bitmap & (~0UL << (fl + 1));
+    if (fl_map == 0)
+      return NULL;
+
+    fl = ffs_ulong (fl_map);
+    sl_map = self->sl_bitmap[fl];
+  }
+
+  return self->free_lists[fl][ffs_ulong (sl_map)];
+}
+
+/* Absorbs the block following @block into it, the following block must not
+ * be in a free list */
+static void
+merge_next_block (ShmAllocBlock * block)
+{
+  ShmAllocBlock *next = block->next_phys;
+
+  block->size += next->size;
+  block->next_phys = next->next_phys;
+  if (block->next_phys)
+    block->next_phys->prev_phys = block;
+
+  spalloc_free (ShmAllocBlock, next);
+}
 
 ShmAllocSpace *
 shm_alloc_space_new (size_t size)
 {
   ShmAllocSpace *self = spalloc_new (ShmAllocSpace);
+  ShmAllocBlock *block;
 
   memset (self, 0, sizeof (ShmAllocSpace));
 
   self->size = size;
 
+  self->granule = MIN_GRANULE;
+  while (size / self->granule > MAX_GRANULES)
+    self->granule <<= 1;
+
+  if (size == 0)
+    return self;
+
+  self->n_granules = (size + self->granule - 1) / self->granule;
+  self->used = spalloc_alloc (self->n_granules * sizeof (ShmAllocBlock *));
+  memset (self->used, 0, self->n_granules * sizeof (ShmAllocBlock *));
+
+  /* All the space starts as one free block */
+  block = spalloc_new (ShmAllocBlock);
+  memset (block, 0, sizeof (ShmAllocBlock));
+  block->space = self;
+  block->size = size;
+  insert_free_block (self, block);
+
   return self;
 }
 
 void
 shm_alloc_space_free (ShmAllocSpace * self)
 {
-  assert (self && self->blocks == NULL);
+  int fl, sl;
+
+  assert (self && self->used_blocks == 0);
+
+  for (fl = 0; fl < FL_COUNT; fl++) {
+    for (sl = 0; sl < SL_COUNT; sl++) {
+      ShmAllocBlock *block;
+
+      while ((block = self->free_lists[fl][sl])) {
+        self->free_lists[fl][sl] = block->next_free;
+        spalloc_free (ShmAllocBlock, block);
+      }
+    }
+  }
+
+  if (self->used)
+    spalloc_free1 (self->n_granules * sizeof (ShmAllocBlock *), self->used);
   spalloc_free (ShmAllocSpace, self);
 }
 
@@ -85,42 +296,59 @@ ShmAllocBlock *
 shm_alloc_space_alloc_block (ShmAllocSpace * self, unsigned long size)
 {
   ShmAllocBlock *block;
-  ShmAllocBlock *item = NULL;
-  ShmAllocBlock *prev_item = NULL;
-  unsigned long prev_end_offset = 0;
-
-
-  for (item = self->blocks; item; item = item->next) {
-    unsigned long max_size = 0;
+  unsigned long asize;
+  int fl, sl, i;
 
-    max_size = item->offset - prev_end_offset;
-
-    if (max_size >= size)
-      break;
+  if (size == 0)
+    size = 1;
+  if (size > self->size)
+    return NULL;
 
-    prev_end_offset = item->offset + item->size;
-    prev_item = item;
+  /* Keep the blocks starting on a granule */
+  asize = (size + self->granule - 1) & ~(self->granule - 1);
+
+  mapping_search (asize, &fl, &sl);
+  block = find_free_block (self, fl, sl);
+
+  if (!block) {
+    /* The search above skips the size class of the request itself, in
+     * which some blocks can still be large enough, e.g. the whole space
+     * when it's empty */
+    mapping_insert (size, &fl, &sl);
+    block = self->free_lists[fl][sl];
+    for (i = 0; block && i < FALLBACK_SCAN; i++) {
+      if (block->size >= size)
+        break;
+      block = block->next_free;
+    }
+    if (!block || block->size < size)
+      return NULL;
   }
 
-  /* Return NULL if there is no big enough space, otherwise, there is space
-   * at the end */
-  assert (prev_end_offset <= self->size);
-  if (!item && self->size - prev_end_offset < size)
-    return NULL;
+  remove_free_block (self, block);
+
+  /* Return the remainder to the free lists, the tail of the space is the
+   * only block allowed to end off a granule */
+  if (block->size >= asize + self->granule) {
+    ShmAllocBlock *rest = spalloc_new (ShmAllocBlock);
+
+    memset (rest, 0, sizeof (ShmAllocBlock));
+    rest->space = self;
+    rest->offset = block->offset + asize;
+    rest->size = block->size - asize;
+    rest->prev_phys = block;
+    rest->next_phys = block->next_phys;
+    if (rest->next_phys)
+      rest->next_phys->prev_phys = rest;
+    block->next_phys = rest;
+    block->size = asize;
+    insert_free_block (self, rest);
+  }
 
-  block = spalloc_new (ShmAllocBlock);
-  memset (block, 0, sizeof (ShmAllocBlock));
-  block->offset = prev_end_offset;
-  block->size = size;
   block->use_count = 1;
-  block->space = self;
-
-  if (prev_item)
-    prev_item->next = block;
-  else
-    self->blocks = block;
-
-  block->next = item;
+  self->used[block->offset / self->granule] = block;
+  self->used_size += block->size;
+  self->used_blocks++;
 
   return block;
 }
@@ -134,37 +362,72 @@ shm_alloc_space_alloc_block_get_offset (ShmAllocBlock * block)
 static void
 shm_alloc_space_free_block (ShmAllocBlock * block)
 {
-  ShmAllocBlock *item = NULL;
-  ShmAllocBlock *prev_item = NULL;
   ShmAllocSpace *self = block->space;
 
-  for (item = self->blocks; item; item = item->next) {
-    if (item == block) {
-      if (prev_item)
-        prev_item->next = item->next;
-      else
-        self->blocks = item->next;
-      break;
-    }
-    prev_item = item;
+  self->used[block->offset / self->granule] = NULL;
+  self->used_size -= block->size;
+  self->used_blocks--;
+
+  if (block->next_phys && block->next_phys->is_free) {
+    remove_free_block (self, block->next_phys);
+    merge_next_block (block);
+  }
+  if (block->prev_phys && block->prev_phys->is_free) {
+    block = block->prev_phys;
+    remove_free_block (self, block);
+    merge_next_block (block);
   }
 
-  spalloc_free (ShmAllocBlock, block);
+  insert_free_block (self, block);
 }
 
 ShmAllocBlock *
 shm_alloc_space_block_get (ShmAllocSpace * self, unsigned long offset)
 {
-  ShmAllocBlock *block = NULL;
+  ShmAllocBlock *block;
+  unsigned long i;
+
+  if (offset >= self->size)
+    return NULL;
 
-  for (block = self->blocks; block; block = block->next) {
-    if (block->offset <= offset && (block->offset + block->size) > offset)
-      return block;
+  /* Look for the closest block starting before the offset, usually in the
+   * same granule as the buffers sent are at the start of their block */
+  for (i = offset / self->granule + 1; i > 0; i--) {
+    block = self->used[i - 1];
+    if (block)
+      return (block->offset + block->size > offset) ? block : NULL;
   }
 
   return NULL;
 }
 
+void
+shm_alloc_space_get_stats (ShmAllocSpace * self, ShmAllocStats * stats)
+{
+  unsigned long free_size = self->size - self->used_size;
+  unsigned long largest = 0;
+
+  /* The largest free block is in the highest non-empty list */
+  if (self->fl_bitmap) {
+    int fl = fls_ulong (self->fl_bitmap);
+    int sl = fls_ulong (self->sl_bitmap[fl]);
+    ShmAllocBlock *block;
+
+    for (block = self->free_lists[fl][sl]; block; block = block->next_free)
+      if (block->size > largest)
+        largest = block->size;
+  }
+
+  stats->size = self->size;
+  stats->used = self->used_size;
+  stats->free = free_size;
+  stats->largest_free = largest;
+  stats->used_blocks = self->used_blocks;
+  stats->free_blocks = self->free_blocks;
+  stats->fragmentation =
+      free_size ? (unsigned int) ((free_size - largest) * 1000 / free_size) : 0;
+}
+
 
 void
 shm_alloc_space_block_inc (ShmAllocBlock * block)
@@ -53,6 +53,24 @@ extern "C" {
 typedef struct _ShmAllocSpace ShmAllocSpace;
 typedef struct _ShmAllocBlock ShmAllocBlock;
 
+typedef struct
+{
+  /* The total size of the space */
+  unsigned long size;
+  /* The size of the allocated blocks, rounded up to the granule */
+  unsigned long used;
+  /* The free space and the size of its largest contiguous block */
+  unsigned long free;
+  unsigned long largest_free;
+
+  unsigned int used_blocks;
+  unsigned int free_blocks;
+
+  /* Per mille of the free space outside of its largest block, 0 if all
+   * the free space is contiguous */
+  unsigned int fragmentation;
+} ShmAllocStats;
+
 ShmAllocSpace *shm_alloc_space_new (size_t size);
 void shm_alloc_space_free (ShmAllocSpace * self);
 
@@ -66,6 +84,8 @@ void shm_alloc_space_block_dec (ShmAllocBlock * block);
 ShmAllocBlock * shm_alloc_space_block_get (ShmAllocSpace * space,
     unsigned long offset);
 
+void shm_alloc_space_get_stats (ShmAllocSpace * self, ShmAllocStats * stats);
+
 
 #ifdef __cplusplus
 }
@@ -45,6 +45,7 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <sys/mman.h>
+#include <time.h>
 #include <assert.h>
 
 #include "shmalloc.h"
@@ -67,9 +68,21 @@
  * type 4: ack buffer
  * offset
  *
- * Type 4 goes from the client to the server
+ * type 5: fd buffer
+ * offset
+ * bufsize
+ * The area id is the id of the buffer, the file descriptor holding the
+ * data is attached to the packet (SCM_RIGHTS)
+ *
+ * type 6: dmabuf buffer
+ * Same as type 5, the file descriptor is a dmabuf
+ *
+ * type 7: ack fd buffer
+ * The area id is the id of the buffer
+ *
+ * Types 4 and 7 go from the client to the server
  * The rest are from the server to the client
- * The client should never write in the SHM
+ * The client should never write in the SHM, nor in the fd buffers
  */
 
 
@@ -80,7 +93,10 @@ enum
   COMMAND_NEW_SHM_AREA = 1,
   COMMAND_CLOSE_SHM_AREA = 2,
   COMMAND_NEW_BUFFER = 3,
-  COMMAND_ACK_BUFFER = 4
+  COMMAND_ACK_BUFFER = 4,
+  COMMAND_NEW_FD_BUFFER = 5,
+  COMMAND_NEW_DMABUF_BUFFER = 6,
+  COMMAND_ACK_FD_BUFFER = 7
 };
 
 typedef struct _ShmArea ShmArea;
@@ -108,6 +124,8 @@ struct _ShmBuffer
 {
   int use_count;
 
+  /* NULL for buffers sent as a file descriptor, whose offset is then the
+   * id of the buffer */
   ShmArea *shm_area;
   unsigned long offset;
   size_t size;
@@ -118,6 +136,9 @@ struct _ShmBuffer
 
   void *tag;
 
+  /* Monotonic time in microseconds at which the buffer was sent */
+  unsigned long long sent_time;
+
   int num_clients;
   /* This must ALWAYS stay last in the struct */
   int clients[0];
@@ -134,6 +155,7 @@ struct _ShmPipe
   ShmArea *shm_area;
 
   int next_area_id;
+  int next_fd_buffer_id;
 
   ShmBuffer *buffers;
 
@@ -147,6 +169,13 @@ struct _ShmClient
 {
   int fd;
 
+  /* Buffers sent to the client that it has not acked yet */
+  unsigned int pending;
+  unsigned int max_pending;
+
+  /* Do not send the next buffers to this client */
+  int skip;
+
   ShmClient *next;
 };
 
@@ -484,6 +513,53 @@ send_command (int fd, struct CommandBuffer *cb, unsigned short int type,
   return 1;
 }
 
+static unsigned long long
+get_monotonic_time (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+/* Same as send_command(), passing @passed_fd along */
+static int
+send_command_fd (int fd, struct CommandBuffer *cb, unsigned short int type,
+    int area_id, int passed_fd)
+{
+  struct msghdr msg = { 0 };
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union
+  {
+    char buf[CMSG_SPACE (sizeof (int))];
+    struct cmsghdr align;
+  } control;
+
+  cb->type = type;
+  cb->area_id = area_id;
+
+  iov.iov_base = cb;
+  iov.iov_len = sizeof (struct CommandBuffer);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+
+  memset (&control, 0, sizeof (control));
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+  cmsg = CMSG_FIRSTHDR (&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN (sizeof (int));
+  memcpy (CMSG_DATA (cmsg), &passed_fd, sizeof (int));
+
+  if (sendmsg (fd, &msg, MSG_NOSIGNAL) != sizeof (struct CommandBuffer))
+    return 0;
+
+  return 1;
+}
+
 int
 sp_writer_resize (ShmPipe * self, size_t size)
 {
@@ -572,7 +648,16 @@ sp_writer_free_block (ShmBlock * block)
   spalloc_free (ShmBlock, block);
 }
 
-/* Returns the number of client this has successfully been sent to */
+static void
+sp_client_inc_pending (ShmClient * client)
+{
+  client->pending++;
+  if (client->pending > client->max_pending)
+    client->max_pending = client->pending;
+}
+
+/* Returns the number of client this has successfully been sent to, the
+ * clients set to skip buffers are left out */
 
 int
 sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
@@ -611,14 +696,18 @@ sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
   sb->num_clients = self->num_clients;
   sb->ablock = ablock;
   sb->tag = tag;
+  sb->sent_time = get_monotonic_time ();
 
   for (client = self->clients; client; client = client->next) {
     struct CommandBuffer cb = { 0 };
+    if (client->skip)
+      continue;
     cb.payload.buffer.offset = offset;
     cb.payload.buffer.size = bsize;
     if (!send_command (client->fd, &cb, COMMAND_NEW_BUFFER, self->shm_area->id))
       continue;
     sb->clients[i++] = client->fd;
+    sp_client_inc_pending (client);
     c++;
   }
 
@@ -638,31 +727,148 @@ sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void *tag)
   return c;
 }
 
+/* Sends @size bytes at @offset of the memory behind @fd by passing the file
+ * descriptor itself, the data is not copied. The caller must keep the
+ * memory unchanged until the buffer has been acked by all the clients.
+ * Returns the number of clients this has successfully been sent to */
+
+int
+sp_writer_send_fd (ShmPipe * self, int fd, unsigned long offset, size_t size,
+    int is_dmabuf, void *tag)
+{
+  ShmBuffer *sb;
+  ShmClient *client = NULL;
+  int id;
+  int i = 0;
+  int c = 0;
+
+  if (self->num_clients == 0)
+    return 0;
+
+  id = self->next_fd_buffer_id++;
+
+  sb = spalloc_alloc (sizeof (ShmBuffer) + sizeof (int) * self->num_clients);
+  memset (sb, 0, sizeof (ShmBuffer));
+  memset (sb->clients, -1, sizeof (int) * self->num_clients);
+  sb->offset = id;
+  sb->size = size;
+  sb->num_clients = self->num_clients;
+  sb->tag = tag;
+  sb->sent_time = get_monotonic_time ();
+
+  for (client = self->clients; client; client = client->next) {
+    struct CommandBuffer cb = { 0 };
+    if (client->skip)
+      continue;
+    cb.payload.buffer.offset = offset;
+    cb.payload.buffer.size = size;
+    if (!send_command_fd (client->fd, &cb, is_dmabuf ?
+            COMMAND_NEW_DMABUF_BUFFER : COMMAND_NEW_FD_BUFFER, id, fd))
+      continue;
+    sb->clients[i++] = client->fd;
+    sp_client_inc_pending (client);
+    c++;
+  }
+
+  if (c == 0) {
+    spalloc_free1 (sizeof (ShmBuffer) + sizeof (int) * sb->num_clients, sb);
+    return 0;
+  }
+
+  sb->use_count = c;
+
+  sb->next = self->buffers;
+  self->buffers = sb;
+
+  return c;
+}
+
+/* Receives a command and the file descriptor passed along if any, which is
+ * closed if @passed_fd is NULL */
 static int
-recv_command (int fd, struct CommandBuffer *cb)
+recv_command (int fd, struct CommandBuffer *cb, int *passed_fd)
 {
+  struct msghdr msg = { 0 };
+  struct iovec iov;
+  struct cmsghdr *cmsg;
+  union
+  {
+    char buf[CMSG_SPACE (sizeof (int))];
+    struct cmsghdr align;
+  } control;
+  int flags = MSG_DONTWAIT;
   int retval;
 
-  retval = recv (fd, cb, sizeof (struct CommandBuffer), MSG_DONTWAIT);
+#ifdef MSG_CMSG_CLOEXEC
+  flags |= MSG_CMSG_CLOEXEC;
+#endif
+
+  iov.iov_base = cb;
+  iov.iov_len = sizeof (struct CommandBuffer);
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof (control.buf);
+
+  retval = recvmsg (fd, &msg, flags);
+
+  for (cmsg = CMSG_FIRSTHDR (&msg); retval > 0 && cmsg;
+      cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+    int received_fd;
+
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+
+    memcpy (&received_fd, CMSG_DATA (cmsg), sizeof (int));
+    if (passed_fd && *passed_fd < 0)
+      *passed_fd = received_fd;
+    else
+      close (received_fd);
+  }
+
   if (retval == sizeof (struct CommandBuffer)) {
     return 1;
   } else {
+    if (passed_fd && *passed_fd >= 0) {
+      close (*passed_fd);
+      *passed_fd = -1;
+    }
     return 0;
   }
 }
 
 long int
 sp_client_recv (ShmPipe * self, char **buf)
+{
+  return sp_client_recv_fd (self, buf, NULL, NULL, NULL, NULL);
+}
+
+/* Same as sp_client_recv(), also receiving the buffers sent as a file
+ * descriptor. For those, @buf is left untouched and @fd, @offset, @id and
+ * @is_dmabuf are set instead. The caller owns @fd and must release the
+ * buffer with sp_client_recv_finish_fd(). If @fd is NULL, such buffers are
+ * released right away */
+
+long int
+sp_client_recv_fd (ShmPipe * self, char **buf, int *fd, unsigned long *offset,
+    int *id, int *is_dmabuf)
 {
   char *area_name = NULL;
   ShmArea *newarea;
   ShmArea *area;
   struct CommandBuffer cb;
+  int passed_fd = -1;
   int retval;
 
-  if (!recv_command (self->main_socket, &cb))
+  if (!recv_command (self->main_socket, &cb, &passed_fd))
     return -1;
 
+  if (passed_fd >= 0 && cb.type != COMMAND_NEW_FD_BUFFER &&
+      cb.type != COMMAND_NEW_DMABUF_BUFFER) {
+    close (passed_fd);
+    passed_fd = -1;
+  }
+
   switch (cb.type) {
     case COMMAND_NEW_SHM_AREA:
       assert (cb.payload.new_shm_area.path_size > 0);
@@ -708,6 +914,24 @@ sp_client_recv (ShmPipe * self, char **buf)
       }
       return -23;
 
+    case COMMAND_NEW_FD_BUFFER:
+    case COMMAND_NEW_DMABUF_BUFFER:
+      if (passed_fd < 0)
+        return -24;
+
+      if (!fd) {
+        close (passed_fd);
+        if (!sp_client_recv_finish_fd (self, cb.area_id))
+          return -25;
+        break;
+      }
+
+      *fd = passed_fd;
+      *offset = cb.payload.buffer.offset;
+      *id = cb.area_id;
+      *is_dmabuf = (cb.type == COMMAND_NEW_DMABUF_BUFFER);
+      return cb.payload.buffer.size;
+
     default:
       return -99;
   }
@@ -721,20 +945,30 @@ sp_writer_recv (ShmPipe * self, ShmClient * client, void **tag)
   ShmBuffer *buf = NULL, *prev_buf = NULL;
   struct CommandBuffer cb;
 
-  if (!recv_command (client->fd, &cb))
+  if (!recv_command (client->fd, &cb, NULL))
     return -1;
 
   switch (cb.type) {
     case COMMAND_ACK_BUFFER:
 
       for (buf = self->buffers; buf; buf = buf->next) {
-        if (buf->shm_area->id == cb.area_id &&
+        if (buf->shm_area && buf->shm_area->id == cb.area_id &&
             buf->offset == cb.payload.ack_buffer.offset) {
           return sp_shmbuf_dec (self, buf, prev_buf, client, tag);
         }
         prev_buf = buf;
       }
 
+      return -2;
+
+    case COMMAND_ACK_FD_BUFFER:
+
+      for (buf = self->buffers; buf; buf = buf->next) {
+        if (!buf->shm_area && buf->offset == (unsigned long) cb.area_id)
+          return sp_shmbuf_dec (self, buf, prev_buf, client, tag);
+        prev_buf = buf;
+      }
+
       return -2;
     default:
       return -99;
@@ -767,6 +1001,14 @@ sp_client_recv_finish (ShmPipe * self, char *buf)
       self->shm_area->id);
 }
 
+int
+sp_client_recv_finish_fd (ShmPipe * self, int id)
+{
+  struct CommandBuffer cb = { 0 };
+
+  return send_command (self->main_socket, &cb, COMMAND_ACK_FD_BUFFER, id);
+}
+
 ShmPipe *
 sp_client_open (const char *path)
 {
@@ -835,6 +1077,9 @@ sp_writer_accept_client (ShmPipe * self)
 
   client = spalloc_new (ShmClient);
   client->fd = fd;
+  client->pending = 0;
+  client->max_pending = 0;
+  client->skip = 0;
 
   /* Prepend ot linked list */
   client->next = self->clients;
@@ -870,6 +1115,7 @@ sp_shmbuf_dec (ShmPipe * self, ShmBuffer * buf, ShmBuffer * prev_buf,
   }
   assert (had_client);
 
+  client->pending--;
   buf->use_count--;
 
   if (buf->use_count == 0) {
@@ -881,8 +1127,10 @@ sp_shmbuf_dec (ShmPipe * self, ShmBuffer * buf, ShmBuffer * prev_buf,
 
     if (tag)
       *tag = buf->tag;
-    shm_alloc_space_block_dec (buf->ablock);
-    sp_shm_area_dec (self, buf->shm_area);
+    if (buf->shm_area) {
+      shm_alloc_space_block_dec (buf->ablock);
+      sp_shm_area_dec (self, buf->shm_area);
+    }
     spalloc_free1 (sizeof (ShmBuffer) + sizeof (int) * buf->num_clients, buf);
     return 0;
   }
@@ -993,3 +1241,60 @@ sp_writer_get_max_buf_size (ShmPipe * self)
 
   return self->shm_area->shm_area_len;
 }
+
+void
+sp_writer_get_alloc_stats (ShmPipe * self, ShmAllocStats * stats)
+{
+  memset (stats, 0, sizeof (ShmAllocStats));
+
+  if (self->shm_area && self->shm_area->allocspace)
+    shm_alloc_space_get_stats (self->shm_area->allocspace, stats);
+}
+
+void
+sp_writer_client_set_skip (ShmClient * client, int skip)
+{
+  client->skip = skip;
+}
+
+unsigned int
+sp_writer_client_get_pending (ShmClient * client)
+{
+  return client->pending;
+}
+
+int
+sp_writer_buf_has_client (ShmBuffer * buffer, ShmClient * client)
+{
+  int i;
+
+  for (i = 0; i < buffer->num_clients; i++)
+    if (buffer->clients[i] == client->fd)
+      return 1;
+
+  return 0;
+}
+
+void
+sp_writer_get_client_stats (ShmPipe * self, ShmClient * client,
+    ShmClientStats * stats)
+{
+  ShmBuffer *buf;
+  unsigned long long now, oldest = 0;
+
+  stats->pending = client->pending;
+  stats->max_pending = client->max_pending;
+  stats->lag = 0;
+
+  if (client->pending == 0)
+    return;
+
+  /* The list starts with the most recent buffer */
+  for (buf = self->buffers; buf; buf = buf->next)
+    if (sp_writer_buf_has_client (buf, client))
+      oldest = buf->sent_time;
+
+  now = get_monotonic_time ();
+  if (oldest && now > oldest)
+    stats->lag = now - oldest;
+}
@@ -68,6 +68,8 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 
+#include "shmalloc.h"
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -80,6 +82,18 @@ typedef struct _ShmBuffer ShmBuffer;
 
 typedef void (*sp_buffer_free_callback) (void * tag, void * user_data);
 
+typedef struct
+{
+  /* The buffers sent to the client that it has not acked yet and the
+   * highest number of them so far */
+  unsigned int pending;
+  unsigned int max_pending;
+
+  /* Time in microseconds since the oldest pending buffer was sent, 0 if
+   * there is none */
+  unsigned long long lag;
+} ShmClientStats;
+
 ShmPipe *sp_writer_create (const char *path, size_t size, mode_t perms);
 const char *sp_writer_get_path (ShmPipe *pipe);
 void sp_writer_close (ShmPipe * self, sp_buffer_free_callback callback,
@@ -97,13 +111,20 @@ int sp_writer_get_client_fd (ShmClient * client);
 ShmBlock *sp_writer_alloc_block (ShmPipe * self, size_t size);
 void sp_writer_free_block (ShmBlock *block);
 int sp_writer_send_buf (ShmPipe * self, char *buf, size_t size, void * tag);
+int sp_writer_send_fd (ShmPipe * self, int fd, unsigned long offset,
+    size_t size, int is_dmabuf, void * tag);
 char *sp_writer_block_get_buf (ShmBlock *block);
 ShmPipe *sp_writer_block_get_pipe (ShmBlock *block);
 size_t sp_writer_get_max_buf_size (ShmPipe * self);
+void sp_writer_get_alloc_stats (ShmPipe * self, ShmAllocStats * stats);
 
 ShmClient * sp_writer_accept_client (ShmPipe * self);
 void sp_writer_close_client (ShmPipe *self, ShmClient * client,
     sp_buffer_free_callback callback, void * user_data);
+void sp_writer_client_set_skip (ShmClient * client, int skip);
+unsigned int sp_writer_client_get_pending (ShmClient * client);
+void sp_writer_get_client_stats (ShmPipe * self, ShmClient * client,
+    ShmClientStats * stats);
 int sp_writer_recv (ShmPipe * self, ShmClient * client, void ** tag);
 
 int sp_writer_pending_writes (ShmPipe * self);
@@ -111,10 +132,14 @@ int sp_writer_pending_writes (ShmPipe * self);
 ShmBuffer *sp_writer_get_pending_buffers (ShmPipe * self);
 ShmBuffer *sp_writer_get_next_buffer (ShmBuffer * buffer);
 void *sp_writer_buf_get_tag (ShmBuffer * buffer);
+int sp_writer_buf_has_client (ShmBuffer * buffer, ShmClient * client);
 
 ShmPipe *sp_client_open (const char *path);
 long int sp_client_recv (ShmPipe * self, char **buf);
+long int sp_client_recv_fd (ShmPipe * self, char **buf, int *fd,
+    unsigned long *offset, int *id, int *is_dmabuf);
 int sp_client_recv_finish (ShmPipe * self, char *buf);
+int sp_client_recv_finish_fd (ShmPipe * self, int id);
 void sp_client_close (ShmPipe * self);
 
 #ifdef __cplusplus
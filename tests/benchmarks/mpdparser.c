@@ -0,0 +1,253 @@
+/* GStreamer
+ *
+ * mpdparser.c: benchmark for parsing and refreshing live DASH manifests
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Usage: mpdparser [N-PERIODS [N-SEGMENTS]]
+ *
+ * Generates a live MPD with N-PERIODS Periods (default 4), each with a
+ * SegmentTimeline of N-SEGMENTS S elements (default 20000) that can't be
+ * folded into repeat counts. Reports the time and the peak amount of memory
+ * allocated by libxml2 for:
+ *
+ *  - tree:   building the libxml2 tree of the whole document, for reference
+ *  - parse:  parsing the MPD from scratch
+ *  - update: parsing the next version of the MPD, where only the last Period
+ *            got new segments, as a refresh of the previous one */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../../ext/dash/gstmpdclient.c"
+#undef GST_CAT_DEFAULT
+
+GST_DEBUG_CATEGORY (gst_dash_demux_debug);
+
+#define NUM_RUNS 5
+
+/* libxml2 allocations are prefixed with their size so that the amount of
+ * memory in use can be tracked */
+#define HEADER_SIZE 16
+
+static gsize xml_mem_current, xml_mem_peak;
+
+static void *
+xml_malloc (size_t size)
+{
+  guint8 *mem = malloc (size + HEADER_SIZE);
+
+  if (mem == NULL)
+    return NULL;
+
+  *(gsize *) mem = size;
+  xml_mem_current += size;
+  xml_mem_peak = MAX (xml_mem_peak, xml_mem_current);
+
+  return mem + HEADER_SIZE;
+}
+
+static void
+xml_free (void *ptr)
+{
+  guint8 *mem;
+
+  if (ptr == NULL)
+    return;
+
+  mem = (guint8 *) ptr - HEADER_SIZE;
+  xml_mem_current -= *(gsize *) mem;
+  free (mem);
+}
+
+static void *
+xml_realloc (void *ptr, size_t size)
+{
+  guint8 *mem;
+  gsize old_size;
+
+  if (ptr == NULL)
+    return xml_malloc (size);
+
+  mem = (guint8 *) ptr - HEADER_SIZE;
+  old_size = *(gsize *) mem;
+  mem = realloc (mem, size + HEADER_SIZE);
+  if (mem == NULL)
+    return NULL;
+
+  *(gsize *) mem = size;
+  xml_mem_current = xml_mem_current - old_size + size;
+  xml_mem_peak = MAX (xml_mem_peak, xml_mem_current);
+
+  return mem + HEADER_SIZE;
+}
+
+static char *
+xml_strdup (const char *str)
+{
+  gsize len = strlen (str) + 1;
+  char *copy = xml_malloc (len);
+
+  if (copy)
+    memcpy (copy, str, len);
+
+  return copy;
+}
+
+static gchar *
+generate_mpd (guint n_periods, guint n_segments, guint n_new_segments)
+{
+  GString *mpd = g_string_new (NULL);
+  guint p, i;
+
+  g_string_append (mpd, "<?xml version=\"1.0\"?>\n"
+      "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\" type=\"dynamic\"\n"
+      "     profiles=\"urn:mpeg:dash:profile:isoff-live:2011\"\n"
+      "     availabilityStartTime=\"2020-01-01T00:00:00Z\"\n"
+      "     minimumUpdatePeriod=\"PT2S\" timeShiftBufferDepth=\"PT1H\">\n"
+      "  <BaseURL>http://example.com/live/</BaseURL>\n");
+
+  for (p = 0; p < n_periods; p++) {
+    guint n = n_segments;
+
+    if (p == n_periods - 1)
+      n += n_new_segments;
+
+    /* segments are 2s on average */
+    g_string_append_printf (mpd, "  <Period id=\"p%u\" start=\"PT%uS\">\n"
+        "    <AdaptationSet mimeType=\"video/mp4\" segmentAlignment=\"true\">\n"
+        "      <SegmentTemplate timescale=\"1000\" media=\"$Time$.m4s\"\n"
+        "          initialization=\"init-$RepresentationID$.mp4\">\n"
+        "        <SegmentTimeline>\n"
+        "          <S t=\"0\" d=\"2000\"/>\n", p, p * n_segments * 2);
+    /* alternating durations, so no S can use a repeat count */
+    for (i = 1; i < n; i++)
+      g_string_append_printf (mpd, "          <S d=\"%u\"/>\n",
+          i % 2 ? 1999 : 2001);
+    g_string_append (mpd, "        </SegmentTimeline>\n"
+        "      </SegmentTemplate>\n"
+        "      <Representation id=\"v0\" bandwidth=\"800000\"/>\n"
+        "      <Representation id=\"v1\" bandwidth=\"2400000\"/>\n"
+        "      <Representation id=\"v2\" bandwidth=\"6000000\"/>\n"
+        "    </AdaptationSet>\n" "  </Period>\n");
+  }
+  g_string_append (mpd, "</MPD>\n");
+
+  return g_string_free (mpd, FALSE);
+}
+
+static void
+report (const gchar * name, GstClockTime best, gsize peak)
+{
+  g_print ("  %-8s %10.3f ms %10" G_GSIZE_FORMAT " kB peak\n", name,
+      (gdouble) best / GST_MSECOND, peak / 1024);
+}
+
+static void
+benchmark_tree (const gchar * mpd)
+{
+  GstClockTime start, best = GST_CLOCK_TIME_NONE;
+  gsize base, peak = 0;
+  gint i;
+
+  for (i = 0; i < NUM_RUNS; i++) {
+    xmlDocPtr doc;
+
+    base = xml_mem_peak = xml_mem_current;
+    start = gst_util_get_timestamp ();
+    doc = xmlReadMemory (mpd, strlen (mpd), "noname.xml", NULL,
+        XML_PARSE_NONET);
+    xmlFreeDoc (doc);
+    best = MIN (best, gst_util_get_timestamp () - start);
+    peak = xml_mem_peak - base;
+  }
+
+  report ("tree", best, peak);
+}
+
+static gboolean
+benchmark_parse (const gchar * name, GstMPDClient * previous,
+    const gchar * mpd)
+{
+  GstClockTime start, best = GST_CLOCK_TIME_NONE;
+  gsize base, peak = 0;
+  gint i;
+
+  for (i = 0; i < NUM_RUNS; i++) {
+    GstMPDClient *client = gst_mpd_client_new ();
+    gboolean ret;
+
+    base = xml_mem_peak = xml_mem_current;
+    start = gst_util_get_timestamp ();
+    ret = gst_mpd_client_parse_update (client, previous, mpd, strlen (mpd));
+    best = MIN (best, gst_util_get_timestamp () - start);
+    peak = xml_mem_peak - base;
+    gst_mpd_client_free (client);
+
+    if (!ret) {
+      g_printerr ("Could not parse the MPD\n");
+      return FALSE;
+    }
+  }
+
+  report (name, best, peak);
+  return TRUE;
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+  GstMPDClient *previous;
+  gchar *mpd, *updated_mpd;
+  guint n_periods = 4, n_segments = 20000;
+
+  /* must be set before libxml2 allocates anything */
+  xmlMemSetup (xml_free, xml_malloc, xml_realloc, xml_strdup);
+
+  gst_init (&argc, &argv);
+  GST_DEBUG_CATEGORY_INIT (gst_dash_demux_debug, "dashdemux", 0,
+      "DASH demuxer");
+
+  if (argc > 1)
+    n_periods = MAX (atoi (argv[1]), 1);
+  if (argc > 2)
+    n_segments = MAX (atoi (argv[2]), 1);
+
+  mpd = generate_mpd (n_periods, n_segments, 0);
+  updated_mpd = generate_mpd (n_periods, n_segments, 1);
+
+  g_print ("%u Periods of %u segments (%" G_GSIZE_FORMAT " bytes)\n",
+      n_periods, n_segments, strlen (mpd));
+
+  benchmark_tree (mpd);
+
+  if (benchmark_parse ("parse", NULL, mpd)) {
+    previous = gst_mpd_client_new ();
+    gst_mpd_client_parse (previous, mpd, strlen (mpd));
+    benchmark_parse ("update", previous, updated_mpd);
+    gst_mpd_client_free (previous);
+  }
+
+  g_free (updated_mpd);
+  g_free (mpd);
+
+  return 0;
+}
@@ -0,0 +1,220 @@
+/* GStreamer
+ *
+ * nalscan.c: benchmark for the Annex B start code and emulation prevention
+ *            byte scanners
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Usage: nalscan [FILE.h264|FILE.h265 ...]
+ *
+ * Without arguments a synthetic Annex B stream is scanned, otherwise each
+ * file is loaded in memory and scanned as is. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <gst/base/gstbytereader.h>
+#include <gst/codecparsers/gsth264parser.h>
+#include <gst/codecparsers/scanutils.h>
+
+#define SYNTHETIC_SIZE (64 * 1024 * 1024)
+#define NUM_RUNS 10
+
+typedef guint (*ScanLoopFunc) (const guint8 * data, gsize size);
+
+/* the byte reader based scanner the parsers used before */
+static guint
+scan_loop_bytereader (const guint8 * data, gsize size)
+{
+  GstByteReader br;
+  guint count = 0;
+  guint offset = 0;
+
+  gst_byte_reader_init (&br, data, size);
+
+  while (offset + 4 <= size) {
+    gint off = gst_byte_reader_masked_scan_uint32 (&br, 0xffffff00,
+        0x00000100, offset, size - offset);
+
+    if (off < 0)
+      break;
+    count++;
+    offset = off + 3;
+  }
+
+  return count;
+}
+
+static guint
+scan_loop_start_codes (const guint8 * data, gsize size)
+{
+  guint count = 0;
+  gsize offset = 0;
+
+  while (offset < size) {
+    gint off = scan_for_start_code_prefix (data + offset, size - offset);
+
+    if (off < 0)
+      break;
+    count++;
+    offset += off + 3;
+  }
+
+  return count;
+}
+
+static guint
+scan_loop_epb (const guint8 * data, gsize size)
+{
+  guint count = 0;
+  gsize offset = 0;
+
+  while (offset < size) {
+    gint off = scan_for_emulation_prevention (data + offset, size - offset);
+
+    if (off < 0)
+      break;
+    count++;
+    offset += off + 3;
+  }
+
+  return count;
+}
+
+static guint
+scan_loop_h264_identify_nalu (const guint8 * data, gsize size)
+{
+  GstH264NalParser *parser = gst_h264_nal_parser_new ();
+  GstH264NalUnit nalu;
+  guint count = 0;
+  guint offset = 0;
+
+  while (gst_h264_parser_identify_nalu (parser, data, offset, size,
+          &nalu) == GST_H264_PARSER_OK) {
+    count++;
+    offset = nalu.offset + nalu.size;
+  }
+
+  gst_h264_nal_parser_free (parser);
+
+  return count;
+}
+
+static void
+run (const gchar * name, ScanLoopFunc func, const guint8 * data, gsize size)
+{
+  GstClockTime start, elapsed;
+  guint count = 0;
+  gint i;
+
+  start = gst_util_get_timestamp ();
+  for (i = 0; i < NUM_RUNS; i++)
+    count = func (data, size);
+  elapsed = gst_util_get_timestamp () - start;
+
+  g_print ("  %-24s %8u matches  %7.2f GB/s\n", name, count,
+      ((gdouble) size * NUM_RUNS) / elapsed);
+}
+
+static void
+benchmark (const gchar * title, const guint8 * data, gsize size)
+{
+  g_print ("%s (%" G_GSIZE_FORMAT " bytes, %s kernel)\n", title, size,
+      scan_utils_get_kernel_name ());
+
+  run ("bytereader", scan_loop_bytereader, data, size);
+  run ("start codes", scan_loop_start_codes, data, size);
+  run ("emulation prevention", scan_loop_epb, data, size);
+  run ("h264 identify_nalu", scan_loop_h264_identify_nalu, data, size);
+}
+
+/* Random slice-sized NAL units with the usual emulation prevention applied,
+ * this is about what a high bitrate stream looks like to the scanner */
+static guint8 *
+make_synthetic_stream (gsize size)
+{
+  GRand *rand = g_rand_new_with_seed (42);
+  guint8 *data = g_malloc (size);
+  gsize i = 0;
+
+  while (i < size) {
+    gsize nal_end = MIN (size, i + g_rand_int_range (rand, 1024, 64 * 1024));
+    guint zeros = 0;
+
+    if (i + 5 < nal_end) {
+      data[i++] = 0x00;
+      data[i++] = 0x00;
+      data[i++] = 0x01;
+      data[i++] = 0x01;
+    }
+
+    while (i < nal_end) {
+      guint8 b = g_rand_int (rand) & 0xff;
+
+      /* make zero bytes a lot more common than in random data */
+      if (b < 0x20)
+        b = 0x00;
+
+      if (zeros >= 2 && b <= 0x03) {
+        data[i++] = 0x03;
+        zeros = 0;
+        continue;
+      }
+
+      zeros = b ? 0 : zeros + 1;
+      data[i++] = b;
+    }
+  }
+
+  g_rand_free (rand);
+
+  return data;
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+  gint i;
+
+  gst_init (&argc, &argv);
+
+  if (argc < 2) {
+    guint8 *data = make_synthetic_stream (SYNTHETIC_SIZE);
+
+    benchmark ("synthetic", data, SYNTHETIC_SIZE);
+    g_free (data);
+  }
+
+  for (i = 1; i < argc; i++) {
+    GError *err = NULL;
+    gchar *data;
+    gsize size;
+
+    if (!g_file_get_contents (argv[i], &data, &size, &err)) {
+      g_printerr ("Could not read %s: %s\n", argv[i], err->message);
+      g_clear_error (&err);
+      continue;
+    }
+
+    benchmark (argv[i], (const guint8 *) data, size);
+    g_free (data);
+  }
+
+  return 0;
+}
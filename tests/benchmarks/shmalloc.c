@@ -0,0 +1,359 @@
+/* GStreamer
+ *
+ * shmalloc.c: stress benchmark for the shm area allocator
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Usage: shmalloc [N-CLIENTS [AREA-MB [N-FRAMES]]]
+ *
+ * Simulates shmsink sending 4K NV12 frames, each followed by a small
+ * buffer of a few kB (e.g. audio or metadata), to N-CLIENTS clients
+ * (default 4) through a shm area of AREA-MB megabytes (default 256). Every
+ * client holds on to each buffer for a random number of frame periods,
+ * the first client releasing them right away and the last one being the
+ * slowest. When the area is full the sender waits for the next release,
+ * like shmsink does.
+ *
+ * The run is done with the shm allocator and, for reference, with a
+ * first-fit allocator walking the list of allocated blocks, which is
+ * what the shm area used before. Reports the average and worst time of
+ * an allocation and of a release, the number of times the sender had
+ * to wait and the fragmentation of the area. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gst/gst.h>
+
+#include "../../sys/shm/shmalloc.h"
+
+#define FRAME_SIZE (3840 * 2160 * 3 / 2)
+#define MIN_SMALL_SIZE 1024
+#define MAX_SMALL_SIZE 8192
+
+/* Frame periods the slowest client holds a buffer for, at most */
+#define MAX_HOLD 32
+
+typedef struct
+{
+  const gchar *name;
+
+  gpointer (*space_new) (gsize size);
+  void (*space_free) (gpointer space);
+  gpointer (*alloc) (gpointer space, gsize size);
+  void (*inc) (gpointer block);
+  void (*dec) (gpointer block);
+} Allocator;
+
+typedef struct
+{
+  GstClockTime alloc_time, alloc_max;
+  GstClockTime free_time, free_max;
+  guint64 n_allocs, n_frees;
+  guint64 n_waits;
+  guint64 fragmentation_sum, n_samples;
+  guint fragmentation_max;
+} Results;
+
+/* First-fit allocator on a list of the allocated blocks sorted by offset */
+typedef struct _FirstFitBlock FirstFitBlock;
+
+typedef struct
+{
+  gsize size;
+  FirstFitBlock *blocks;
+} FirstFitSpace;
+
+struct _FirstFitBlock
+{
+  gint use_count;
+  FirstFitSpace *space;
+  gsize offset;
+  gsize size;
+  FirstFitBlock *next;
+};
+
+static gpointer
+first_fit_space_new (gsize size)
+{
+  FirstFitSpace *space = g_new0 (FirstFitSpace, 1);
+
+  space->size = size;
+
+  return space;
+}
+
+static void
+first_fit_space_free (gpointer space)
+{
+  g_free (space);
+}
+
+static gpointer
+first_fit_alloc (gpointer data, gsize size)
+{
+  FirstFitSpace *space = data;
+  FirstFitBlock *item, *prev = NULL, *block;
+  gsize prev_end = 0;
+
+  for (item = space->blocks; item; item = item->next) {
+    if (item->offset - prev_end >= size)
+      break;
+    prev_end = item->offset + item->size;
+    prev = item;
+  }
+
+  if (!item && space->size - prev_end < size)
+    return NULL;
+
+  block = g_new0 (FirstFitBlock, 1);
+  block->use_count = 1;
+  block->space = space;
+  block->offset = prev_end;
+  block->size = size;
+  block->next = item;
+  if (prev)
+    prev->next = block;
+  else
+    space->blocks = block;
+
+  return block;
+}
+
+static void
+first_fit_inc (gpointer data)
+{
+  FirstFitBlock *block = data;
+
+  block->use_count++;
+}
+
+static void
+first_fit_dec (gpointer data)
+{
+  FirstFitBlock *block = data;
+  FirstFitBlock **item;
+
+  if (--block->use_count > 0)
+    return;
+
+  for (item = &block->space->blocks; *item != block; item = &(*item)->next);
+  *item = block->next;
+  g_free (block);
+}
+
+static guint
+first_fit_fragmentation (FirstFitSpace * space)
+{
+  FirstFitBlock *item;
+  gsize prev_end = 0, free_size = 0, largest = 0, gap;
+
+  for (item = space->blocks;; item = item->next) {
+    gap = (item ? item->offset : space->size) - prev_end;
+    free_size += gap;
+    largest = MAX (largest, gap);
+    if (!item)
+      break;
+    prev_end = item->offset + item->size;
+  }
+
+  return free_size ? (free_size - largest) * 1000 / free_size : 0;
+}
+
+/* Wrappers for the shm allocator */
+static gpointer
+shm_space_new (gsize size)
+{
+  return shm_alloc_space_new (size);
+}
+
+static void
+shm_space_free (gpointer space)
+{
+  shm_alloc_space_free (space);
+}
+
+static gpointer
+shm_alloc (gpointer space, gsize size)
+{
+  return shm_alloc_space_alloc_block (space, size);
+}
+
+static void
+shm_inc (gpointer block)
+{
+  shm_alloc_space_block_inc (block);
+}
+
+static void
+shm_dec (gpointer block)
+{
+  shm_alloc_space_block_dec (block);
+}
+
+static const Allocator allocators[] = {
+  {"shm", shm_space_new, shm_space_free, shm_alloc, shm_inc, shm_dec},
+  {"first-fit", first_fit_space_new, first_fit_space_free, first_fit_alloc,
+      first_fit_inc, first_fit_dec},
+};
+
+/* Releases of the clients, by frame period modulo MAX_HOLD + 1 */
+static GPtrArray *releases[MAX_HOLD + 1];
+
+static void
+release_period (const Allocator * allocator, guint period, Results * results)
+{
+  GPtrArray *blocks = releases[period % G_N_ELEMENTS (releases)];
+  GstClockTime start, elapsed;
+  guint i;
+
+  for (i = 0; i < blocks->len; i++) {
+    start = gst_util_get_timestamp ();
+    allocator->dec (g_ptr_array_index (blocks, i));
+    elapsed = gst_util_get_timestamp () - start;
+
+    results->free_time += elapsed;
+    results->free_max = MAX (results->free_max, elapsed);
+    results->n_frees++;
+  }
+  g_ptr_array_set_size (blocks, 0);
+}
+
+/* Allocates a block and sends it to all the clients, waiting for releases
+ * if the area is full */
+static void
+send_buffer (const Allocator * allocator, gpointer space, gsize size,
+    guint n_clients, GRand * rand, guint * period, Results * results)
+{
+  GstClockTime start, elapsed;
+  gpointer block;
+  guint i;
+
+  for (;;) {
+    start = gst_util_get_timestamp ();
+    block = allocator->alloc (space, size);
+    elapsed = gst_util_get_timestamp () - start;
+
+    results->alloc_time += elapsed;
+    results->alloc_max = MAX (results->alloc_max, elapsed);
+    results->n_allocs++;
+
+    if (block)
+      break;
+
+    results->n_waits++;
+    release_period (allocator, ++(*period), results);
+  }
+
+  for (i = 0; i < n_clients; i++) {
+    guint max_hold = 1 + i * (MAX_HOLD - 1) / MAX (n_clients - 1, 1);
+    guint hold = i == 0 ? 1 : g_rand_int_range (rand, 1, max_hold + 1);
+
+    allocator->inc (block);
+    g_ptr_array_add (releases[(*period + hold) % G_N_ELEMENTS (releases)],
+        block);
+  }
+
+  /* the sender is done with it once it has been sent */
+  allocator->dec (block);
+}
+
+static void
+run (const Allocator * allocator, gsize area_size, guint n_clients,
+    guint n_frames)
+{
+  Results results = { 0, };
+  gpointer space;
+  GRand *rand;
+  guint period = 0, frame, i;
+
+  rand = g_rand_new_with_seed (42);
+  space = allocator->space_new (area_size);
+
+  for (frame = 0; frame < n_frames; frame++) {
+    guint fragmentation;
+
+    send_buffer (allocator, space, FRAME_SIZE, n_clients, rand, &period,
+        &results);
+    send_buffer (allocator, space, g_rand_int_range (rand, MIN_SMALL_SIZE,
+            MAX_SMALL_SIZE + 1), n_clients, rand, &period, &results);
+
+    if (allocator->space_new == shm_space_new) {
+      ShmAllocStats stats;
+
+      shm_alloc_space_get_stats (space, &stats);
+      fragmentation = stats.fragmentation;
+    } else {
+      fragmentation = first_fit_fragmentation (space);
+    }
+    results.fragmentation_sum += fragmentation;
+    results.fragmentation_max = MAX (results.fragmentation_max, fragmentation);
+    results.n_samples++;
+
+    release_period (allocator, ++period, &results);
+  }
+
+  for (i = 0; i <= MAX_HOLD; i++)
+    release_period (allocator, ++period, &results);
+
+  allocator->space_free (space);
+  g_rand_free (rand);
+
+  g_print ("  %-10s alloc %8.1f ns avg %8.1f us max, "
+      "free %8.1f ns avg %8.1f us max, %6" G_GUINT64_FORMAT " waits, "
+      "fragmentation %5.1f%% avg %5.1f%% max\n", allocator->name,
+      (gdouble) results.alloc_time / results.n_allocs,
+      (gdouble) results.alloc_max / GST_USECOND,
+      (gdouble) results.free_time / results.n_frees,
+      (gdouble) results.free_max / GST_USECOND, results.n_waits,
+      results.fragmentation_sum / (gdouble) results.n_samples / 10.0,
+      results.fragmentation_max / 10.0);
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+  guint n_clients = 4, area_mb = 256, n_frames = 20000;
+  guint i;
+
+  gst_init (&argc, &argv);
+
+  if (argc > 1)
+    n_clients = MAX (atoi (argv[1]), 1);
+  if (argc > 2)
+    area_mb = MAX (atoi (argv[2]), FRAME_SIZE / (1024 * 1024) + 1);
+  if (argc > 3)
+    n_frames = MAX (atoi (argv[3]), 1);
+
+  for (i = 0; i < G_N_ELEMENTS (releases); i++)
+    releases[i] = g_ptr_array_new ();
+
+  g_print ("%u clients, %u MB area, %u frames\n", n_clients, area_mb,
+      n_frames);
+
+  for (i = 0; i < G_N_ELEMENTS (allocators); i++)
+    run (&allocators[i], (gsize) area_mb * 1024 * 1024, n_clients, n_frames);
+
+  for (i = 0; i < G_N_ELEMENTS (releases); i++)
+    g_ptr_array_free (releases[i], TRUE);
+
+  return 0;
+}
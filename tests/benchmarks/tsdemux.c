@@ -0,0 +1,148 @@
+/* GStreamer
+ *
+ * tsdemux.c: benchmark for MPEG-TS packet parsing and demuxing
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Usage: tsdemux FILE.ts [PROGRAM-NUMBER]
+ *
+ * Pushes a recorded transport stream through tsparse and tsdemux as fast as
+ * possible and reports the number of 188 bytes packets handled per second.
+ * If a program number is given, tsdemux only outputs that program. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+
+#define NUM_RUNS 5
+
+static void
+on_pad_added (GstElement * demux, GstPad * pad, GstBin * bin)
+{
+  GstElement *sink = gst_element_factory_make ("fakesink", NULL);
+  GstPad *sinkpad;
+
+  g_object_set (sink, "sync", FALSE, "async", FALSE, NULL);
+  gst_bin_add (bin, sink);
+  gst_element_sync_state_with_parent (sink);
+
+  sinkpad = gst_element_get_static_pad (sink, "sink");
+  gst_pad_link (pad, sinkpad);
+  gst_object_unref (sinkpad);
+}
+
+static gboolean
+run_pipeline (const gchar * desc, GstClockTime * elapsed)
+{
+  GError *err = NULL;
+  GstElement *pipeline, *demux;
+  GstMessage *msg;
+  GstClockTime start;
+  gboolean ret;
+
+  pipeline = gst_parse_launch (desc, &err);
+  if (!pipeline) {
+    g_printerr ("Could not create pipeline: %s\n", err->message);
+    g_clear_error (&err);
+    return FALSE;
+  }
+
+  demux = gst_bin_get_by_name (GST_BIN (pipeline), "demux");
+  if (demux) {
+    g_signal_connect (demux, "pad-added", G_CALLBACK (on_pad_added),
+        pipeline);
+    gst_object_unref (demux);
+  }
+
+  start = gst_util_get_timestamp ();
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  msg = gst_bus_timed_pop_filtered (GST_ELEMENT_BUS (pipeline),
+      GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  *elapsed = gst_util_get_timestamp () - start;
+
+  ret = GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS;
+  if (!ret) {
+    gst_message_parse_error (msg, &err, NULL);
+    g_printerr ("Error: %s\n", err->message);
+    g_clear_error (&err);
+  }
+
+  gst_message_unref (msg);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  return ret;
+}
+
+static void
+benchmark (const gchar * name, const gchar * desc, guint64 n_packets)
+{
+  GstClockTime elapsed, best = GST_CLOCK_TIME_NONE;
+  gint i;
+
+  for (i = 0; i < NUM_RUNS; i++) {
+    if (!run_pipeline (desc, &elapsed))
+      return;
+    best = MIN (best, elapsed);
+  }
+
+  g_print ("  %-10s %10.0f packets/s  (%" GST_TIME_FORMAT ")\n", name,
+      (gdouble) n_packets * GST_SECOND / best, GST_TIME_ARGS (best));
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+  GStatBuf st;
+  gchar *desc, *demux_opts;
+  guint64 n_packets;
+
+  gst_init (&argc, &argv);
+
+  if (argc < 2) {
+    g_printerr ("Usage: %s FILE.ts [PROGRAM-NUMBER]\n", argv[0]);
+    return 1;
+  }
+
+  if (g_stat (argv[1], &st) < 0) {
+    g_printerr ("Could not stat %s\n", argv[1]);
+    return 1;
+  }
+  n_packets = st.st_size / 188;
+
+  demux_opts = argc > 2 ? g_strdup_printf ("program-number=%s", argv[2]) :
+      g_strdup ("");
+
+  g_print ("%s (%" G_GUINT64_FORMAT " packets)\n", argv[1], n_packets);
+
+  desc = g_strdup_printf ("filesrc location=\"%s\" blocksize=65424 ! "
+      "tsparse set-timestamps=false ! fakesink sync=false", argv[1]);
+  benchmark ("tsparse", desc, n_packets);
+  g_free (desc);
+
+  desc = g_strdup_printf ("filesrc location=\"%s\" blocksize=65424 ! "
+      "tsdemux name=demux %s", argv[1], demux_opts);
+  benchmark ("tsdemux", desc, n_packets);
+  g_free (desc);
+
+  g_free (demux_opts);
+
+  return 0;
+}
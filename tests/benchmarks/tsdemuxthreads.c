@@ -0,0 +1,163 @@
+/* GStreamer
+ *
+ * tsdemuxthreads.c: benchmark for the output threads of tsdemux
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Usage: tsdemuxthreads FILE.ts [MAX-THREADS] [WORK-US]
+ *
+ * Demuxes a recorded transport stream with tsdemux using 0 (the streaming
+ * thread only), 1, 2, 4, ... up to MAX-THREADS output threads, and reports
+ * the throughput for each. Every output buffer costs WORK-US microseconds of
+ * CPU time in its sink, standing in for the parsers and decoders that
+ * normally run downstream of each pad. Only files with several elementary
+ * streams in the demuxed program can scale. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <gst/gst.h>
+#include <glib/gstdio.h>
+
+#define NUM_RUNS 3
+#define DEFAULT_MAX_THREADS 8
+#define DEFAULT_WORK_US 200
+
+static gint64 work_us = DEFAULT_WORK_US;
+
+static void
+on_handoff (GstElement * sink, GstBuffer * buf, GstPad * pad, gpointer data)
+{
+  gint64 end = g_get_monotonic_time () + work_us;
+
+  /* busy loop, sleeping wouldn't keep a core busy */
+  while (g_get_monotonic_time () < end);
+}
+
+static void
+on_pad_added (GstElement * demux, GstPad * pad, GstBin * bin)
+{
+  GstElement *sink = gst_element_factory_make ("fakesink", NULL);
+  GstPad *sinkpad;
+
+  g_object_set (sink, "sync", FALSE, "async", FALSE, "signal-handoffs", TRUE,
+      NULL);
+  g_signal_connect (sink, "handoff", G_CALLBACK (on_handoff), NULL);
+  gst_bin_add (bin, sink);
+  gst_element_sync_state_with_parent (sink);
+
+  sinkpad = gst_element_get_static_pad (sink, "sink");
+  gst_pad_link (pad, sinkpad);
+  gst_object_unref (sinkpad);
+}
+
+static gboolean
+run_pipeline (const gchar * location, guint n_threads, GstClockTime * elapsed)
+{
+  GError *err = NULL;
+  GstElement *pipeline, *demux;
+  GstMessage *msg;
+  GstClockTime start;
+  gchar *desc;
+  gboolean ret;
+
+  desc = g_strdup_printf ("filesrc location=\"%s\" blocksize=65424 ! "
+      "tsdemux name=demux output-threads=%u", location, n_threads);
+  pipeline = gst_parse_launch (desc, &err);
+  g_free (desc);
+  if (!pipeline) {
+    g_printerr ("Could not create pipeline: %s\n", err->message);
+    g_clear_error (&err);
+    return FALSE;
+  }
+
+  demux = gst_bin_get_by_name (GST_BIN (pipeline), "demux");
+  g_signal_connect (demux, "pad-added", G_CALLBACK (on_pad_added), pipeline);
+  gst_object_unref (demux);
+
+  start = gst_util_get_timestamp ();
+  gst_element_set_state (pipeline, GST_STATE_PLAYING);
+  msg = gst_bus_timed_pop_filtered (GST_ELEMENT_BUS (pipeline),
+      GST_CLOCK_TIME_NONE, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  *elapsed = gst_util_get_timestamp () - start;
+
+  ret = GST_MESSAGE_TYPE (msg) == GST_MESSAGE_EOS;
+  if (!ret) {
+    gst_message_parse_error (msg, &err, NULL);
+    g_printerr ("Error: %s\n", err->message);
+    g_clear_error (&err);
+  }
+
+  gst_message_unref (msg);
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+
+  return ret;
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+  GstClockTime base_time = GST_CLOCK_TIME_NONE;
+  GStatBuf st;
+  guint64 n_packets;
+  guint max_threads = DEFAULT_MAX_THREADS, n_threads;
+
+  gst_init (&argc, &argv);
+
+  if (argc < 2) {
+    g_printerr ("Usage: %s FILE.ts [MAX-THREADS] [WORK-US]\n", argv[0]);
+    return 1;
+  }
+
+  if (g_stat (argv[1], &st) < 0) {
+    g_printerr ("Could not stat %s\n", argv[1]);
+    return 1;
+  }
+  n_packets = st.st_size / 188;
+
+  if (argc > 2)
+    max_threads = CLAMP (atoi (argv[2]), 1, 64);
+  if (argc > 3)
+    work_us = MAX (atoi (argv[3]), 0);
+
+  g_print ("%s (%" G_GUINT64_FORMAT " packets, %" G_GINT64_FORMAT
+      " us per output buffer)\n", argv[1], n_packets, work_us);
+
+  for (n_threads = 0; n_threads <= max_threads;
+      n_threads = n_threads ? n_threads * 2 : 1) {
+    GstClockTime elapsed, best = GST_CLOCK_TIME_NONE;
+    gint i;
+
+    for (i = 0; i < NUM_RUNS; i++) {
+      if (!run_pipeline (argv[1], n_threads, &elapsed))
+        return 1;
+      best = MIN (best, elapsed);
+    }
+
+    if (n_threads == 0)
+      base_time = best;
+
+    g_print ("  %2u threads %10.0f packets/s  (%" GST_TIME_FORMAT
+        ", x%.2f)\n", n_threads, (gdouble) n_packets * GST_SECOND / best,
+        GST_TIME_ARGS (best), (gdouble) base_time / best);
+  }
+
+  return 0;
+}
@@ -0,0 +1,159 @@
+/* GStreamer
+ *
+ * tsmux.c: benchmark for the PSI/SI output of the MPEG-TS muxer
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Usage: tsmux [N-PROGRAMS] [N-ITERATIONS]
+ *
+ * Creates a muxer session with N programs (one H.264 stream each) plus a SDT
+ * and forces the PAT, all the PMTs and the SI to be resent before every
+ * stream packet, as happens with very short table intervals. Reports the
+ * time spent per full table carousel. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <gst/gst.h>
+#include <gst/mpegts/mpegts.h>
+
+#include "../../gst/mpegtsmux/tsmux/tsmux.h"
+
+GST_DEBUG_CATEGORY (gst_base_ts_mux_debug);
+
+#define DEFAULT_PROGRAMS 32
+#define DEFAULT_ITERATIONS 20000
+
+static guint8 payload[184 * 4];
+static guint64 n_packets;
+
+static gboolean
+write_packet (GstBuffer * buf, void *user_data, gint64 new_pcr)
+{
+  n_packets++;
+  gst_buffer_unref (buf);
+  return TRUE;
+}
+
+static void
+alloc_packet (GstBuffer ** buf, void *user_data)
+{
+  *buf = gst_buffer_new_and_alloc (188);
+}
+
+static TsMuxStream *
+new_stream (guint16 new_pid, guint stream_type, void *user_data)
+{
+  return tsmux_stream_new (new_pid, stream_type);
+}
+
+static GstMpegtsSection *
+make_sdt (guint n_programs)
+{
+  GstMpegtsSDT *sdt = gst_mpegts_sdt_new ();
+  guint i;
+
+  sdt->original_network_id = 1;
+  sdt->actual_ts = TRUE;
+  sdt->transport_stream_id = 1;
+
+  for (i = 0; i < n_programs; i++) {
+    GstMpegtsSDTService *service = gst_mpegts_sdt_service_new ();
+    gchar *name = g_strdup_printf ("Service %u", i + 1);
+
+    service->service_id = i + 1;
+    g_ptr_array_add (service->descriptors,
+        gst_mpegts_descriptor_from_dvb_service
+        (GST_DVB_SERVICE_DIGITAL_TELEVISION, name, "Provider"));
+    g_ptr_array_add (sdt->services, service);
+    g_free (name);
+  }
+
+  return gst_mpegts_section_from_sdt (sdt);
+}
+
+int
+main (int argc, char **argv)
+{
+  TsMuxProgram **programs;
+  TsMuxStream **streams;
+  GstClockTime start, elapsed;
+  guint n_programs = DEFAULT_PROGRAMS, n_iterations = DEFAULT_ITERATIONS;
+  guint i, j;
+  TsMux *mux;
+
+  gst_init (&argc, &argv);
+  gst_mpegts_initialize ();
+  GST_DEBUG_CATEGORY_INIT (gst_base_ts_mux_debug, "basetsmux", 0,
+      "tsmux benchmark");
+
+  if (argc > 1)
+    n_programs = CLAMP (atoi (argv[1]), 1, 256);
+  if (argc > 2)
+    n_iterations = MAX (atoi (argv[2]), 1);
+
+  mux = tsmux_new ();
+  tsmux_set_write_func (mux, write_packet, NULL);
+  tsmux_set_alloc_func (mux, alloc_packet, NULL);
+  tsmux_set_new_stream_func (mux, new_stream, NULL);
+
+  programs = g_new0 (TsMuxProgram *, n_programs);
+  streams = g_new0 (TsMuxStream *, n_programs);
+
+  for (i = 0; i < n_programs; i++) {
+    programs[i] = tsmux_program_new (mux, i + 1);
+    streams[i] =
+        tsmux_create_stream (mux, TSMUX_ST_VIDEO_H264, TSMUX_PID_AUTO, NULL);
+    tsmux_program_add_stream (programs[i], streams[i]);
+    tsmux_program_set_pcr_stream (programs[i], streams[i]);
+  }
+
+  tsmux_add_mpegts_si_section (mux, make_sdt (n_programs));
+
+  start = gst_util_get_timestamp ();
+  for (i = 0; i < n_iterations; i++) {
+    TsMuxStream *stream = streams[0];
+
+    tsmux_resend_pat (mux);
+    tsmux_resend_si (mux);
+    for (j = 0; j < n_programs; j++)
+      tsmux_resend_pmt (programs[j]);
+
+    if (tsmux_stream_bytes_in_buffer (stream) == 0)
+      tsmux_stream_add_data (stream, payload, sizeof (payload), NULL,
+          i * 3600, i * 3600, TRUE);
+
+    if (!tsmux_write_stream_packet (mux, stream)) {
+      g_printerr ("Failed to write packet\n");
+      return 1;
+    }
+  }
+  elapsed = gst_util_get_timestamp () - start;
+
+  g_print ("%u programs: %" G_GUINT64_FORMAT " packets, %.2f us per carousel,"
+      " %.2f Mpackets/s\n", n_programs, n_packets,
+      (gdouble) elapsed / GST_USECOND / n_iterations,
+      (gdouble) n_packets / ((gdouble) elapsed / GST_SECOND) / 1e6);
+
+  tsmux_free (mux);
+  g_free (programs);
+  g_free (streams);
+
+  return 0;
+}
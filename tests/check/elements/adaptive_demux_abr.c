@@ -0,0 +1,518 @@
+/* GStreamer unit test for the bitrate adaptation of adaptive demuxers
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/*
+ * The network is simulated: a GstTestClock is installed as the system clock
+ * and the HTTP source advances it by the time each request and each block
+ * of data would have taken with the bandwidth given by a trace. hlsdemux is
+ * then played with sync disabled, so a whole session only takes as long as
+ * it takes to push the data around, and the variant of each downloaded
+ * fragment is checked against what the algorithm is expected to do.
+ */
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gsttestclock.h>
+#include "adaptive_demux_common.h"
+
+#define DEMUX_ELEMENT_NAME "hlsdemux"
+
+#define TS_PACKET_LEN 188
+
+#define N_VARIANTS 4
+#define N_FRAGMENTS 30
+#define REQUEST_LATENCY (20 * GST_MSECOND)
+
+static const guint64 variant_bitrates[N_VARIANTS] = {
+  250000, 500000, 1000000, 2000000
+};
+
+/* The network can carry @bitrate for @duration. A trace ends with an empty
+ * step, its last step then lasts forever unless the trace loops. */
+typedef struct _AbrTestBandwidthStep
+{
+  GstClockTime duration;
+  guint64 bitrate;
+} AbrTestBandwidthStep;
+
+typedef struct _AbrTestResource
+{
+  GBytes *data;
+  const gchar *content_type;
+  /* variant and number of a fragment, -1 for playlists */
+  gint variant;
+  gint number;
+} AbrTestResource;
+
+typedef struct _AbrTestCase
+{
+  const gchar *algorithm;
+  const guint64 *bitrates;      /* N_VARIANTS of them */
+  const AbrTestBandwidthStep *trace;
+  gboolean loop_trace;
+
+  GstTestClock *clock;
+  GstClockTime start_time;
+  GHashTable *resources;        /* uri -> AbrTestResource */
+
+  GMutex lock;
+  /* variant of each fragment, in the order they were requested */
+  GArray *fragment_variants;
+  gboolean done;
+} AbrTestCase;
+
+static GByteArray *
+generate_transport_stream (guint length)
+{
+  GByteArray *mpeg_ts;
+  guint pos;
+  guint cc = 0;
+
+  fail_unless ((length % TS_PACKET_LEN) == 0);
+  mpeg_ts = g_byte_array_sized_new (length);
+  g_byte_array_set_size (mpeg_ts, length);
+  memset (mpeg_ts->data, 0xFF, length);
+  for (pos = 0; pos < length; pos += TS_PACKET_LEN) {
+    mpeg_ts->data[pos] = 0x47;
+    mpeg_ts->data[pos + 1] = 0x1F;
+    mpeg_ts->data[pos + 2] = 0xFF;
+    mpeg_ts->data[pos + 3] = cc;
+    cc = (cc + 1) & 0x0F;
+  }
+  return mpeg_ts;
+}
+
+static void
+abr_test_resource_free (AbrTestResource * resource)
+{
+  g_bytes_unref (resource->data);
+  g_slice_free (AbrTestResource, resource);
+}
+
+static void
+abr_test_add_resource (AbrTestCase * test, gchar * uri, GBytes * data,
+    const gchar * content_type, gint variant, gint number)
+{
+  AbrTestResource *resource = g_slice_new (AbrTestResource);
+
+  resource->data = data;
+  resource->content_type = content_type;
+  resource->variant = variant;
+  resource->number = number;
+  g_hash_table_insert (test->resources, uri, resource);
+}
+
+/* A master playlist listing the variants lowest bitrate first, so that
+ * playback starts with the lowest one, and a playlist of N_FRAGMENTS one
+ * second fragments for each of them. Variants are named after their index
+ * as several of them can have the same bitrate. */
+static void
+abr_test_setup_resources (AbrTestCase * test)
+{
+  GString *master;
+  gint i, j;
+
+  test->resources = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+      (GDestroyNotify) abr_test_resource_free);
+
+  master = g_string_new ("#EXTM3U\n");
+  for (i = 0; i < N_VARIANTS; i++) {
+    guint size = test->bitrates[i] / 8 / TS_PACKET_LEN * TS_PACKET_LEN;
+    GString *media;
+    GBytes *fragment;
+
+    g_string_append_printf (master, "#EXT-X-STREAM-INF:PROGRAM-ID=1, "
+        "BANDWIDTH=%" G_GUINT64_FORMAT "\n%d/media.m3u8\n",
+        test->bitrates[i], i);
+
+    media = g_string_new ("#EXTM3U\n#EXT-X-TARGETDURATION:1\n");
+    for (j = 0; j < N_FRAGMENTS; j++)
+      g_string_append_printf (media, "#EXTINF:1,Test\n%03d.ts\n", j);
+    g_string_append (media, "#EXT-X-ENDLIST\n");
+    abr_test_add_resource (test,
+        g_strdup_printf ("http://unit.test/%d/media.m3u8", i),
+        g_string_free_to_bytes (media), "application/vnd.apple.mpegurl", -1,
+        -1);
+
+    fragment = g_byte_array_free_to_bytes (generate_transport_stream (size));
+    for (j = 0; j < N_FRAGMENTS; j++) {
+      abr_test_add_resource (test,
+          g_strdup_printf ("http://unit.test/%d/%03d.ts", i, j),
+          g_bytes_ref (fragment), "video/mp2t", i, j);
+    }
+    g_bytes_unref (fragment);
+  }
+
+  abr_test_add_resource (test, g_strdup ("http://unit.test/master.m3u8"),
+      g_string_free_to_bytes (master), "application/vnd.apple.mpegurl", -1,
+      -1);
+}
+
+/* Time it takes to receive @size bytes from @start, both relative to the
+ * start of the test */
+static GstClockTime
+abr_test_transfer_time (AbrTestCase * test, GstClockTime start, gsize size)
+{
+  const AbrTestBandwidthStep *step = test->trace;
+  GstClockTime step_start = 0, t = start;
+  guint64 bits = (guint64) size * 8;
+
+  while (bits > 0) {
+    GstClockTime step_end = GST_CLOCK_TIME_NONE;
+    guint64 available;
+
+    if (step[1].duration != 0 || test->loop_trace)
+      step_end = step_start + step->duration;
+
+    if (GST_CLOCK_TIME_IS_VALID (step_end) && step_end <= t) {
+      step_start = step_end;
+      step++;
+      if (step->duration == 0)
+        step = test->trace;
+      continue;
+    }
+
+    if (GST_CLOCK_TIME_IS_VALID (step_end))
+      available = gst_util_uint64_scale (step_end - t, step->bitrate,
+          GST_SECOND);
+    else
+      available = G_MAXUINT64;
+
+    if (available >= bits) {
+      t += gst_util_uint64_scale_ceil (bits, GST_SECOND, step->bitrate);
+      bits = 0;
+    } else {
+      bits -= available;
+      t = step_end;
+    }
+  }
+
+  return t - start;
+}
+
+static gboolean
+abr_test_src_start (GstTestHTTPSrc * src, const gchar * uri,
+    GstTestHTTPSrcInput * input_data, gpointer user_data)
+{
+  AbrTestCase *test = user_data;
+  AbrTestResource *resource;
+
+  GST_DEBUG ("src_start %s", uri);
+  resource = g_hash_table_lookup (test->resources, uri);
+  if (!resource)
+    return FALSE;
+
+  gst_test_clock_advance_time (test->clock, REQUEST_LATENCY);
+
+  input_data->context = resource;
+  input_data->size = g_bytes_get_size (resource->data);
+  input_data->response_headers = gst_structure_new ("response-headers",
+      "Content-Type", G_TYPE_STRING, resource->content_type, NULL);
+
+  if (resource->variant >= 0) {
+    g_mutex_lock (&test->lock);
+    fail_unless_equals_int (test->fragment_variants->len, resource->number);
+    g_array_append_val (test->fragment_variants, resource->variant);
+    g_mutex_unlock (&test->lock);
+  }
+
+  return TRUE;
+}
+
+static GstFlowReturn
+abr_test_src_create (GstTestHTTPSrc * src, guint64 offset, guint length,
+    GstBuffer ** retbuf, gpointer context, gpointer user_data)
+{
+  AbrTestCase *test = user_data;
+  AbrTestResource *resource = context;
+  gsize size;
+  const guint8 *data = g_bytes_get_data (resource->data, &size);
+  GstClockTime now;
+
+  fail_unless (offset + length <= size);
+
+  /* playlists come from a server close by, only fragments cost bandwidth */
+  if (resource->variant >= 0) {
+    now = gst_clock_get_time (GST_CLOCK (test->clock)) - test->start_time;
+    gst_test_clock_advance_time (test->clock,
+        abr_test_transfer_time (test, now, length));
+  }
+
+  *retbuf = gst_buffer_new_allocate (NULL, length, NULL);
+  gst_buffer_fill (*retbuf, 0, data + offset, length);
+
+  if (resource->number == N_FRAGMENTS - 1 && offset + length == size) {
+    g_mutex_lock (&test->lock);
+    test->done = TRUE;
+    g_mutex_unlock (&test->lock);
+  }
+
+  return GST_FLOW_OK;
+}
+
+static void
+abr_test_pre_test (GstAdaptiveDemuxTestEngine * engine, gpointer user_data)
+{
+  AbrTestCase *test = user_data;
+
+  gst_util_set_object_arg (G_OBJECT (engine->demux), "abr-algorithm",
+      test->algorithm);
+}
+
+/* Each variant switch ends the current pad, only stop once the last
+ * fragment went through */
+static void
+abr_test_appsink_eos (GstAdaptiveDemuxTestEngine * engine,
+    GstAdaptiveDemuxTestOutputStream * stream, gpointer user_data)
+{
+  AbrTestCase *test = user_data;
+
+  g_mutex_lock (&test->lock);
+  if (test->done)
+    g_main_loop_quit (engine->loop);
+  g_mutex_unlock (&test->lock);
+}
+
+/* Plays the whole stream with @algorithm over the network described by
+ * @trace, and returns the variant of each fragment */
+static GArray *
+run_abr_test_with_bitrates (const gchar * algorithm,
+    const guint64 * bitrates, const AbrTestBandwidthStep * trace,
+    gboolean loop_trace)
+{
+  GstTestHTTPSrcCallbacks http_src_callbacks = { 0 };
+  GstAdaptiveDemuxTestCallbacks engine_callbacks = { 0 };
+  AbrTestCase test = { 0 };
+  GString *variants;
+  guint i;
+
+  test.algorithm = algorithm;
+  test.bitrates = bitrates;
+  test.trace = trace;
+  test.loop_trace = loop_trace;
+  g_mutex_init (&test.lock);
+  test.fragment_variants = g_array_new (FALSE, FALSE, sizeof (gint));
+  abr_test_setup_resources (&test);
+
+  /* the demuxer uses the system clock to time downloads */
+  test.clock = GST_TEST_CLOCK (gst_test_clock_new ());
+  test.start_time = gst_clock_get_time (GST_CLOCK (test.clock));
+  gst_system_clock_set_default (GST_CLOCK (test.clock));
+
+  http_src_callbacks.src_start = abr_test_src_start;
+  http_src_callbacks.src_create = abr_test_src_create;
+  engine_callbacks.pre_test = abr_test_pre_test;
+  engine_callbacks.appsink_eos = abr_test_appsink_eos;
+
+  gst_test_http_src_install_callbacks (&http_src_callbacks, &test);
+  gst_adaptive_demux_test_run (DEMUX_ELEMENT_NAME,
+      "http://unit.test/master.m3u8", &engine_callbacks, &test);
+
+  gst_system_clock_set_default (NULL);
+  gst_object_unref (test.clock);
+  g_hash_table_unref (test.resources);
+  g_mutex_clear (&test.lock);
+
+  fail_unless_equals_int (test.fragment_variants->len, N_FRAGMENTS);
+
+  variants = g_string_new (NULL);
+  for (i = 0; i < test.fragment_variants->len; i++)
+    g_string_append_printf (variants, "%d",
+        g_array_index (test.fragment_variants, gint, i));
+  GST_INFO ("%s: %s", algorithm, variants->str);
+  g_string_free (variants, TRUE);
+
+  return test.fragment_variants;
+}
+
+static GArray *
+run_abr_test (const gchar * algorithm, const AbrTestBandwidthStep * trace,
+    gboolean loop_trace)
+{
+  return run_abr_test_with_bitrates (algorithm, variant_bitrates, trace,
+      loop_trace);
+}
+
+static guint
+count_switches (GArray * variants)
+{
+  guint i, switches = 0;
+
+  for (i = 1; i < variants->len; i++) {
+    if (g_array_index (variants, gint, i) !=
+        g_array_index (variants, gint, i - 1))
+      switches++;
+  }
+
+  return switches;
+}
+
+static gint
+max_variant (GArray * variants, guint from, guint to)
+{
+  gint ret = 0;
+  guint i;
+
+  for (i = from; i < to; i++)
+    ret = MAX (ret, g_array_index (variants, gint, i));
+
+  return ret;
+}
+
+static const AbrTestBandwidthStep bandwidth_drop_trace[] = {
+  {10 * GST_SECOND, 3000000},
+  {GST_SECOND, 400000},
+  {0, 0}
+};
+
+static void
+check_bandwidth_drop (const gchar * algorithm)
+{
+  GArray *variants = run_abr_test (algorithm, bandwidth_drop_trace, FALSE);
+  guint i;
+
+  /* went up to at least 1 Mbps while the network allowed it... */
+  fail_unless (max_variant (variants, 0, 8) >= 2);
+  /* ...and ended up on the only variant that fits in 400 kbps at 80% */
+  for (i = N_FRAGMENTS - 5; i < N_FRAGMENTS; i++)
+    fail_unless_equals_int (g_array_index (variants, gint, i), 0);
+
+  g_array_free (variants, TRUE);
+}
+
+/*
+ * The bandwidth drops from 3 Mbps to 400 kbps after 10 seconds, every
+ * algorithm must follow it down.
+ */
+GST_START_TEST (testBandwidthDrop)
+{
+  check_bandwidth_drop ("moving-average");
+  check_bandwidth_drop ("throughput");
+  check_bandwidth_drop ("bola");
+}
+
+GST_END_TEST;
+
+static const AbrTestBandwidthStep constant_trace[] = {
+  {GST_SECOND, 5000000},
+  {0, 0}
+};
+
+/*
+ * With plenty of bandwidth, BOLA must get to the highest variant quickly
+ * while the buffer is still small, and stay there.
+ */
+GST_START_TEST (testBolaStable)
+{
+  GArray *variants = run_abr_test ("bola", constant_trace, FALSE);
+  guint i;
+
+  for (i = 5; i < N_FRAGMENTS; i++)
+    fail_unless_equals_int (g_array_index (variants, gint, i),
+        N_VARIANTS - 1);
+  fail_unless (count_switches (variants) <= 2);
+
+  g_array_free (variants, TRUE);
+}
+
+GST_END_TEST;
+
+static const guint64 duplicate_bitrates[N_VARIANTS] = {
+  250000, 500000, 500000, 2000000
+};
+
+static const guint64 equal_bitrates[N_VARIANTS] = {
+  500000, 500000, 500000, 500000
+};
+
+/*
+ * Variants sharing a bitrate must not confuse BOLA: with plenty of
+ * bandwidth it still gets to the highest variant, and it keeps working when
+ * there is a single distinct bitrate.
+ */
+GST_START_TEST (testBolaDuplicateBitrates)
+{
+  GArray *variants;
+  guint i;
+
+  variants = run_abr_test_with_bitrates ("bola", duplicate_bitrates,
+      constant_trace, FALSE);
+  for (i = 5; i < N_FRAGMENTS; i++)
+    fail_unless_equals_int (g_array_index (variants, gint, i),
+        N_VARIANTS - 1);
+  g_array_free (variants, TRUE);
+
+  variants = run_abr_test_with_bitrates ("bola", equal_bitrates,
+      constant_trace, FALSE);
+  g_array_free (variants, TRUE);
+}
+
+GST_END_TEST;
+
+static const AbrTestBandwidthStep oscillating_trace[] = {
+  {GST_SECOND, 3000000},
+  {GST_SECOND, 1200000},
+  {0, 0}
+};
+
+/*
+ * The bandwidth keeps going between 3 Mbps and 1.2 Mbps. The smoothed
+ * throughput estimate must not switch more than the plain moving average,
+ * and BOLA must not fall back to the lowest variant as its buffer never
+ * gets big.
+ */
+GST_START_TEST (testOscillatingBandwidth)
+{
+  GArray *moving_average, *throughput, *bola;
+  guint i;
+
+  moving_average = run_abr_test ("moving-average", oscillating_trace, TRUE);
+  throughput = run_abr_test ("throughput", oscillating_trace, TRUE);
+  bola = run_abr_test ("bola", oscillating_trace, TRUE);
+
+  fail_unless (count_switches (throughput) <= count_switches (moving_average));
+  fail_unless (count_switches (throughput) <= 4);
+  for (i = 5; i < N_FRAGMENTS; i++)
+    fail_unless (g_array_index (bola, gint, i) > 0);
+
+  g_array_free (moving_average, TRUE);
+  g_array_free (throughput, TRUE);
+  g_array_free (bola, TRUE);
+}
+
+GST_END_TEST;
+
+static Suite *
+adaptive_demux_abr_suite (void)
+{
+  Suite *s = suite_create ("adaptive_demux_abr");
+  TCase *tc_basicTest = tcase_create ("basicTest");
+
+  tcase_add_test (tc_basicTest, testBandwidthDrop);
+  tcase_add_test (tc_basicTest, testBolaStable);
+  tcase_add_test (tc_basicTest, testBolaDuplicateBitrates);
+  tcase_add_test (tc_basicTest, testOscillatingBandwidth);
+
+  tcase_add_unchecked_fixture (tc_basicTest, gst_adaptive_demux_test_setup,
+      gst_adaptive_demux_test_teardown);
+
+  suite_add_tcase (s, tc_basicTest);
+
+  return s;
+}
+
+GST_CHECK_MAIN (adaptive_demux_abr);
@@ -818,6 +818,7 @@ GST_END_TEST;
 typedef struct _DataProbeResult
 {
   guint64 received;
+  guint buffers;
 } DataProbeResult;
 
 static GstPadProbeReturn
@@ -829,6 +830,7 @@ src_data_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
   if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
     buf = GST_PAD_PROBE_INFO_BUFFER (info);
     dpr->received += gst_buffer_get_size (buf);
+    dpr->buffers++;
   }
 
   return GST_PAD_PROBE_OK;
@@ -853,6 +855,7 @@ GST_START_TEST (test_range_get)
   src_pad = gst_element_get_static_pad (context.downloader1->src, "src");
   fail_unless (src_pad != NULL);
   dpr.received = 0;
+  dpr.buffers = 0;
   probe_id = gst_pad_add_probe (src_pad, GST_PAD_PROBE_TYPE_BUFFER,
       src_data_probe, &dpr, NULL);
   fail_unless (probe_id > 0);
@@ -887,6 +890,56 @@ GST_START_TEST (test_range_get)
 
 GST_END_TEST;
 
+/* With a coalesce-size larger than the resource, the whole body is gathered
+ * and pushed as a single buffer once the transfer is done */
+GST_START_TEST (test_coalesce_size)
+{
+  GstElement *pipe, *src, *sink;
+  GioHttpServer *server;
+  DataProbeResult dpr = { 0, };
+  GstMessage *msg;
+  GstPad *src_pad;
+  gchar *url;
+
+  server = run_server ();
+  fail_if (server == NULL, "Failed to start up HTTP server");
+
+  pipe = gst_pipeline_new (NULL);
+  src = gst_element_factory_make ("curlhttpsrc", NULL);
+  fail_unless (src != NULL);
+  sink = gst_element_factory_make ("fakesink", NULL);
+  fail_unless (sink != NULL);
+  gst_bin_add_many (GST_BIN (pipe), src, sink, NULL);
+  fail_unless (gst_element_link (src, sink));
+
+  url = g_strdup_printf ("http://127.0.0.1:%u/",
+      get_port_from_server (server));
+  g_object_set (src, "location", url, "coalesce-size", 4 * 1024, NULL);
+  g_free (url);
+
+  src_pad = gst_element_get_static_pad (src, "src");
+  gst_pad_add_probe (src_pad, GST_PAD_PROBE_TYPE_BUFFER, src_data_probe,
+      &dpr, NULL);
+  gst_object_unref (src_pad);
+
+  fail_if (gst_element_set_state (pipe, GST_STATE_PLAYING) ==
+      GST_STATE_CHANGE_FAILURE);
+  msg = gst_bus_timed_pop_filtered (GST_ELEMENT_BUS (pipe),
+      10 * GST_SECOND, GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless (msg != NULL);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+
+  fail_unless_equals_uint64 (dpr.received, http_content_length);
+  fail_unless_equals_int (dpr.buffers, 1);
+
+  gst_element_set_state (pipe, GST_STATE_NULL);
+  gst_object_unref (pipe);
+  stop_server (server);
+}
+
+GST_END_TEST;
+
 static Suite *
 curlhttpsrc_suite (void)
 {
@@ -911,6 +964,7 @@ curlhttpsrc_suite (void)
   tcase_add_test (tc_chain, test_cookies);
   tcase_add_test (tc_chain, test_multiple_http_requests);
   tcase_add_test (tc_chain, test_range_get);
+  tcase_add_test (tc_chain, test_coalesce_size);
 
   return s;
 }
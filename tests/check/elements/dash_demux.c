@@ -19,6 +19,7 @@
  */
 
 #include <gst/check/gstcheck.h>
+#include <gst/check/gsttestclock.h>
 #include "adaptive_demux_common.h"
 
 #define DEMUX_ELEMENT_NAME "dashdemux"
@@ -1520,6 +1521,215 @@ GST_START_TEST (testContentProtection)
 
 GST_END_TEST;
 
+/*
+ * Test a low latency live stream, whose segments can be requested before
+ * they are complete and then arrive chunk after chunk
+ *
+ */
+#define LL_SEGMENT_DURATION (2 * GST_SECOND)
+#define LL_AVAILABILITY_TIME_OFFSET (1500 * GST_MSECOND)
+#define LL_CHUNKS_PER_SEGMENT 4
+#define LL_CHUNK_SIZE 1000
+#define LL_N_SEGMENTS 4
+
+typedef struct
+{
+  GstTestClock *clock;
+  GstClockTime clock_start;
+  /* UTC at clock_start, and availabilityStartTime of the MPD, in us */
+  gint64 utc_start;
+  gint64 availability_start;
+  gchar *mpd;
+
+  GMutex lock;
+  guint n_segments;
+  guint n_early_requests;
+  guint64 received;
+} LowLatencyTestCase;
+
+static gint64
+low_latency_test_utc_now (LowLatencyTestCase * test)
+{
+  GstClockTime now = gst_clock_get_time (GST_CLOCK (test->clock));
+
+  return test->utc_start + GST_TIME_AS_USECONDS (now - test->clock_start);
+}
+
+/* Blocks until the test clock reaches @utc, in us */
+static void
+low_latency_test_wait_utc (LowLatencyTestCase * test, gint64 utc)
+{
+  GstClockID id;
+
+  if (utc <= low_latency_test_utc_now (test))
+    return;
+
+  id = gst_clock_new_single_shot_id (GST_CLOCK (test->clock),
+      test->clock_start + (utc - test->utc_start) * GST_USECOND);
+  gst_clock_id_wait (id, NULL);
+  gst_clock_id_unref (id);
+}
+
+static gboolean
+low_latency_test_src_start (GstTestHTTPSrc * src, const gchar * uri,
+    GstTestHTTPSrcInput * input_data, gpointer user_data)
+{
+  LowLatencyTestCase *test = user_data;
+  gint64 now, segment_end;
+  guint number;
+
+  if (g_strcmp0 (uri, "http://unit.test/test.mpd") == 0) {
+    input_data->context = NULL;
+    input_data->size = strlen (test->mpd);
+    return TRUE;
+  }
+
+  if (sscanf (uri, "http://unit.test/segment-%u.webm", &number) != 1)
+    return FALSE;
+  fail_unless (number > 0);
+
+  /* segment @number covers [(number - 1) * duration, number * duration) and
+   * is available availabilityTimeOffset before its end */
+  now = low_latency_test_utc_now (test);
+  segment_end = test->availability_start +
+      GST_TIME_AS_USECONDS (number * LL_SEGMENT_DURATION);
+  GST_DEBUG ("request for segment %u, %" G_GINT64_FORMAT "us before its end",
+      number, segment_end - now);
+
+  /* leave some room for the demuxer having read the UTC slightly later */
+  fail_unless (now + 100 * G_TIME_SPAN_MILLISECOND >=
+      segment_end - GST_TIME_AS_USECONDS (LL_AVAILABILITY_TIME_OFFSET));
+
+  g_mutex_lock (&test->lock);
+  test->n_segments++;
+  if (now < segment_end)
+    test->n_early_requests++;
+  g_mutex_unlock (&test->lock);
+
+  input_data->context = GUINT_TO_POINTER (number);
+  input_data->size = LL_CHUNKS_PER_SEGMENT * LL_CHUNK_SIZE;
+  return TRUE;
+}
+
+static GstFlowReturn
+low_latency_test_src_create (GstTestHTTPSrc * src, guint64 offset,
+    guint length, GstBuffer ** retbuf, gpointer context, gpointer user_data)
+{
+  LowLatencyTestCase *test = user_data;
+  guint number = GPOINTER_TO_UINT (context);
+
+  if (number == 0) {
+    *retbuf = gst_buffer_new_allocate (NULL, length, NULL);
+    gst_buffer_fill (*retbuf, 0, test->mpd + offset, length);
+    return GST_FLOW_OK;
+  }
+
+  /* each chunk is produced once the media it contains is */
+  if (length > 0) {
+    guint chunk = (offset + length - 1) / LL_CHUNK_SIZE;
+    GstClockTime produced = (number - 1) * LL_SEGMENT_DURATION +
+        (chunk + 1) * LL_SEGMENT_DURATION / LL_CHUNKS_PER_SEGMENT;
+
+    low_latency_test_wait_utc (test,
+        test->availability_start + GST_TIME_AS_USECONDS (produced));
+  }
+
+  *retbuf = gst_buffer_new_allocate (NULL, length, NULL);
+  gst_buffer_memset (*retbuf, 0, 0, length);
+  return GST_FLOW_OK;
+}
+
+static gboolean
+low_latency_test_appsink_received_data (GstAdaptiveDemuxTestEngine * engine,
+    GstAdaptiveDemuxTestOutputStream * stream, GstBuffer * buffer,
+    gpointer user_data)
+{
+  LowLatencyTestCase *test = user_data;
+
+  g_mutex_lock (&test->lock);
+  test->received += gst_buffer_get_size (buffer);
+  if (test->received >=
+      LL_N_SEGMENTS * LL_CHUNKS_PER_SEGMENT * LL_CHUNK_SIZE)
+    g_main_loop_quit (engine->loop);
+  g_mutex_unlock (&test->lock);
+
+  return TRUE;
+}
+
+GST_START_TEST (testLowLatencyLive)
+{
+  GstTestHTTPSrcCallbacks http_src_callbacks = { 0 };
+  GstAdaptiveDemuxTestCallbacks test_callbacks = { 0 };
+  LowLatencyTestCase test = { 0 };
+  GDateTime *now, *availability_start;
+  gchar *availability_start_str;
+
+  g_mutex_init (&test.lock);
+
+  /* the demuxer waits for segments on the system clock */
+  test.clock = GST_TEST_CLOCK (gst_test_clock_new ());
+  test.clock_start = gst_clock_get_time (GST_CLOCK (test.clock));
+  test.utc_start = g_get_real_time ();
+  gst_system_clock_set_default (GST_CLOCK (test.clock));
+
+  /* the stream started 20s ago, the ServiceDescription asks to stay 3s
+   * behind the live edge */
+  now = g_date_time_new_from_unix_utc (test.utc_start / G_USEC_PER_SEC);
+  availability_start = g_date_time_add_seconds (now, -20);
+  test.availability_start =
+      g_date_time_to_unix (availability_start) * G_USEC_PER_SEC;
+  availability_start_str =
+      g_date_time_format (availability_start, "%Y-%m-%dT%H:%M:%SZ");
+  g_date_time_unref (availability_start);
+  g_date_time_unref (now);
+
+  test.mpd = g_strdup_printf ("<?xml version=\"1.0\" encoding=\"utf-8\"?>"
+      "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\""
+      "     profiles=\"urn:mpeg:dash:profile:isoff-live:2011\""
+      "     type=\"dynamic\""
+      "     availabilityStartTime=\"%s\""
+      "     minimumUpdatePeriod=\"PT500S\""
+      "     minBufferTime=\"PT1S\">"
+      "  <ServiceDescription id=\"0\">"
+      "    <Latency target=\"3000\"/>"
+      "  </ServiceDescription>"
+      "  <Period id=\"0\" start=\"PT0S\">"
+      "    <AdaptationSet mimeType=\"video/webm\">"
+      "      <SegmentTemplate media=\"segment-$Number$.webm\""
+      "                       duration=\"2\" startNumber=\"1\""
+      "                       availabilityTimeOffset=\"1.5\""
+      "                       availabilityTimeComplete=\"false\"/>"
+      "      <Representation id=\"video\" codecs=\"vp9\""
+      "                      width=\"426\" height=\"240\""
+      "                      bandwidth=\"16000\"/>"
+      "    </AdaptationSet></Period></MPD>", availability_start_str);
+  g_free (availability_start_str);
+
+  http_src_callbacks.src_start = low_latency_test_src_start;
+  http_src_callbacks.src_create = low_latency_test_src_create;
+  gst_test_http_src_install_callbacks (&http_src_callbacks, &test);
+  gst_test_http_src_set_default_blocksize (LL_CHUNK_SIZE);
+
+  test_callbacks.appsink_received_data =
+      low_latency_test_appsink_received_data;
+
+  gst_adaptive_demux_test_run (DEMUX_ELEMENT_NAME, "http://unit.test/test.mpd",
+      &test_callbacks, &test);
+
+  gst_system_clock_set_default (NULL);
+  gst_object_unref (test.clock);
+
+  /* playback started around the target latency, each following segment was
+   * requested before it was complete */
+  fail_unless (test.n_segments >= LL_N_SEGMENTS);
+  fail_unless (test.n_early_requests >= LL_N_SEGMENTS - 1);
+
+  g_free (test.mpd);
+  g_mutex_clear (&test.lock);
+}
+
+GST_END_TEST;
+
 static Suite *
 dash_demux_suite (void)
 {
@@ -1545,6 +1755,7 @@ dash_demux_suite (void)
   tcase_add_test (tc_basicTest, testMediaDownloadErrorMiddleFragment);
   tcase_add_test (tc_basicTest, testQuery);
   tcase_add_test (tc_basicTest, testContentProtection);
+  tcase_add_test (tc_basicTest, testLowLatencyLive);
 
   tcase_add_unchecked_fixture (tc_basicTest, gst_adaptive_demux_test_setup,
       gst_adaptive_demux_test_teardown);
@@ -27,6 +27,7 @@
 #include "../../ext/dash/gstmpdrootnode.c"
 #include "../../ext/dash/gstmpdbaseurlnode.c"
 #include "../../ext/dash/gstmpdutctimingnode.c"
+#include "../../ext/dash/gstmpdservicedescriptionnode.c"
 #include "../../ext/dash/gstmpdmetricsnode.c"
 #include "../../ext/dash/gstmpdmetricsrangenode.c"
 #include "../../ext/dash/gstmpdsnode.c"
@@ -2713,6 +2714,42 @@ GST_START_TEST (dash_mpdparser_utctiming)
 
 GST_END_TEST;
 
+/*
+ * Test parsing ServiceDescription attributes
+ *
+ */
+GST_START_TEST (dash_mpdparser_service_description)
+{
+  GstMPDServiceDescriptionNode *service;
+  const gchar *xml =
+      "<?xml version=\"1.0\"?>"
+      "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\""
+      "     profiles=\"urn:mpeg:dash:profile:isoff-main:2011\">"
+      "  <ServiceDescription id=\"3\">"
+      "    <Latency target=\"3000\" min=\"2000\" max=\"6000\"/>"
+      "    <PlaybackRate min=\"0.96\" max=\"1.04\"/>"
+      "  </ServiceDescription></MPD>";
+
+  gboolean ret;
+  GstMPDClient *mpdclient = gst_mpd_client_new ();
+
+  ret = gst_mpd_client_parse (mpdclient, xml, (gint) strlen (xml));
+  assert_equals_int (ret, TRUE);
+
+  service = gst_mpd_client_get_service_description (mpdclient);
+  fail_if (service == NULL);
+  assert_equals_uint64 (service->id, 3);
+  assert_equals_int64 (service->latencyTarget, 3000);
+  assert_equals_int64 (service->latencyMin, 2000);
+  assert_equals_int64 (service->latencyMax, 6000);
+  assert_equals_float (service->playbackRateMin, 0.96);
+  assert_equals_float (service->playbackRateMax, 1.04);
+
+  gst_mpd_client_free (mpdclient);
+}
+
+GST_END_TEST;
+
 /*
  * Test parsing invalid UTCTiming values:
  * - elements with no schemeIdUri property should be rejected
@@ -4969,6 +5006,299 @@ GST_START_TEST (dash_mpdparser_segment_timeline)
 
 GST_END_TEST;
 
+/*
+ * Test that a SegmentTimeline listing equal segments one S at a time is
+ * stored as repeated runs and that seeking finds segments inside them
+ *
+ */
+GST_START_TEST (dash_mpdparser_segment_timeline_runs)
+{
+  GList *adaptationSets;
+  GstMPDAdaptationSetNode *adapt_set;
+  GstActiveStream *activeStream;
+  GstMediaSegment *segment;
+  GstClockTime ts;
+
+  const gchar *xml =
+      "<?xml version=\"1.0\"?>"
+      "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\""
+      "     profiles=\"urn:mpeg:dash:profile:isoff-live:2011\""
+      "     mediaPresentationDuration=\"P0Y0M0DT0H0M16S\">"
+      "  <Period start=\"P0Y0M0DT0H0M0S\">"
+      "    <AdaptationSet mimeType=\"video/mp4\">"
+      "      <SegmentTemplate media=\"$Number$.mp4\">"
+      "        <SegmentTimeline>"
+      "          <S t=\"0\" d=\"2\"/>"
+      "          <S d=\"2\"/>"
+      "          <S t=\"4\" d=\"2\" r=\"1\"/>"
+      "          <S d=\"3\" r=\"1\"/>"
+      "          <S d=\"2\"/>"
+      "        </SegmentTimeline></SegmentTemplate>"
+      "      <Representation id=\"1\" bandwidth=\"250000\">"
+      "      </Representation></AdaptationSet></Period></MPD>";
+
+  gboolean ret;
+  GstMPDClient *mpdclient = gst_mpd_client_new ();
+
+  ret = gst_mpd_client_parse (mpdclient, xml, (gint) strlen (xml));
+  assert_equals_int (ret, TRUE);
+
+  ret =
+      gst_mpd_client_setup_media_presentation (mpdclient, GST_CLOCK_TIME_NONE,
+      -1, NULL);
+  assert_equals_int (ret, TRUE);
+
+  adaptationSets = gst_mpd_client_get_adaptation_sets (mpdclient);
+  fail_if (adaptationSets == NULL);
+  adapt_set = (GstMPDAdaptationSetNode *) g_list_nth_data (adaptationSets, 0);
+  fail_if (adapt_set == NULL);
+  ret = gst_mpd_client_setup_streaming (mpdclient, adapt_set);
+  assert_equals_int (ret, TRUE);
+
+  activeStream = gst_mpd_client_get_active_stream_by_index (mpdclient, 0);
+  fail_if (activeStream == NULL);
+
+  /* 4 segments of 2s, 2 of 3s and 1 of 2s */
+  assert_equals_int (activeStream->segments->len, 3);
+  segment = g_ptr_array_index (activeStream->segments, 0);
+  assert_equals_int (segment->number, 1);
+  assert_equals_int (segment->repeat, 3);
+  segment = g_ptr_array_index (activeStream->segments, 1);
+  assert_equals_int (segment->number, 5);
+  assert_equals_int (segment->repeat, 1);
+  assert_equals_uint64 (segment->start, 8 * GST_SECOND);
+  segment = g_ptr_array_index (activeStream->segments, 2);
+  assert_equals_int (segment->number, 7);
+  assert_equals_uint64 (segment->start, 14 * GST_SECOND);
+
+  ret = gst_mpd_client_stream_seek (mpdclient, activeStream, TRUE, 0,
+      9 * GST_SECOND, &ts);
+  assert_equals_int (ret, TRUE);
+  assert_equals_uint64 (ts, 8 * GST_SECOND);
+  assert_equals_int (activeStream->segment_index, 1);
+  assert_equals_int (activeStream->segment_repeat_index, 0);
+
+  /* the next segment is in the same run */
+  ret = gst_mpd_client_stream_seek (mpdclient, activeStream, TRUE,
+      GST_SEEK_FLAG_SNAP_AFTER, 1 * GST_SECOND, &ts);
+  assert_equals_int (ret, TRUE);
+  assert_equals_uint64 (ts, 2 * GST_SECOND);
+  assert_equals_int (activeStream->segment_index, 0);
+  assert_equals_int (activeStream->segment_repeat_index, 1);
+
+  ret = gst_mpd_client_stream_seek (mpdclient, activeStream, TRUE, 0,
+      15 * GST_SECOND, &ts);
+  assert_equals_int (ret, TRUE);
+  assert_equals_uint64 (ts, 14 * GST_SECOND);
+  assert_equals_int (activeStream->segment_index, 2);
+
+  ret = gst_mpd_client_stream_seek (mpdclient, activeStream, TRUE, 0,
+      20 * GST_SECOND, &ts);
+  assert_equals_int (ret, FALSE);
+
+  gst_mpd_client_free (mpdclient);
+}
+
+GST_END_TEST;
+
+/*
+ * Test availabilityTimeOffset and availabilityTimeComplete of low latency
+ * streams
+ *
+ */
+GST_START_TEST (dash_mpdparser_availability_time_offset)
+{
+  GList *adaptationSets;
+  GstMPDAdaptationSetNode *adapt_set;
+  GstActiveStream *activeStream;
+  GstDateTime *segmentAvailability;
+  GstMPDSegmentBaseNode *segmentBase;
+
+  /*
+   * The SegmentTemplate of the AdaptationSet makes segments available 1.5s
+   * before their end, the BaseURL 0.5s more. The Representation inherits
+   * both from its own SegmentTemplate.
+   */
+  const gchar *xml =
+      "<?xml version=\"1.0\"?>"
+      "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\""
+      "     type=\"dynamic\""
+      "     profiles=\"urn:mpeg:dash:profile:isoff-live:2011\""
+      "     availabilityStartTime=\"2015-03-24T0:0:0\">"
+      "  <BaseURL availabilityTimeOffset=\"0.5\">http://example.com/</BaseURL>"
+      "  <Period id=\"Period0\" start=\"P0Y0M0DT0H0M10S\">"
+      "    <AdaptationSet mimeType=\"video/mp4\">"
+      "      <SegmentTemplate duration=\"2\" startNumber=\"1\""
+      "                       availabilityTimeOffset=\"1.5\""
+      "                       availabilityTimeComplete=\"false\"/>"
+      "      <Representation id=\"1\" bandwidth=\"250000\">"
+      "        <SegmentTemplate media=\"$Number$.mp4\"/>"
+      "      </Representation></AdaptationSet></Period></MPD>";
+
+  gboolean ret;
+  GstMPDClient *mpdclient = gst_mpd_client_new ();
+
+  ret = gst_mpd_client_parse (mpdclient, xml, (gint) strlen (xml));
+  assert_equals_int (ret, TRUE);
+
+  ret =
+      gst_mpd_client_setup_media_presentation (mpdclient, GST_CLOCK_TIME_NONE,
+      -1, NULL);
+  assert_equals_int (ret, TRUE);
+
+  adaptationSets = gst_mpd_client_get_adaptation_sets (mpdclient);
+  fail_if (adaptationSets == NULL);
+  adapt_set = (GstMPDAdaptationSetNode *) g_list_nth_data (adaptationSets, 0);
+  fail_if (adapt_set == NULL);
+  ret = gst_mpd_client_setup_streaming (mpdclient, adapt_set);
+  assert_equals_int (ret, TRUE);
+
+  activeStream = gst_mpd_client_get_active_stream_by_index (mpdclient, 0);
+  fail_if (activeStream == NULL);
+  fail_if (activeStream->cur_seg_template == NULL);
+
+  segmentBase =
+      GST_MPD_MULT_SEGMENT_BASE_NODE (activeStream->cur_seg_template)->
+      SegmentBase;
+  fail_if (segmentBase == NULL);
+  assert_equals_float (segmentBase->availabilityTimeOffset, 1.5);
+  assert_equals_int (segmentBase->availabilityTimeComplete, FALSE);
+
+  assert_equals_uint64 (gst_mpd_client_get_availability_time_offset
+      (mpdclient, activeStream), 2 * GST_SECOND);
+  assert_equals_int (gst_mpd_client_is_availability_time_complete (mpdclient,
+          activeStream), FALSE);
+
+  /* the first segment ends 12s after availabilityStartTime, period start
+   * included, and is available 2s earlier */
+  segmentAvailability =
+      gst_mpd_client_get_next_segment_availability_start_time (mpdclient,
+      activeStream);
+  fail_unless (segmentAvailability != NULL);
+  assert_equals_int (gst_date_time_get_hour (segmentAvailability), 0);
+  assert_equals_int (gst_date_time_get_minute (segmentAvailability), 0);
+  assert_equals_int (gst_date_time_get_second (segmentAvailability), 10);
+  gst_date_time_unref (segmentAvailability);
+
+  gst_mpd_client_free (mpdclient);
+}
+
+GST_END_TEST;
+
+/*
+ * Test that a refreshed live MPD shares the Periods that did not change with
+ * the previous version and parses the others again
+ *
+ */
+GST_START_TEST (dash_mpdparser_update_unchanged_periods)
+{
+  GstMPDPeriodNode *oldPeriod0, *oldPeriod1, *newPeriod0, *newPeriod1;
+  GstMPDSegmentTemplateNode *segmentTemplate;
+  GstMPDSegmentTimelineNode *segmentTimeline;
+  GstMPDSNode *sNode, *oldSNode;
+  const gchar *xml =
+      "<?xml version=\"1.0\"?>"
+      "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\""
+      "     type=\"dynamic\""
+      "     profiles=\"urn:mpeg:dash:profile:isoff-live:2011\""
+      "     availabilityStartTime=\"2015-03-24T0:0:0\">"
+      "  <Period id=\"Period0\" start=\"P0Y0M0DT0H0M0S\">"
+      "    <AdaptationSet mimeType=\"video/mp4\">"
+      "      <SegmentTemplate timescale=\"10\" media=\"$Time$.mp4\">"
+      "        <SegmentTimeline>"
+      "          <S t=\"0\" d=\"20\" r=\"4\"/>"
+      "        </SegmentTimeline></SegmentTemplate>"
+      "      <Representation id=\"1\" bandwidth=\"250000\"/>"
+      "    </AdaptationSet></Period>"
+      "  <Period id=\"Period1\" start=\"P0Y0M0DT0H0M10S\">"
+      "    <AdaptationSet mimeType=\"video/mp4\">"
+      "      <SegmentTemplate timescale=\"10\" media=\"$Time$.mp4\">"
+      "        <SegmentTimeline>"
+      "          <S t=\"0\" d=\"20\" r=\"1\"/>"
+      "        </SegmentTimeline></SegmentTemplate>"
+      "      <Representation id=\"1\" bandwidth=\"250000\"/>"
+      "    </AdaptationSet></Period></MPD>";
+
+  /* one more segment in the second Period */
+  const gchar *updated_xml =
+      "<?xml version=\"1.0\"?>"
+      "<MPD xmlns=\"urn:mpeg:dash:schema:mpd:2011\""
+      "     type=\"dynamic\""
+      "     profiles=\"urn:mpeg:dash:profile:isoff-live:2011\""
+      "     availabilityStartTime=\"2015-03-24T0:0:0\">"
+      "  <Period id=\"Period0\" start=\"P0Y0M0DT0H0M0S\">"
+      "    <AdaptationSet mimeType=\"video/mp4\">"
+      "      <SegmentTemplate timescale=\"10\" media=\"$Time$.mp4\">"
+      "        <SegmentTimeline>"
+      "          <S t=\"0\" d=\"20\" r=\"4\"/>"
+      "        </SegmentTimeline></SegmentTemplate>"
+      "      <Representation id=\"1\" bandwidth=\"250000\"/>"
+      "    </AdaptationSet></Period>"
+      "  <Period id=\"Period1\" start=\"P0Y0M0DT0H0M10S\">"
+      "    <AdaptationSet mimeType=\"video/mp4\">"
+      "      <SegmentTemplate timescale=\"10\" media=\"$Time$.mp4\">"
+      "        <SegmentTimeline>"
+      "          <S t=\"0\" d=\"20\" r=\"1\"/>"
+      "          <S d=\"&#x33;0\"/>"
+      "        </SegmentTimeline></SegmentTemplate>"
+      "      <Representation id=\"1\" bandwidth=\"250000\"/>"
+      "    </AdaptationSet></Period></MPD>";
+
+  gboolean ret;
+  GstMPDClient *mpdclient = gst_mpd_client_new ();
+  GstMPDClient *new_mpdclient = gst_mpd_client_new ();
+
+  ret = gst_mpd_client_parse (mpdclient, xml, (gint) strlen (xml));
+  assert_equals_int (ret, TRUE);
+  assert_equals_int (g_list_length (mpdclient->mpd_root_node->Periods), 2);
+  oldPeriod0 = g_list_nth_data (mpdclient->mpd_root_node->Periods, 0);
+  oldPeriod1 = g_list_nth_data (mpdclient->mpd_root_node->Periods, 1);
+  segmentTemplate = ((GstMPDAdaptationSetNode *)
+      oldPeriod1->AdaptationSets->data)->SegmentTemplate;
+  oldSNode = g_queue_peek_head (&GST_MPD_MULT_SEGMENT_BASE_NODE
+      (segmentTemplate)->SegmentTimeline->S);
+
+  ret = gst_mpd_client_parse_update (new_mpdclient, mpdclient, updated_xml,
+      (gint) strlen (updated_xml));
+  assert_equals_int (ret, TRUE);
+  assert_equals_int (g_list_length (new_mpdclient->mpd_root_node->Periods), 2);
+  newPeriod0 = g_list_nth_data (new_mpdclient->mpd_root_node->Periods, 0);
+  newPeriod1 = g_list_nth_data (new_mpdclient->mpd_root_node->Periods, 1);
+
+  /* the first Period is shared, the second one got a new S element */
+  fail_unless (newPeriod0 == oldPeriod0);
+  fail_unless (newPeriod1 != oldPeriod1);
+  assert_equals_string (newPeriod1->id, "Period1");
+
+  segmentTemplate = ((GstMPDAdaptationSetNode *)
+      newPeriod1->AdaptationSets->data)->SegmentTemplate;
+  segmentTimeline =
+      GST_MPD_MULT_SEGMENT_BASE_NODE (segmentTemplate)->SegmentTimeline;
+  assert_equals_int (g_queue_get_length (&segmentTimeline->S), 2);
+  sNode = (GstMPDSNode *) g_queue_peek_head (&segmentTimeline->S);
+  assert_equals_uint64 (sNode->t, 0);
+  assert_equals_uint64 (sNode->d, 20);
+  assert_equals_int (sNode->r, 1);
+  /* the S element that was already there is not allocated again */
+  fail_unless (sNode == oldSNode);
+  /* a value with a character reference is still parsed */
+  sNode = (GstMPDSNode *) g_queue_peek_tail (&segmentTimeline->S);
+  assert_equals_uint64 (sNode->d, 30);
+  assert_equals_int (sNode->r, 0);
+
+  /* the shared Period outlives the client it was parsed for */
+  gst_mpd_client_free (mpdclient);
+  assert_equals_string (newPeriod0->id, "Period0");
+  ret =
+      gst_mpd_client_setup_media_presentation (new_mpdclient,
+      GST_CLOCK_TIME_NONE, -1, NULL);
+  assert_equals_int (ret, TRUE);
+
+  gst_mpd_client_free (new_mpdclient);
+}
+
+GST_END_TEST;
+
 /*
  * Test SegmentList with multiple inherited segmentURLs
  *
@@ -6439,6 +6769,7 @@ dash_suite (void)
   tcase_add_test (tc_simpleMPD, dash_mpdparser_period_subset);
   tcase_add_test (tc_simpleMPD, dash_mpdparser_utctiming);
   tcase_add_test (tc_simpleMPD, dash_mpdparser_utctiming_invalid_value);
+  tcase_add_test (tc_simpleMPD, dash_mpdparser_service_description);
 
   /* tests checking other possible values for attributes */
   tcase_add_test (tc_simpleMPD, dash_mpdparser_type_dynamic);
@@ -6483,7 +6814,10 @@ dash_suite (void)
   tcase_add_test (tc_complexMPD, dash_mpdparser_segment_list);
   tcase_add_test (tc_complexMPD, dash_mpdparser_segment_template);
   tcase_add_test (tc_complexMPD, dash_mpdparser_segment_timeline);
+  tcase_add_test (tc_complexMPD, dash_mpdparser_segment_timeline_runs);
   tcase_add_test (tc_complexMPD, dash_mpdparser_multiple_inherited_segmentURL);
+  tcase_add_test (tc_complexMPD, dash_mpdparser_availability_time_offset);
+  tcase_add_test (tc_complexMPD, dash_mpdparser_update_unchanged_periods);
 
   /* tests checking the parsing of missing/incomplete attributes of xml */
   tcase_add_test (tc_negativeTests, dash_mpdparser_missing_xml);
@@ -21,6 +21,19 @@
 #include <gst/check/gstcheck.h>
 #include "adaptive_demux_common.h"
 
+#if defined(HAVE_OPENSSL)
+#include <openssl/evp.h>
+#elif defined(HAVE_NETTLE)
+#include <nettle/aes.h>
+#include <nettle/cbc.h>
+#elif defined(HAVE_LIBGCRYPT)
+#include <gcrypt.h>
+#endif
+
+#if defined(HAVE_OPENSSL) || defined(HAVE_NETTLE) || defined(HAVE_LIBGCRYPT)
+#define HAVE_HLS_CRYPTO
+#endif
+
 #define DEMUX_ELEMENT_NAME "hlsdemux"
 
 #define TS_PACKET_LEN 188
@@ -52,6 +65,9 @@ typedef struct _GstHlsDemuxTestSelectBitrateContext
   gulong signal_handle;
 } GstHlsDemuxTestSelectBitrateContext;
 
+/* fragments can be fetched from several threads when prefetching */
+static GMutex state_lock;
+
 static GByteArray *
 generate_transport_stream (guint length)
 {
@@ -158,6 +174,7 @@ gst_hlsdemux_test_set_input_data (const GstHlsDemuxTestCase * test_case,
     output->response_headers = gst_structure_new ("response-headers",
         "Content-Type", G_TYPE_STRING, "video/mp2t", NULL);
   }
+  g_mutex_lock (&state_lock);
   if (gst_structure_has_field (test_case->state, "requests")) {
     GstHlsDemuxTestAppendUriContext context =
         { g_quark_from_string ("requests"), input->uri };
@@ -174,6 +191,7 @@ gst_hlsdemux_test_set_input_data (const GstHlsDemuxTestCase * test_case,
     g_value_unset (&uri_val);
     g_value_unset (&requests);
   }
+  g_mutex_unlock (&state_lock);
 }
 
 static gboolean
@@ -194,10 +212,12 @@ gst_hlsdemux_test_src_start (GstTestHTTPSrc * src,
       return TRUE;
     }
   }
+  g_mutex_lock (&state_lock);
   gst_structure_get_uint (test_case->state, "failure-count", &fail_count);
   fail_count++;
   gst_structure_set (test_case->state, "failure-count", G_TYPE_UINT,
       fail_count, NULL);
+  g_mutex_unlock (&state_lock);
   return FALSE;
 }
 
@@ -726,6 +746,440 @@ GST_START_TEST (testFragmentDownloadError)
 
 GST_END_TEST;
 
+#define PREFETCH_SEGMENT_SIZE (30 * TS_PACKET_LEN)
+
+static void
+testPrefetchPreTestCallback (GstAdaptiveDemuxTestEngine * engine,
+    gpointer user_data)
+{
+  g_object_set (engine->demux, "prefetch-fragments", 2, NULL);
+}
+
+/* All the fragments have the same content, check the data against it
+ * regardless of which fragment it comes from */
+static gboolean
+testPrefetchCheckReceivedData (GstAdaptiveDemuxTestEngine * engine,
+    GstAdaptiveDemuxTestOutputStream * stream, GstBuffer * buffer,
+    gpointer user_data)
+{
+  GstAdaptiveDemuxTestCase *testData = GST_ADAPTIVE_DEMUX_TEST_CASE (user_data);
+  GstAdaptiveDemuxTestExpectedOutput *testOutputStreamData;
+  guint64 offset;
+  GstMapInfo info;
+  gsize i;
+
+  testOutputStreamData =
+      gst_adaptive_demux_test_find_test_data_by_stream (testData, stream, NULL);
+  fail_unless (testOutputStreamData != NULL);
+
+  offset = stream->total_received_size + stream->segment_received_size;
+  fail_unless (gst_buffer_map (buffer, &info, GST_MAP_READ));
+  for (i = 0; i < info.size; i++) {
+    guint64 pos = (offset + i) % PREFETCH_SEGMENT_SIZE;
+
+    fail_unless (info.data[i] == testOutputStreamData->expected_data[pos],
+        "Received data differs at offset %" G_GUINT64_FORMAT, offset + i);
+  }
+  gst_buffer_unmap (buffer, &info);
+
+  return TRUE;
+}
+
+/*
+ * Test downloading fragments ahead of time. The data must still come out
+ * in order, and each fragment must only be downloaded once.
+ */
+GST_START_TEST (testPrefetch)
+{
+  const guint segment_size = PREFETCH_SEGMENT_SIZE;
+  const gchar *manifest =
+      "#EXTM3U \n"
+      "#EXT-X-TARGETDURATION:1\n"
+      "#EXTINF:1,Test\n" "001.ts\n"
+      "#EXTINF:1,Test\n" "002.ts\n"
+      "#EXTINF:1,Test\n" "003.ts\n"
+      "#EXTINF:1,Test\n" "004.ts\n" "#EXT-X-ENDLIST\n";
+  GstHlsDemuxTestInputData inputTestData[] = {
+    {"http://unit.test/media.m3u8", (guint8 *) manifest, 0},
+    {"http://unit.test/001.ts", NULL, segment_size},
+    {"http://unit.test/002.ts", NULL, segment_size},
+    {"http://unit.test/003.ts", NULL, segment_size},
+    {"http://unit.test/004.ts", NULL, segment_size},
+    {NULL, NULL, 0},
+  };
+  GstAdaptiveDemuxTestExpectedOutput outputTestData[] = {
+    {"src_0", 4 * segment_size, NULL},
+    {NULL, 0, NULL}
+  };
+  const GValue *requests;
+  guint i, j;
+  TESTCASE_INIT_BOILERPLATE (segment_size);
+
+  http_src_callbacks.src_start = gst_hlsdemux_test_src_start;
+  http_src_callbacks.src_create = gst_hlsdemux_test_src_create;
+  engine_callbacks.pre_test = testPrefetchPreTestCallback;
+  engine_callbacks.appsink_received_data = testPrefetchCheckReceivedData;
+  engine_callbacks.appsink_eos =
+      gst_adaptive_demux_test_check_size_of_received_data;
+
+  gst_test_http_src_install_callbacks (&http_src_callbacks, &hlsTestCase);
+  gst_adaptive_demux_test_run (DEMUX_ELEMENT_NAME,
+      inputTestData[0].uri, &engine_callbacks, engineTestData);
+
+  requests = gst_structure_get_value (hlsTestCase.state, "requests");
+  fail_unless (requests != NULL);
+  for (i = 1; inputTestData[i].uri; i++) {
+    guint count = 0;
+
+    for (j = 0; j < gst_value_array_get_size (requests); j++) {
+      const GValue *uri = gst_value_array_get_value (requests, j);
+
+      if (strcmp (g_value_get_string (uri), inputTestData[i].uri) == 0)
+        count++;
+    }
+    fail_unless_equals_int (count, 1);
+  }
+
+  TESTCASE_UNREF_BOILERPLATE;
+}
+
+GST_END_TEST;
+
+/* number of bytes that reached the appsink in the prefetch limit tests */
+static guint64 prefetch_received_bytes;
+
+static void
+testPrefetchMaxBytesPreTestCallback (GstAdaptiveDemuxTestEngine * engine,
+    gpointer user_data)
+{
+  g_object_set (engine->demux, "prefetch-fragments", 3,
+      "prefetch-max-bytes", (guint64) PREFETCH_SEGMENT_SIZE, NULL);
+}
+
+static void
+testPrefetchMaxTimePreTestCallback (GstAdaptiveDemuxTestEngine * engine,
+    gpointer user_data)
+{
+  g_object_set (engine->demux, "prefetch-fragments", 3,
+      "prefetch-max-time", (guint64) GST_SECOND, NULL);
+}
+
+static gboolean
+testPrefetchLimitCheckReceivedData (GstAdaptiveDemuxTestEngine * engine,
+    GstAdaptiveDemuxTestOutputStream * stream, GstBuffer * buffer,
+    gpointer user_data)
+{
+  g_mutex_lock (&state_lock);
+  prefetch_received_bytes += gst_buffer_get_size (buffer);
+  g_mutex_unlock (&state_lock);
+
+  return testPrefetchCheckReceivedData (engine, stream, buffer, user_data);
+}
+
+/* Both limits allow a single fragment after the current one: fragment n can
+ * only be requested once fragment n - 2 was entirely pushed out */
+static gboolean
+testPrefetchLimitSrcStart (GstTestHTTPSrc * src, const gchar * uri,
+    GstTestHTTPSrcInput * input_data, gpointer user_data)
+{
+  if (g_str_has_suffix (uri, ".ts")) {
+    gchar *basename = g_path_get_basename (uri);
+    guint64 n = g_ascii_strtoull (basename, NULL, 10);
+
+    g_free (basename);
+    fail_unless (n >= 1);
+
+    g_mutex_lock (&state_lock);
+    if (n > 2)
+      fail_unless (prefetch_received_bytes >= (n - 2) * PREFETCH_SEGMENT_SIZE,
+          "%s requested with only %" G_GUINT64_FORMAT " bytes received", uri,
+          prefetch_received_bytes);
+    g_mutex_unlock (&state_lock);
+  }
+
+  return gst_hlsdemux_test_src_start (src, uri, input_data, user_data);
+}
+
+static void
+run_prefetch_limit_test (void (*pre_test) (GstAdaptiveDemuxTestEngine *
+        engine, gpointer user_data))
+{
+  const guint segment_size = PREFETCH_SEGMENT_SIZE;
+  /* the byte ranges give the size of the fragments before they are
+   * downloaded, for the byte limit */
+  const gchar *manifest =
+      "#EXTM3U \n"
+      "#EXT-X-VERSION:4\n"
+      "#EXT-X-TARGETDURATION:1\n"
+      "#EXTINF:1,Test\n" "#EXT-X-BYTERANGE:5640@0\n" "001.ts\n"
+      "#EXTINF:1,Test\n" "#EXT-X-BYTERANGE:5640@0\n" "002.ts\n"
+      "#EXTINF:1,Test\n" "#EXT-X-BYTERANGE:5640@0\n" "003.ts\n"
+      "#EXTINF:1,Test\n" "#EXT-X-BYTERANGE:5640@0\n" "004.ts\n"
+      "#EXTINF:1,Test\n" "#EXT-X-BYTERANGE:5640@0\n" "005.ts\n"
+      "#EXTINF:1,Test\n" "#EXT-X-BYTERANGE:5640@0\n" "006.ts\n"
+      "#EXT-X-ENDLIST\n";
+  GstHlsDemuxTestInputData inputTestData[] = {
+    {"http://unit.test/media.m3u8", (guint8 *) manifest, 0},
+    {"http://unit.test/001.ts", NULL, segment_size},
+    {"http://unit.test/002.ts", NULL, segment_size},
+    {"http://unit.test/003.ts", NULL, segment_size},
+    {"http://unit.test/004.ts", NULL, segment_size},
+    {"http://unit.test/005.ts", NULL, segment_size},
+    {"http://unit.test/006.ts", NULL, segment_size},
+    {NULL, NULL, 0},
+  };
+  GstAdaptiveDemuxTestExpectedOutput outputTestData[] = {
+    {"src_0", 6 * segment_size, NULL},
+    {NULL, 0, NULL}
+  };
+  const GValue *requests;
+  guint i, j;
+  TESTCASE_INIT_BOILERPLATE (segment_size);
+
+  fail_unless_equals_int (segment_size, 5640);
+  prefetch_received_bytes = 0;
+
+  http_src_callbacks.src_start = testPrefetchLimitSrcStart;
+  http_src_callbacks.src_create = gst_hlsdemux_test_src_create;
+  engine_callbacks.pre_test = pre_test;
+  engine_callbacks.appsink_received_data = testPrefetchLimitCheckReceivedData;
+  engine_callbacks.appsink_eos =
+      gst_adaptive_demux_test_check_size_of_received_data;
+
+  gst_test_http_src_install_callbacks (&http_src_callbacks, &hlsTestCase);
+  gst_adaptive_demux_test_run (DEMUX_ELEMENT_NAME,
+      inputTestData[0].uri, &engine_callbacks, engineTestData);
+
+  /* the limits don't disable prefetching, nor cause extra downloads */
+  requests = gst_structure_get_value (hlsTestCase.state, "requests");
+  fail_unless (requests != NULL);
+  for (i = 1; inputTestData[i].uri; i++) {
+    guint count = 0;
+
+    for (j = 0; j < gst_value_array_get_size (requests); j++) {
+      const GValue *uri = gst_value_array_get_value (requests, j);
+
+      if (strcmp (g_value_get_string (uri), inputTestData[i].uri) == 0)
+        count++;
+    }
+    fail_unless_equals_int (count, 1);
+  }
+
+  TESTCASE_UNREF_BOILERPLATE;
+}
+
+/*
+ * Test that prefetch-max-bytes limits how many fragments are downloaded
+ * ahead of time.
+ */
+GST_START_TEST (testPrefetchMaxBytes)
+{
+  run_prefetch_limit_test (testPrefetchMaxBytesPreTestCallback);
+}
+
+GST_END_TEST;
+
+/*
+ * Test that prefetch-max-time limits how many fragments are downloaded
+ * ahead of time.
+ */
+GST_START_TEST (testPrefetchMaxTime)
+{
+  run_prefetch_limit_test (testPrefetchMaxTimePreTestCallback);
+}
+
+GST_END_TEST;
+
+#ifdef HAVE_HLS_CRYPTO
+
+/* Larger than two of the blocks hlsdemux decrypts at once */
+#define ENCRYPTED_SEGMENT_SIZE (1800 * TS_PACKET_LEN)
+
+static const guint8 encryption_keys[2][16] = {
+  {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+      0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff},
+  {0x0f, 0x1e, 0x2d, 0x3c, 0x4b, 0x5a, 0x69, 0x78,
+      0x87, 0x96, 0xa5, 0xb4, 0xc3, 0xd2, 0xe1, 0xf0},
+};
+
+/* the IVs of the manifest below */
+static const guint8 encryption_ivs[2][16] = {
+  {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+      0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f},
+  {0x0f, 0x0e, 0x0d, 0x0c, 0x0b, 0x0a, 0x09, 0x08,
+      0x07, 0x06, 0x05, 0x04, 0x03, 0x02, 0x01, 0x00},
+};
+
+/* AES-128-CBC with PKCS7 padding, as described by the HLS specification */
+static GByteArray *
+encrypt_fragment (const guint8 * data, guint size, const guint8 * key,
+    const guint8 * iv)
+{
+  GByteArray *encrypted;
+  guint8 *padded;
+  guint padded_size;
+  guint pad;
+
+  pad = 16 - size % 16;
+  padded_size = size + pad;
+  padded = g_malloc (padded_size);
+  memcpy (padded, data, size);
+  memset (padded + size, pad, pad);
+
+  encrypted = g_byte_array_sized_new (padded_size);
+  g_byte_array_set_size (encrypted, padded_size);
+
+#if defined(HAVE_OPENSSL)
+  {
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new ();
+    gint len;
+
+    fail_unless (EVP_EncryptInit_ex (ctx, EVP_aes_128_cbc (), NULL, key, iv));
+    EVP_CIPHER_CTX_set_padding (ctx, 0);
+    fail_unless (EVP_EncryptUpdate (ctx, encrypted->data, &len, padded,
+            padded_size));
+    fail_unless_equals_int (len, padded_size);
+    EVP_CIPHER_CTX_free (ctx);
+  }
+#elif defined(HAVE_NETTLE)
+  {
+    struct CBC_CTX (struct aes128_ctx, AES_BLOCK_SIZE) ctx;
+
+    aes128_set_encrypt_key (&ctx.ctx, key);
+    CBC_SET_IV (&ctx, iv);
+    CBC_ENCRYPT (&ctx, aes128_encrypt, padded_size, encrypted->data, padded);
+  }
+#elif defined(HAVE_LIBGCRYPT)
+  {
+    gcry_cipher_hd_t handle;
+
+    gcry_check_version (NULL);
+    fail_if (gcry_cipher_open (&handle, GCRY_CIPHER_AES128,
+            GCRY_CIPHER_MODE_CBC, 0));
+    fail_if (gcry_cipher_setkey (handle, key, 16));
+    fail_if (gcry_cipher_setiv (handle, iv, 16));
+    fail_if (gcry_cipher_encrypt (handle, encrypted->data, padded_size, padded,
+            padded_size));
+    gcry_cipher_close (handle);
+  }
+#endif
+
+  g_free (padded);
+
+  return encrypted;
+}
+
+/* the test case of testSeekDuringKeyFetch, for the HTTP src callbacks */
+static GstAdaptiveDemuxTestCase *key_fetch_test_data;
+static guint key_fetch_count;
+static gboolean key_fetch_timed_out;
+
+/* The first download of the key of the second fragment is the prefetch done
+ * at the start of the first fragment. It is held until the seek, or for 5
+ * seconds if the stream waits for it, which would keep the seek from
+ * happening. */
+static gboolean
+testSeekDuringKeyFetchSrcStart (GstTestHTTPSrc * src, const gchar * uri,
+    GstTestHTTPSrcInput * input_data, gpointer user_data)
+{
+  if (g_str_has_suffix (uri, "key2.bin")) {
+    gboolean hold;
+    guint i;
+
+    g_mutex_lock (&state_lock);
+    hold = (key_fetch_count++ == 0);
+    g_mutex_unlock (&state_lock);
+
+    for (i = 0; hold && i < 500; i++) {
+      g_mutex_lock (&key_fetch_test_data->test_task_state_lock);
+      hold = key_fetch_test_data->test_task_state ==
+          TEST_TASK_STATE_NOT_STARTED;
+      g_mutex_unlock (&key_fetch_test_data->test_task_state_lock);
+      if (hold)
+        g_usleep (10 * 1000);
+    }
+
+    if (hold) {
+      g_mutex_lock (&state_lock);
+      key_fetch_timed_out = TRUE;
+      g_mutex_unlock (&state_lock);
+    }
+  }
+
+  return gst_hlsdemux_test_src_start (src, uri, input_data, user_data);
+}
+
+/*
+ * Test decrypting fragments larger than the decryption blocks, and seeking
+ * while the key of the next fragment is being prefetched. The stream must
+ * not wait for that prefetch, and the seek must stop it.
+ */
+GST_START_TEST (testSeekDuringKeyFetch)
+{
+  const guint segment_size = ENCRYPTED_SEGMENT_SIZE;
+  const gchar *manifest =
+      "#EXTM3U \n"
+      "#EXT-X-TARGETDURATION:1\n"
+      "#EXT-X-KEY:METHOD=AES-128,URI=\"key1.bin\","
+      "IV=0x000102030405060708090a0b0c0d0e0f\n"
+      "#EXTINF:1,Test\n" "001.ts\n"
+      "#EXT-X-KEY:METHOD=AES-128,URI=\"key2.bin\","
+      "IV=0x0f0e0d0c0b0a09080706050403020100\n"
+      "#EXTINF:1,Test\n" "002.ts\n" "#EXT-X-ENDLIST\n";
+  GstHlsDemuxTestInputData inputTestData[] = {
+    {"http://unit.test/media.m3u8", (guint8 *) manifest, 0},
+    {"http://unit.test/key1.bin", encryption_keys[0], 16},
+    {"http://unit.test/key2.bin", encryption_keys[1], 16},
+    {"http://unit.test/001.ts", NULL, 0},
+    {"http://unit.test/002.ts", NULL, 0},
+    {NULL, NULL, 0},
+  };
+  GstAdaptiveDemuxTestExpectedOutput outputTestData[] = {
+    {"src_0", 2 * segment_size, NULL},
+    {NULL, 0, NULL}
+  };
+  GByteArray *encrypted[2];
+  guint i;
+  TESTCASE_INIT_BOILERPLATE (segment_size);
+
+  for (i = 0; i < 2; i++) {
+    encrypted[i] = encrypt_fragment (mpeg_ts->data, segment_size,
+        encryption_keys[i], encryption_ivs[i]);
+    inputTestData[3 + i].payload = encrypted[i]->data;
+    inputTestData[3 + i].size = encrypted[i]->len;
+  }
+
+  key_fetch_test_data = engineTestData;
+  key_fetch_count = 0;
+  key_fetch_timed_out = FALSE;
+
+  http_src_callbacks.src_start = testSeekDuringKeyFetchSrcStart;
+  http_src_callbacks.src_create = gst_hlsdemux_test_src_create;
+  /* seek back to the start once the second fragment is being output */
+  engineTestData->threshold_for_seek = segment_size + 20 * TS_PACKET_LEN;
+  engineTestData->seek_event =
+      gst_event_new_seek (1.0, GST_FORMAT_TIME,
+      GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT, GST_SEEK_TYPE_SET, 0,
+      GST_SEEK_TYPE_NONE, 0);
+
+  gst_test_http_src_install_callbacks (&http_src_callbacks, &hlsTestCase);
+  gst_adaptive_demux_test_seek (DEMUX_ELEMENT_NAME,
+      inputTestData[0].uri, engineTestData);
+
+  fail_unless (engineTestData->seeked);
+  fail_if (key_fetch_timed_out, "The stream waited for the key prefetch");
+  fail_unless (key_fetch_count >= 2);
+
+  key_fetch_test_data = NULL;
+  for (i = 0; i < 2; i++)
+    g_byte_array_free (encrypted[i], TRUE);
+  TESTCASE_UNREF_BOILERPLATE;
+}
+
+GST_END_TEST;
+
+#endif /* HAVE_HLS_CRYPTO */
+
 static Suite *
 hls_demux_suite (void)
 {
@@ -745,6 +1199,12 @@ hls_demux_suite (void)
   tcase_add_test (tc_basicTest, testSeekSnapAfterPosition);
   tcase_add_test (tc_basicTest, testReverseSeekSnapBeforePosition);
   tcase_add_test (tc_basicTest, testReverseSeekSnapAfterPosition);
+  tcase_add_test (tc_basicTest, testPrefetch);
+  tcase_add_test (tc_basicTest, testPrefetchMaxBytes);
+  tcase_add_test (tc_basicTest, testPrefetchMaxTime);
+#ifdef HAVE_HLS_CRYPTO
+  tcase_add_test (tc_basicTest, testSeekDuringKeyFetch);
+#endif
 
   tcase_add_unchecked_fixture (tc_basicTest, gst_adaptive_demux_test_setup,
       gst_adaptive_demux_test_teardown);
@@ -82,6 +82,19 @@ https://priv.example.com/fileSequence3003.ts\n\
 #EXTINF:8,\n\
 https://priv.example.com/fileSequence3004.ts";
 
+static const gchar *LIVE_SLIDING_PLAYLIST = "#EXTM3U\n\
+#EXT-X-TARGETDURATION:8\n\
+#EXT-X-MEDIA-SEQUENCE:2682\n\
+\n\
+#EXTINF:8,\n\
+fileSequence2682.ts\n\
+#EXTINF:8,\n\
+fileSequence2683.ts\n\
+#EXTINF:8,\n\
+fileSequence2684.ts\n\
+#EXTINF:8,\n\
+fileSequence2685.ts";
+
 static const gchar *VARIANT_PLAYLIST = "#EXTM3U \n\
 #EXT-X-STREAM-INF:PROGRAM-ID=1,BANDWIDTH=128000\n\
 http://example.com/low.m3u8\n\
@@ -335,6 +348,46 @@ main.mp4\n\
 main.mp4\n\
 #EXT-X-ENDLIST";
 
+static const gchar *LOW_LATENCY_PLAYLIST = "#EXTM3U\n\
+#EXT-X-TARGETDURATION:4\n\
+#EXT-X-VERSION:6\n\
+#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=3.0\n\
+#EXT-X-PART-INF:PART-TARGET=1.0\n\
+#EXT-X-MEDIA-SEQUENCE:266\n\
+#EXTINF:4.0,\n\
+fileSequence266.mp4\n\
+#EXT-X-PART:DURATION=1.0,URI=\"filePart267.0.mp4\",INDEPENDENT=YES\n\
+#EXT-X-PART:DURATION=1.0,URI=\"filePart267.1.mp4\"\n\
+#EXT-X-PART:DURATION=1.0,URI=\"filePart267.2.mp4\",INDEPENDENT=YES\n\
+#EXT-X-PART:DURATION=1.0,URI=\"filePart267.3.mp4\"\n\
+#EXTINF:4.0,\n\
+fileSequence267.mp4\n\
+#EXT-X-PART:DURATION=1.0,URI=\"filePart268.0.mp4\",INDEPENDENT=YES\n\
+#EXT-X-PART:DURATION=1.0,URI=\"filePart268.1.mp4\"\n\
+#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"filePart268.2.mp4\"\n\
+#EXT-X-RENDITION-REPORT:URI=\"1M/waitForMSN.php\",LAST-MSN=268,LAST-PART=1\n\
+#EXT-X-RENDITION-REPORT:URI=\"4M/waitForMSN.php\",LAST-MSN=268,LAST-PART=0\n";
+
+static const gchar *LOW_LATENCY_UPDATED_PLAYLIST = "#EXTM3U\n\
+#EXT-X-TARGETDURATION:4\n\
+#EXT-X-VERSION:6\n\
+#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=3.0\n\
+#EXT-X-PART-INF:PART-TARGET=1.0\n\
+#EXT-X-MEDIA-SEQUENCE:267\n\
+#EXT-X-PART:DURATION=1.0,URI=\"filePart267.0.mp4\",INDEPENDENT=YES\n\
+#EXT-X-PART:DURATION=1.0,URI=\"filePart267.1.mp4\"\n\
+#EXT-X-PART:DURATION=1.0,URI=\"filePart267.2.mp4\",INDEPENDENT=YES\n\
+#EXT-X-PART:DURATION=1.0,URI=\"filePart267.3.mp4\"\n\
+#EXTINF:4.0,\n\
+fileSequence267.mp4\n\
+#EXT-X-PART:DURATION=1.0,URI=\"filePart268.0.mp4\",INDEPENDENT=YES\n\
+#EXT-X-PART:DURATION=1.0,URI=\"filePart268.1.mp4\"\n\
+#EXT-X-PART:DURATION=1.0,URI=\"filePart268.2.mp4\"\n\
+#EXTINF:3.0,\n\
+fileSequence268.mp4\n\
+#EXT-X-PART:DURATION=1.0,URI=\"filePart269.0.mp4\",INDEPENDENT=YES\n\
+#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"filePart269.1.mp4\"\n";
+
 static GstHLSMasterPlaylist *
 load_playlist (const gchar * data)
 {
@@ -714,6 +767,45 @@ GST_START_TEST (test_update_playlist)
 
 GST_END_TEST;
 
+GST_START_TEST (test_update_playlist_incremental)
+{
+  GstHLSMasterPlaylist *master;
+  GstM3U8 *pl;
+  GstM3U8MediaFile *file2682, *file2683, *file;
+  GList *files;
+
+  master = load_playlist (LIVE_PLAYLIST);
+  pl = master->default_variant->m3u8;
+  gst_m3u8_set_uri (pl, "https://priv.example.com/live.m3u8", NULL, NULL);
+
+  file2682 = gst_m3u8_media_file_ref (g_list_nth_data (pl->files, 2));
+  file2683 = gst_m3u8_media_file_ref (g_list_nth_data (pl->files, 3));
+
+  /* Nothing is done if the playlist didn't change */
+  files = pl->files;
+  fail_unless (gst_m3u8_update (pl, g_strdup (LIVE_PLAYLIST)));
+  fail_unless (pl->files == files);
+
+  /* Segments still listed are kept, expired ones are dropped */
+  fail_unless (gst_m3u8_update (pl, g_strdup (LIVE_SLIDING_PLAYLIST)));
+  assert_equals_int (g_list_length (pl->files), 4);
+  fail_unless (g_list_nth_data (pl->files, 0) == file2682);
+  fail_unless (g_list_nth_data (pl->files, 1) == file2683);
+  assert_equals_int (file2682->ref_count, 2);
+
+  file = g_list_nth_data (pl->files, 2);
+  assert_equals_string (file->uri,
+      "https://priv.example.com/fileSequence2684.ts");
+  assert_equals_int (file->sequence, 2684);
+  assert_equals_uint64 (file->duration, 8 * GST_SECOND);
+
+  gst_m3u8_media_file_unref (file2682);
+  gst_m3u8_media_file_unref (file2683);
+  gst_hls_master_playlist_unref (master);
+}
+
+GST_END_TEST;
+
 GST_START_TEST (test_playlist_media_files)
 {
   GstHLSMasterPlaylist *master;
@@ -845,6 +937,148 @@ GST_START_TEST (test_get_next_fragment)
 
 GST_END_TEST;
 
+GST_START_TEST (test_low_latency_playlist)
+{
+  GstHLSMasterPlaylist *master;
+  GstM3U8 *pl;
+  GstM3U8MediaFile *file;
+  GstM3U8PartialSegment *part;
+  gint64 msn;
+  gint last_part;
+
+  master = load_playlist (LOW_LATENCY_PLAYLIST);
+  pl = master->default_variant->m3u8;
+
+  assert_equals_int (gst_m3u8_is_live (pl), TRUE);
+  assert_equals_uint64 (pl->part_target, GST_SECOND);
+  assert_equals_uint64 (pl->part_hold_back, 3 * GST_SECOND);
+  assert_equals_int (pl->can_block_reload, TRUE);
+
+  /* Only complete segments are media files */
+  assert_equals_int (g_list_length (pl->files), 2);
+  file = GST_M3U8_MEDIA_FILE (g_list_first (pl->files)->data);
+  fail_unless (file->partial_segments == NULL);
+  file = GST_M3U8_MEDIA_FILE (g_list_last (pl->files)->data);
+  assert_equals_int (file->sequence, 267);
+  assert_equals_int (file->partial_segments->len, 4);
+  part = g_ptr_array_index (file->partial_segments, 2);
+  assert_equals_string (part->uri, "http://localhost/filePart267.2.mp4");
+  assert_equals_uint64 (part->duration, GST_SECOND);
+  assert_equals_int (part->independent, TRUE);
+  part = g_ptr_array_index (file->partial_segments, 3);
+  assert_equals_int (part->independent, FALSE);
+
+  /* The segment in progress comes after them */
+  fail_unless (pl->partial_file != NULL);
+  assert_equals_int (pl->partial_file->sequence, 268);
+  assert_equals_int (pl->partial_file->partial_segments->len, 2);
+  fail_unless (pl->preload_hint != NULL);
+  assert_equals_string (pl->preload_hint->uri,
+      "http://localhost/filePart268.2.mp4");
+  assert_equals_int (pl->preload_hint_sequence, 268);
+  assert_equals_int (pl->preload_hint_part, 2);
+
+  fail_unless (gst_m3u8_get_blocking_reload_position (pl, &msn, &last_part));
+  assert_equals_int64 (msn, 268);
+  assert_equals_int (last_part, 2);
+
+  fail_unless (gst_m3u8_get_rendition_report (pl,
+          "http://localhost/1M/waitForMSN.php", &msn, &last_part));
+  assert_equals_int64 (msn, 268);
+  assert_equals_int (last_part, 1);
+  fail_if (gst_m3u8_get_rendition_report (pl,
+          "http://localhost/2M/waitForMSN.php", &msn, &last_part));
+
+  gst_hls_master_playlist_unref (master);
+
+  /* Regular live playlists play whole segments */
+  master = load_playlist (LIVE_PLAYLIST);
+  pl = master->default_variant->m3u8;
+  assert_equals_int (gst_m3u8_is_low_latency (pl), FALSE);
+  fail_if (gst_m3u8_get_blocking_reload_position (pl, &msn, &last_part));
+  gst_hls_master_playlist_unref (master);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_low_latency_get_next_fragment)
+{
+  GstHLSMasterPlaylist *master;
+  GstM3U8 *pl;
+  GstM3U8MediaFile *mf;
+  gboolean discontinuous;
+  GstClockTime timestamp;
+  gint64 msn;
+  gint last_part;
+
+  master = load_playlist (LOW_LATENCY_PLAYLIST);
+  pl = master->default_variant->m3u8;
+
+  /* Playback starts at the first independent part PART-HOLD-BACK from the
+   * end */
+  assert_equals_int (gst_m3u8_is_low_latency (pl), TRUE);
+  assert_equals_int (pl->sequence, 267);
+  assert_equals_int (pl->part, 2);
+
+  mf = gst_m3u8_get_next_fragment (pl, TRUE, &timestamp, &discontinuous);
+  fail_unless (mf != NULL);
+  assert_equals_int (discontinuous, FALSE);
+  assert_equals_string (mf->uri, "http://localhost/filePart267.2.mp4");
+  assert_equals_uint64 (timestamp, 6 * GST_SECOND);
+  assert_equals_uint64 (mf->duration, GST_SECOND);
+  assert_equals_int (mf->incomplete, FALSE);
+  gst_m3u8_media_file_unref (mf);
+
+  mf = gst_m3u8_peek_fragment (pl, TRUE, 2);
+  fail_unless (mf != NULL);
+  assert_equals_string (mf->uri, "http://localhost/filePart268.0.mp4");
+  gst_m3u8_media_file_unref (mf);
+
+  /* Parts of the next segment follow the last part of a complete one */
+  gst_m3u8_advance_fragment (pl, TRUE);
+  gst_m3u8_advance_fragment (pl, TRUE);
+  mf = gst_m3u8_get_next_fragment (pl, TRUE, &timestamp, &discontinuous);
+  fail_unless (mf != NULL);
+  assert_equals_string (mf->uri, "http://localhost/filePart268.0.mp4");
+  assert_equals_int (mf->sequence, 268);
+  assert_equals_uint64 (timestamp, 8 * GST_SECOND);
+  gst_m3u8_media_file_unref (mf);
+
+  /* and the preload hint follows the listed parts */
+  gst_m3u8_advance_fragment (pl, TRUE);
+  gst_m3u8_advance_fragment (pl, TRUE);
+  mf = gst_m3u8_get_next_fragment (pl, TRUE, &timestamp, &discontinuous);
+  fail_unless (mf != NULL);
+  assert_equals_string (mf->uri, "http://localhost/filePart268.2.mp4");
+  assert_equals_uint64 (timestamp, 10 * GST_SECOND);
+  assert_equals_uint64 (mf->duration, GST_SECOND);
+  assert_equals_int (mf->incomplete, TRUE);
+  gst_m3u8_media_file_unref (mf);
+  assert_equals_int (gst_m3u8_has_next_fragment (pl, TRUE), FALSE);
+
+  /* Nothing more until the playlist is reloaded */
+  gst_m3u8_advance_fragment (pl, TRUE);
+  mf = gst_m3u8_get_next_fragment (pl, TRUE, &timestamp, &discontinuous);
+  fail_unless (mf == NULL);
+
+  fail_unless (gst_m3u8_update (pl, g_strdup (LOW_LATENCY_UPDATED_PLAYLIST)));
+  fail_unless (gst_m3u8_get_blocking_reload_position (pl, &msn, &last_part));
+  assert_equals_int64 (msn, 269);
+  assert_equals_int (last_part, 1);
+
+  /* Segment 268 ended up with 3 parts, so its successor comes next */
+  mf = gst_m3u8_get_next_fragment (pl, TRUE, &timestamp, &discontinuous);
+  fail_unless (mf != NULL);
+  assert_equals_string (mf->uri, "http://localhost/filePart269.0.mp4");
+  assert_equals_int (mf->sequence, 269);
+  assert_equals_uint64 (timestamp, 11 * GST_SECOND);
+  gst_m3u8_media_file_unref (mf);
+
+  gst_hls_master_playlist_unref (master);
+}
+
+GST_END_TEST;
+
 GST_START_TEST (test_get_duration)
 {
   GstHLSMasterPlaylist *master;
@@ -1495,9 +1729,12 @@ hlsdemux_suite (void)
   tcase_add_test (tc_m3u8, test_playlist_with_encryption);
   tcase_add_test (tc_m3u8, test_update_invalid_playlist);
   tcase_add_test (tc_m3u8, test_update_playlist);
+  tcase_add_test (tc_m3u8, test_update_playlist_incremental);
   tcase_add_test (tc_m3u8, test_playlist_media_files);
   tcase_add_test (tc_m3u8, test_playlist_byte_range_media_files);
   tcase_add_test (tc_m3u8, test_get_next_fragment);
+  tcase_add_test (tc_m3u8, test_low_latency_playlist);
+  tcase_add_test (tc_m3u8, test_low_latency_get_next_fragment);
   tcase_add_test (tc_m3u8, test_get_duration);
   tcase_add_test (tc_m3u8, test_get_target_duration);
   tcase_add_test (tc_m3u8, test_get_stream_for_bitrate);
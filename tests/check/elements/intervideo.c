@@ -0,0 +1,264 @@
+/* GStreamer
+ *
+ * intervideo.c: unit tests for the frame ring of intervideosink and
+ * intervideosrc
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gst/check/gstcheck.h>
+#include <gst/check/gstharness.h>
+
+#include "../../../gst/inter/gstintersurface.h"
+
+#define VIDEO_CAPS "video/x-raw,format=GRAY8,width=8,height=8,framerate=30/1"
+#define FRAME_SIZE (8 * 8)
+
+static GstBuffer *
+create_frame (guint8 value, GstClockTime pts)
+{
+  GstBuffer *buf = gst_buffer_new_allocate (NULL, FRAME_SIZE, NULL);
+
+  gst_buffer_memset (buf, 0, value, FRAME_SIZE);
+  GST_BUFFER_PTS (buf) = pts;
+
+  return buf;
+}
+
+static guint8
+frame_value (GstBuffer * buf)
+{
+  guint8 value;
+
+  fail_unless_equals_int (gst_buffer_extract (buf, 0, &value, 1), 1);
+
+  return value;
+}
+
+GST_START_TEST (test_ring_readers)
+{
+  GstInterSurface *surface;
+  GstInterFrame *frame, *kept;
+  GstBuffer *bufs[10];
+  guint64 lost = 0;
+  guint read_index = 0, other_index = 4;
+  guint i;
+
+  surface = gst_inter_surface_get ("ring-test");
+  /* rounded up to a power of two */
+  gst_inter_surface_set_video_ring_size (surface, 3);
+  fail_unless_equals_int (surface->video_ring_size, 4);
+
+  for (i = 0; i < G_N_ELEMENTS (bufs); i++)
+    bufs[i] = create_frame (i, i * GST_SECOND);
+
+  for (i = 0; i < 6; i++)
+    gst_inter_surface_push_video_frame (surface, bufs[i], i * GST_SECOND);
+
+  /* the two oldest frames were replaced */
+  for (i = 0; i < 2; i++)
+    ASSERT_BUFFER_REFCOUNT (bufs[i], "buffer", 1);
+
+  for (i = 2; i < 6; i++) {
+    frame = gst_inter_surface_read_video_frame (surface, &read_index, &lost);
+    fail_unless (frame != NULL);
+    fail_unless (frame->buffer == bufs[i]);
+    fail_unless_equals_uint64 (frame->time, i * GST_SECOND);
+    if (i < 5)
+      gst_inter_frame_unref (frame);
+  }
+  fail_unless_equals_uint64 (lost, 2);
+  fail_unless (gst_inter_surface_read_video_frame (surface, &read_index,
+          &lost) == NULL);
+  kept = frame;
+
+  /* reading doesn't take the frames out, another reader gets them too */
+  lost = 0;
+  for (i = 4; i < 6; i++) {
+    frame = gst_inter_surface_read_video_frame (surface, &other_index, &lost);
+    fail_unless (frame != NULL);
+    fail_unless (frame->buffer == bufs[i]);
+    gst_inter_frame_unref (frame);
+  }
+  fail_unless_equals_uint64 (lost, 0);
+
+  /* a frame that was read stays valid once replaced in the ring */
+  for (i = 6; i < 10; i++)
+    gst_inter_surface_push_video_frame (surface, bufs[i], i * GST_SECOND);
+  ASSERT_BUFFER_REFCOUNT (bufs[5], "buffer", 2);
+  fail_unless (kept->buffer == bufs[5]);
+  gst_inter_frame_unref (kept);
+  ASSERT_BUFFER_REFCOUNT (bufs[5], "buffer", 1);
+
+  frame = gst_inter_surface_read_video_frame (surface, &read_index, &lost);
+  fail_unless (frame != NULL);
+  fail_unless (frame->buffer == bufs[6]);
+  gst_inter_frame_unref (frame);
+
+  /* after the ring was cleared, there is nothing left to read */
+  gst_inter_surface_clear_video_ring (surface);
+  fail_unless (gst_inter_surface_read_video_frame (surface, &read_index,
+          &lost) == NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (bufs); i++) {
+    ASSERT_BUFFER_REFCOUNT (bufs[i], "buffer", 1);
+    gst_buffer_unref (bufs[i]);
+  }
+
+  gst_inter_surface_unref (surface);
+}
+
+GST_END_TEST;
+
+static GstHarness *
+setup_inter_sink (const gchar * channel)
+{
+  GstElement *sink;
+  GstHarness *h;
+
+  sink = gst_element_factory_make ("intervideosink", NULL);
+  fail_unless (sink != NULL);
+  g_object_set (sink, "channel", channel, "ring-size", 8, "sync", FALSE,
+      "show-preroll-frame", FALSE, NULL);
+
+  h = gst_harness_new_with_element (sink, "sink", NULL);
+  gst_object_unref (sink);
+  gst_harness_use_testclock (h);
+  gst_harness_set_src_caps_str (h, VIDEO_CAPS);
+
+  return h;
+}
+
+static GstHarness *
+setup_inter_src (const gchar * channel)
+{
+  GstHarness *h;
+
+  h = gst_harness_new_with_padnames ("intervideosrc", NULL, "src");
+  g_object_set (h->element, "channel", channel, NULL);
+  gst_harness_use_testclock (h);
+  gst_harness_play (h);
+
+  return h;
+}
+
+/* Pulls the next frame of @h and checks that it is the one filled with
+ * @value */
+static void
+pull_frame (GstHarness * h, guint8 value)
+{
+  GstBuffer *buf;
+
+  fail_unless (gst_harness_crank_single_clock_wait (h));
+  buf = gst_harness_pull (h);
+  fail_unless (buf != NULL);
+  fail_unless_equals_int (frame_value (buf), value);
+  gst_buffer_unref (buf);
+}
+
+static void
+check_counters (GstHarness * h, guint64 expected_drop,
+    guint64 expected_duplicate)
+{
+  guint64 drop, duplicate;
+
+  g_object_get (h->element, "drop", &drop, "duplicate", &duplicate, NULL);
+  fail_unless_equals_uint64 (drop, expected_drop);
+  fail_unless_equals_uint64 (duplicate, expected_duplicate);
+}
+
+/* The sink renders four frames at 0, 10, 60 and 90 ms. The source outputs
+ * 30 fps and picks the most recent frame due in the middle of each of its
+ * frames, at 16.7, 50, 83.3 and 116.7 ms: the first frame is dropped and
+ * the second one is output twice */
+static void
+push_test_frames (GstHarness * h)
+{
+  static const guint times[] = { 0, 10, 60, 90 };
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (times); i++)
+    fail_unless_equals_int (gst_harness_push (h, create_frame (i + 1,
+                times[i] * GST_MSECOND)), GST_FLOW_OK);
+}
+
+static void
+pull_test_frames (GstHarness * h)
+{
+  pull_frame (h, 2);
+  pull_frame (h, 2);
+  pull_frame (h, 3);
+  pull_frame (h, 4);
+}
+
+GST_START_TEST (test_drop_duplicate)
+{
+  GstHarness *h_sink, *h_src;
+
+  h_sink = setup_inter_sink ("drop-duplicate-test");
+  push_test_frames (h_sink);
+
+  h_src = setup_inter_src ("drop-duplicate-test");
+  pull_test_frames (h_src);
+  check_counters (h_src, 1, 1);
+
+  gst_harness_teardown (h_src);
+  gst_harness_teardown (h_sink);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_two_sources)
+{
+  GstHarness *h_sink, *h_src1, *h_src2;
+
+  h_sink = setup_inter_sink ("two-sources-test");
+  push_test_frames (h_sink);
+
+  /* both sources see all the frames, they don't split them */
+  h_src1 = setup_inter_src ("two-sources-test");
+  h_src2 = setup_inter_src ("two-sources-test");
+  pull_test_frames (h_src1);
+  pull_test_frames (h_src2);
+  check_counters (h_src1, 1, 1);
+  check_counters (h_src2, 1, 1);
+
+  gst_harness_teardown (h_src1);
+  gst_harness_teardown (h_src2);
+  gst_harness_teardown (h_sink);
+}
+
+GST_END_TEST;
+
+static Suite *
+intervideo_suite (void)
+{
+  Suite *s = suite_create ("intervideo");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_ring_readers);
+  tcase_add_test (tc_chain, test_drop_duplicate);
+  tcase_add_test (tc_chain, test_two_sources);
+
+  return s;
+}
+
+GST_CHECK_MAIN (intervideo);
@@ -0,0 +1,445 @@
+/* GStreamer
+ *
+ * ipcpipeline.c: unit tests for the buffer flow between ipcpipelinesink and
+ * ipcpipelinesrc
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <gst/check/gstcheck.h>
+#include <gst/allocators/allocators.h>
+
+#ifdef HAVE_MEMFD_CREATE
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define FD_BUFFER_SIZE 4096
+
+static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
+    GST_PAD_SRC,
+    GST_PAD_ALWAYS,
+    GST_STATIC_CAPS_ANY);
+
+/* The master pipeline is only an ipcpipelinesink fed by srcpad, the slave
+ * pipeline an ipcpipelinesrc and a fakesink whose buffers are kept by the
+ * test, which also decides of their flow return */
+static int sockets[2];
+static GstElement *master, *slave, *ipcsink, *ipcsrc;
+static GstPad *srcpad;
+
+static GMutex slave_lock;
+static GCond slave_cond;
+static gboolean slave_blocked;
+static GstFlowReturn slave_ret;
+static GList *slave_buffers;
+
+static GstPadProbeReturn
+slave_buffer_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER (info);
+
+  g_mutex_lock (&slave_lock);
+  while (slave_blocked)
+    g_cond_wait (&slave_cond, &slave_lock);
+  slave_buffers = g_list_append (slave_buffers, buf);
+  GST_PAD_PROBE_INFO_FLOW_RETURN (info) = slave_ret;
+  g_cond_broadcast (&slave_cond);
+  g_mutex_unlock (&slave_lock);
+
+  return GST_PAD_PROBE_HANDLED;
+}
+
+static void
+set_slave_blocked (gboolean blocked)
+{
+  g_mutex_lock (&slave_lock);
+  slave_blocked = blocked;
+  g_cond_broadcast (&slave_cond);
+  g_mutex_unlock (&slave_lock);
+}
+
+static void
+set_slave_ret (GstFlowReturn ret)
+{
+  g_mutex_lock (&slave_lock);
+  slave_ret = ret;
+  g_mutex_unlock (&slave_lock);
+}
+
+static void
+wait_slave_buffers (guint n)
+{
+  g_mutex_lock (&slave_lock);
+  while (g_list_length (slave_buffers) < n)
+    g_cond_wait (&slave_cond, &slave_lock);
+  g_mutex_unlock (&slave_lock);
+}
+
+static void
+push_segment (void)
+{
+  GstSegment segment;
+
+  gst_segment_init (&segment, GST_FORMAT_TIME);
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_segment (&segment)));
+}
+
+static GstFlowReturn
+push_buffer (void)
+{
+  return gst_pad_push (srcpad, gst_buffer_new_allocate (NULL, 16, NULL));
+}
+
+static void
+setup_ipcpipeline (guint max_pending_buffers, gboolean pass_fds,
+    guint64 ack_time)
+{
+  GstElement *fakesink;
+  GstPad *sinkpad;
+  guint n;
+
+  fail_unless (socketpair (AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+  for (n = 0; n < 2; n++)
+    fail_unless (fcntl (sockets[n], F_SETFL, O_NONBLOCK) == 0);
+
+  slave_blocked = FALSE;
+  slave_ret = GST_FLOW_OK;
+  slave_buffers = NULL;
+
+  slave = gst_element_factory_make ("ipcslavepipeline", NULL);
+  ipcsrc = gst_element_factory_make ("ipcpipelinesrc", NULL);
+  fakesink = gst_element_factory_make ("fakesink", NULL);
+  fail_unless (slave && ipcsrc && fakesink);
+  g_object_set (fakesink, "sync", FALSE, "async", FALSE, NULL);
+  gst_bin_add_many (GST_BIN (slave), ipcsrc, fakesink, NULL);
+  fail_unless (gst_element_link (ipcsrc, fakesink));
+  g_object_set (ipcsrc, "fdin", sockets[1], "fdout", sockets[1], NULL);
+
+  sinkpad = gst_element_get_static_pad (fakesink, "sink");
+  gst_pad_add_probe (sinkpad, GST_PAD_PROBE_TYPE_BUFFER, slave_buffer_probe,
+      NULL, NULL);
+  gst_object_unref (sinkpad);
+
+  master = gst_pipeline_new (NULL);
+  ipcsink = gst_element_factory_make ("ipcpipelinesink", NULL);
+  fail_unless (ipcsink != NULL);
+  g_object_set (ipcsink, "max-pending-buffers", max_pending_buffers,
+      "pass-fds", pass_fds, "ack-time", ack_time, NULL);
+  gst_bin_add (GST_BIN (master), ipcsink);
+  g_object_set (ipcsink, "fdin", sockets[0], "fdout", sockets[0], NULL);
+
+  srcpad = gst_pad_new_from_static_template (&src_template, "src");
+  sinkpad = gst_element_get_static_pad (ipcsink, "sink");
+  fail_unless_equals_int (gst_pad_link (srcpad, sinkpad), GST_PAD_LINK_OK);
+  gst_object_unref (sinkpad);
+  gst_pad_set_active (srcpad, TRUE);
+
+  /* the slave follows the state of the master */
+  fail_unless (gst_element_set_state (master, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+  fail_unless_equals_int (gst_element_get_state (master, NULL, NULL,
+          GST_CLOCK_TIME_NONE), GST_STATE_CHANGE_SUCCESS);
+
+  fail_unless (gst_pad_push_event (srcpad,
+          gst_event_new_stream_start ("test")));
+  push_segment ();
+}
+
+static void
+teardown_ipcpipeline (void)
+{
+  set_slave_blocked (FALSE);
+
+  gst_element_set_state (master, GST_STATE_NULL);
+  gst_element_set_state (slave, GST_STATE_NULL);
+
+  g_mutex_lock (&slave_lock);
+  g_list_free_full (slave_buffers, (GDestroyNotify) gst_buffer_unref);
+  slave_buffers = NULL;
+  g_mutex_unlock (&slave_lock);
+
+  gst_pad_set_active (srcpad, FALSE);
+  gst_object_unref (srcpad);
+  gst_object_unref (master);
+  gst_object_unref (slave);
+
+  close (sockets[0]);
+  close (sockets[1]);
+}
+
+GST_START_TEST (test_windowed_acks)
+{
+  guint i;
+
+  setup_ipcpipeline (4, FALSE, 10 * G_TIME_SPAN_SECOND);
+
+  /* the slave is stuck in its first buffer, the sink doesn't wait for it
+   * until four buffers are pending */
+  set_slave_blocked (TRUE);
+  for (i = 0; i < 4; i++)
+    fail_unless_equals_int (push_buffer (), GST_FLOW_OK);
+
+  set_slave_blocked (FALSE);
+  wait_slave_buffers (4);
+
+  for (i = 0; i < 4; i++)
+    fail_unless_equals_int (push_buffer (), GST_FLOW_OK);
+  wait_slave_buffers (8);
+
+  teardown_ipcpipeline ();
+}
+
+GST_END_TEST;
+
+/* Pushes buffers to a slave returning EOS until the sink returns it too,
+ * which happens at the latest when it waits for the ack of the first one */
+static void
+push_until_eos (void)
+{
+  GstFlowReturn ret = GST_FLOW_OK;
+  guint i;
+
+  set_slave_ret (GST_FLOW_EOS);
+  for (i = 0; i < 5 && ret == GST_FLOW_OK; i++)
+    ret = push_buffer ();
+  fail_unless_equals_int (ret, GST_FLOW_EOS);
+}
+
+GST_START_TEST (test_pending_flow_return)
+{
+  guint i;
+
+  setup_ipcpipeline (4, FALSE, 10 * G_TIME_SPAN_SECOND);
+
+  push_until_eos ();
+
+  /* the flow return sticks until the next flush, the sink doesn't wait for
+   * a free slot anymore even with the slave stuck */
+  set_slave_blocked (TRUE);
+  for (i = 0; i < 8; i++)
+    fail_unless_equals_int (push_buffer (), GST_FLOW_EOS);
+
+  teardown_ipcpipeline ();
+}
+
+GST_END_TEST;
+
+/* Waits until the streaming thread of the slave paused on a flush start,
+ * so that the flush stop restarts it */
+static void
+wait_slave_task_paused (void)
+{
+  GstPad *pad = gst_element_get_static_pad (ipcsrc, "src");
+
+  while (!GST_PAD_TASK (pad) ||
+      gst_task_get_state (GST_PAD_TASK (pad)) != GST_TASK_PAUSED)
+    g_usleep (G_USEC_PER_SEC / 100);
+  gst_object_unref (pad);
+}
+
+GST_START_TEST (test_flush_resets_flow_return)
+{
+  guint n_buffers, i;
+
+  setup_ipcpipeline (4, FALSE, 10 * G_TIME_SPAN_SECOND);
+
+  push_until_eos ();
+
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_flush_start ()));
+  wait_slave_task_paused ();
+  fail_unless (gst_pad_push_event (srcpad, gst_event_new_flush_stop (TRUE)));
+  push_segment ();
+
+  g_mutex_lock (&slave_lock);
+  n_buffers = g_list_length (slave_buffers);
+  slave_ret = GST_FLOW_OK;
+  g_mutex_unlock (&slave_lock);
+
+  for (i = 0; i < 8; i++)
+    fail_unless_equals_int (push_buffer (), GST_FLOW_OK);
+  wait_slave_buffers (n_buffers + 8);
+
+  teardown_ipcpipeline ();
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_pending_ack_timeout)
+{
+  GstMessage *msg;
+  GstBus *bus;
+
+  setup_ipcpipeline (2, FALSE, 200 * G_TIME_SPAN_MILLISECOND);
+
+  set_slave_blocked (TRUE);
+  fail_unless_equals_int (push_buffer (), GST_FLOW_OK);
+  fail_unless_equals_int (push_buffer (), GST_FLOW_OK);
+
+  /* no room is made in time for this one */
+  fail_unless_equals_int (push_buffer (), GST_FLOW_COMM_ERROR);
+
+  bus = gst_element_get_bus (master);
+  msg = gst_bus_pop_filtered (bus, GST_MESSAGE_ERROR);
+  fail_unless (msg != NULL);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+
+  teardown_ipcpipeline ();
+}
+
+GST_END_TEST;
+
+#ifdef HAVE_MEMFD_CREATE
+static GMutex fd_buffer_lock;
+static GCond fd_buffer_cond;
+static gboolean fd_buffer_freed;
+
+static void
+fd_buffer_freed_cb (gpointer user_data, GstMiniObject * obj)
+{
+  g_mutex_lock (&fd_buffer_lock);
+  fd_buffer_freed = TRUE;
+  g_cond_broadcast (&fd_buffer_cond);
+  g_mutex_unlock (&fd_buffer_lock);
+}
+
+static GstBuffer *
+create_fd_buffer (struct stat *st, guint8 * data)
+{
+  GstAllocator *alloc;
+  GstMemory *mem;
+  GstBuffer *buf;
+  gint fd;
+  guint i;
+
+  for (i = 0; i < FD_BUFFER_SIZE; i++)
+    data[i] = i % 251;
+
+  fd = memfd_create ("ipcpipeline-unit-test", MFD_CLOEXEC);
+  fail_unless (fd >= 0);
+  fail_unless (write (fd, data, FD_BUFFER_SIZE) == FD_BUFFER_SIZE);
+  fail_unless (fstat (fd, st) == 0);
+
+  alloc = gst_fd_allocator_new ();
+  mem = gst_fd_allocator_alloc (alloc, fd, FD_BUFFER_SIZE,
+      GST_FD_MEMORY_FLAG_NONE);
+  fail_unless (mem != NULL);
+  gst_object_unref (alloc);
+
+  buf = gst_buffer_new ();
+  gst_buffer_append_memory (buf, mem);
+
+  return buf;
+}
+
+static void
+run_pass_fds_test (guint max_pending_buffers)
+{
+  GstBuffer *buf;
+  GstMemory *mem;
+  GstMapInfo map;
+  struct stat in_stat, out_stat;
+  guint8 data[FD_BUFFER_SIZE];
+
+  setup_ipcpipeline (max_pending_buffers, TRUE, 10 * G_TIME_SPAN_SECOND);
+
+  buf = create_fd_buffer (&in_stat, data);
+  fd_buffer_freed = FALSE;
+  gst_mini_object_weak_ref (GST_MINI_OBJECT_CAST (buf), fd_buffer_freed_cb,
+      NULL);
+
+  fail_unless_equals_int (gst_pad_push (srcpad, buf), GST_FLOW_OK);
+  wait_slave_buffers (1);
+
+  /* the slave gets the same file, not a copy */
+  buf = slave_buffers->data;
+  fail_unless_equals_int (gst_buffer_n_memory (buf), 1);
+  mem = gst_buffer_peek_memory (buf, 0);
+  fail_unless (gst_is_fd_memory (mem));
+  fail_unless (fstat (gst_fd_memory_get_fd (mem), &out_stat) == 0);
+  fail_unless_equals_uint64 (out_stat.st_dev, in_stat.st_dev);
+  fail_unless_equals_uint64 (out_stat.st_ino, in_stat.st_ino);
+
+  fail_unless (gst_buffer_map (buf, &map, GST_MAP_READ));
+  fail_unless_equals_int (map.size, FD_BUFFER_SIZE);
+  fail_unless (memcmp (map.data, data, FD_BUFFER_SIZE) == 0);
+  gst_buffer_unmap (buf, &map);
+
+  /* the sink keeps the buffer as long as the slave uses its memory, even
+   * after the slave pushed it */
+  fail_unless_equals_int (push_buffer (), GST_FLOW_OK);
+  wait_slave_buffers (2);
+  g_mutex_lock (&fd_buffer_lock);
+  fail_if (fd_buffer_freed);
+  g_mutex_unlock (&fd_buffer_lock);
+
+  g_mutex_lock (&slave_lock);
+  slave_buffers = g_list_remove (slave_buffers, buf);
+  g_mutex_unlock (&slave_lock);
+  gst_buffer_unref (buf);
+
+  g_mutex_lock (&fd_buffer_lock);
+  while (!fd_buffer_freed)
+    g_cond_wait (&fd_buffer_cond, &fd_buffer_lock);
+  g_mutex_unlock (&fd_buffer_lock);
+
+  teardown_ipcpipeline ();
+}
+
+GST_START_TEST (test_pass_fds)
+{
+  run_pass_fds_test (1);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_pass_fds_windowed)
+{
+  run_pass_fds_test (4);
+}
+
+GST_END_TEST;
+#endif
+
+static Suite *
+ipcpipeline_suite (void)
+{
+  Suite *s = suite_create ("ipcpipeline");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_windowed_acks);
+  tcase_add_test (tc_chain, test_pending_flow_return);
+  tcase_add_test (tc_chain, test_flush_resets_flow_return);
+  tcase_add_test (tc_chain, test_pending_ack_timeout);
+#ifdef HAVE_MEMFD_CREATE
+  tcase_add_test (tc_chain, test_pass_fds);
+  tcase_add_test (tc_chain, test_pass_fds_windowed);
+#endif
+
+  return s;
+}
+
+GST_CHECK_MAIN (ipcpipeline);
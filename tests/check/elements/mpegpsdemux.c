@@ -0,0 +1,278 @@
+/* GStreamer
+ *
+ * mpegpsdemux.c: unit tests for mpegpsdemux seeking
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <glib/gstdio.h>
+#include <gst/check/gstcheck.h>
+
+/* The test stream: 10 seconds of MPEG-2 video at 25 fps, one picture per
+ * pack of PACK_SIZE bytes, with an I picture every second and P pictures
+ * in between. The first SCR is 1 second, and each PTS is 100 ms after the
+ * SCR of its pack, so picture n has stream time n * 40 ms + 100 ms */
+#define N_FRAMES 250
+#define GOP_SIZE 25
+#define PACK_SIZE 2048
+#define FIRST_SCR 90000
+#define FRAME_TICKS 3600
+#define PTS_DELAY 9000
+
+#define FRAME_TIME(n) ((n) * 40 * GST_MSECOND + 100 * GST_MSECOND)
+
+static gchar *stream_location;
+
+static GMutex check_lock;
+static gboolean got_segment;
+static GstSegment first_segment;
+static GstClockTime first_buffer_time;
+
+static void
+write_pack (guint8 * data, guint n)
+{
+  guint64 scr = FIRST_SCR + n * FRAME_TICKS;
+  guint64 pts = scr + PTS_DELAY;
+  /* bytes per second / 50 */
+  guint32 mux_rate = PACK_SIZE * 25 / 50;
+  guint pes_length = PACK_SIZE - 14 - 6;
+
+  memset (data, 0, PACK_SIZE);
+
+  /* pack header, see ISO/IEC 13818-1 2.5.3.3 */
+  GST_WRITE_UINT32_BE (data, 0x000001ba);
+  data[4] = 0x44 | ((scr >> 27) & 0x38) | ((scr >> 28) & 0x03);
+  data[5] = (scr >> 20) & 0xff;
+  data[6] = 0x04 | ((scr >> 12) & 0xf8) | ((scr >> 13) & 0x03);
+  data[7] = (scr >> 5) & 0xff;
+  data[8] = 0x04 | ((scr & 0x1f) << 3);
+  data[9] = 0x01;
+  data[10] = (mux_rate >> 14) & 0xff;
+  data[11] = (mux_rate >> 6) & 0xff;
+  data[12] = ((mux_rate << 2) & 0xfc) | 0x03;
+  data[13] = 0xf8;
+  data += 14;
+
+  /* video PES with a PTS */
+  GST_WRITE_UINT32_BE (data, 0x000001e0);
+  GST_WRITE_UINT16_BE (data + 4, pes_length);
+  data[6] = 0x80;
+  data[7] = 0x80;
+  data[8] = 5;
+  data[9] = 0x21 | ((pts >> 29) & 0x0e);
+  data[10] = (pts >> 22) & 0xff;
+  data[11] = ((pts >> 14) & 0xfe) | 0x01;
+  data[12] = (pts >> 7) & 0xff;
+  data[13] = ((pts << 1) & 0xfe) | 0x01;
+  data += 14;
+
+  /* picture header: temporal_reference:10, picture_coding_type:3 */
+  GST_WRITE_UINT32_BE (data, 0x00000100);
+  data[5] = (n % GOP_SIZE == 0 ? 1 : 2) << 3;
+}
+
+static void
+create_stream (void)
+{
+  guint8 *data;
+  gint fd;
+  guint i;
+
+  fd = g_file_open_tmp ("mpegpsdemux-XXXXXX.mpg", &stream_location, NULL);
+  fail_unless (fd >= 0);
+  g_close (fd, NULL);
+
+  data = g_malloc (N_FRAMES * PACK_SIZE);
+  for (i = 0; i < N_FRAMES; i++)
+    write_pack (data + i * PACK_SIZE, i);
+
+  fail_unless (g_file_set_contents (stream_location, (const gchar *) data,
+          N_FRAMES * PACK_SIZE, NULL));
+  g_free (data);
+}
+
+static void
+remove_stream (void)
+{
+  g_unlink (stream_location);
+  g_free (stream_location);
+  stream_location = NULL;
+}
+
+static GstPadProbeReturn
+demux_src_probe (GstPad * pad, GstPadProbeInfo * info, gpointer user_data)
+{
+  g_mutex_lock (&check_lock);
+
+  if (GST_PAD_PROBE_INFO_TYPE (info) & GST_PAD_PROBE_TYPE_BUFFER) {
+    GstBuffer *buf = GST_PAD_PROBE_INFO_BUFFER (info);
+
+    if (got_segment && !GST_CLOCK_TIME_IS_VALID (first_buffer_time))
+      first_buffer_time = gst_segment_to_stream_time (&first_segment,
+          GST_FORMAT_TIME, GST_BUFFER_PTS (buf));
+  } else {
+    GstEvent *event = GST_PAD_PROBE_INFO_EVENT (info);
+
+    if (GST_EVENT_TYPE (event) == GST_EVENT_SEGMENT && !got_segment) {
+      gst_event_copy_segment (event, &first_segment);
+      got_segment = TRUE;
+    }
+  }
+
+  g_mutex_unlock (&check_lock);
+
+  return GST_PAD_PROBE_OK;
+}
+
+static void
+reset_first_output (void)
+{
+  g_mutex_lock (&check_lock);
+  got_segment = FALSE;
+  first_buffer_time = GST_CLOCK_TIME_NONE;
+  g_mutex_unlock (&check_lock);
+}
+
+static void
+demux_pad_added (GstElement * demux, GstPad * pad, GstElement * sink)
+{
+  GstPad *sinkpad = gst_element_get_static_pad (sink, "sink");
+
+  gst_pad_add_probe (pad, GST_PAD_PROBE_TYPE_BUFFER |
+      GST_PAD_PROBE_TYPE_EVENT_DOWNSTREAM, demux_src_probe, NULL, NULL);
+  fail_unless_equals_int (gst_pad_link (pad, sinkpad), GST_PAD_LINK_OK);
+  gst_object_unref (sinkpad);
+}
+
+static void
+wait_for_eos (GstElement * pipeline)
+{
+  GstBus *bus = gst_element_get_bus (pipeline);
+  GstMessage *msg;
+
+  msg = gst_bus_timed_pop_filtered (bus, GST_CLOCK_TIME_NONE,
+      GST_MESSAGE_EOS | GST_MESSAGE_ERROR);
+  fail_unless_equals_int (GST_MESSAGE_TYPE (msg), GST_MESSAGE_EOS);
+  gst_message_unref (msg);
+  gst_object_unref (bus);
+}
+
+/* Plays the whole stream once so that the indexes get filled, then seeks
+ * to @target with @flags and checks where the output restarted */
+static void
+run_seek_test (gboolean track_keyframes, GstSeekFlags flags,
+    GstClockTime target, GstClockTime expected_start,
+    GstClockTime expected_first_buffer)
+{
+  GstElement *pipeline, *src, *demux, *sink;
+
+  create_stream ();
+
+  pipeline = gst_pipeline_new (NULL);
+  src = gst_element_factory_make ("filesrc", NULL);
+  demux = gst_element_factory_make ("mpegpsdemux", NULL);
+  sink = gst_element_factory_make ("fakesink", NULL);
+  fail_unless (src && demux && sink);
+
+  g_object_set (src, "location", stream_location, NULL);
+  g_object_set (demux, "track-keyframes", track_keyframes, NULL);
+  g_object_set (sink, "sync", FALSE, NULL);
+  gst_bin_add_many (GST_BIN (pipeline), src, demux, sink, NULL);
+  fail_unless (gst_element_link (src, demux));
+  g_signal_connect (demux, "pad-added", G_CALLBACK (demux_pad_added), sink);
+
+  reset_first_output ();
+  fail_unless (gst_element_set_state (pipeline, GST_STATE_PLAYING) !=
+      GST_STATE_CHANGE_FAILURE);
+  wait_for_eos (pipeline);
+
+  reset_first_output ();
+  fail_unless (gst_element_seek (pipeline, 1.0, GST_FORMAT_TIME,
+          GST_SEEK_FLAG_FLUSH | flags, GST_SEEK_TYPE_SET, target,
+          GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE));
+  wait_for_eos (pipeline);
+
+  g_mutex_lock (&check_lock);
+  fail_unless (got_segment);
+  GST_DEBUG ("segment after seek %" GST_SEGMENT_FORMAT ", first buffer at %"
+      GST_TIME_FORMAT, &first_segment, GST_TIME_ARGS (first_buffer_time));
+  fail_unless_equals_uint64 (first_segment.time, expected_start);
+  fail_unless_equals_uint64 (first_buffer_time, expected_first_buffer);
+  g_mutex_unlock (&check_lock);
+
+  gst_element_set_state (pipeline, GST_STATE_NULL);
+  gst_object_unref (pipeline);
+  remove_stream ();
+}
+
+GST_START_TEST (test_seek_accurate)
+{
+  /* The SCR search finds the pack at or before the target: picture 137 */
+  run_seek_test (FALSE, GST_SEEK_FLAG_ACCURATE, 5500 * GST_MSECOND,
+      5500 * GST_MSECOND, FRAME_TIME (137));
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_seek_accurate_keyframes)
+{
+  /* Decoding restarts from the I picture 125, the segment still starts at
+   * the target */
+  run_seek_test (TRUE, GST_SEEK_FLAG_ACCURATE, 5500 * GST_MSECOND,
+      5500 * GST_MSECOND, FRAME_TIME (125));
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_seek_key_unit)
+{
+  /* Without keyframe tracking, key unit seeks are approximate */
+  run_seek_test (FALSE, GST_SEEK_FLAG_KEY_UNIT, 5500 * GST_MSECOND,
+      5500 * GST_MSECOND, FRAME_TIME (137));
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_seek_key_unit_keyframes)
+{
+  /* The segment snaps to the SCR of the pack of I picture 125 */
+  run_seek_test (TRUE, GST_SEEK_FLAG_KEY_UNIT, 5500 * GST_MSECOND,
+      125 * 40 * GST_MSECOND, FRAME_TIME (125));
+}
+
+GST_END_TEST;
+
+static Suite *
+mpegpsdemux_suite (void)
+{
+  Suite *s = suite_create ("mpegpsdemux");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_seek_accurate);
+  tcase_add_test (tc_chain, test_seek_accurate_keyframes);
+  tcase_add_test (tc_chain, test_seek_key_unit);
+  tcase_add_test (tc_chain, test_seek_key_unit_keyframes);
+
+  return s;
+}
+
+GST_CHECK_MAIN (mpegpsdemux);
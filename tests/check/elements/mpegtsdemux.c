@@ -377,6 +377,101 @@ GST_START_TEST (test_tsdemux_simple)
 
 GST_END_TEST;
 
+GST_START_TEST (test_tsdemux_pid_filter)
+{
+  GstHarness *h = gst_harness_new_with_padnames ("tsdemux", "sink", NULL);
+  GstStructure *stats;
+  GstBuffer *buf;
+  GstCaps *caps;
+  GstSegment segment;
+  guint64 packets, filtered;
+
+  caps = gst_caps_from_string ("video/mpegts,systemstream=true");
+  gst_harness_push_event (h, gst_event_new_caps (caps));
+  gst_caps_unref (caps);
+
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  gst_harness_push_event (h, gst_event_new_segment (&segment));
+
+  gst_harness_set_sink_caps_str (h,
+      "audio/mpeg,mpegversion=4,stream-format=adts");
+
+  g_signal_connect (h->element, "pad-added",
+      G_CALLBACK (tsdemux_simple_pad_added), h);
+
+  buf =
+      gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY, (guint8 *) aac_ts,
+      sizeof aac_ts, 0, sizeof aac_ts, NULL, NULL);
+  fail_unless (gst_harness_push (h, buf) == GST_FLOW_OK);
+
+  /* The program is selected now, padding packets are dropped early */
+  buf =
+      gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY,
+      (guint8 *) padding_ts, sizeof padding_ts, 0, sizeof padding_ts, NULL,
+      NULL);
+  fail_unless (gst_harness_push (h, gst_buffer_ref (buf)) == GST_FLOW_OK);
+  fail_unless (gst_harness_push (h, buf) == GST_FLOW_OK);
+  gst_harness_push_event (h, gst_event_new_eos ());
+
+  buf = gst_harness_take_all_data_as_buffer (h);
+  gst_check_buffer_data (buf, aac_data, sizeof aac_data);
+  gst_buffer_unref (buf);
+
+  g_object_get (h->element, "stats", &stats, NULL);
+  fail_unless (gst_structure_get_uint64 (stats, "packets", &packets));
+  fail_unless (gst_structure_get_uint64 (stats, "filtered-packets",
+          &filtered));
+  fail_unless_equals_uint64 (packets, aac_ts_packets + 2);
+  fail_unless_equals_uint64 (filtered, 2);
+  gst_structure_free (stats);
+
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_tsdemux_output_threads)
+{
+  GstElement *tsdemux = gst_element_factory_make ("tsdemux", NULL);
+  GstHarness *h;
+  GstBuffer *buf;
+  GstCaps *caps;
+  GstSegment segment;
+
+  g_object_set (tsdemux, "output-threads", 2, NULL);
+  h = gst_harness_new_with_element (tsdemux, "sink", NULL);
+  gst_object_unref (tsdemux);
+
+  caps = gst_caps_from_string ("video/mpegts,systemstream=true");
+  gst_harness_push_event (h, gst_event_new_caps (caps));
+  gst_caps_unref (caps);
+
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  gst_harness_push_event (h, gst_event_new_segment (&segment));
+
+  gst_harness_set_sink_caps_str (h,
+      "audio/mpeg,mpegversion=4,stream-format=adts");
+
+  g_signal_connect (h->element, "pad-added",
+      G_CALLBACK (tsdemux_simple_pad_added), h);
+
+  buf =
+      gst_buffer_new_wrapped_full (GST_MEMORY_FLAG_READONLY, (guint8 *) aac_ts,
+      sizeof aac_ts, 0, sizeof aac_ts, NULL, NULL);
+  fail_unless (gst_harness_push (h, buf) == GST_FLOW_OK);
+
+  /* EOS only goes out after the queued buffers, in order */
+  gst_harness_push_event (h, gst_event_new_eos ());
+
+  buf = gst_harness_take_all_data_as_buffer (h);
+  gst_check_buffer_data (buf, aac_data, sizeof aac_data);
+  gst_buffer_unref (buf);
+
+  gst_harness_teardown (h);
+}
+
+GST_END_TEST;
+
 static Suite *
 mpegtsdemux_suite (void)
 {
@@ -394,6 +489,8 @@ mpegtsdemux_suite (void)
   tc = tcase_create ("tsdemux");
   suite_add_tcase (s, tc);
   tcase_add_test (tc, test_tsdemux_simple);
+  tcase_add_test (tc, test_tsdemux_pid_filter);
+  tcase_add_test (tc, test_tsdemux_output_threads);
 
   return s;
 }
@@ -19,6 +19,7 @@
  */
 
 #include <gst/check/gstcheck.h>
+#include <gst/check/gstharness.h>
 #include <string.h>
 #include <gst/video/video.h>
 
@@ -557,6 +558,149 @@ GST_START_TEST (test_align)
 
 GST_END_TEST;
 
+#define ALIGN_TEST_N_BUFFERS 40
+
+static void
+push_align_test_buffers (GstHarness * h)
+{
+  GstClockTime ts = 0;
+  guint i;
+
+  for (i = 0; i < ALIGN_TEST_N_BUFFERS; i++) {
+    gsize size = 200 + (i * 997) % 4000;
+    GstBuffer *buf = gst_buffer_new_allocate (NULL, size, NULL);
+
+    gst_buffer_memset (buf, 0, i & 0xff, size);
+    GST_BUFFER_PTS (buf) = GST_BUFFER_DTS (buf) = ts;
+    if (i % KEYFRAME_DISTANCE != 0)
+      GST_BUFFER_FLAG_SET (buf, GST_BUFFER_FLAG_DELTA_UNIT);
+
+    fail_unless_equals_int (gst_harness_push (h, buf), GST_FLOW_OK);
+    ts += 40 * GST_MSECOND;
+  }
+}
+
+/* Concatenates the output buffers, checking that each is exactly one
+ * aligned chunk (or one packet without alignment). If @until_eos is set,
+ * waits for the EOS event first so that all output has been pushed */
+static GByteArray *
+pull_align_test_output (GstHarness * h, guint alignment, gboolean until_eos)
+{
+  GByteArray *data = g_byte_array_new ();
+  GstBuffer *buf;
+
+  if (until_eos) {
+    GstEvent *event;
+    gboolean eos = FALSE;
+
+    while (!eos && (event = gst_harness_pull_event (h))) {
+      eos = GST_EVENT_TYPE (event) == GST_EVENT_EOS;
+      gst_event_unref (event);
+    }
+    fail_unless (eos);
+  }
+
+  while ((buf = gst_harness_try_pull (h))) {
+    GstMapInfo map;
+
+    gst_buffer_map (buf, &map, GST_MAP_READ);
+    fail_unless_equals_int (map.size, MAX (alignment, 1) * 188);
+    g_byte_array_append (data, map.data, map.size);
+    gst_buffer_unmap (buf, &map);
+    gst_buffer_unref (buf);
+  }
+
+  return data;
+}
+
+/* Muxes the same input with the given alignment. With @flush, some data is
+ * muxed and flushed first, and only the output after the flush is
+ * returned */
+static GByteArray *
+run_align_test (guint alignment, gboolean flush)
+{
+  GstHarness *h;
+  GByteArray *data;
+
+  h = gst_harness_new_with_padnames ("mpegtsmux", "sink_%d", "src");
+  g_object_set (h->element, "alignment", alignment, NULL);
+  gst_harness_set_src_caps_str (h, VIDEO_CAPS_STRING);
+
+  if (flush) {
+    GstSegment segment;
+    GstQuery *drain;
+
+    push_align_test_buffers (h);
+
+    drain = gst_query_new_drain ();
+    gst_pad_peer_query (h->srcpad, drain);
+    gst_query_unref (drain);
+    g_byte_array_unref (pull_align_test_output (h, alignment, FALSE));
+
+    fail_unless (gst_harness_push_event (h, gst_event_new_flush_start ()));
+    fail_unless (gst_harness_push_event (h, gst_event_new_flush_stop (TRUE)));
+    gst_segment_init (&segment, GST_FORMAT_TIME);
+    fail_unless (gst_harness_push_event (h, gst_event_new_segment (&segment)));
+  }
+
+  push_align_test_buffers (h);
+  fail_unless (gst_harness_push_event (h, gst_event_new_eos ()));
+
+  data = pull_align_test_output (h, alignment, TRUE);
+  gst_harness_teardown (h);
+
+  return data;
+}
+
+/* The aligned output must be the unaligned packets, byte for byte, padded
+ * with null packets at EOS */
+static void
+check_align_test_output (GByteArray * unaligned, GByteArray * aligned)
+{
+  guint offset;
+
+  fail_unless (unaligned->len > 0);
+  fail_unless (unaligned->len % 188 == 0);
+  fail_unless (aligned->len % (7 * 188) == 0);
+  fail_unless (aligned->len >= unaligned->len);
+  fail_unless (aligned->len - unaligned->len < 7 * 188);
+  fail_unless (memcmp (aligned->data, unaligned->data, unaligned->len) == 0);
+
+  for (offset = unaligned->len; offset < aligned->len; offset += 188) {
+    fail_unless_equals_int (aligned->data[offset], 0x47);
+    fail_unless_equals_int (GST_READ_UINT16_BE (aligned->data + offset + 1) &
+        0x1FFF, 0x1FFF);
+  }
+}
+
+GST_START_TEST (test_align_output_identical)
+{
+  GByteArray *unaligned, *aligned;
+
+  unaligned = run_align_test (0, FALSE);
+  aligned = run_align_test (7, FALSE);
+  check_align_test_output (unaligned, aligned);
+  g_byte_array_unref (unaligned);
+  g_byte_array_unref (aligned);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_align_flush)
+{
+  GByteArray *unaligned, *aligned;
+
+  /* Packets pending in the aligned buffer when flushing are dropped, the
+   * output after the flush is the same as without alignment */
+  unaligned = run_align_test (0, TRUE);
+  aligned = run_align_test (7, TRUE);
+  check_align_test_output (unaligned, aligned);
+  g_byte_array_unref (unaligned);
+  g_byte_array_unref (aligned);
+}
+
+GST_END_TEST;
+
 static void
 test_keyframe_propagation_check_output (GList * bufs)
 {
@@ -586,6 +730,55 @@ GST_START_TEST (test_keyframe_flag_propagation)
 
 GST_END_TEST;
 
+static void
+test_pat_resend_check_output (GList * bufs)
+{
+  guint8 first_pat[188];
+  guint n_pats = 0;
+  guint8 last_cc = 0;
+
+  while (bufs != NULL) {
+    GstBuffer *buf = bufs->data;
+    GstMapInfo map;
+    gsize offset;
+
+    gst_buffer_map (buf, &map, GST_MAP_READ);
+    fail_unless (map.size % 188 == 0);
+
+    for (offset = 0; offset < map.size; offset += 188) {
+      const guint8 *packet = map.data + offset;
+
+      if ((GST_READ_UINT16_BE (packet + 1) & 0x1FFF) != 0)
+        continue;
+
+      /* Resent PATs only differ by their continuity counter */
+      if (n_pats == 0) {
+        memcpy (first_pat, packet, 188);
+      } else {
+        fail_unless_equals_int (packet[3] & 0x0f, (last_cc + 1) & 0x0f);
+        fail_unless_equals_int (packet[3] & 0xf0, first_pat[3] & 0xf0);
+        fail_unless (memcmp (packet + 4, first_pat + 4, 184) == 0);
+      }
+      last_cc = packet[3] & 0x0f;
+      n_pats++;
+    }
+
+    gst_buffer_unmap (buf, &map);
+    bufs = bufs->next;
+  }
+
+  /* 2 seconds of data with the default 100ms interval */
+  fail_unless (n_pats >= 10);
+}
+
+GST_START_TEST (test_pat_resend)
+{
+  check_tsmux_pad (&video_src_template, VIDEO_CAPS_STRING, 0xE0, 0x1b,
+      "sink_%d", test_pat_resend_check_output, 50, -1, 0);
+}
+
+GST_END_TEST;
+
 static Suite *
 mpegtsmux_suite (void)
 {
@@ -598,7 +791,10 @@ mpegtsmux_suite (void)
   tcase_add_test (tc_chain, test_video);
   tcase_add_test (tc_chain, test_multiple_state_change);
   tcase_add_test (tc_chain, test_align);
+  tcase_add_test (tc_chain, test_align_output_identical);
+  tcase_add_test (tc_chain, test_align_flush);
   tcase_add_test (tc_chain, test_keyframe_flag_propagation);
+  tcase_add_test (tc_chain, test_pat_resend);
   tcase_add_test (tc_chain, test_reappearing_pad_while_playing);
   tcase_add_test (tc_chain, test_reappearing_pad_while_stopped);
   tcase_add_test (tc_chain, test_unused_pad);
@@ -26,6 +26,14 @@
 
 #include <gst/gst.h>
 #include <gst/check/gstcheck.h>
+#include <gst/allocators/allocators.h>
+
+#ifdef HAVE_MEMFD_CREATE
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
@@ -40,6 +48,30 @@ static GstStaticPadTemplate src_template = GST_STATIC_PAD_TEMPLATE ("src",
 
 GstElement *src, *sink;
 GstPad *sinkpad, *srcpad;
+gint client_fd;
+
+static GMutex client_mutex;
+static GCond client_cond;
+static gboolean client_disconnected;
+
+static void
+client_connected_cb (GstElement * shmsink, gint fd, gpointer user_data)
+{
+  g_mutex_lock (&client_mutex);
+  client_fd = fd;
+  client_disconnected = FALSE;
+  g_cond_broadcast (&client_cond);
+  g_mutex_unlock (&client_mutex);
+}
+
+static void
+client_disconnected_cb (GstElement * shmsink, gint fd, gpointer user_data)
+{
+  g_mutex_lock (&client_mutex);
+  client_disconnected = TRUE;
+  g_cond_broadcast (&client_cond);
+  g_mutex_unlock (&client_mutex);
+}
 
 static void
 setup_shm (void)
@@ -53,6 +85,11 @@ setup_shm (void)
   sinkpad = gst_check_setup_sink_pad (src, &sink_template);
 
   g_object_set (sink, "socket-path", "shm-unit-test", NULL);
+  client_fd = -1;
+  g_signal_connect (sink, "client-connected", G_CALLBACK (client_connected_cb),
+      NULL);
+  g_signal_connect (sink, "client-disconnected",
+      G_CALLBACK (client_disconnected_cb), NULL);
 
   fail_unless (gst_element_set_state (sink, GST_STATE_PLAYING) ==
       GST_STATE_CHANGE_ASYNC);
@@ -169,6 +206,201 @@ GST_START_TEST (test_shm_alloc)
 
 GST_END_TEST;
 
+static void
+push_buffers (gint n)
+{
+  gint i;
+
+  for (i = 0; i < n; i++)
+    fail_unless (gst_pad_push (srcpad, gst_buffer_new_allocate (NULL, 1000,
+                NULL)) == GST_FLOW_OK);
+}
+
+static void
+wait_for_buffers (guint n)
+{
+  g_mutex_lock (&check_mutex);
+  while (g_list_length (buffers) < n)
+    g_cond_wait (&check_cond, &check_mutex);
+  g_mutex_unlock (&check_mutex);
+}
+
+static void
+get_client_stats (guint64 * sent, guint64 * dropped, guint * pending)
+{
+  GstStructure *stats = NULL;
+  gint fd;
+
+  g_mutex_lock (&client_mutex);
+  while (client_fd < 0)
+    g_cond_wait (&client_cond, &client_mutex);
+  fd = client_fd;
+  g_mutex_unlock (&client_mutex);
+
+  g_signal_emit_by_name (sink, "get-stats", fd, &stats);
+  fail_unless (stats != NULL);
+  fail_unless (gst_structure_get_uint64 (stats, "buffers-sent", sent));
+  fail_unless (gst_structure_get_uint64 (stats, "buffers-dropped", dropped));
+  fail_unless (gst_structure_get_uint (stats, "pending-buffers", pending));
+  gst_structure_free (stats);
+}
+
+GST_START_TEST (test_shm_drop_lagging_client)
+{
+  GstSegment segment;
+  guint64 sent, dropped;
+  guint pending;
+
+  gst_util_set_object_arg (G_OBJECT (sink), "client-policy", "drop");
+  g_object_set (sink, "client-max-lag", 2, NULL);
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  /* the received buffers are kept, so the client lags after two of them
+   * and the next ones are dropped instead of blocking */
+  push_buffers (5);
+  wait_for_buffers (2);
+
+  get_client_stats (&sent, &dropped, &pending);
+  fail_unless_equals_uint64 (sent, 2);
+  fail_unless_equals_uint64 (dropped, 3);
+  fail_unless_equals_int (pending, 2);
+
+  /* once it has caught up, the client gets the new buffers again */
+  gst_check_drop_buffers ();
+  do {
+    g_usleep (G_USEC_PER_SEC / 100);
+    get_client_stats (&sent, &dropped, &pending);
+  } while (pending > 0);
+
+  push_buffers (1);
+  wait_for_buffers (1);
+
+  get_client_stats (&sent, &dropped, &pending);
+  fail_unless_equals_uint64 (sent, 3);
+  fail_unless_equals_uint64 (dropped, 3);
+
+  gst_check_drop_buffers ();
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_shm_disconnect_lagging_client)
+{
+  GstSegment segment;
+
+  gst_util_set_object_arg (G_OBJECT (sink), "client-policy", "disconnect");
+  g_object_set (sink, "client-timeout", 50 * GST_MSECOND, NULL);
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  push_buffers (1);
+  wait_for_buffers (1);
+
+  /* the client holds on to the buffer, it gets disconnected */
+  g_mutex_lock (&client_mutex);
+  while (!client_disconnected)
+    g_cond_wait (&client_cond, &client_mutex);
+  g_mutex_unlock (&client_mutex);
+
+  gst_check_drop_buffers ();
+  teardown_shm ();
+}
+
+GST_END_TEST;
+
+#ifdef HAVE_MEMFD_CREATE
+#define FD_BUFFER_SIZE 4096
+
+static gboolean fd_buffer_freed;
+
+static void
+fd_buffer_freed_cb (gpointer user_data, GstMiniObject * obj)
+{
+  g_mutex_lock (&client_mutex);
+  fd_buffer_freed = TRUE;
+  g_cond_broadcast (&client_cond);
+  g_mutex_unlock (&client_mutex);
+}
+
+GST_START_TEST (test_shm_pass_fds)
+{
+  GstAllocator *alloc;
+  GstSegment segment;
+  GstBuffer *buf;
+  GstMemory *mem;
+  GstMapInfo map;
+  struct stat in_stat, out_stat;
+  guint8 data[FD_BUFFER_SIZE];
+  gint fd;
+  guint i;
+
+  g_object_set (sink, "pass-fds", TRUE, "enable-last-sample", FALSE, NULL);
+
+  gst_pad_push_event (srcpad, gst_event_new_stream_start ("test"));
+  gst_segment_init (&segment, GST_FORMAT_BYTES);
+  gst_pad_push_event (srcpad, gst_event_new_segment (&segment));
+
+  for (i = 0; i < FD_BUFFER_SIZE; i++)
+    data[i] = i % 251;
+
+  fd = memfd_create ("shm-unit-test", MFD_CLOEXEC);
+  fail_unless (fd >= 0);
+  fail_unless (write (fd, data, FD_BUFFER_SIZE) == FD_BUFFER_SIZE);
+  fail_unless (fstat (fd, &in_stat) == 0);
+
+  alloc = gst_fd_allocator_new ();
+  mem = gst_fd_allocator_alloc (alloc, fd, FD_BUFFER_SIZE,
+      GST_FD_MEMORY_FLAG_NONE);
+  fail_unless (mem != NULL);
+  gst_object_unref (alloc);
+
+  buf = gst_buffer_new ();
+  gst_buffer_append_memory (buf, mem);
+  fd_buffer_freed = FALSE;
+  gst_mini_object_weak_ref (GST_MINI_OBJECT_CAST (buf), fd_buffer_freed_cb,
+      NULL);
+
+  fail_unless (gst_pad_push (srcpad, buf) == GST_FLOW_OK);
+  wait_for_buffers (1);
+
+  /* shmsrc outputs the same file, not a copy in the shm area */
+  buf = buffers->data;
+  fail_unless_equals_int (gst_buffer_n_memory (buf), 1);
+  mem = gst_buffer_peek_memory (buf, 0);
+  fail_unless (gst_is_fd_memory (mem));
+  fail_unless (fstat (gst_fd_memory_get_fd (mem), &out_stat) == 0);
+  fail_unless_equals_uint64 (out_stat.st_dev, in_stat.st_dev);
+  fail_unless_equals_uint64 (out_stat.st_ino, in_stat.st_ino);
+
+  fail_unless (gst_buffer_map (buf, &map, GST_MAP_READ));
+  fail_unless_equals_int (map.size, FD_BUFFER_SIZE);
+  fail_unless (memcmp (map.data, data, FD_BUFFER_SIZE) == 0);
+  gst_buffer_unmap (buf, &map);
+
+  /* shmsink keeps the buffer as long as the client uses it */
+  g_mutex_lock (&client_mutex);
+  fail_if (fd_buffer_freed);
+  g_mutex_unlock (&client_mutex);
+
+  gst_check_drop_buffers ();
+
+  g_mutex_lock (&client_mutex);
+  while (!fd_buffer_freed)
+    g_cond_wait (&client_cond, &client_mutex);
+  g_mutex_unlock (&client_mutex);
+
+  teardown_shm ();
+}
+
+GST_END_TEST;
+#endif
+
 GST_START_TEST (test_shm_live)
 {
   GstElement *producer, *consumer;
@@ -239,6 +471,11 @@ shm_suite (void)
   tcase_add_checked_fixture (tc, setup_shm, NULL);
   tcase_add_test (tc, test_shm_sysmem_alloc);
   tcase_add_test (tc, test_shm_alloc);
+  tcase_add_test (tc, test_shm_drop_lagging_client);
+  tcase_add_test (tc, test_shm_disconnect_lagging_client);
+#ifdef HAVE_MEMFD_CREATE
+  tcase_add_test (tc, test_shm_pass_fds);
+#endif
   suite_add_tcase (s, tc);
 
   tc = tcase_create ("shm2");
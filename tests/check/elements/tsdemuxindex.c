@@ -0,0 +1,224 @@
+/* GStreamer
+ *
+ * tsdemuxindex.c: unit tests for the keyframe index of tsdemux
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <glib/gstdio.h>
+#include <gst/check/gstcheck.h>
+
+#include "../../../gst/mpegtsdemux/tsdemuxindex.h"
+
+#define INDEX_FILE_SIZE (100 * 10000)
+#define INDEX_PID 0x100
+
+/* Keyframe n is at n seconds, in the PES starting at n * 10000 */
+#define KF_TS(n) ((n) * GST_SECOND)
+#define KF_OFFSET(n) ((n) * 10000)
+
+static void
+add_keyframes (TSDemuxIndex * index, guint first, guint last)
+{
+  guint i;
+
+  for (i = first; i <= last; i++)
+    ts_demux_index_add (index, KF_TS (i), KF_OFFSET (i));
+}
+
+static void
+assert_lookup (TSDemuxIndex * index, GstClockTime target, gint expected)
+{
+  TSDemuxIndexEntry entry;
+  gboolean found;
+
+  found = ts_demux_index_lookup (index, target, &entry);
+  if (expected < 0) {
+    fail_if (found, "Unexpected keyframe for %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (target));
+  } else {
+    fail_unless (found, "No keyframe for %" GST_TIME_FORMAT,
+        GST_TIME_ARGS (target));
+    fail_unless_equals_uint64 (entry.ts, KF_TS (expected));
+    fail_unless_equals_uint64 (entry.offset, KF_OFFSET (expected));
+  }
+}
+
+GST_START_TEST (test_index_add_lookup)
+{
+  TSDemuxIndex *index;
+
+  index = ts_demux_index_new (INDEX_FILE_SIZE, INDEX_PID);
+  fail_if (index->dirty);
+
+  add_keyframes (index, 1, 5);
+  fail_unless_equals_int (index->entries->len, 5);
+  fail_unless (index->dirty);
+
+  /* Before the first keyframe */
+  assert_lookup (index, 500 * GST_MSECOND, -1);
+  /* Exact hits and in between */
+  assert_lookup (index, KF_TS (1), 1);
+  assert_lookup (index, 2500 * GST_MSECOND, 2);
+  assert_lookup (index, KF_TS (4), 4);
+  /* Nothing is known after the last keyframe */
+  assert_lookup (index, 5500 * GST_MSECOND, -1);
+
+  /* Playing the same range again with slightly different timestamps doesn't
+   * add entries */
+  ts_demux_index_discont (index);
+  ts_demux_index_add (index, KF_TS (2) + GST_MSECOND, KF_OFFSET (2));
+  ts_demux_index_add (index, KF_TS (3) - GST_MSECOND, KF_OFFSET (3));
+  fail_unless_equals_int (index->entries->len, 5);
+  assert_lookup (index, 2500 * GST_MSECOND, 2);
+
+  ts_demux_index_free (index);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_index_discont)
+{
+  TSDemuxIndex *index;
+
+  index = ts_demux_index_new (INDEX_FILE_SIZE, INDEX_PID);
+
+  /* Play 0-1s, then seek and play 4-6s: keyframes 2 and 3 are missing */
+  add_keyframes (index, 0, 1);
+  ts_demux_index_discont (index);
+  add_keyframes (index, 4, 6);
+
+  assert_lookup (index, 500 * GST_MSECOND, 0);
+  /* The keyframe following 1 isn't known */
+  assert_lookup (index, 1500 * GST_MSECOND, -1);
+  assert_lookup (index, 3500 * GST_MSECOND, -1);
+  assert_lookup (index, 4500 * GST_MSECOND, 4);
+
+  /* Play the gap partially: 3 is known to precede 4, but not to follow 1 */
+  ts_demux_index_discont (index);
+  add_keyframes (index, 3, 4);
+  assert_lookup (index, 1500 * GST_MSECOND, -1);
+  assert_lookup (index, 3500 * GST_MSECOND, 3);
+
+  /* Inserting an entry between two contiguous ones breaks the link */
+  ts_demux_index_discont (index);
+  ts_demux_index_add (index, 4500 * GST_MSECOND, 45000);
+  assert_lookup (index, 4200 * GST_MSECOND, -1);
+
+  /* Play the rest of the gap, the ranges join up */
+  ts_demux_index_discont (index);
+  add_keyframes (index, 1, 3);
+  assert_lookup (index, 1500 * GST_MSECOND, 1);
+  assert_lookup (index, 2500 * GST_MSECOND, 2);
+
+  ts_demux_index_free (index);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_index_save_load)
+{
+  TSDemuxIndex *index, *loaded;
+  GError *err = NULL;
+  gchar *location;
+  gint fd;
+  guint i;
+
+  fd = g_file_open_tmp ("tsdemuxindex-XXXXXX", &location, NULL);
+  fail_unless (fd >= 0);
+  g_close (fd, NULL);
+
+  index = ts_demux_index_new (INDEX_FILE_SIZE, INDEX_PID);
+  add_keyframes (index, 0, 3);
+  ts_demux_index_discont (index);
+  add_keyframes (index, 10, 12);
+
+  fail_unless (ts_demux_index_save (index, location, &err));
+  g_assert_no_error (err);
+  fail_if (index->dirty);
+
+  loaded = ts_demux_index_load (location, INDEX_FILE_SIZE, INDEX_PID, &err);
+  g_assert_no_error (err);
+  fail_unless (loaded != NULL);
+  fail_if (loaded->dirty);
+  fail_unless_equals_int (loaded->entries->len, index->entries->len);
+  for (i = 0; i < index->entries->len; i++) {
+    TSDemuxIndexEntry *a = &g_array_index (index->entries,
+        TSDemuxIndexEntry, i);
+    TSDemuxIndexEntry *b = &g_array_index (loaded->entries,
+        TSDemuxIndexEntry, i);
+
+    fail_unless_equals_uint64 (a->ts, b->ts);
+    fail_unless_equals_uint64 (a->offset, b->offset);
+    fail_unless_equals_int (a->flags, b->flags);
+  }
+
+  /* The hole is still known after loading */
+  assert_lookup (loaded, 2500 * GST_MSECOND, 2);
+  assert_lookup (loaded, 5 * GST_SECOND, -1);
+  assert_lookup (loaded, 10500 * GST_MSECOND, 10);
+
+  /* A new session extends the loaded index */
+  ts_demux_index_add (loaded, KF_TS (13), KF_OFFSET (13));
+  fail_unless (loaded->dirty);
+  ts_demux_index_free (loaded);
+
+  /* Index of another file or stream */
+  loaded = ts_demux_index_load (location, INDEX_FILE_SIZE + 1, INDEX_PID,
+      &err);
+  fail_unless (loaded == NULL);
+  fail_unless (err != NULL);
+  g_clear_error (&err);
+
+  loaded = ts_demux_index_load (location, INDEX_FILE_SIZE, INDEX_PID + 1,
+      &err);
+  fail_unless (loaded == NULL);
+  fail_unless (err != NULL);
+  g_clear_error (&err);
+
+  /* Truncated file */
+  fail_unless (g_file_set_contents (location, "GSTTSIDX\0\0", 10, NULL));
+  loaded = ts_demux_index_load (location, INDEX_FILE_SIZE, INDEX_PID, &err);
+  fail_unless (loaded == NULL);
+  fail_unless (err != NULL);
+  g_clear_error (&err);
+
+  ts_demux_index_free (index);
+  g_unlink (location);
+  g_free (location);
+}
+
+GST_END_TEST;
+
+static Suite *
+tsdemuxindex_suite (void)
+{
+  Suite *s = suite_create ("tsdemuxindex");
+  TCase *tc_chain = tcase_create ("general");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_index_add_lookup);
+  tcase_add_test (tc_chain, test_index_discont);
+  tcase_add_test (tc_chain, test_index_save_load);
+
+  return s;
+}
+
+GST_CHECK_MAIN (tsdemuxindex);
@@ -236,6 +236,38 @@ GST_START_TEST (test_mpegts_pat)
 
 GST_END_TEST;
 
+GST_START_TEST (test_mpegts_section_crc)
+{
+  GstMpegtsSection *section;
+  GPtrArray *pat;
+  guint8 *data;
+  gint i;
+
+  /* The same section parsed several times must always validate */
+  for (i = 0; i < 3; i++) {
+    data = g_memdup (pat_data_check, sizeof (pat_data_check));
+    section = gst_mpegts_section_new (0, data, sizeof (pat_data_check));
+    fail_if (section == NULL);
+
+    pat = gst_mpegts_section_get_pat (section);
+    fail_if (pat == NULL);
+    assert_equals_int (pat->len, 2);
+    g_ptr_array_unref (pat);
+    gst_mpegts_section_unref (section);
+  }
+
+  /* A corrupted payload with an unchanged CRC field must be rejected */
+  data = g_memdup (pat_data_check, sizeof (pat_data_check));
+  data[9]++;
+  section = gst_mpegts_section_new (0, data, sizeof (pat_data_check));
+  fail_if (section == NULL);
+  pat = gst_mpegts_section_get_pat (section);
+  fail_unless (pat == NULL);
+  gst_mpegts_section_unref (section);
+}
+
+GST_END_TEST;
+
 GST_START_TEST (test_mpegts_pmt)
 {
   GstMpegtsPMT *pmt;
@@ -679,6 +711,7 @@ mpegts_suite (void)
   suite_add_tcase (s, tc_chain);
   tcase_add_test (tc_chain, test_scte_sit);
   tcase_add_test (tc_chain, test_mpegts_pat);
+  tcase_add_test (tc_chain, test_mpegts_section_crc);
   tcase_add_test (tc_chain, test_mpegts_pmt);
   tcase_add_test (tc_chain, test_mpegts_nit);
   tcase_add_test (tc_chain, test_mpegts_sdt);
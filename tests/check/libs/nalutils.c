@@ -20,6 +20,7 @@
 
 #include <gst/check/gstcheck.h>
 #include <gst/codecparsers/nalutils.h>
+#include <gst/codecparsers/scanutils.h>
 #include <string.h>
 
 GST_START_TEST (test_nal_writer_init)
@@ -102,6 +103,142 @@ GST_START_TEST (test_nal_writer_emulation_preventation)
 
 GST_END_TEST;
 
+GST_START_TEST (test_nal_reader_emulation_prevention)
+{
+  /* 0x00 0x00 0x03 sequences are removed from the RBSP, but the reported
+   * position and count only account for the bytes actually read */
+  static const guint8 data[] = {
+    0x80, 0x00, 0x00, 0x03, 0x01, 0xa5, 0x00, 0x00, 0x03, 0x00, 0x00, 0x03,
+    0x02, 0xff, 0x00, 0x00, 0x03
+  };
+  static const guint8 rbsp[] = {
+    0x80, 0x00, 0x00, 0x01, 0xa5, 0x00, 0x00, 0x00, 0x00, 0x02, 0xff, 0x00,
+    0x00
+  };
+  guint8 bytes[sizeof (rbsp)];
+  NalReader nr;
+  guint32 val;
+  guint i;
+
+  nal_reader_init (&nr, data, sizeof (data));
+  fail_unless (nal_reader_get_ue (&nr, &val));
+  assert_equals_int (val, 0);
+  assert_equals_int (nal_reader_get_pos (&nr), 1);
+  fail_unless (nal_reader_get_bits_uint32 (&nr, &val, 23));
+  assert_equals_int (val, 0);
+  assert_equals_int (nal_reader_get_pos (&nr), 24);
+  fail_unless (nal_reader_is_byte_aligned (&nr));
+  assert_equals_int (nal_reader_get_epb_count (&nr), 0);
+  assert_equals_int (nal_reader_get_remaining (&nr), 14 * 8);
+
+  /* crosses the first emulation prevention byte */
+  fail_unless (nal_reader_get_bits_uint8 (&nr, (guint8 *) & val, 8));
+  assert_equals_int (val & 0xff, 0x01);
+  assert_equals_int (nal_reader_get_pos (&nr), 40);
+  assert_equals_int (nal_reader_get_epb_count (&nr), 1);
+
+  fail_unless (nal_reader_get_bits_uint32 (&nr, &val, 32));
+  assert_equals_int (val, 0xa5000000);
+  assert_equals_int (nal_reader_get_epb_count (&nr), 2);
+  fail_unless (nal_reader_get_bits_uint32 (&nr, &val, 3));
+  assert_equals_int (nal_reader_get_pos (&nr), 83);
+  assert_equals_int (nal_reader_get_epb_count (&nr), 2);
+  fail_if (nal_reader_is_byte_aligned (&nr));
+
+  /* bulk copies give the same bytes as reading them one by one */
+  for (i = 0; i < sizeof (rbsp); i++) {
+    nal_reader_init (&nr, data, sizeof (data));
+    fail_unless (nal_reader_skip_long (&nr, i * 8));
+    memset (bytes, 0, sizeof (bytes));
+    fail_unless (nal_reader_get_bytes (&nr, bytes, sizeof (rbsp) - i));
+    fail_if (memcmp (bytes, rbsp + i, sizeof (rbsp) - i));
+    fail_if (nal_reader_get_bytes (&nr, bytes, 1));
+  }
+}
+
+GST_END_TEST;
+
+static gint
+scan_for_pattern_ref (const guint8 * data, guint size, guint8 third,
+    guint need)
+{
+  guint i;
+
+  for (i = 0; i + need <= size; i++) {
+    if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == third)
+      return i;
+  }
+
+  return -1;
+}
+
+GST_START_TEST (test_scan_for_start_codes)
+{
+  static const guint8 sc[] = { 0x00, 0x00, 0x01, 0x65 };
+  guint8 data[256];
+  GRand *rand;
+  gint i, j;
+
+  GST_INFO ("using %s kernel", scan_utils_get_kernel_name ());
+
+  /* start code at every position, including the vector kernel tails */
+  for (i = 0; i + sizeof (sc) <= sizeof (data); i++) {
+    memset (data, 0xff, sizeof (data));
+    memcpy (data + i, sc, sizeof (sc));
+    assert_equals_int (scan_for_start_codes (data, sizeof (data)), i);
+    /* the byte following the start code must be available */
+    assert_equals_int (scan_for_start_codes (data, i + 3), -1);
+    assert_equals_int (scan_for_start_codes (data, i + 4), i);
+  }
+
+  /* 4 bytes start code reports the offset of the last 3 */
+  memset (data, 0xff, sizeof (data));
+  memset (data + 50, 0, 3);
+  data[53] = 0x01;
+  assert_equals_int (scan_for_start_codes (data, sizeof (data)), 51);
+
+  /* emulation prevention bytes may end the data */
+  memset (data, 0xff, sizeof (data));
+  data[61] = data[62] = 0x00;
+  data[63] = 0x03;
+  assert_equals_int (scan_for_emulation_prevention (data, 64), 61);
+  assert_equals_int (scan_for_emulation_prevention (data, 63), -1);
+  assert_equals_int (scan_for_start_codes (data, 64), -1);
+
+  /* zero heavy random data against a bytewise reference */
+  rand = g_rand_new_with_seed (0x1234);
+  for (i = 0; i < 10000; i++) {
+    guint size = g_rand_int_range (rand, 0, sizeof (data) + 1);
+    guint offset = g_rand_int_range (rand, 0, size + 1);
+
+    for (j = 0; j < size; j++) {
+      switch (g_rand_int_range (rand, 0, 8)) {
+        case 0:
+          data[j] = 0x01;
+          break;
+        case 1:
+          data[j] = 0x03;
+          break;
+        case 2:
+          data[j] = g_rand_int_range (rand, 0, 256);
+          break;
+        default:
+          data[j] = 0x00;
+          break;
+      }
+    }
+
+    assert_equals_int (scan_for_start_codes (data + offset, size - offset),
+        scan_for_pattern_ref (data + offset, size - offset, 0x01, 4));
+    assert_equals_int (scan_for_emulation_prevention (data + offset,
+            size - offset), scan_for_pattern_ref (data + offset,
+            size - offset, 0x03, 3));
+  }
+  g_rand_free (rand);
+}
+
+GST_END_TEST;
+
 static Suite *
 nalutils_suite (void)
 {
@@ -112,6 +249,8 @@ nalutils_suite (void)
   suite_add_tcase (s, tc_chain);
   tcase_add_test (tc_chain, test_nal_writer_init);
   tcase_add_test (tc_chain, test_nal_writer_emulation_preventation);
+  tcase_add_test (tc_chain, test_nal_reader_emulation_prevention);
+  tcase_add_test (tc_chain, test_scan_for_start_codes);
 
   return s;
 }
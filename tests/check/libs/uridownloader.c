@@ -0,0 +1,314 @@
+/* GStreamer unit tests for GstUriDownloader
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+# include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gio/gio.h>
+#include <gst/check/gstcheck.h>
+#include <gst/uridownloader/gsturidownloader.h>
+
+#define CONTENT_LENGTH 1024
+
+/* HTTP/1.1 server keeping its connections open, counting them */
+typedef struct
+{
+  GSocketService *service;
+  guint16 port;
+  gint connections;
+  gint requests;
+} KeepAliveServer;
+
+static gboolean
+server_callback (GThreadedSocketService * service,
+    GSocketConnection * connection, GSocketListener * listener,
+    gpointer user_data)
+{
+  KeepAliveServer *server = user_data;
+  GOutputStream *out;
+  GDataInputStream *data;
+  gchar *line;
+
+  g_atomic_int_inc (&server->connections);
+
+  out = g_io_stream_get_output_stream (G_IO_STREAM (connection));
+  data = g_data_input_stream_new (g_io_stream_get_input_stream (G_IO_STREAM
+          (connection)));
+  g_data_input_stream_set_newline_type (data, G_DATA_STREAM_NEWLINE_TYPE_ANY);
+
+  /* serve requests until the client closes the connection */
+  while ((line = g_data_input_stream_read_line (data, NULL, NULL, NULL))) {
+    gboolean head = g_str_has_prefix (line, "HEAD ");
+    gint64 start = 0, stop = CONTENT_LENGTH - 1;
+    gboolean partial = FALSE;
+    gchar body[CONTENT_LENGTH];
+    GString *s;
+
+    GST_DEBUG ("Request: %s", line);
+    g_atomic_int_inc (&server->requests);
+
+    /* headers, up to the empty line */
+    do {
+      g_free (line);
+      line = g_data_input_stream_read_line (data, NULL, NULL, NULL);
+      if (line && g_ascii_strncasecmp (line, "Range: bytes=", 13) == 0) {
+        gchar *end;
+
+        start = g_ascii_strtoll (line + 13, &end, 10);
+        if (*end == '-' && end[1] != '\0')
+          stop = MIN (g_ascii_strtoll (end + 1, NULL, 10), stop);
+        partial = TRUE;
+      }
+    } while (line && *line != '\0');
+    if (line == NULL)
+      break;
+    g_free (line);
+
+    s = g_string_new (partial ? "HTTP/1.1 206 Partial Content\r\n" :
+        "HTTP/1.1 200 OK\r\n");
+    g_string_append_printf (s, "Content-Type: application/octet-stream\r\n"
+        "Accept-Ranges: bytes\r\n"
+        "Content-Length: %" G_GINT64_FORMAT "\r\n", stop + 1 - start);
+    if (partial)
+      g_string_append_printf (s, "Content-Range: bytes %" G_GINT64_FORMAT
+          "-%" G_GINT64_FORMAT "/%d\r\n", start, stop, CONTENT_LENGTH);
+    g_string_append (s, "\r\n");
+
+    memset (body, 'a', sizeof (body));
+    if (!g_output_stream_write_all (out, s->str, s->len, NULL, NULL, NULL) ||
+        (!head && !g_output_stream_write_all (out, body + start,
+                stop + 1 - start, NULL, NULL, NULL))) {
+      g_string_free (s, TRUE);
+      break;
+    }
+    g_string_free (s, TRUE);
+  }
+
+  g_object_unref (data);
+
+  return TRUE;
+}
+
+static KeepAliveServer *
+run_server (void)
+{
+  KeepAliveServer *server = g_new0 (KeepAliveServer, 1);
+
+  server->service = g_threaded_socket_service_new (10);
+  server->port =
+      g_socket_listener_add_any_inet_port (G_SOCKET_LISTENER (server->service),
+      NULL, NULL);
+  fail_if (server->port == 0);
+  g_signal_connect (server->service, "run", G_CALLBACK (server_callback),
+      server);
+
+  GST_DEBUG ("HTTP server listening on port %u", server->port);
+
+  return server;
+}
+
+static void
+stop_server (KeepAliveServer * server)
+{
+  g_socket_service_stop (server->service);
+  g_socket_listener_close (G_SOCKET_LISTENER (server->service));
+  g_object_unref (server->service);
+  g_free (server);
+}
+
+static gboolean
+have_http_source (void)
+{
+  GstElementFactory *factory;
+
+  /* the sharing of connections relies on the session context of
+   * souphttpsrc */
+  factory = gst_element_factory_find ("souphttpsrc");
+  if (factory == NULL) {
+    GST_INFO ("souphttpsrc not available, skipping");
+    return FALSE;
+  }
+  gst_object_unref (factory);
+
+  return TRUE;
+}
+
+static void
+fetch (GstUriDownloader * downloader, KeepAliveServer * server,
+    const gchar * path, gint64 range_start, gint64 range_end, gsize size)
+{
+  GstFragment *fragment;
+  GstBuffer *buffer;
+  GError *err = NULL;
+  gchar *uri;
+
+  uri = g_strdup_printf ("http://127.0.0.1:%u%s", server->port, path);
+  fragment = gst_uri_downloader_fetch_uri_with_range (downloader, uri, NULL,
+      FALSE, FALSE, TRUE, range_start, range_end, &err);
+  fail_unless (fragment != NULL, "Failed to fetch %s: %s", uri,
+      err ? err->message : "unknown error");
+  fail_unless (fragment->completed);
+
+  buffer = gst_fragment_get_buffer (fragment);
+  fail_unless (buffer != NULL);
+  fail_unless_equals_int (gst_buffer_get_size (buffer), size);
+  gst_buffer_unref (buffer);
+
+  g_object_unref (fragment);
+  g_free (uri);
+}
+
+static void
+check_stats (GstUriDownloader * downloader, guint64 requests,
+    guint64 sources_created, guint64 sources_reused, guint64 bytes)
+{
+  GstStructure *stats = gst_uri_downloader_get_stats (downloader);
+  guint64 value;
+
+  GST_DEBUG ("%" GST_PTR_FORMAT, stats);
+
+  fail_unless (gst_structure_get_uint64 (stats, "requests", &value));
+  fail_unless_equals_uint64 (value, requests);
+  fail_unless (gst_structure_get_uint64 (stats, "sources-created", &value));
+  fail_unless_equals_uint64 (value, sources_created);
+  fail_unless (gst_structure_get_uint64 (stats, "sources-reused", &value));
+  fail_unless_equals_uint64 (value, sources_reused);
+  fail_unless (gst_structure_get_uint64 (stats, "bytes", &value));
+  fail_unless_equals_uint64 (value, bytes);
+
+  gst_structure_free (stats);
+}
+
+GST_START_TEST (test_reuse_source)
+{
+  KeepAliveServer *server;
+  GstUriDownloader *downloader;
+
+  if (!have_http_source ())
+    return;
+
+  server = run_server ();
+  downloader = gst_uri_downloader_new ();
+
+  fetch (downloader, server, "/init.mp4", 0, -1, CONTENT_LENGTH);
+  fetch (downloader, server, "/segment1.m4s", 0, 99, 100);
+  fetch (downloader, server, "/segment1.m4s", 100, 199, 100);
+
+  /* one source and one connection for all the requests */
+  check_stats (downloader, 3, 1, 2, CONTENT_LENGTH + 200);
+  fail_unless_equals_int (g_atomic_int_get (&server->requests), 3);
+  fail_unless_equals_int (g_atomic_int_get (&server->connections), 1);
+
+  gst_object_unref (downloader);
+  stop_server (server);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_share_session)
+{
+  KeepAliveServer *server;
+  GstUriDownloader *downloaders[2];
+  GstElement *parent;
+  GstStructure *stats;
+  guint64 shared;
+
+  if (!have_http_source ())
+    return;
+
+  server = run_server ();
+  parent = gst_object_ref_sink (gst_bin_new (NULL));
+  downloaders[0] = gst_uri_downloader_new ();
+  downloaders[1] = gst_uri_downloader_new ();
+  gst_uri_downloader_set_parent (downloaders[0], parent);
+  gst_uri_downloader_set_parent (downloaders[1], parent);
+
+  /* the downloads are sequential, so the second downloader gets the idle
+   * connection of the first one through the session set on the parent */
+  fetch (downloaders[0], server, "/manifest.mpd", 0, -1, CONTENT_LENGTH);
+  fetch (downloaders[1], server, "/video/segment1.m4s", 0, -1,
+      CONTENT_LENGTH);
+  fetch (downloaders[0], server, "/manifest.mpd", 0, -1, CONTENT_LENGTH);
+  fetch (downloaders[1], server, "/video/segment2.m4s", 0, 511, 512);
+
+  check_stats (downloaders[0], 2, 1, 1, 2 * CONTENT_LENGTH);
+  check_stats (downloaders[1], 2, 1, 1, CONTENT_LENGTH + 512);
+  fail_unless_equals_int (g_atomic_int_get (&server->requests), 4);
+  fail_unless_equals_int (g_atomic_int_get (&server->connections), 1);
+
+  stats = gst_uri_downloader_get_stats (downloaders[1]);
+  fail_unless (gst_structure_get_uint64 (stats, "shared-contexts", &shared));
+  fail_unless (shared > 0);
+  gst_structure_free (stats);
+
+  gst_object_unref (downloaders[0]);
+  gst_object_unref (downloaders[1]);
+  gst_object_unref (parent);
+  stop_server (server);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_no_parent_no_sharing)
+{
+  KeepAliveServer *server;
+  GstUriDownloader *downloaders[2];
+
+  if (!have_http_source ())
+    return;
+
+  server = run_server ();
+  downloaders[0] = gst_uri_downloader_new ();
+  downloaders[1] = gst_uri_downloader_new ();
+
+  fetch (downloaders[0], server, "/a", 0, -1, CONTENT_LENGTH);
+  fetch (downloaders[1], server, "/b", 0, -1, CONTENT_LENGTH);
+
+  /* each source has its own session */
+  fail_unless_equals_int (g_atomic_int_get (&server->connections), 2);
+
+  gst_object_unref (downloaders[0]);
+  gst_object_unref (downloaders[1]);
+  stop_server (server);
+}
+
+GST_END_TEST;
+
+static Suite *
+uridownloader_suite (void)
+{
+  Suite *s = suite_create ("uridownloader");
+  TCase *tc_chain = tcase_create ("general");
+
+  /* we don't support exceptions from the proxy, so just unset the environment
+   * variable, it would otherwise prevent us from connecting to localhost */
+  g_unsetenv ("http_proxy");
+
+  suite_add_tcase (s, tc_chain);
+  tcase_add_test (tc_chain, test_reuse_source);
+  tcase_add_test (tc_chain, test_share_session);
+  tcase_add_test (tc_chain, test_no_parent_no_sharing);
+
+  return s;
+}
+
+GST_CHECK_MAIN (uridownloader);